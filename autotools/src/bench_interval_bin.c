@@ -0,0 +1,289 @@
+/*
+ * @file bench_interval_bin.c
+ * @brief Microbenchmark of interval binning: (sec, nsec) walk, division kernel and shift kernel
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+/* System libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <inttypes.h>
+
+/* Project libraries */
+#include "lib_output_format.h"
+#include "lib_error.h"
+#include "lib_interval_bin.h"
+
+/* Constants */
+#define CLI_MAX_INPUTS      5
+#define BENCH_PACKETS       (1 << 22)   /* synthetic packets, 64 MiB of timestamps */
+#define BENCH_MEAN_GAP_NSEC 500         /* mean gap between synthetic packets (nsec) */
+
+/**
+ * @brief Result of one kernel, all kernels must agree on checksum
+ */
+typedef struct {
+    uint64_t checksum;      /* sum of interval index of every packet */
+    double   elapsed;       /* elapsed time (sec) */
+} bench_result_t;
+
+/**
+ * @brief Binning kernel under test
+ * @param bin Binning state
+ * @param ts Timestamps
+ * @param count Number of timestamps
+ * @return Checksum
+ */
+typedef uint64_t (*bench_kernel_t) (const interval_bin_t *bin, const struct timespec *ts, size_t count);
+
+/**
+ * @brief Print help message
+ */
+static void print_help_message (void);
+
+/**
+ * @brief Get monotonic time in seconds
+ * @return Time (sec)
+ */
+static double get_time (void);
+
+/**
+ * @brief Fill timestamps with random gaps, same layout as packets read from trace
+ * @param ts Timestamps
+ * @param count Number of timestamps
+ * @return void
+ */
+static void generate_timestamps (struct timespec *ts, size_t count);
+
+/**
+ * @brief Previous per_packet logic, walk (sec, nsec) boundary until it passes the packet
+ */
+static uint64_t kernel_walk (const interval_bin_t *bin, const struct timespec *ts, size_t count);
+
+/**
+ * @brief Division kernel
+ */
+static uint64_t kernel_div (const interval_bin_t *bin, const struct timespec *ts, size_t count);
+
+/**
+ * @brief Shift kernel, interval must be a power of two nanoseconds
+ */
+static uint64_t kernel_pow2 (const interval_bin_t *bin, const struct timespec *ts, size_t count);
+
+/**
+ * @brief Run kernel for given rounds and keep the fastest round
+ * @param kernel Kernel
+ * @param bin Binning state
+ * @param ts Timestamps
+ * @param count Number of timestamps
+ * @param rounds Rounds
+ * @param result Fastest result
+ * @return void
+ */
+static void run_kernel (bench_kernel_t kernel, const interval_bin_t *bin, const struct timespec *ts, size_t count, long int rounds, bench_result_t *result);
+
+/**
+ * @brief Main function, run each kernel on the same timestamps and report per-packet cost
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @return Error code
+ * @details
+ * Normal usage:            ./bench_interval_bin [-t <time_interval>] [-c <rounds>]
+ * Display help message:    ./bench_interval_bin -h
+ */
+int main (int argc, char *argv[]) {
+    /* params */
+                        errno = 0;              /* error number */
+    ec_t                ec = 0;                 /* error code */
+    int                 i;                      /* iterator */
+    char               *endptr;                 /* string to int conversion pointer */
+    double              time_interval = 0.001048576; /* time interval (sec), 2^20 nsec */
+    long int            rounds = 5;             /* rounds of each kernel */
+    interval_bin_t      bin;                    /* binning state */
+    struct timespec    *ts = NULL;              /* synthetic timestamps */
+    bench_result_t      walk_result;            /* result of walk kernel */
+    bench_result_t      div_result;             /* result of division kernel */
+    bench_result_t      pow2_result;            /* result of shift kernel */
+    bool                agree;                  /* all kernels agree on checksum */
+    output_format       format;                 /* output format */
+
+    get_format(&format);
+
+    /* parse CLI arguments */
+    if (argc > CLI_MAX_INPUTS) {
+        ec = EC_CLI_MAX_INPUTS;
+    }
+    for (i=1 ; (i<argc) && (ec==0) ; i++) {
+        if ((strcmp(argv[i], "-t") == 0) || (strcmp(argv[i], "--time-interval") == 0)) {
+            i++;
+            if (i < argc) {
+                time_interval = strtod(argv[i], &endptr);
+                if ((errno != EC_SUCCESS) || (endptr == argv[i])) {
+                    ec = EC_CLI_INVALID_TIME_INTERVAL;
+                }
+            } else {
+                ec = EC_CLI_NO_TIME_INTERVAL_VALUE;
+            }
+        } else if ((strcmp(argv[i], "-c") == 0) || (strcmp(argv[i], "--count-size") == 0)) {
+            i++;
+            if (i < argc) {
+                rounds = strtol(argv[i], &endptr, 10);
+                if ((errno != EC_SUCCESS) || (endptr == argv[i]) || (rounds < 1)) {
+                    ec = EC_CLI_INVALID_COUNT_SIZE;
+                }
+            } else {
+                ec = EC_CLI_NO_COUNT_SIZE_VALUE;
+            }
+        } else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "--help") == 0)) {
+            print_help_message();
+            exit(EXIT_SUCCESS);
+        } else {
+            ec = EC_CLI_UNKNOWN_OPTION;
+        }
+    }
+    if (ec == EC_SUCCESS) {
+        ec = interval_bin_init(&bin, time_interval);
+    }
+    if (ec != EC_SUCCESS) {
+        print_ec_message(ec);
+        print_help_message();
+        exit(EXIT_FAILURE);
+    }
+
+    ts = (struct timespec *) malloc(BENCH_PACKETS * sizeof(struct timespec));
+    if (ts == NULL) {
+        perror("malloc");
+        print_ec_message(EC_GEN_UNABLE_TO_MALLOC);
+        exit(EXIT_FAILURE);
+    }
+    generate_timestamps(ts, BENCH_PACKETS);
+    bin.origin_nsec = timespec_to_nsec(ts[0]);
+
+    /* run */
+    run_kernel(kernel_walk, &bin, ts, BENCH_PACKETS, rounds, &walk_result);
+    run_kernel(kernel_div, &bin, ts, BENCH_PACKETS, rounds, &div_result);
+    memset(&pow2_result, 0, sizeof(bench_result_t));
+    if (bin.pow2) {
+        run_kernel(kernel_pow2, &bin, ts, BENCH_PACKETS, rounds, &pow2_result);
+    }
+    free(ts);
+
+    /* report */
+    printf("Interval: %" PRIu64 " nsec, packets: %d, rounds: %ld\n", bin.interval_nsec, BENCH_PACKETS, rounds);
+    printf("Kernel\tTime(sec)\tns/packet\tChecksum\n");
+    printf("walk\t%.6lf\t%.3lf\t\t%" PRIu64 "\n", walk_result.elapsed, walk_result.elapsed * 1e9 / BENCH_PACKETS, walk_result.checksum);
+    printf("div\t%.6lf\t%.3lf\t\t%" PRIu64 "\n", div_result.elapsed, div_result.elapsed * 1e9 / BENCH_PACKETS, div_result.checksum);
+    if (bin.pow2) {
+        printf("pow2\t%.6lf\t%.3lf\t\t%" PRIu64 "\n", pow2_result.elapsed, pow2_result.elapsed * 1e9 / BENCH_PACKETS, pow2_result.checksum);
+    } else {
+        printf("pow2\tskipped, interval is not a power of two nanoseconds\n");
+    }
+    agree = (walk_result.checksum == div_result.checksum) && (!bin.pow2 || (pow2_result.checksum == div_result.checksum));
+    if (!agree) {
+        printf("%sKernels disagree on interval index\n", format.status.fail);
+        exit(EXIT_FAILURE);
+    }
+    printf("%sKernels agree on interval index\n", format.status.pass);
+    exit(EXIT_SUCCESS);
+}
+
+static void print_help_message (void) {
+    printf("Usage: ./bench_interval_bin [-t <time_interval>] [-c <rounds>]\n");
+    printf("       ./bench_interval_bin -h\n");
+    printf("Options:\n");
+    printf("  -t, --time-interval <time_interval>   (optional) Time interval (sec), default=0.001048576 (2^20 nsec)\n");
+    printf("  -c, --count-size <rounds>             (optional) Rounds of each kernel, fastest round is reported, default=5\n");
+    printf("  -h, --help                            Display help message\n");
+    return;
+}
+
+static double get_time (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static void generate_timestamps (struct timespec *ts, size_t count) {
+    /* params */
+    uint64_t    state = 0x9E3779B97F4A7C15ULL;     /* xorshift state */
+    uint64_t    time_nsec = 1700000000ULL * NSEC_PER_SEC; /* current timestamp (nsec) */
+    size_t      i;                                  /* iterator */
+
+    for (i=0; i<count; i++) {
+        ts[i].tv_sec = (time_t) (time_nsec / NSEC_PER_SEC);
+        ts[i].tv_nsec = (long int) (time_nsec % NSEC_PER_SEC);
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        time_nsec += state % (2 * BENCH_MEAN_GAP_NSEC);
+    }
+    return;
+}
+
+static uint64_t kernel_walk (const interval_bin_t *bin, const struct timespec *ts, size_t count) {
+    /* params */
+    time_t      next_sec = (time_t) ((bin->origin_nsec + bin->interval_nsec) / NSEC_PER_SEC);  /* end of interval (sec) */
+    long int    next_nsec = (long int) ((bin->origin_nsec + bin->interval_nsec) % NSEC_PER_SEC); /* end of interval (nsec) */
+    time_t      step_sec = (time_t) (bin->interval_nsec / NSEC_PER_SEC);                        /* interval (sec) */
+    long int    step_nsec = (long int) (bin->interval_nsec % NSEC_PER_SEC);                     /* interval (nsec) */
+    uint64_t    index = 0;      /* current interval index */
+    uint64_t    checksum = 0;   /* checksum */
+    size_t      i;              /* iterator */
+
+    for (i=0; i<count; i++) {
+        while ((ts[i].tv_sec > next_sec) || ((ts[i].tv_sec == next_sec) && (ts[i].tv_nsec > next_nsec))) {
+            next_sec += step_sec;
+            next_nsec += step_nsec;
+            if (next_nsec >= (long int) NSEC_PER_SEC) {
+                next_sec++;
+                next_nsec -= (long int) NSEC_PER_SEC;
+            }
+            index++;
+        }
+        checksum += index;
+    }
+    return checksum;
+}
+
+static uint64_t kernel_div (const interval_bin_t *bin, const struct timespec *ts, size_t count) {
+    /* params */
+    uint64_t    checksum = 0;   /* checksum */
+    size_t      i;              /* iterator */
+
+    for (i=0; i<count; i++) {
+        checksum += interval_bin_index_div(bin, timespec_to_nsec(ts[i]));
+    }
+    return checksum;
+}
+
+static uint64_t kernel_pow2 (const interval_bin_t *bin, const struct timespec *ts, size_t count) {
+    /* params */
+    uint64_t    checksum = 0;   /* checksum */
+    size_t      i;              /* iterator */
+
+    for (i=0; i<count; i++) {
+        checksum += interval_bin_index_pow2(bin, timespec_to_nsec(ts[i]));
+    }
+    return checksum;
+}
+
+static void run_kernel (bench_kernel_t kernel, const interval_bin_t *bin, const struct timespec *ts, size_t count, long int rounds, bench_result_t *result) {
+    /* params */
+    double      start;      /* start time */
+    double      elapsed;    /* elapsed time of one round */
+    long int    i;          /* iterator */
+
+    for (i=0; i<rounds; i++) {
+        start = get_time();
+        result->checksum = kernel(bin, ts, count);
+        elapsed = get_time() - start;
+        if ((i == 0) || (elapsed < result->elapsed)) {
+            result->elapsed = elapsed;
+        }
+    }
+    return;
+}
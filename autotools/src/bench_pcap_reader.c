@@ -0,0 +1,257 @@
+/*
+ * @file bench_pcap_reader.c
+ * @brief Benchmark libtrace reader against mmap reader on the same pcap file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+/* System libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <inttypes.h>
+
+/* Public libraries */
+#include "libtrace.h"
+
+/* Project libraries */
+#include "lib_output_format.h"
+#include "lib_error.h"
+#include "lib_pcap_mmap.h"
+
+/* Constants */
+#define CLI_MAX_INPUTS 5
+
+/**
+ * @brief Accumulated result of one pass, both readers must agree on it
+ */
+typedef struct {
+    uint64_t packets;       /* packet count */
+    uint64_t bytes;         /* sum of wire length */
+    uint64_t time_sum;      /* sum of timestamp (nsec), detect timestamp difference */
+    double   elapsed;       /* elapsed time (sec) */
+} bench_result_t;
+
+/**
+ * @brief Print help message
+ */
+static void print_help_message (void);
+
+/**
+ * @brief Get monotonic time in seconds
+ * @return Time (sec)
+ */
+static double get_time (void);
+
+/**
+ * @brief Read the whole file with libtrace, retrieve timestamp and wire length of every packet
+ * @param input_file Input file
+ * @param result Result of pass
+ * @return Error code
+ */
+static ec_t bench_libtrace (const char *input_file, bench_result_t *result);
+
+/**
+ * @brief Read the whole file with mmap reader, retrieve timestamp and wire length of every packet
+ * @param input_file Input file
+ * @param result Result of pass
+ * @return Error code
+ */
+static ec_t bench_mmap (const char *input_file, bench_result_t *result);
+
+/**
+ * @brief Main function, run both readers for given rounds and report throughput
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @return Error code
+ * @details
+ * Normal usage:            ./bench_pcap_reader -i <input_file> [-c <rounds>]
+ * Display help message:    ./bench_pcap_reader -h
+ */
+int main (int argc, char *argv[]) {
+    /* params */
+                        errno = 0;          /* error number */
+    ec_t                ec = 0;             /* error code */
+    int                 i;                  /* iterator */
+    char               *endptr;             /* string to int conversion pointer */
+    const char         *input_file = NULL;  /* input file */
+    long int            rounds = 3;         /* rounds of each reader */
+    bench_result_t      libtrace_result;    /* best result of libtrace reader */
+    bench_result_t      mmap_result;        /* best result of mmap reader */
+    bench_result_t      result;             /* result of one round */
+    output_format       format;             /* output format */
+
+    get_format(&format);
+
+    /* parse CLI arguments */
+    if (argc < 2) {
+        ec = EC_CLI_NO_INPUTS;
+    } else if (argc > CLI_MAX_INPUTS) {
+        ec = EC_CLI_MAX_INPUTS;
+    }
+    for (i=1 ; (i<argc) && (ec==0) ; i++) {
+        if ((strcmp(argv[i], "-i") == 0) || (strcmp(argv[i], "--input") == 0)) {
+            i++;
+            if (i < argc) {
+                input_file = argv[i];
+            } else {
+                ec = EC_CLI_NO_INPUT_FILE_VALUE;
+            }
+        } else if ((strcmp(argv[i], "-c") == 0) || (strcmp(argv[i], "--count-size") == 0)) {
+            i++;
+            if (i < argc) {
+                rounds = strtol(argv[i], &endptr, 10);
+                if ((errno != EC_SUCCESS) || (endptr == argv[i]) || (rounds < 1)) {
+                    ec = EC_CLI_INVALID_COUNT_SIZE;
+                }
+            } else {
+                ec = EC_CLI_NO_COUNT_SIZE_VALUE;
+            }
+        } else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "--help") == 0)) {
+            print_help_message();
+            exit(EXIT_SUCCESS);
+        } else {
+            ec = EC_CLI_UNKNOWN_OPTION;
+        }
+    }
+    if ((ec == EC_SUCCESS) && (input_file == NULL)) {
+        ec = EC_CLI_NO_INPUT_OPTION;
+    }
+    if (ec != EC_SUCCESS) {
+        print_ec_message(ec);
+        print_help_message();
+        exit(EXIT_FAILURE);
+    }
+
+    /* run both readers alternately, keep the fastest round of each so page cache state is comparable */
+    memset(&libtrace_result, 0, sizeof(bench_result_t));
+    memset(&mmap_result, 0, sizeof(bench_result_t));
+    for (i=0 ; (i<(int) rounds) && (ec==EC_SUCCESS) ; i++) {
+        ec = bench_libtrace(input_file, &result);
+        if ((ec == EC_SUCCESS) && ((i == 0) || (result.elapsed < libtrace_result.elapsed))) {
+            libtrace_result = result;
+        }
+        if (ec == EC_SUCCESS) {
+            ec = bench_mmap(input_file, &result);
+        }
+        if ((ec == EC_SUCCESS) && ((i == 0) || (result.elapsed < mmap_result.elapsed))) {
+            mmap_result = result;
+        }
+    }
+    if (ec != EC_SUCCESS) {
+        print_ec_message(ec);
+        exit(EXIT_FAILURE);
+    }
+
+    /* report */
+    printf("Reader\t\tPackets\t\tBytes\t\tTime(sec)\tMpps\tns/packet\n");
+    printf("libtrace\t%" PRIu64 "\t%" PRIu64 "\t%.6lf\t%.3lf\t%.2lf\n",
+            libtrace_result.packets, libtrace_result.bytes, libtrace_result.elapsed,
+            (double) libtrace_result.packets / libtrace_result.elapsed / 1e6,
+            libtrace_result.elapsed * 1e9 / (double) libtrace_result.packets);
+    printf("mmap\t\t%" PRIu64 "\t%" PRIu64 "\t%.6lf\t%.3lf\t%.2lf\n",
+            mmap_result.packets, mmap_result.bytes, mmap_result.elapsed,
+            (double) mmap_result.packets / mmap_result.elapsed / 1e6,
+            mmap_result.elapsed * 1e9 / (double) mmap_result.packets);
+    printf("Speedup: %.2lfx\n", libtrace_result.elapsed / mmap_result.elapsed);
+    if ((libtrace_result.packets != mmap_result.packets) ||
+        (libtrace_result.bytes != mmap_result.bytes) ||
+        (libtrace_result.time_sum != mmap_result.time_sum)) {
+        printf("%sReaders disagree on packets, bytes or timestamps\n", format.status.fail);
+        exit(EXIT_FAILURE);
+    }
+    printf("%sReaders agree on packets, bytes and timestamps\n", format.status.pass);
+    exit(EXIT_SUCCESS);
+}
+
+static void print_help_message (void) {
+    printf("Usage: ./bench_pcap_reader -i <input_file> [-c <rounds>]\n");
+    printf("       ./bench_pcap_reader -h\n");
+    printf("Options:\n");
+    printf("  -i, --input <input_file>      Input file, uncompressed classic pcap\n");
+    printf("  -c, --count-size <rounds>     (optional) Rounds of each reader, fastest round is reported, default=3\n");
+    printf("  -h, --help                    Display help message\n");
+    return;
+}
+
+static double get_time (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static ec_t bench_libtrace (const char *input_file, bench_result_t *result) {
+    /* params */
+    ec_t                ec = EC_SUCCESS;    /* error code */
+    libtrace_t         *trace = NULL;       /* trace file */
+    libtrace_packet_t  *packet = NULL;      /* packet */
+    struct timespec     ts;                 /* timestamp */
+    double              start;              /* start time */
+
+    memset(result, 0, sizeof(bench_result_t));
+    start = get_time();
+    packet = trace_create_packet();
+    if (packet == NULL) {
+        perror("trace_create_packet");
+        ec = EC_GEN_UNABLE_TO_CREATE_PACKET;
+    }
+    if (ec == EC_SUCCESS) {
+        trace = trace_create(input_file);
+        if (trace_is_err(trace)) {
+            trace_perror(trace, "trace_create");
+            ec = EC_GEN_UNABLE_TO_CREATE_TRACE;
+        } else if (trace_start(trace) != 0) {
+            trace_perror(trace, "trace_start");
+            ec = EC_GEN_UNABLE_TO_START_TRACE;
+        }
+    }
+    if (ec == EC_SUCCESS) {
+        while (trace_read_packet(trace, packet) > 0) {
+            /* following line will result in -Waggregate-return warning, same as pt_count_packet */
+            ts = trace_get_timespec(packet);
+            result->packets++;
+            result->bytes += trace_get_wire_length(packet);
+            result->time_sum += (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+        }
+        if (trace_is_err(trace)) {
+            trace_perror(trace, "Reading packets");
+            ec = EC_GEN_TRACE_READ_PACKET_ERROR;
+        }
+    }
+    if (trace != NULL) {
+        trace_destroy(trace);
+    }
+    if (packet != NULL) {
+        trace_destroy_packet(packet);
+    }
+    result->elapsed = get_time() - start;
+    return ec;
+}
+
+static ec_t bench_mmap (const char *input_file, bench_result_t *result) {
+    /* params */
+    ec_t                ec = EC_SUCCESS;    /* error code */
+    pcap_mmap_t         pcap;               /* mmap reader */
+    pcap_packet_view_t  view;               /* packet view */
+    int                 rc;                 /* return code of mmap reader */
+    double              start;              /* start time */
+
+    memset(result, 0, sizeof(bench_result_t));
+    start = get_time();
+    ec = pcap_mmap_open(input_file, &pcap);
+    if (ec == EC_SUCCESS) {
+        while ((rc = pcap_mmap_next(&pcap, &view)) > 0) {
+            result->packets++;
+            result->bytes += view.wire_length;
+            result->time_sum += (uint64_t) view.ts.tv_sec * 1000000000 + (uint64_t) view.ts.tv_nsec;
+        }
+        if (rc < 0) {
+            ec = EC_GEN_TRACE_READ_PACKET_ERROR;
+        }
+        pcap_mmap_close(&pcap);
+    }
+    result->elapsed = get_time() - start;
+    return ec;
+}
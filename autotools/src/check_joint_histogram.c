@@ -0,0 +1,276 @@
+/*
+ * @file check_joint_histogram.c
+ * @brief Check joint histogram files of several runs, read back and merged, against a single run of synthetic packets
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+/* System libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <inttypes.h>
+
+/* Project libraries */
+#include "lib_output_format.h"
+#include "lib_error.h"
+#include "lib_joint_histogram.h"
+
+/* Constants */
+#define CLI_MAX_INPUTS      2
+#define CHECK_PACKETS       (1 << 20)   /* synthetic packets */
+#define CHECK_PARTS         2           /* runs written to files, read back and merged */
+#define CHECK_TICKS_PER_SEC 1000000000  /* tick of synthetic IAT, written to and read from file header */
+
+/**
+ * @brief Print help message
+ */
+static void print_help_message (void);
+
+/**
+ * @brief Next uniform value in (0, 1) of xorshift generator
+ * @param state Generator state
+ * @return Uniform value
+ */
+static double next_uniform (uint64_t *state);
+
+/**
+ * @brief Fill size and IAT of each packet, the same packets on every run
+ * @param sizes Wire length of each packet (byte)
+ * @param iats IAT ending at each packet (tick), about 1% negative as in traces of several interfaces
+ * @param count Number of packets
+ * @return void
+ */
+static void generate_packets (uint32_t *sizes, long int *iats, size_t count);
+
+/**
+ * @brief Count packets of one run, the first packet of the trace has no IAT
+ * @param histogram Histogram
+ * @param sizes Wire length of each packet (byte)
+ * @param iats IAT ending at each packet (tick)
+ * @param begin First packet of run
+ * @param end Packet after the last one of run
+ * @return void
+ * @details A later run is given the IAT across the boundary, as the merger of multi-threaded mode adds it
+ */
+static void count_packets (joint_histogram_t *histogram, const uint32_t *sizes, const long int *iats, size_t begin, size_t end);
+
+/**
+ * @brief Check each part written to a file, read back and merged against the single run
+ * @param sizes Wire length of each packet (byte)
+ * @param iats IAT ending at each packet (tick)
+ * @param count Number of packets
+ * @param passed Cleared if merged histogram differs from single run
+ * @return Error code
+ */
+static ec_t check_merge (const uint32_t *sizes, const long int *iats, size_t count, bool *passed);
+
+/**
+ * @brief Main function, compare merged histogram files with one histogram of the same packets
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @return Error code
+ * @details
+ * Normal usage:            ./check_joint_histogram
+ * Display help message:    ./check_joint_histogram -h
+ */
+int main (int argc, char *argv[]) {
+    /* params */
+                        errno = 0;              /* error number */
+    ec_t                ec = 0;                 /* error code */
+    int                 i;                      /* iterator */
+    uint32_t           *sizes = NULL;           /* synthetic wire lengths */
+    long int           *iats = NULL;            /* synthetic IAT */
+    bool                passed = true;          /* merged histogram is identical to single run */
+    output_format       format;                 /* output format */
+
+    get_format(&format);
+
+    /* parse CLI arguments */
+    if (argc > CLI_MAX_INPUTS) {
+        ec = EC_CLI_MAX_INPUTS;
+    }
+    for (i=1 ; (i<argc) && (ec==0) ; i++) {
+        if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "--help") == 0)) {
+            print_help_message();
+            exit(EXIT_SUCCESS);
+        } else {
+            ec = EC_CLI_UNKNOWN_OPTION;
+        }
+    }
+    if (ec != EC_SUCCESS) {
+        print_ec_message(ec);
+        print_help_message();
+        exit(EXIT_FAILURE);
+    }
+
+    sizes = (uint32_t *) malloc(CHECK_PACKETS * sizeof(uint32_t));
+    iats = (long int *) malloc(CHECK_PACKETS * sizeof(long int));
+    if ((sizes == NULL) || (iats == NULL)) {
+        perror("malloc");
+        free(sizes);
+        free(iats);
+        print_ec_message(EC_GEN_UNABLE_TO_MALLOC);
+        exit(EXIT_FAILURE);
+    }
+
+    /* run */
+    printf("Packets: %d, parts: %d\n", CHECK_PACKETS, CHECK_PARTS);
+    generate_packets(sizes, iats, CHECK_PACKETS);
+    ec = check_merge(sizes, iats, CHECK_PACKETS, &passed);
+    free(sizes);
+    free(iats);
+    if (ec != EC_SUCCESS) {
+        print_ec_message(ec);
+        exit(EXIT_FAILURE);
+    }
+
+    /* report */
+    if (!passed) {
+        printf("%sMerged histogram files differ from a single run\n", format.status.fail);
+        exit(EXIT_FAILURE);
+    }
+    printf("%sMerged histogram files are identical to a single run\n", format.status.pass);
+    exit(EXIT_SUCCESS);
+}
+
+static void print_help_message (void) {
+    printf("Usage: ./check_joint_histogram\n");
+    printf("       ./check_joint_histogram -h\n");
+    printf("Options:\n");
+    printf("  -h, --help                                Display help message\n");
+    return;
+}
+
+static double next_uniform (uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    /* top 53 bits, offset by half a step so neither 0 nor 1 is returned */
+    return ((double) (*state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+/* @brief Fill size and IAT of each packet
+ * @details sizes reach past the last size bin and row, IAT is heavy-tailed so it reaches the last columns
+ */
+static void generate_packets (uint32_t *sizes, long int *iats, size_t count) {
+    /* params */
+    uint64_t    state = 0x9E3779B97F4A7C15ULL;     /* xorshift state */
+    double      u;                                  /* uniform value */
+    size_t      i;                                  /* iterator */
+
+    for (i=0; i<count; i++) {
+        sizes[i] = 40 + (uint32_t) floor(next_uniform(&state) * 9000);
+        if ((i % 4096) == 0) {
+            sizes[i] = 1 << 18;
+        }
+        u = next_uniform(&state);
+        iats[i] = (long int) (1000 * pow(u, -1 / 1.1));
+        if (next_uniform(&state) < 0.01) {
+            iats[i] = -iats[i];
+        }
+    }
+    return;
+}
+
+static void count_packets (joint_histogram_t *histogram, const uint32_t *sizes, const long int *iats, size_t begin, size_t end) {
+    /* params */
+    size_t      i;                                  /* iterator */
+
+    for (i=begin; i<end; i++) {
+        if (i == 0) {
+            joint_histogram_size(histogram, sizes[i]);
+        } else {
+            joint_histogram_packet(histogram, sizes[i], iats[i]);
+        }
+    }
+    return;
+}
+
+/* @brief Check each part written to a file, read back and merged
+ * @details files are written to the working directory and removed, a file of another magic must be rejected
+ */
+static ec_t check_merge (const uint32_t *sizes, const long int *iats, size_t count, bool *passed) {
+    /* params */
+    ec_t                ec = EC_SUCCESS;        /* error code */
+    joint_histogram_t   single;                 /* histogram of all packets */
+    joint_histogram_t   part;                   /* histogram of one part, then read back from its file */
+    joint_histogram_t   merged;                 /* histogram merged from files */
+    char                paths[CHECK_PARTS][64]; /* file of each part */
+    uint64_t            ticks_per_sec;          /* tick read from file */
+    FILE               *file;                   /* file of another format */
+    size_t              i;                      /* iterator */
+
+    memset(&single, 0, sizeof(joint_histogram_t));
+    memset(&part, 0, sizeof(joint_histogram_t));
+    memset(&merged, 0, sizeof(joint_histogram_t));
+    for (i=0; i<CHECK_PARTS; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "check_joint_histogram_%zu.bin", i);
+    }
+    ec = joint_histogram_init(&single);
+    if (ec == EC_SUCCESS) {
+        ec = joint_histogram_init(&part);
+    }
+    if (ec == EC_SUCCESS) {
+        ec = joint_histogram_init(&merged);
+    }
+    if (ec == EC_SUCCESS) {
+        count_packets(&single, sizes, iats, 0, count);
+    }
+
+    /* each part is a run of its own, written to its own file */
+    for (i=0; (i<CHECK_PARTS) && (ec==EC_SUCCESS); i++) {
+        memset(part.size, 0, JOINT_SIZE_BINS * sizeof(uint64_t));
+        memset(part.joint, 0, JOINT_ROWS * JOINT_COLUMNS * sizeof(uint64_t));
+        part.packets = 0;
+        part.negative = 0;
+        count_packets(&part, sizes, iats, i * count / CHECK_PARTS, (i + 1) * count / CHECK_PARTS);
+        ec = joint_histogram_write(&part, paths[i], CHECK_TICKS_PER_SEC);
+    }
+
+    /* files are read back and merged */
+    for (i=0; (i<CHECK_PARTS) && (ec==EC_SUCCESS); i++) {
+        ec = joint_histogram_read(&part, paths[i], &ticks_per_sec);
+        if ((ec == EC_SUCCESS) && (ticks_per_sec != CHECK_TICKS_PER_SEC)) {
+            printf("%s\tticks per second %" PRIu64 " instead of %d\n", paths[i], ticks_per_sec, CHECK_TICKS_PER_SEC);
+            *passed = false;
+        }
+        if (ec == EC_SUCCESS) {
+            joint_histogram_merge(&merged, &part);
+        }
+    }
+    if (ec == EC_SUCCESS) {
+        printf("Single:\tpackets %" PRIu64 ", negative %" PRIu64 "\n", single.packets, single.negative);
+        printf("Merged:\tpackets %" PRIu64 ", negative %" PRIu64 "\n", merged.packets, merged.negative);
+        if ((merged.packets != single.packets) || (merged.negative != single.negative)
+            || (memcmp(merged.size, single.size, JOINT_SIZE_BINS * sizeof(uint64_t)) != 0)
+            || (memcmp(merged.joint, single.joint, JOINT_ROWS * JOINT_COLUMNS * sizeof(uint64_t)) != 0)) {
+            *passed = false;
+        }
+    }
+
+    /* a file of another format is not merged */
+    if (ec == EC_SUCCESS) {
+        file = fopen(paths[0], "w");
+        if (file == NULL) {
+            perror("fopen");
+            ec = EC_GEN_UNABLE_TO_OPEN_DATA_FILE;
+        } else {
+            fprintf(file, "PTHIS, not a joint histogram\n");
+            fclose(file);
+            if (joint_histogram_read(&part, paths[0], &ticks_per_sec) != EC_GEN_INVALID_JOINT_HISTOGRAM) {
+                printf("%s\tfile of another format is read\n", paths[0]);
+                *passed = false;
+            }
+        }
+    }
+    for (i=0; i<CHECK_PARTS; i++) {
+        remove(paths[i]);
+    }
+    joint_histogram_free(&single);
+    joint_histogram_free(&part);
+    joint_histogram_free(&merged);
+    return ec;
+}
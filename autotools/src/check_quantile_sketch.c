@@ -0,0 +1,263 @@
+/*
+ * @file check_quantile_sketch.c
+ * @brief Check quantile sketch against exact quantiles of synthetic IAT and packet sizes, single and merged
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+/* System libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <inttypes.h>
+
+/* Project libraries */
+#include "lib_output_format.h"
+#include "lib_error.h"
+#include "lib_quantile_sketch.h"
+
+/* Constants */
+#define CLI_MAX_INPUTS      5
+#define CHECK_VALUES        (1 << 21)   /* synthetic values of each distribution */
+#define CHECK_PARTS         4           /* sketches merged into one, as per-thread sketches are */
+#define CHECK_DISTRIBUTIONS 3           /* number of synthetic distributions */
+#define CHECK_QUANTILES     4           /* number of checked quantiles */
+#define CHECK_TOLERANCE     0.05        /* largest relative error accepted at default compression */
+
+/**
+ * @brief Synthetic distribution
+ */
+typedef enum {
+    CHECK_EXPONENTIAL,      /* IAT of Poisson arrivals, mean 1000 */
+    CHECK_PARETO,           /* heavy-tailed IAT, alpha 1.5, minimum 1000 */
+    CHECK_UNIFORM           /* integer packet sizes of 40 to 1539 bytes, many ties */
+} check_distribution_t;
+
+/**
+ * @brief Print help message
+ */
+static void print_help_message (void);
+
+/**
+ * @brief Next uniform value in (0, 1) of xorshift generator
+ * @param state Generator state
+ * @return Uniform value
+ */
+static double next_uniform (uint64_t *state);
+
+/**
+ * @brief Fill values of one distribution, the same values on every run
+ * @param values Values
+ * @param count Number of values
+ * @param distribution Distribution
+ * @return void
+ */
+static void generate_values (double *values, size_t count, check_distribution_t distribution);
+
+/**
+ * @brief Compare values for qsort
+ */
+static int compare_value (const void *a, const void *b);
+
+/**
+ * @brief Check sketches of one distribution against exact quantiles and print them
+ * @param values Values, sorted on return
+ * @param count Number of values
+ * @param distribution Distribution
+ * @param compression Compression of sketches
+ * @param tolerance Largest relative error accepted
+ * @param passed Cleared if any quantile is outside tolerance
+ * @return Error code
+ */
+static ec_t check_distribution (double *values, size_t count, check_distribution_t distribution, uint32_t compression, double tolerance, bool *passed);
+
+/**
+ * @brief Main function, compare sketched p50, p99, p99.9 and p99.99 with exact ones
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @return Error code
+ * @details
+ * Normal usage:            ./check_quantile_sketch [-C <compression>]
+ * Display help message:    ./check_quantile_sketch -h
+ */
+int main (int argc, char *argv[]) {
+    /* params */
+                        errno = 0;              /* error number */
+    ec_t                ec = 0;                 /* error code */
+    int                 i;                      /* iterator */
+    char               *endptr;                 /* string to int conversion pointer */
+    long int            compression = QUANTILE_SKETCH_DEFAULT_COMPRESSION; /* compression of sketches */
+    double              tolerance = CHECK_TOLERANCE;    /* largest relative error accepted, tightened above default compression */
+    double             *values = NULL;          /* synthetic values */
+    bool                passed = true;          /* all quantiles within tolerance */
+    output_format       format;                 /* output format */
+
+    get_format(&format);
+
+    /* parse CLI arguments */
+    if (argc > CLI_MAX_INPUTS) {
+        ec = EC_CLI_MAX_INPUTS;
+    }
+    for (i=1 ; (i<argc) && (ec==0) ; i++) {
+        if ((strcmp(argv[i], "-C") == 0) || (strcmp(argv[i], "--quantile-compression") == 0)) {
+            i++;
+            if (i < argc) {
+                compression = strtol(argv[i], &endptr, 10);
+                if ((errno != EC_SUCCESS) || (endptr == argv[i])
+                    || (compression < QUANTILE_SKETCH_MIN_COMPRESSION) || (compression > QUANTILE_SKETCH_MAX_COMPRESSION)) {
+                    ec = EC_CLI_INVALID_QUANTILE_COMPRESSION;
+                }
+            } else {
+                ec = EC_CLI_NO_QUANTILE_COMPRESSION_VALUE;
+            }
+        } else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "--help") == 0)) {
+            print_help_message();
+            exit(EXIT_SUCCESS);
+        } else {
+            ec = EC_CLI_UNKNOWN_OPTION;
+        }
+    }
+    if (ec != EC_SUCCESS) {
+        print_ec_message(ec);
+        print_help_message();
+        exit(EXIT_FAILURE);
+    }
+    /* error shrinks about in proportion to compression above default, and grows faster below it */
+    if (compression > QUANTILE_SKETCH_DEFAULT_COMPRESSION) {
+        tolerance = CHECK_TOLERANCE * QUANTILE_SKETCH_DEFAULT_COMPRESSION / (double) compression;
+    }
+
+    values = (double *) malloc(CHECK_VALUES * sizeof(double));
+    if (values == NULL) {
+        perror("malloc");
+        print_ec_message(EC_GEN_UNABLE_TO_MALLOC);
+        exit(EXIT_FAILURE);
+    }
+
+    /* run */
+    printf("Compression: %ld, values: %d, parts: %d, tolerance: %.2lf%%\n", compression, CHECK_VALUES, CHECK_PARTS, tolerance * 100);
+    printf("Dist.\tQuantile\tExact\t\tSingle\t\tMerged\n");
+    for (i=0; (i<CHECK_DISTRIBUTIONS) && (ec==EC_SUCCESS); i++) {
+        generate_values(values, CHECK_VALUES, (check_distribution_t) i);
+        ec = check_distribution(values, CHECK_VALUES, (check_distribution_t) i, (uint32_t) compression, tolerance, &passed);
+    }
+    free(values);
+    if (ec != EC_SUCCESS) {
+        print_ec_message(ec);
+        exit(EXIT_FAILURE);
+    }
+
+    /* report */
+    if (!passed) {
+        printf("%sSketched quantiles differ from exact ones by more than %.2lf%%\n", format.status.fail, tolerance * 100);
+        exit(EXIT_FAILURE);
+    }
+    printf("%sSketched quantiles are within %.2lf%% of exact ones\n", format.status.pass, tolerance * 100);
+    exit(EXIT_SUCCESS);
+}
+
+static void print_help_message (void) {
+    printf("Usage: ./check_quantile_sketch [-C <compression>]\n");
+    printf("       ./check_quantile_sketch -h\n");
+    printf("Options:\n");
+    printf("  -C, --quantile-compression <compression>  (optional) Compression of sketches, 10-100000, default=200,\n");
+    printf("                                            p50, p99, p99.9 and p99.99 must be within 5%%, or 5%% x 200 / compression above 200\n");
+    printf("  -h, --help                                Display help message\n");
+    return;
+}
+
+static double next_uniform (uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    /* top 53 bits, offset by half a step so neither 0 nor 1 is returned */
+    return ((double) (*state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static void generate_values (double *values, size_t count, check_distribution_t distribution) {
+    /* params */
+    uint64_t    state = 0x9E3779B97F4A7C15ULL;     /* xorshift state */
+    double      u;                                  /* uniform value */
+    size_t      i;                                  /* iterator */
+
+    for (i=0; i<count; i++) {
+        u = next_uniform(&state);
+        switch (distribution) {
+            case CHECK_EXPONENTIAL:
+                values[i] = -1000 * log(u);
+                break;
+            case CHECK_PARETO:
+                values[i] = 1000 * pow(u, -1 / 1.5);
+                break;
+            case CHECK_UNIFORM:
+                values[i] = 40 + floor(u * 1500);
+                break;
+            default:
+                values[i] = 0;
+                break;
+        }
+    }
+    return;
+}
+
+static int compare_value (const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static ec_t check_distribution (double *values, size_t count, check_distribution_t distribution, uint32_t compression, double tolerance, bool *passed) {
+    /* params */
+    static const char  *names[CHECK_DISTRIBUTIONS] = {"exp", "pareto", "uniform"};  /* names of distributions */
+    static const double quantiles[CHECK_QUANTILES] = {0.5, 0.99, 0.999, 0.9999};     /* checked quantiles */
+    ec_t                ec = EC_SUCCESS;        /* error code */
+    quantile_sketch_t   single;                 /* sketch of all values */
+    quantile_sketch_t   parts[CHECK_PARTS];     /* sketches of consecutive parts of values */
+    quantile_sketch_t   merged;                 /* sketch merged from parts */
+    double              exact;                  /* exact quantile, nearest rank */
+    double              single_error;           /* relative error of single sketch */
+    double              merged_error;           /* relative error of merged sketch */
+    size_t              i;                      /* iterator */
+
+    memset(parts, 0, sizeof(parts));
+    memset(&merged, 0, sizeof(quantile_sketch_t));
+    ec = quantile_sketch_init(&single, compression);
+    if (ec == EC_SUCCESS) {
+        ec = quantile_sketch_init(&merged, compression);
+    }
+    for (i=0; (i<CHECK_PARTS) && (ec==EC_SUCCESS); i++) {
+        ec = quantile_sketch_init(&parts[i], compression);
+    }
+    if (ec == EC_SUCCESS) {
+        for (i=0; i<count; i++) {
+            quantile_sketch_add(&single, values[i]);
+            quantile_sketch_add(&parts[i * CHECK_PARTS / count], values[i]);
+        }
+        for (i=0; i<CHECK_PARTS; i++) {
+            quantile_sketch_merge(&merged, &parts[i]);
+        }
+        qsort(values, count, sizeof(double), compare_value);
+        for (i=0; i<CHECK_QUANTILES; i++) {
+            exact = values[(size_t) ceil(quantiles[i] * (double) count) - 1];
+            single_error = quantile_sketch_quantile(&single, quantiles[i]) / exact - 1;
+            merged_error = quantile_sketch_quantile(&merged, quantiles[i]) / exact - 1;
+            printf("%s\tp%g\t\t%.2lf\t\t%+.3lf%%\t\t%+.3lf%%\n", names[distribution], quantiles[i] * 100, exact,
+                   single_error * 100, merged_error * 100);
+            if ((fabs(single_error) > tolerance) || (fabs(merged_error) > tolerance)) {
+                *passed = false;
+            }
+        }
+        if ((single.min > values[0]) || (single.min < values[0]) || (single.max > values[count - 1]) || (single.max < values[count - 1])) {
+            printf("%s\tminimum or maximum is not exact\n", names[distribution]);
+            *passed = false;
+        }
+    }
+    quantile_sketch_free(&single);
+    quantile_sketch_free(&merged);
+    for (i=0; i<CHECK_PARTS; i++) {
+        quantile_sketch_free(&parts[i]);
+    }
+    return ec;
+}
@@ -0,0 +1,249 @@
+/*
+ * @file lib_burst_detector.c
+ * @brief Micro-burst detector library source file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "lib_burst_detector.h"
+
+/**
+ * @brief Init callback of stage, bursts are printed relative to origin
+ * @param origin Timestamp of first packet (nsec)
+ * @param arg Burst stage
+ * @return EC_SUCCESS
+ */
+static ec_t burst_init (uint64_t origin, void *arg);
+
+/**
+ * @brief Packet callback of stage, print burst ended by this packet
+ * @param packet Decoded packet
+ * @param arg Burst stage
+ * @return void
+ */
+static void burst_packet (const pipeline_packet_t *packet, void *arg);
+
+/**
+ * @brief Finish callback of stage, print burst still going at the end of trace
+ * @param index Interval of last packet
+ * @param arg Burst stage
+ * @return EC_SUCCESS
+ */
+static ec_t burst_finish (uint64_t index, void *arg);
+
+/**
+ * @brief Print one finished micro-burst
+ * @param event Finished burst
+ * @param bursts Burst stage
+ * @return void
+ */
+static void print_burst (const burst_event_t *event, const burst_stage_t *bursts);
+
+ec_t burst_detector_init (burst_detector_t *detector, uint32_t threshold, uint64_t window) {
+    memset(detector, 0, sizeof(burst_detector_t));
+    detector->threshold = threshold;
+    detector->window = window;
+    detector->ts = (uint64_t *) malloc(threshold * sizeof(uint64_t));
+    detector->length = (uint32_t *) malloc(threshold * sizeof(uint32_t));
+    if ((detector->ts == NULL) || (detector->length == NULL)) {
+        perror("malloc");
+        return EC_GEN_UNABLE_TO_MALLOC;
+    }
+    return EC_SUCCESS;
+}
+
+void burst_detector_free (burst_detector_t *detector) {
+    free(detector->ts);
+    free(detector->length);
+    detector->ts = NULL;
+    detector->length = NULL;
+    return;
+}
+
+/* @brief Start burst
+ * @details head is the oldest packet once ring is full
+ */
+void burst_detector_start (burst_detector_t *detector, uint64_t ts) {
+    memset(&detector->event, 0, sizeof(burst_event_t));
+    detector->event.start = detector->ts[detector->head];
+    detector->event.end = ts;
+    detector->event.packets = detector->threshold;
+    detector->event.bytes = detector->window_bytes;
+    detector->event.min_span = UINT64_MAX;
+    detector->event.peak_span = 1;
+    detector->open = true;
+    return;
+}
+
+/* @brief Continue burst
+ * @details less than threshold packets passed since the last one of burst, they are walked back from the newest,
+ *          which is just before head
+ */
+void burst_detector_extend (burst_detector_t *detector, uint64_t ts) {
+    /* params */
+    uint64_t    fresh = detector->seq - detector->last_seq; /* packets after the last one of burst */
+    uint32_t    position = detector->head;                  /* ring position */
+    uint64_t    i;                                          /* iterator */
+
+    for (i=0; i<fresh; i++) {
+        position = (position == 0) ? detector->threshold - 1 : position - 1;
+        detector->event.bytes += detector->length[position];
+    }
+    detector->event.packets += fresh;
+    detector->event.end = ts;
+    return;
+}
+
+bool burst_detector_flush (burst_detector_t *detector, burst_event_t *event) {
+    if (!detector->open) {
+        return false;
+    }
+    detector->open = false;
+    *event = detector->event;
+    detector->bursts++;
+    detector->burst_packets += event->packets;
+    detector->burst_bytes += event->bytes;
+    if (event->packets > detector->max_packets) {
+        detector->max_packets = event->packets;
+    }
+    if ((event->end > event->start) && (event->end - event->start > detector->max_duration)) {
+        detector->max_duration = event->end - event->start;
+    }
+    return true;
+}
+
+void burst_stage_init (burst_stage_t *bursts) {
+    memset(bursts, 0, sizeof(burst_stage_t));
+    return;
+}
+
+ec_t burst_option (int argc, char *argv[], int *i, void *arg) {
+    /* params */
+    burst_stage_t  *bursts = (burst_stage_t *) arg;
+    ec_t            ec = EC_SUCCESS;    /* error code */
+    char           *endptr;             /* string to number conversion pointer */
+
+    if ((strcmp(argv[*i], "-B") == 0) || (strcmp(argv[*i], "--burst") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            bursts->threshold = strtol(argv[*i], &endptr, 10);
+            if ((errno != EC_SUCCESS) || (endptr == argv[*i]) || (*endptr != ',')) {
+                fprintf(stderr, "Expected <packets>,<burst_window>\n");
+                ec = EC_CLI_INVALID_BURST;
+            } else {
+                bursts->window = strtod(endptr + 1, &endptr);
+                if ((errno != EC_SUCCESS) || (*endptr != '\0')) {
+                    fprintf(stderr, "Expected <packets>,<burst_window>\n");
+                    ec = EC_CLI_INVALID_BURST;
+                }
+            }
+        } else {
+            ec = EC_CLI_NO_BURST_VALUE;
+        }
+    } else {
+        ec = EC_CLI_UNKNOWN_OPTION;
+    }
+    return ec;
+}
+
+/* @brief Register burst stage
+ * @details ring spans chunks and is not saved in checkpoint
+ */
+ec_t burst_register (burst_stage_t *bursts, pipeline_t *pipeline, bool nsec) {
+    /* params */
+    pipeline_stage_t    stage;      /* stage registered to pipeline */
+
+    if (bursts->threshold == 0) {
+        return EC_SUCCESS;
+    }
+    if ((bursts->threshold < BURST_MIN_PACKETS) || (bursts->threshold > BURST_MAX_PACKETS)
+        || (bursts->window < 1e-9) || (bursts->window > 3600) || (!nsec && (bursts->window < 1e-6))) {
+        return EC_CLI_INVALID_BURST;
+    }
+    bursts->nsec = nsec;
+    memset(&stage, 0, sizeof(pipeline_stage_t));
+    stage.name = "burst";
+    stage.unsupported = EC_CLI_INVALID_BURST;
+    stage.arg = bursts;
+    stage.init = burst_init;
+    stage.packet = burst_packet;
+    stage.finish = burst_finish;
+    return pipeline_add_stage(pipeline, &stage);
+}
+
+/* @brief Allocate burst stage
+ * @details ring of the last threshold packets, filled behind reorder buffer so bursts are found in timestamp order
+ */
+ec_t burst_start (burst_stage_t *bursts) {
+    return burst_detector_init(&bursts->detector, (uint32_t) bursts->threshold, (uint64_t) (bursts->window * (double) pipeline_ticks_per_sec(bursts->nsec)));
+}
+
+void burst_print (const burst_stage_t *bursts) {
+    /* params */
+    const burst_detector_t *detector = &bursts->detector;
+    const char             *unit = bursts->nsec ? "nsec" : "usec";     /* unit of printed time */
+
+    printf("Bursts of %u packets in %lu %s: bursts %lu, packets %lu, bytes %lu, largest %lu packets, longest %lu %s\n",
+           detector->threshold, detector->window, unit, detector->bursts, detector->burst_packets,
+           detector->burst_bytes, detector->max_packets, detector->max_duration, unit);
+    return;
+}
+
+static ec_t burst_init (uint64_t origin, void *arg) {
+    /* params */
+    burst_stage_t *bursts = (burst_stage_t *) arg;
+
+    bursts->initial = pipeline_ticks(origin, bursts->nsec);
+    return EC_SUCCESS;
+}
+
+/* @brief Bursts of one packet
+ * @details burst ended by this packet is printed at once, bursts are rare compared to packets
+ */
+static void burst_packet (const pipeline_packet_t *packet, void *arg) {
+    /* params */
+    burst_stage_t  *bursts = (burst_stage_t *) arg;
+    burst_event_t   event;      /* finished micro-burst */
+
+    if (burst_detector_packet(&bursts->detector, pipeline_ticks(packet->ts, bursts->nsec), packet->wire_length, &event)) {
+        print_burst(&event, bursts);
+    }
+    return;
+}
+
+/* @brief Finish burst stage
+ * @details burst still going at the end of trace is cut there
+ */
+static ec_t burst_finish (uint64_t index, void *arg) {
+    /* params */
+    burst_stage_t  *bursts = (burst_stage_t *) arg;
+    burst_event_t   event;      /* burst finished at end of trace */
+
+    (void) index;
+    if (burst_detector_flush(&bursts->detector, &event)) {
+        print_burst(&event, bursts);
+    }
+    return EC_SUCCESS;
+}
+
+/* @brief Print micro-burst
+ * @details start is relative to the first packet of trace, rates are taken over the windows of threshold packets
+ */
+static void print_burst (const burst_event_t *event, const burst_stage_t *bursts) {
+    /* params */
+    const char     *unit = bursts->nsec ? "nsec" : "usec";                 /* unit of printed time */
+    uint64_t        ticks_per_sec = pipeline_ticks_per_sec(bursts->nsec);   /* ticks per second */
+    double          pps;                                                    /* peak packet rate (packet/sec) */
+    double          mbps;                                                   /* peak bit rate (Mbit/sec) */
+
+    pps = (double) bursts->detector.threshold * (double) ticks_per_sec / (double) event->min_span;
+    mbps = (double) event->peak_bytes * 8 * (double) ticks_per_sec / (double) event->peak_span / 1e6;
+    printf("Burst[%06lu]: at %lu %s, duration %lu %s, packets %lu, bytes %lu, peak %.0f pps, %.3f Mbps\n", bursts->detector.bursts,
+           (event->start > bursts->initial) ? event->start - bursts->initial : 0, unit,
+           (event->end > event->start) ? event->end - event->start : 0, unit, event->packets, event->bytes, pps, mbps);
+    return;
+}
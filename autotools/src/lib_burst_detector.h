@@ -0,0 +1,221 @@
+/**
+ * @file lib_burst_detector.h
+ * @brief Streaming micro-burst detector over a ring of recent timestamps
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ * @details
+ * A micro-burst is a run of packets where every packet closes a window of threshold packets spanning
+ * at most window ticks, i.e. threshold - 1 consecutive IAT sum to at most window.
+ * The ring holds timestamp and wire length of the last threshold packets, so each packet is one store,
+ * one load of the oldest timestamp and one comparison, and byte count of the window is kept as a running sum.
+ * A burst starts with the oldest packet of the first qualifying window and ends at the last packet closing one.
+ * A qualifying window overlapping the burst continues it, packets between are added, so a burst is reported
+ * once threshold packets passed without a qualifying window and always has at least threshold packets.
+ * Peak packet rate is threshold packets over the shortest window of the burst, peak byte rate is the window
+ * of highest bytes per tick. Timestamps of the same tick are taken one tick apart,
+ * packets earlier than the oldest of the window count as zero span.
+ * Burst stage runs the detector on the packets of a pipeline and prints each burst as it ends,
+ * option "-B" is parsed by burst_option.
+ * Ref:
+ * 1. https://en.wikipedia.org/wiki/Circular_buffer
+ * 2. https://en.wikipedia.org/wiki/Micro-bursting_(networking)
+*/
+
+#ifndef BURST_DETECTOR_H
+#define BURST_DETECTOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lib_error.h"
+#include "lib_pipeline.h"
+
+#define BURST_MIN_PACKETS   2           /* smallest threshold, one IAT */
+#define BURST_MAX_PACKETS   (1 << 20)   /* largest threshold, 12 MB of ring */
+
+/**
+ * @brief One detected burst
+ */
+typedef struct {
+    uint64_t    start;          ///< timestamp of first packet (tick)
+    uint64_t    end;            ///< timestamp of last packet (tick)
+    uint64_t    packets;        ///< packets of burst
+    uint64_t    bytes;          ///< wire length sum of burst (byte)
+    uint64_t    min_span;       ///< shortest window of threshold packets (tick), at least 1
+    uint64_t    peak_bytes;     ///< bytes of the window of highest byte rate
+    uint64_t    peak_span;      ///< span of the window of highest byte rate (tick), at least 1
+} burst_event_t;
+
+/**
+ * @brief Burst detector
+ */
+typedef struct {
+    uint64_t   *ts;             ///< ring of timestamps (tick)
+    uint32_t   *length;         ///< ring of wire lengths (byte)
+    uint32_t    threshold;      ///< packets of window, also ring size
+    uint32_t    head;           ///< position of next packet, the oldest once ring is full
+    uint32_t    count;          ///< packets in ring
+    uint64_t    window;         ///< largest span of threshold packets (tick)
+    uint64_t    window_bytes;   ///< wire length sum of packets in ring
+    uint64_t    seq;            ///< packets seen
+    uint64_t    last_seq;       ///< seq of last packet of current burst
+    bool        open;           ///< current burst is not reported yet
+    burst_event_t event;        ///< current burst
+    uint64_t    bursts;         ///< finished bursts
+    uint64_t    burst_packets;  ///< packets of finished bursts
+    uint64_t    burst_bytes;    ///< bytes of finished bursts
+    uint64_t    max_packets;    ///< packets of largest burst
+    uint64_t    max_duration;   ///< duration of longest burst (tick)
+} burst_detector_t;
+
+/**
+ * @brief Micro-burst stage
+ */
+typedef struct {
+    long int            threshold;      ///< "-B" packets of micro-burst, 0 unless burst mode
+    double              window;         ///< largest span of threshold packets (sec)
+    bool                nsec;           ///< tick is nanosecond, otherwise microsecond, set by burst_register
+    burst_detector_t    detector;       ///< ring of the last threshold packets
+    uint64_t            initial;        ///< timestamp of first packet, bursts are printed relative to it (tick)
+} burst_stage_t;
+
+/**
+ * @brief Initialize burst detector
+ * @param detector Detector
+ * @param threshold Packets of window, BURST_MIN_PACKETS to BURST_MAX_PACKETS
+ * @param window Largest span of threshold packets (tick)
+ * @return EC_SUCCESS or EC_GEN_UNABLE_TO_MALLOC
+ */
+ec_t burst_detector_init (burst_detector_t *detector, uint32_t threshold, uint64_t window);
+
+/**
+ * @brief Free burst detector
+ * @param detector Detector
+ * @return void
+ */
+void burst_detector_free (burst_detector_t *detector);
+
+/**
+ * @brief Start burst at the oldest packet of window
+ * @param detector Detector, ring is full
+ * @param ts Timestamp of current packet (tick)
+ * @return void
+ */
+void burst_detector_start (burst_detector_t *detector, uint64_t ts);
+
+/**
+ * @brief Continue burst with every packet after its last one
+ * @param detector Detector, window overlaps current burst
+ * @param ts Timestamp of current packet (tick)
+ * @return void
+ */
+void burst_detector_extend (burst_detector_t *detector, uint64_t ts);
+
+/**
+ * @brief Report current burst and add it to totals
+ * @param detector Detector
+ * @param event Finished burst
+ * @return True if a burst was open
+ */
+bool burst_detector_flush (burst_detector_t *detector, burst_event_t *event);
+
+/**
+ * @brief Add one packet
+ * @param detector Detector
+ * @param ts Timestamp (tick)
+ * @param wire_length Packet length on wire (byte)
+ * @param event Finished burst, if any
+ * @return True if a burst is finished, its last packet is threshold packets before this one
+ * @details Inlined as it is called once per packet, window is maintained in O(1)
+ */
+static inline bool burst_detector_packet (burst_detector_t *detector, uint64_t ts, uint32_t wire_length, burst_event_t *event) {
+    /* params */
+    uint64_t    oldest;         /* timestamp of oldest packet of window (tick) */
+    uint64_t    span;           /* span of window (tick) */
+
+    if (detector->count == detector->threshold) {
+        detector->window_bytes -= detector->length[detector->head];
+    } else {
+        detector->count++;
+    }
+    detector->ts[detector->head] = ts;
+    detector->length[detector->head] = wire_length;
+    detector->window_bytes += wire_length;
+    detector->head = (detector->head + 1 == detector->threshold) ? 0 : detector->head + 1;
+    detector->seq++;
+    if (detector->count < detector->threshold) {
+        return false;
+    }
+
+    oldest = detector->ts[detector->head];
+    span = (ts > oldest) ? ts - oldest : 0;
+    if (span > detector->window) {
+        if (detector->open && (detector->seq - detector->last_seq >= detector->threshold)) {
+            return burst_detector_flush(detector, event);
+        }
+        return false;
+    }
+    if (span == 0) {
+        span = 1;
+    }
+    if (!detector->open) {
+        burst_detector_start(detector, ts);
+    } else if (detector->last_seq + 1 != detector->seq) {
+        burst_detector_extend(detector, ts);
+    } else {
+        detector->event.end = ts;
+        detector->event.packets++;
+        detector->event.bytes += wire_length;
+    }
+    detector->last_seq = detector->seq;
+    if (span < detector->event.min_span) {
+        detector->event.min_span = span;
+    }
+    /* cross-multiplied in double, bytes of a full ring times a span of an hour may exceed 64 bits */
+    if ((double) detector->window_bytes * (double) detector->event.peak_span > (double) detector->event.peak_bytes * (double) span) {
+        detector->event.peak_bytes = detector->window_bytes;
+        detector->event.peak_span = span;
+    }
+    return false;
+}
+
+/**
+ * @brief Initialize stage
+ * @param bursts Burst stage
+ * @return void
+ */
+void burst_stage_init (burst_stage_t *bursts);
+
+/**
+ * @brief Option parser of stage: -B
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @param i Index of option, moved to its value if it takes one
+ * @param arg Burst stage
+ * @return EC_SUCCESS, error of option, or EC_CLI_UNKNOWN_OPTION
+ */
+ec_t burst_option (int argc, char *argv[], int *i, void *arg);
+
+/**
+ * @brief Check options of stage and register it if enabled
+ * @param bursts Burst stage
+ * @param pipeline Pipeline
+ * @param nsec Tick is nanosecond, otherwise microsecond
+ * @return Error code
+ */
+ec_t burst_register (burst_stage_t *bursts, pipeline_t *pipeline, bool nsec);
+
+/**
+ * @brief Allocate ring of burst detector
+ * @param bursts Burst stage
+ * @return Error code
+ */
+ec_t burst_start (burst_stage_t *bursts);
+
+/**
+ * @brief Print summary of finished bursts
+ * @param bursts Burst stage
+ * @return void
+ */
+void burst_print (const burst_stage_t *bursts);
+
+#endif // BURST_DETECTOR_H
@@ -0,0 +1,102 @@
+/*
+ * @file lib_checkpoint.c
+ * @brief Checkpoint file library source file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "lib_checkpoint.h"
+
+/**
+ * @brief Header in front of state
+ */
+typedef struct {
+    char        magic[8];       /* CHECKPOINT_MAGIC */
+    uint32_t    version;        /* CHECKPOINT_VERSION */
+    uint32_t    reserved;       /* zero */
+    uint64_t    size;           /* size of state */
+    uint64_t    checksum;       /* hash of state */
+} checkpoint_header_t;
+
+uint64_t checkpoint_hash (uint64_t hash, const void *data, size_t size) {
+    /* params */
+    const uint8_t  *byte = (const uint8_t *) data;  /* data iterator */
+    size_t          i;                              /* iterator */
+
+    for (i=0; i<size; i++) {
+        hash ^= byte[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+ec_t checkpoint_write (const char *path, const void *state, size_t size) {
+    /* params */
+    char                tmp_path[1024];     /* path of file being written */
+    FILE               *file;               /* checkpoint file */
+    checkpoint_header_t header;             /* header */
+    bool                written;            /* header and state are written */
+
+    memset(&header, 0, sizeof(checkpoint_header_t));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    header.version = CHECKPOINT_VERSION;
+    header.size = (uint64_t) size;
+    header.checksum = checkpoint_hash(CHECKPOINT_HASH_INIT, state, size);
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    file = fopen(tmp_path, "wb");
+    if (file == NULL) {
+        perror("fopen");
+        return EC_GEN_UNABLE_TO_WRITE_CHECKPOINT;
+    }
+    /* state must reach the disk before it replaces the previous checkpoint */
+    written = (fwrite(&header, sizeof(checkpoint_header_t), 1, file) == 1) && (fwrite(state, 1, size, file) == size);
+    written = written && (fflush(file) == 0) && (fsync(fileno(file)) == 0);
+    if ((fclose(file) != 0) || !written) {
+        perror("fwrite");
+        remove(tmp_path);
+        return EC_GEN_UNABLE_TO_WRITE_CHECKPOINT;
+    }
+    if (rename(tmp_path, path) != 0) {
+        perror("rename");
+        return EC_GEN_UNABLE_TO_WRITE_CHECKPOINT;
+    }
+    return EC_SUCCESS;
+}
+
+ec_t checkpoint_read (const char *path, void *state, size_t size) {
+    /* params */
+    ec_t                ec = EC_SUCCESS;    /* error code */
+    FILE               *file;               /* checkpoint file */
+    checkpoint_header_t header;             /* header */
+
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        perror("fopen");
+        return EC_GEN_INVALID_CHECKPOINT;
+    }
+    if (fread(&header, sizeof(checkpoint_header_t), 1, file) != 1) {
+        fprintf(stderr, "Checkpoint %s is truncated\n", path);
+        ec = EC_GEN_INVALID_CHECKPOINT;
+    } else if ((memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0) || (header.version != CHECKPOINT_VERSION)) {
+        fprintf(stderr, "%s is not a checkpoint of this version\n", path);
+        ec = EC_GEN_INVALID_CHECKPOINT;
+    } else if (header.size != (uint64_t) size) {
+        fprintf(stderr, "Checkpoint %s holds %" PRIu64 " bytes of state, %zu expected\n", path, header.size, size);
+        ec = EC_GEN_INVALID_CHECKPOINT;
+    } else if (fread(state, 1, size, file) != size) {
+        fprintf(stderr, "Checkpoint %s is truncated\n", path);
+        ec = EC_GEN_INVALID_CHECKPOINT;
+    } else if (checkpoint_hash(CHECKPOINT_HASH_INIT, state, size) != header.checksum) {
+        fprintf(stderr, "Checksum of checkpoint %s does not match\n", path);
+        ec = EC_GEN_INVALID_CHECKPOINT;
+    }
+    fclose(file);
+    return ec;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file lib_checkpoint.h
+ * @brief Checkpoint file of long trace analyses, an opaque state blob guarded by magic, size and checksum
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ * @details
+ * The caller owns the layout of its state, this library only makes sure a resumed run reads back a complete state
+ * written by the same build: the file is written to "<path>.tmp", flushed to disk and renamed over the previous checkpoint,
+ * so a run killed while checkpointing still leaves the previous checkpoint intact.
+ * State is stored in host byte order, a checkpoint is only meant to be resumed on the same machine.
+ * Ref:
+ * 1. https://man7.org/linux/man-pages/man2/rename.2.html
+ * 2. http://www.isthe.com/chongo/tech/comp/fnv/index.html
+*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "lib_error.h"
+
+#define CHECKPOINT_MAGIC        "PTCKPT"                /* magic of checkpoint file */
+#define CHECKPOINT_VERSION      1                       /* version of checkpoint file */
+#define CHECKPOINT_HASH_INIT    0xcbf29ce484222325ULL   /* FNV-1a offset basis */
+
+/**
+ * @brief Hash data with 64-bit FNV-1a, used for checksum and for fingerprint of run options
+ * @param hash Previous hash, CHECKPOINT_HASH_INIT for the first block
+ * @param data Data
+ * @param size Size of data
+ * @return Hash
+ */
+uint64_t checkpoint_hash (uint64_t hash, const void *data, size_t size);
+
+/**
+ * @brief Write state to checkpoint file, replacing previous checkpoint atomically
+ * @param path Checkpoint file
+ * @param state State
+ * @param size Size of state
+ * @return EC_SUCCESS or EC_GEN_UNABLE_TO_WRITE_CHECKPOINT
+ */
+ec_t checkpoint_write (const char *path, const void *state, size_t size);
+
+/**
+ * @brief Read state from checkpoint file
+ * @param path Checkpoint file
+ * @param state State to fill
+ * @param size Expected size of state
+ * @return EC_SUCCESS, or EC_GEN_INVALID_CHECKPOINT if the file is missing, truncated, of another size or corrupted
+ */
+ec_t checkpoint_read (const char *path, void *state, size_t size);
+
+#endif // CHECKPOINT_H
@@ -14,112 +14,241 @@ void print_ec_message (ec_t ec) {
     get_format(&format);
     switch (ec) {
         case 0:
-            printf("%sSuccess\n", format.status.success);
+            fprintf(stderr, "%sSuccess\n", format.status.success);
             break;
         /* > 0x1000: CLI general errors */
         case EC_CLI_NO_INPUTS:
-            printf("%s0x%x: No input CLI arguments provided\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: No input CLI arguments provided\n\n", format.status.error, ec);
             break;
         case EC_CLI_MAX_INPUTS:
-            printf("%s0x%x: Too many input CLI arguments provided\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Too many input CLI arguments provided\n\n", format.status.error, ec);
             break;
         case EC_CLI_UNKNOWN_OPTION:
-            printf("%s0x%x: Unknown CLI option provided\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Unknown CLI option provided\n\n", format.status.error, ec);
             break;
         case EC_CLI_INPUT_FILE_NOT_FOUND:
-            printf("%s0x%x: Input file not found\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Input file not found\n\n", format.status.error, ec);
             break;
         /* > 0x1400: CLI input value missing errors */
         case EC_CLI_NO_INPUT_FILE_VALUE:
-            printf("%s0x%x: No input file value provided\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: No input file value provided\n\n", format.status.error, ec);
             break;
         case EC_CLI_NO_QUANTIZE_TIME_VALUE:
-            printf("%s0x%x: No quantize time value provided\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: No quantize time value provided\n\n", format.status.error, ec);
             break;
         case EC_CLI_NO_OUTPUT_FILE_VALUE:
-            printf("%s0x%x: No output file value provided\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: No output file value provided\n\n", format.status.error, ec);
             break;
         case EC_CLI_NO_TIME_INTERVAL_VALUE:
-            printf("%s0x%x: No time interval value provided\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: No time interval value provided\n\n", format.status.error, ec);
             break;
         case EC_CLI_NO_COUNT_SIZE_VALUE:
-            printf("%s0x%x: No count size value provided\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: No count size value provided\n\n", format.status.error, ec);
             break;
         case EC_CLI_NO_HISTOGRAM_PATH_VALUE:
-            printf("%s0x%x: No histogram path value provided\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: No histogram path value provided\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_NO_THREADS_VALUE:
+            fprintf(stderr, "%s0x%x: No threads value provided\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_NO_READER_VALUE:
+            fprintf(stderr, "%s0x%x: No reader value provided\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_NO_METRICS_VALUE:
+            fprintf(stderr, "%s0x%x: No metrics value provided\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_NO_STATS_VALUE:
+            fprintf(stderr, "%s0x%x: No stats target value provided\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_NO_CHECKPOINT_VALUE:
+            fprintf(stderr, "%s0x%x: No checkpoint file value provided\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_NO_CHECKPOINT_PERIOD_VALUE:
+            fprintf(stderr, "%s0x%x: No checkpoint period value provided\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_NO_LOG_DIGITS_VALUE:
+            fprintf(stderr, "%s0x%x: No log-linear significant digits value provided\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_NO_FLOW_TIMEOUT_VALUE:
+            fprintf(stderr, "%s0x%x: No flow timeout value provided\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_NO_TOP_FLOWS_VALUE:
+            fprintf(stderr, "%s0x%x: No top flows value provided\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_NO_HISTOGRAM_SERIES_VALUE:
+            fprintf(stderr, "%s0x%x: No histogram series file value provided\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_NO_REORDER_WINDOW_VALUE:
+            fprintf(stderr, "%s0x%x: No reorder window value provided\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_NO_BURST_VALUE:
+            fprintf(stderr, "%s0x%x: No micro-burst value provided\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_NO_JOINT_HISTOGRAM_VALUE:
+            fprintf(stderr, "%s0x%x: No joint histogram file provided\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_NO_QUANTILE_COMPRESSION_VALUE:
+            fprintf(stderr, "%s0x%x: No quantile compression value provided\n\n", format.status.error, ec);
             break;
         /* > 0x1800: CLI input option missing errors */
         case EC_CLI_NO_INPUT_OPTION:
-            printf("%s0x%x: No \"-i\" or \"--input\" option provided\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: No \"-i\" or \"--input\" option provided\n\n", format.status.error, ec);
             break;
         case EC_CLI_NO_QUANTIZE_TIME_OPTION:
-            printf("%s0x%x: No \"-q\" or \"--quantize-time\" option provided\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: No \"-q\" or \"--quantize-time\" option provided\n\n", format.status.error, ec);
             break;
         case EC_CLI_NO_OUTPUT_OPTION:
-            printf("%s0x%x: No \"-o\" or \"--output\" option provided\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: No \"-o\" or \"--output\" option provided\n\n", format.status.error, ec);
             break;
         case EC_CLI_NO_TIME_INTERVAL_OPTION:
-            printf("%s0x%x: No \"-t\" or \"--time-interval\" option provided\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: No \"-t\" or \"--time-interval\" option provided\n\n", format.status.error, ec);
             break;
         case EC_CLI_NO_COUNT_SIZE_OPTION:
-            printf("%s0x%x: No \"-c\" or \"--count-size\" option provided\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: No \"-c\" or \"--count-size\" option provided\n\n", format.status.error, ec);
             break;
         case EC_CLI_NO_HISTOGRAM_PATH_OPTION:
-            printf("%s0x%x: No \"-p\" or \"--histogram-path\" option provided\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: No \"-p\" or \"--histogram-path\" option provided\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_NO_CHECKPOINT_OPTION:
+            fprintf(stderr, "%s0x%x: No \"-k\" or \"--checkpoint\" option provided, required by \"--resume\"\n\n", format.status.error, ec);
             break;
         /* > 0x1C00: CLI input value invalid errors */
         case EC_CLI_INVALID_INPUT_FILE:
-            printf("%s0x%x: Invalid input file, should contains \".pcap\" in filename\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Invalid input file, should contains \".pcap\" in filename\n\n", format.status.error, ec);
             break;
         case EC_CLI_INVALID_QUANTIZE_TIME:
-            printf("%s0x%x: Invalid quantize time, should provides valid integer number\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Invalid quantize time, should provides valid integer number from 1 to 63\n\n", format.status.error, ec);
             break;
         case EC_CLI_INVALID_OUTPUT_FILE:
-            printf("%s0x%x: Invalid output file, should contains \".csv\" in filename\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Invalid output file, should end with \".csv\", \".bin\" or \".col\"\n\n", format.status.error, ec);
             break;
         case EC_CLI_INVALID_TIME_INTERVAL:
-            printf("%s0x%x: Invalid time interval, should provides valid floating point number\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Invalid time interval, should provides valid floating point number\n\n", format.status.error, ec);
             break;
         case EC_CLI_INVALID_COUNT_SIZE:
-            printf("%s0x%x: Invalid count size, should provides valid integer number\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Invalid count size, should provides valid integer number\n\n", format.status.error, ec);
             break;
         case EC_CLI_INVALID_HISTOGRAM_PATH:
-            printf("%s0x%x: Invalid histogram path, should provides valid path\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Invalid histogram path, should provides valid path\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_INVALID_THREADS:
+            fprintf(stderr, "%s0x%x: Invalid threads, should provides valid positive integer number\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_INVALID_READER:
+            fprintf(stderr, "%s0x%x: Invalid reader, should be one of \"auto\", \"mmap\" or \"libtrace\"\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_INVALID_METRICS:
+            fprintf(stderr, "%s0x%x: Invalid metrics, should be comma separated metric names or \"all\"\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_INVALID_CHECKPOINT_PERIOD:
+            fprintf(stderr, "%s0x%x: Invalid checkpoint period, should provides valid positive floating point number\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_INVALID_LOG_DIGITS:
+            fprintf(stderr, "%s0x%x: Invalid log-linear significant digits, should be an integer from 1 to 5\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_INVALID_FLOW_TIMEOUT:
+            fprintf(stderr, "%s0x%x: Invalid flow timeout, should be a positive number of seconds\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_INVALID_TOP_FLOWS:
+            fprintf(stderr, "%s0x%x: Invalid top flows, should be an integer from 0 to 1000\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_INVALID_PER_FLOW:
+            fprintf(stderr, "%s0x%x: Per-flow mode reads files serially and is not checkpointed, remove \"-n\" or \"-k\"\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_INVALID_QUANTILES:
+            fprintf(stderr, "%s0x%x: Quantile sketches are not checkpointed, remove \"-k\"\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_INVALID_HISTOGRAM_SERIES:
+            fprintf(stderr, "%s0x%x: Histogram series reads files serially and is not checkpointed, remove \"-n\" or \"-k\"\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_INVALID_REORDER_WINDOW:
+            fprintf(stderr, "%s0x%x: Invalid reorder window, should be from 1 usec (1 nsec with \"-E\") to 3600 sec\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_INVALID_REORDER:
+            fprintf(stderr, "%s0x%x: Reorder buffer reads files serially, holds no header and is not checkpointed, remove \"-n\", \"-F\", protocol metrics of \"-m\" or \"-k\"\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_INVALID_BURST:
+            fprintf(stderr, "%s0x%x: Invalid micro-burst, expected <packets>,<burst_window> of 2-1048576 packets within 1e-9 (1e-6 without \"-E\") to 3600 seconds, can not be combined with \"-n\" or \"-k\"\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_INVALID_JOINT_HISTOGRAM:
+            fprintf(stderr, "%s0x%x: Joint histogram can not be combined with \"-k\"\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_INVALID_QUANTILE_COMPRESSION:
+            fprintf(stderr, "%s0x%x: Invalid quantile compression, expected 10-100000\n\n", format.status.error, ec);
+            break;
+        case EC_CLI_INVALID_COUNT_STAGE:
+            fprintf(stderr, "%s0x%x: Packet count output reads files serially and is not checkpointed, remove \"-n\" or \"-k\"\n\n", format.status.error, ec);
             break;
         /* > 0x2000: general errors */
         case EC_GEN_UNABLE_TO_CREATE_PACKET:
-            printf("%s0x%x: Unable to create packet structure\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Unable to create packet structure\n\n", format.status.error, ec);
             break;
         case EC_GEN_UNABLE_TO_CREATE_TRACE:
-            printf("%s0x%x: Unable to create trace file\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Unable to create trace file\n\n", format.status.error, ec);
             break;
         case EC_GEN_UNABLE_TO_START_TRACE:
-            printf("%s0x%x: Unable to start trace file\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Unable to start trace file\n\n", format.status.error, ec);
             break;
         case EC_GEN_TRACE_READ_PACKET_ERROR:
-            printf("%s0x%x: Error occurred while reading packet from trace file\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Error occurred while reading packet from trace file\n\n", format.status.error, ec);
             break;
         case EC_GEN_UNABLE_TO_GET_TIMESPEC:
-            printf("%s0x%x: Unable to get timespec\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Unable to get timespec\n\n", format.status.error, ec);
             break;
         case EC_GEN_CLOCK_GETTIME_ERROR:
-            printf("%s0x%x: Error occurred while getting clock_gettime\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Error occurred while getting clock_gettime\n\n", format.status.error, ec);
             break;
         case EC_GEN_UNABLE_TO_USE_GNUPLOT:
-            printf("%s0x%x: Unable to open gnuplot, please check your environment.\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Unable to open gnuplot, please check your environment.\n\n", format.status.error, ec);
             break;
         case EC_GEN_GNUPLOT_ERROR:
-            printf("%s0x%x: Error occurred while using gnuplot\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Error occurred while using gnuplot\n\n", format.status.error, ec);
             break;
         case EC_GEN_UNABLE_TO_OPEN_DATA_FILE:
-            printf("%s0x%x: Unable to open data file at given path\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Unable to open data file at given path\n\n", format.status.error, ec);
             break;
         case EC_GEN_UNABLE_TO_WRITE_DATA_FILE:
-            printf("%s0x%x: Unable to write data file\n\n", format.status.error, ec);
+            fprintf(stderr, "%s0x%x: Unable to write data file\n\n", format.status.error, ec);
+            break;
+        case EC_GEN_UNABLE_TO_CREATE_CALLBACK:
+            fprintf(stderr, "%s0x%x: Unable to create parallel callback set\n\n", format.status.error, ec);
+            break;
+        case EC_GEN_EMPTY_TRACE:
+            fprintf(stderr, "%s0x%x: Trace file contains no packet\n\n", format.status.error, ec);
+            break;
+        case EC_GEN_UNABLE_TO_MMAP_TRACE:
+            fprintf(stderr, "%s0x%x: Unable to map trace file into memory\n\n", format.status.error, ec);
+            break;
+        case EC_GEN_UNSUPPORTED_MMAP_FORMAT:
+            fprintf(stderr, "%s0x%x: Trace file is not uncompressed classic pcap, mmap reader is not available\n\n", format.status.error, ec);
+            break;
+        case EC_GEN_UNABLE_TO_MALLOC:
+            fprintf(stderr, "%s0x%x: Unable to allocate memory\n\n", format.status.error, ec);
+            break;
+        case EC_GEN_UNABLE_TO_CREATE_THREAD:
+            fprintf(stderr, "%s0x%x: Unable to create thread\n\n", format.status.error, ec);
+            break;
+        case EC_GEN_UNABLE_TO_OPEN_STATS:
+            fprintf(stderr, "%s0x%x: Unable to publish stats to file or shared memory\n\n", format.status.error, ec);
+            break;
+        case EC_GEN_UNABLE_TO_WRITE_CHECKPOINT:
+            fprintf(stderr, "%s0x%x: Unable to write checkpoint file\n\n", format.status.error, ec);
+            break;
+        case EC_GEN_INVALID_CHECKPOINT:
+            fprintf(stderr, "%s0x%x: Checkpoint file is corrupted or does not match inputs and options of this run\n\n", format.status.error, ec);
+            break;
+        case EC_GEN_INVALID_HISTOGRAM_SERIES:
+            fprintf(stderr, "%s0x%x: Histogram series file is corrupted, not finalized or has no such interval\n\n", format.status.error, ec);
+            break;
+        case EC_GEN_TOO_MANY_STAGES:
+            fprintf(stderr, "%s0x%x: Pipeline has no room for another stage\n\n", format.status.error, ec);
+            break;
+        case EC_GEN_INVALID_JOINT_HISTOGRAM:
+            fprintf(stderr, "%s0x%x: Joint histogram file is corrupted or of another layout\n\n", format.status.error, ec);
             break;
         /* > default: Unknown error code */
         default:
-            printf("%sUnknown error code: 0x%x\n", format.status.error, ec);
+            fprintf(stderr, "%sUnknown error code: 0x%x\n", format.status.error, ec);
             break;
     }
 }
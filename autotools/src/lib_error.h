@@ -23,6 +23,20 @@
 #define EC_CLI_NO_TIME_INTERVAL_VALUE       0x1404 /* No value provided for time interval */
 #define EC_CLI_NO_COUNT_SIZE_VALUE          0x1405 /* No value provided for count size */
 #define EC_CLI_NO_HISTOGRAM_PATH_VALUE      0x1406 /* No value provided for histogram path */
+#define EC_CLI_NO_THREADS_VALUE             0x1407 /* No value provided for threads */
+#define EC_CLI_NO_READER_VALUE              0x1408 /* No value provided for reader */
+#define EC_CLI_NO_METRICS_VALUE             0x1409 /* No value provided for metrics */
+#define EC_CLI_NO_STATS_VALUE               0x140A /* No value provided for stats target */
+#define EC_CLI_NO_CHECKPOINT_VALUE          0x140B /* No value provided for checkpoint file */
+#define EC_CLI_NO_CHECKPOINT_PERIOD_VALUE   0x140C /* No value provided for checkpoint period */
+#define EC_CLI_NO_LOG_DIGITS_VALUE          0x140D /* No value provided for log-linear significant digits */
+#define EC_CLI_NO_FLOW_TIMEOUT_VALUE        0x140E /* No value provided for flow timeout */
+#define EC_CLI_NO_TOP_FLOWS_VALUE           0x140F /* No value provided for top flows */
+#define EC_CLI_NO_HISTOGRAM_SERIES_VALUE    0x1410 /* No value provided for histogram series file */
+#define EC_CLI_NO_REORDER_WINDOW_VALUE      0x1411 /* No value provided for reorder window */
+#define EC_CLI_NO_BURST_VALUE               0x1412 /* No value provided for micro-burst threshold */
+#define EC_CLI_NO_JOINT_HISTOGRAM_VALUE     0x1413 /* No value provided for joint histogram file */
+#define EC_CLI_NO_QUANTILE_COMPRESSION_VALUE 0x1414 /* No value provided for quantile compression */
 /* > 0x1800: CLI input option missing errors */
 #define EC_CLI_NO_INPUT_OPTION              0x1801 /* No option "-i" or "--input" provided to CLI */
 #define EC_CLI_NO_QUANTIZE_TIME_OPTION      0x1802 /* No option "-q" or "--quantize-time" provided to CLI */
@@ -30,6 +44,7 @@
 #define EC_CLI_NO_TIME_INTERVAL_OPTION      0x1804 /* No option "-t" or "--time-interval" provided to CLI */
 #define EC_CLI_NO_COUNT_SIZE_OPTION         0x1805 /* No option "-c" or "--count-size" provided to CLI */
 #define EC_CLI_NO_HISTOGRAM_PATH_OPTION     0x1806 /* No option "-p" or "--histogram-path" provided to CLI */
+#define EC_CLI_NO_CHECKPOINT_OPTION         0x1807 /* No option "-k" or "--checkpoint" provided to CLI */
 /* > 0x1C00: CLI input value invalid errors */
 #define EC_CLI_INVALID_INPUT_FILE           0x1C01 /* Invalid input file */
 #define EC_CLI_INVALID_QUANTIZE_TIME        0x1C02 /* Invalid quantize time */
@@ -37,6 +52,22 @@
 #define EC_CLI_INVALID_TIME_INTERVAL        0x1C04 /* Invalid time interval */
 #define EC_CLI_INVALID_COUNT_SIZE           0x1C05 /* Invalid count size */
 #define EC_CLI_INVALID_HISTOGRAM_PATH       0x1C06 /* Invalid histogram path */
+#define EC_CLI_INVALID_THREADS              0x1C07 /* Invalid threads */
+#define EC_CLI_INVALID_READER               0x1C08 /* Invalid reader */
+#define EC_CLI_INVALID_METRICS              0x1C09 /* Invalid metrics */
+#define EC_CLI_INVALID_CHECKPOINT_PERIOD    0x1C0A /* Invalid checkpoint period */
+#define EC_CLI_INVALID_LOG_DIGITS           0x1C0B /* Invalid log-linear significant digits */
+#define EC_CLI_INVALID_FLOW_TIMEOUT         0x1C0C /* Invalid flow timeout */
+#define EC_CLI_INVALID_TOP_FLOWS            0x1C0D /* Invalid top flows */
+#define EC_CLI_INVALID_PER_FLOW             0x1C0E /* Per-flow mode combined with threads or checkpoint */
+#define EC_CLI_INVALID_QUANTILES            0x1C0F /* Quantile mode combined with checkpoint */
+#define EC_CLI_INVALID_HISTOGRAM_SERIES     0x1C10 /* Histogram series combined with threads or checkpoint */
+#define EC_CLI_INVALID_REORDER_WINDOW       0x1C11 /* Invalid reorder window */
+#define EC_CLI_INVALID_REORDER              0x1C12 /* Reorder buffer combined with threads, per-flow mode, protocol metrics or checkpoint */
+#define EC_CLI_INVALID_BURST                0x1C13 /* Invalid micro-burst threshold, or combined with threads or checkpoint */
+#define EC_CLI_INVALID_JOINT_HISTOGRAM      0x1C14 /* Joint histogram combined with checkpoint */
+#define EC_CLI_INVALID_QUANTILE_COMPRESSION 0x1C15 /* Invalid quantile compression */
+#define EC_CLI_INVALID_COUNT_STAGE          0x1C16 /* Packet count output combined with threads or checkpoint */
 /* > 0x2000: general errors */
 #define EC_GEN_UNABLE_TO_CREATE_PACKET      0x2001 /* Unable to open trace file */
 #define EC_GEN_UNABLE_TO_CREATE_TRACE       0x2002 /* Unable to create trace */
@@ -48,6 +79,18 @@
 #define EC_GEN_GNUPLOT_ERROR                0x2008 /* Error in gnuplot drawing process */
 #define EC_GEN_UNABLE_TO_OPEN_DATA_FILE     0x2009 /* Unable to open data file */
 #define EC_GEN_UNABLE_TO_WRITE_DATA_FILE    0x200A /* Unable to write data file */
+#define EC_GEN_UNABLE_TO_CREATE_CALLBACK    0x200B /* Unable to create parallel callback set */
+#define EC_GEN_EMPTY_TRACE                  0x200C /* Trace file contains no packet */
+#define EC_GEN_UNABLE_TO_MMAP_TRACE         0x200D /* Unable to map trace file into memory */
+#define EC_GEN_UNSUPPORTED_MMAP_FORMAT      0x200E /* Trace file is not uncompressed classic pcap */
+#define EC_GEN_UNABLE_TO_MALLOC             0x200F /* Unable to allocate memory */
+#define EC_GEN_UNABLE_TO_CREATE_THREAD      0x2010 /* Unable to create thread */
+#define EC_GEN_UNABLE_TO_OPEN_STATS         0x2011 /* Unable to publish stats to file or shared memory */
+#define EC_GEN_UNABLE_TO_WRITE_CHECKPOINT   0x2012 /* Unable to write checkpoint file */
+#define EC_GEN_INVALID_CHECKPOINT           0x2013 /* Checkpoint file is corrupted or does not match the run */
+#define EC_GEN_INVALID_HISTOGRAM_SERIES     0x2014 /* Histogram series file is corrupted or has no such interval */
+#define EC_GEN_TOO_MANY_STAGES              0x2015 /* Pipeline has no room for another stage */
+#define EC_GEN_INVALID_JOINT_HISTOGRAM      0x2016 /* Joint histogram file is corrupted or of another layout */
 
 /**
  * @brief Error code
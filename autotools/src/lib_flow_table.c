@@ -0,0 +1,639 @@
+/*
+ * @file lib_flow_table.c
+ * @brief Per-flow IAT library source file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include "lib_flow_table.h"
+
+/**
+ * @brief Allocate slots and insert every flow of old slots
+ * @param table Flow table
+ * @param slots Number of slots, power of 2
+ * @return EC_SUCCESS or EC_GEN_UNABLE_TO_MALLOC
+ */
+static ec_t resize_slots (flow_table_t *table, uint64_t slots);
+
+/**
+ * @brief Finish flow: add it to aggregate and top-N heap, and release its record
+ * @param table Flow table
+ * @param slot Slot of flow, left as is
+ * @return void
+ */
+static void finish_flow (flow_table_t *table, const flow_slot_t *slot);
+
+/**
+ * @brief Offer finished flow to top-N heap
+ * @param table Flow table
+ * @param key Flow key
+ * @param record Flow record
+ * @return void
+ */
+static void offer_top (flow_table_t *table, const flow_key_t *key, const flow_record_t *record);
+
+/**
+ * @brief Compare top-N entries, by packets then by key so the order does not depend on table layout
+ * @param a Entry
+ * @param b Entry
+ * @return true if a is smaller than b
+ */
+static bool top_less (const flow_top_t *a, const flow_top_t *b);
+
+/**
+ * @brief qsort comparator of top-N entries, larger flow first
+ * @param a Entry
+ * @param b Entry
+ * @return Order
+ */
+static int compare_top (const void *a, const void *b);
+
+/**
+ * @brief Fold IPv6 address into 32 bits
+ * @param address IPv6 address
+ * @return Fold
+ */
+static uint32_t fold_address (const uint8_t *address);
+
+/**
+ * @brief Packet callback of stage, count IAT within flow of one packet
+ * @param packet Decoded packet
+ * @param arg Flow stage
+ * @return void
+ */
+static void flow_packet (const pipeline_packet_t *packet, void *arg);
+
+/**
+ * @brief Finish callback of stage, finish every live flow
+ * @param index Interval of last packet
+ * @param arg Flow stage
+ * @return Error code of flow table
+ */
+static ec_t flow_finish (uint64_t index, void *arg);
+
+ec_t flow_table_init (flow_table_t *table, uint64_t timeout, size_t top) {
+    /* params */
+    ec_t ec;    /* error code */
+
+    memset(table, 0, sizeof(flow_table_t));
+    table->timeout = timeout;
+    table->free_record = FLOW_NO_RECORD;
+    ec = resize_slots(table, FLOW_TABLE_MIN_SLOTS);
+    if ((ec == EC_SUCCESS) && (top > 0)) {
+        table->top = (flow_top_t *) calloc(top, sizeof(flow_top_t));
+        if (table->top == NULL) {
+            perror("calloc");
+            ec = EC_GEN_UNABLE_TO_MALLOC;
+        }
+        table->top_size = top;
+    }
+    return ec;
+}
+
+void flow_table_free (flow_table_t *table) {
+    /* params */
+    size_t i;   /* iterator */
+
+    for (i=0; i<table->slab_count; i++) {
+        free(table->slabs[i]);
+    }
+    free(table->slabs);
+    free(table->slots);
+    free(table->top);
+    memset(table, 0, sizeof(flow_table_t));
+    return;
+}
+
+bool flow_packet_parse (void *layer2, libtrace_linktype_t linktype, uint32_t remaining, flow_packet_t *packet) {
+    /* params */
+    void               *nexthdr;    /* current header */
+    uint16_t            ethertype;  /* type of current header */
+    const uint8_t      *transport;  /* transport header */
+    const libtrace_ip_t    *ip;     /* IPv4 header */
+    libtrace_ip6_t     *ip6;        /* IPv6 header */
+    uint32_t            header;     /* IPv4 header length */
+    uint8_t             protocol;   /* transport protocol */
+    uint16_t            port[2];    /* source and destination port, network order */
+
+    memset(&packet->key, 0, sizeof(flow_key_t));
+    nexthdr = trace_get_payload_from_layer2(layer2, linktype, &ethertype, &remaining);
+    while ((nexthdr != NULL) && (remaining > 0)) {
+        if ((ethertype == 0x8100) || (ethertype == 0x88A8)) {           /* VLAN, QinQ */
+            nexthdr = trace_get_payload_from_vlan(nexthdr, &ethertype, &remaining);
+        } else if (ethertype == 0x8847) {                               /* MPLS */
+            nexthdr = trace_get_payload_from_mpls(nexthdr, &ethertype, &remaining);
+        } else {
+            break;
+        }
+    }
+    if (nexthdr == NULL) {
+        return false;
+    }
+
+    /* layer 3 header, ports are only read from the first fragment */
+    transport = NULL;
+    if ((ethertype == 0x0800) && (remaining >= sizeof(libtrace_ip_t))) {          /* IPv4 */
+        ip = (const libtrace_ip_t *) nexthdr;
+        header = (uint32_t) ip->ip_hl * 4;
+        packet->key.version = 4;
+        packet->key.protocol = ip->ip_p;
+        packet->src = (const uint8_t *) &ip->ip_src;
+        packet->dst = (const uint8_t *) &ip->ip_dst;
+        memcpy(&packet->key.src, packet->src, sizeof(uint32_t));
+        memcpy(&packet->key.dst, packet->dst, sizeof(uint32_t));
+        if ((header >= sizeof(libtrace_ip_t)) && (header <= remaining) && ((ntohs(ip->ip_off) & 0x1FFF) == 0)) {
+            transport = (const uint8_t *) nexthdr + header;
+            remaining -= header;
+        }
+    } else if ((ethertype == 0x86DD) && (remaining >= sizeof(libtrace_ip6_t))) {  /* IPv6 */
+        ip6 = (libtrace_ip6_t *) nexthdr;
+        packet->key.version = 6;
+        packet->src = (const uint8_t *) &ip6->ip_src;
+        packet->dst = (const uint8_t *) &ip6->ip_dst;
+        packet->key.src = fold_address(packet->src);
+        packet->key.dst = fold_address(packet->dst);
+        /* skip extension headers */
+        protocol = ip6->nxt;
+        transport = (const uint8_t *) trace_get_payload_from_ip6(ip6, &protocol, &remaining);
+        packet->key.protocol = protocol;
+    } else {
+        return false;
+    }
+    if ((transport != NULL) && (remaining >= sizeof(port)) && ((packet->key.protocol == 6) || (packet->key.protocol == 17))) {
+        memcpy(port, transport, sizeof(port));
+        packet->key.src_port = ntohs(port[0]);
+        packet->key.dst_port = ntohs(port[1]);
+    }
+    return true;
+}
+
+/* @brief Sweep idle flows
+ * @details idle flows are cleared in one pass, then every flow left is moved back to the first empty slot
+ *          from its home, scanning from an empty slot so no cluster wraps around the start.
+ *          Deleting flows one by one would shift the rest of the cluster for every flow removed.
+ */
+void flow_table_sweep (flow_table_t *table, uint64_t now) {
+    /* params */
+    uint64_t     start = 0;     /* empty slot to start from */
+    uint64_t     i;             /* slot iterator */
+    uint64_t     j;             /* slot iterator from start */
+    uint64_t     k;             /* target slot iterator */
+    flow_slot_t *slot;          /* current slot */
+    bool         removed = false;   /* a flow is removed */
+
+    table->next_sweep = now + table->timeout;
+    for (i=0; i<=table->mask; i++) {
+        slot = &table->slots[i];
+        if (slot->key.version == 0) {
+            start = i;
+        } else if ((int64_t) (now - slot->last) > (int64_t) table->timeout) {
+            finish_flow(table, slot);
+            memset(slot, 0, sizeof(flow_slot_t));
+            table->evicted++;
+            table->live--;
+            removed = true;
+        }
+    }
+    if (!removed) {
+        return;
+    }
+    for (j=1; j<=table->mask; j++) {
+        i = (start + j) & table->mask;
+        if (table->slots[i].key.version == 0) {
+            continue;
+        }
+        k = flow_key_hash(&table->slots[i].key) & table->mask;
+        while ((k != i) && (table->slots[k].key.version != 0)) {
+            k = (k + 1) & table->mask;
+        }
+        if (k != i) {
+            table->slots[k] = table->slots[i];
+            memset(&table->slots[i], 0, sizeof(flow_slot_t));
+        }
+    }
+    return;
+}
+
+void flow_table_finish_all (flow_table_t *table) {
+    /* params */
+    uint64_t i;     /* slot iterator */
+
+    for (i=0; i<=table->mask; i++) {
+        if (table->slots[i].key.version != 0) {
+            finish_flow(table, &table->slots[i]);
+            memset(&table->slots[i], 0, sizeof(flow_slot_t));
+        }
+    }
+    table->live = 0;
+    qsort(table->top, table->top_count, sizeof(flow_top_t), compare_top);
+    return;
+}
+
+/* @brief Insert new flow
+ * @details table grows at 70% load, linear probing gets slow above it
+ */
+void flow_table_insert (flow_table_t *table, flow_slot_t *slot, const flow_packet_t *packet, uint64_t now) {
+    /* params */
+    uint64_t i;     /* slot iterator */
+
+    if (table->ec != EC_SUCCESS) {
+        table->untracked++;
+        return;
+    }
+    if ((table->live + 1) * 10 > (table->mask + 1) * 7) {
+        table->ec = resize_slots(table, (table->mask + 1) * 2);
+        if (table->ec != EC_SUCCESS) {
+            table->untracked++;
+            return;
+        }
+        /* slot belongs to the old table */
+        i = flow_key_hash(&packet->key) & table->mask;
+        while (table->slots[i].key.version != 0) {
+            i = (i + 1) & table->mask;
+        }
+        slot = &table->slots[i];
+    }
+    slot->key = packet->key;
+    slot->last = now;
+    slot->record = FLOW_NO_RECORD;
+    table->live++;
+    if (table->live > table->peak) {
+        table->peak = table->live;
+    }
+    return;
+}
+
+void flow_table_restart (flow_table_t *table, flow_slot_t *slot, uint64_t now) {
+    finish_flow(table, slot);
+    table->evicted++;
+    slot->last = now;
+    slot->record = FLOW_NO_RECORD;
+    return;
+}
+
+/* @brief Take record
+ * @details free list first, then the next record of the last slab, a new slab is allocated when it is used up
+ */
+uint32_t flow_table_new_record (flow_table_t *table, const flow_packet_t *packet) {
+    /* params */
+    uint32_t        index;      /* record index */
+    flow_record_t  *record;     /* record */
+    flow_record_t **slabs;      /* grown slab array */
+    size_t          length;     /* address length */
+
+    if (table->free_record != FLOW_NO_RECORD) {
+        index = table->free_record;
+        table->free_record = (uint32_t) flow_table_record(table, index)->packets;
+    } else {
+        if ((table->next_record >> FLOW_SLAB_BITS) == table->slab_count) {
+            if (table->slab_count == (size_t) (FLOW_NO_RECORD >> FLOW_SLAB_BITS)) {
+                table->ec = EC_GEN_UNABLE_TO_MALLOC;
+                return FLOW_NO_RECORD;
+            }
+            slabs = (flow_record_t **) realloc(table->slabs, (table->slab_count + 1) * sizeof(flow_record_t *));
+            if (slabs == NULL) {
+                perror("realloc");
+                table->ec = EC_GEN_UNABLE_TO_MALLOC;
+                return FLOW_NO_RECORD;
+            }
+            table->slabs = slabs;
+            table->slabs[table->slab_count] = (flow_record_t *) malloc(sizeof(flow_record_t) << FLOW_SLAB_BITS);
+            if (table->slabs[table->slab_count] == NULL) {
+                perror("malloc");
+                table->ec = EC_GEN_UNABLE_TO_MALLOC;
+                return FLOW_NO_RECORD;
+            }
+            table->slab_count++;
+        }
+        index = table->next_record;
+        table->next_record++;
+    }
+    record = flow_table_record(table, index);
+    memset(record, 0, sizeof(flow_record_t));
+    /* first packet is counted here, its IAT is the one of the second packet */
+    record->packets = 1;
+    length = (packet->key.version == 4) ? 4 : 16;
+    memcpy(record->src, packet->src, length);
+    memcpy(record->dst, packet->dst, length);
+    return index;
+}
+
+uint64_t flow_table_percentile (const flow_table_t *table, const uint64_t *count, double percentile) {
+    /* params */
+    uint64_t    total = 0;  /* recorded values */
+    uint64_t    rank;       /* values at or below percentile */
+    uint64_t    seen = 0;   /* values in counters so far */
+    size_t      i;          /* iterator */
+
+    for (i=0; i<FLOW_HISTOGRAM_BUCKETS; i++) {
+        total += count[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    rank = (uint64_t) ceil(percentile / 100.0 * (double) total);
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (i=0; i<FLOW_HISTOGRAM_BUCKETS; i++) {
+        seen += count[i];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    /* no IAT within a flow exceeds timeout */
+    if ((i >= FLOW_HISTOGRAM_BUCKETS - 1) || (flow_bucket_highest(i) > table->timeout)) {
+        return table->timeout;
+    }
+    return flow_bucket_highest(i);
+}
+
+void flow_stage_init (flow_stage_t *flows) {
+    memset(flows, 0, sizeof(flow_stage_t));
+    flows->timeout = FLOW_DEFAULT_TIMEOUT;
+    flows->top = FLOW_DEFAULT_TOP;
+    return;
+}
+
+ec_t flow_option (int argc, char *argv[], int *i, void *arg) {
+    /* params */
+    flow_stage_t   *flows = (flow_stage_t *) arg;
+    ec_t            ec = EC_SUCCESS;    /* error code */
+    char           *endptr;             /* string to number conversion pointer */
+
+    if ((strcmp(argv[*i], "-T") == 0) || (strcmp(argv[*i], "--flow-timeout") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            flows->timeout = strtod(argv[*i], &endptr);
+            if (errno != EC_SUCCESS) {
+                perror("strtod");
+                ec = EC_CLI_INVALID_FLOW_TIMEOUT;
+            }
+            if (endptr == argv[*i]) {
+                fprintf(stderr, "No digits were found\n");
+                ec = EC_CLI_INVALID_FLOW_TIMEOUT;
+            }
+        } else {
+            ec = EC_CLI_NO_FLOW_TIMEOUT_VALUE;
+        }
+    } else if ((strcmp(argv[*i], "-N") == 0) || (strcmp(argv[*i], "--top-flows") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            flows->top = strtol(argv[*i], &endptr, 10);
+            if (errno != EC_SUCCESS) {
+                perror("strtol");
+                ec = EC_CLI_INVALID_TOP_FLOWS;
+            }
+            if (endptr == argv[*i]) {
+                fprintf(stderr, "No digits were found\n");
+                ec = EC_CLI_INVALID_TOP_FLOWS;
+            }
+        } else {
+            ec = EC_CLI_NO_TOP_FLOWS_VALUE;
+        }
+    } else if ((strcmp(argv[*i], "-F") == 0) || (strcmp(argv[*i], "--per-flow") == 0)) {
+        flows->enabled = true;
+    } else {
+        ec = EC_CLI_UNKNOWN_OPTION;
+    }
+    return ec;
+}
+
+/* @brief Register flow stage
+ * @details per-flow mode walks headers from ethernet, flow table spans file boundaries and is not saved in checkpoint
+ */
+ec_t flow_register (flow_stage_t *flows, pipeline_t *pipeline) {
+    /* params */
+    pipeline_stage_t    stage;      /* stage registered to pipeline */
+
+    if ((flows->timeout < 1e-6) || (flows->timeout > 1e9)) {
+        return EC_CLI_INVALID_FLOW_TIMEOUT;
+    }
+    if ((flows->top < 0) || (flows->top > FLOW_MAX_TOP)) {
+        return EC_CLI_INVALID_TOP_FLOWS;
+    }
+    if (!flows->enabled) {
+        return EC_SUCCESS;
+    }
+    memset(&stage, 0, sizeof(pipeline_stage_t));
+    stage.name = "flow";
+    stage.needs = PIPELINE_NEED_LAYER2;
+    stage.unsupported = EC_CLI_INVALID_PER_FLOW;
+    stage.arg = flows;
+    stage.packet = flow_packet;
+    stage.finish = flow_finish;
+    return pipeline_add_stage(pipeline, &stage);
+}
+
+ec_t flow_start (flow_stage_t *flows) {
+    return flow_table_init(&flows->table, (uint64_t) (flows->timeout * 1e6), (size_t) flows->top);
+}
+
+/* @brief Print flows
+ * @details counters of each bucket and percentiles are the same format as log-linear mode,
+ *          the last IAT bucket ends at flow timeout as no IAT within a flow exceeds it
+ */
+void flow_print (const flow_stage_t *flows) {
+    /* params */
+    const flow_table_t *table = &flows->table;      /* finished flow table */
+    const flow_top_t   *top;                        /* largest flow */
+    uint64_t            count[FLOW_HISTOGRAM_BUCKETS];  /* IAT counters of one flow */
+    char                src[INET6_ADDRSTRLEN];      /* source address */
+    char                dst[INET6_ADDRSTRLEN];      /* destination address */
+    int                 family;                     /* address family */
+    uint64_t            highest;                    /* highest IAT of bucket */
+    size_t              i;                          /* iterator */
+    size_t              j;                          /* iterator */
+
+    printf("Flows: %lu, single-packet: %lu, finished by idle timeout: %lu, peak live: %lu\n",
+           table->flows, table->size[flow_bucket(1)], table->evicted, table->peak);
+    for (i=0; i<FLOW_HISTOGRAM_BUCKETS; i++) {
+        if (table->count[i] != 0) {
+            highest = flow_bucket_highest(i);
+            if ((i == FLOW_HISTOGRAM_BUCKETS - 1) || (highest > table->timeout)) {
+                highest = table->timeout;
+            }
+            printf("Flow IAT[%02zu] %lu-%lu usec: %lu\n", i, flow_bucket_lowest(i), highest, table->count[i]);
+        }
+    }
+    printf("Flow IAT p50: %lu usec\n", flow_table_percentile(table, table->count, 50));
+    printf("Flow IAT p90: %lu usec\n", flow_table_percentile(table, table->count, 90));
+    printf("Flow IAT p99: %lu usec\n", flow_table_percentile(table, table->count, 99));
+    printf("Flow IAT max: %lu usec\n", flow_table_percentile(table, table->count, 100));
+    printf("Flow IAT negative: %lu, packets without IP header: %lu\n", table->negative, table->untracked);
+    for (i=0; i<FLOW_SIZE_BUCKETS; i++) {
+        if (table->size[i] != 0) {
+            printf("Flow packets[%02zu] %lu-%lu: %lu\n", i, flow_bucket_lowest(i), flow_bucket_highest(i), table->size[i]);
+        }
+    }
+    for (i=0; i<table->top_count; i++) {
+        top = &table->top[i];
+        family = (top->key.version == 4) ? AF_INET : AF_INET6;
+        inet_ntop(family, top->record.src, src, sizeof(src));
+        inet_ntop(family, top->record.dst, dst, sizeof(dst));
+        for (j=0; j<FLOW_HISTOGRAM_BUCKETS; j++) {
+            count[j] = top->record.count[j];
+        }
+        printf("Top flow[%02zu]: protocol %u %s:%u -> %s:%u, packets %lu, IAT p50 %lu p99 %lu max %lu usec\n", i + 1,
+               top->key.protocol, src, top->key.src_port, dst, top->key.dst_port, top->record.packets,
+               flow_table_percentile(table, count, 50), flow_table_percentile(table, count, 99), flow_table_percentile(table, count, 100));
+    }
+    return;
+}
+
+static ec_t resize_slots (flow_table_t *table, uint64_t slots) {
+    /* params */
+    flow_slot_t *old = table->slots;        /* old slots */
+    uint64_t     old_slots = (old != NULL) ? table->mask + 1 : 0;   /* number of old slots */
+    uint64_t     i;                         /* old slot iterator */
+    uint64_t     j;                         /* new slot iterator */
+
+    table->slots = (flow_slot_t *) calloc(slots, sizeof(flow_slot_t));
+    if (table->slots == NULL) {
+        perror("calloc");
+        table->slots = old;
+        return EC_GEN_UNABLE_TO_MALLOC;
+    }
+    table->mask = slots - 1;
+    for (i=0; i<old_slots; i++) {
+        if (old[i].key.version != 0) {
+            j = flow_key_hash(&old[i].key) & table->mask;
+            while (table->slots[j].key.version != 0) {
+                j = (j + 1) & table->mask;
+            }
+            table->slots[j] = old[i];
+        }
+    }
+    free(old);
+    return EC_SUCCESS;
+}
+
+static void finish_flow (flow_table_t *table, const flow_slot_t *slot) {
+    /* params */
+    flow_record_t  *record;     /* record of flow */
+    size_t          i;          /* iterator */
+
+    table->flows++;
+    if (slot->record == FLOW_NO_RECORD) {
+        table->size[flow_bucket(1)]++;
+        return;
+    }
+    record = flow_table_record(table, slot->record);
+    table->size[flow_bucket(record->packets)]++;
+    for (i=0; i<FLOW_HISTOGRAM_BUCKETS; i++) {
+        table->count[i] += record->count[i];
+    }
+    offer_top(table, &slot->key, record);
+    record->packets = table->free_record;
+    table->free_record = slot->record;
+    return;
+}
+
+/* @brief Offer to top-N heap
+ * @details heap root is the smallest kept flow, a larger flow replaces it and sifts down
+ */
+static void offer_top (flow_table_t *table, const flow_key_t *key, const flow_record_t *record) {
+    /* params */
+    flow_top_t  entry;      /* offered flow */
+    flow_top_t  swap;       /* swap buffer */
+    size_t      i;          /* heap iterator */
+    size_t      child;      /* smaller child */
+
+    if (table->top_size == 0) {
+        return;
+    }
+    entry.key = *key;
+    entry.record = *record;
+    if (table->top_count < table->top_size) {
+        /* sift up */
+        i = table->top_count;
+        table->top[i] = entry;
+        table->top_count++;
+        while ((i > 0) && top_less(&table->top[i], &table->top[(i - 1) / 2])) {
+            swap = table->top[i];
+            table->top[i] = table->top[(i - 1) / 2];
+            table->top[(i - 1) / 2] = swap;
+            i = (i - 1) / 2;
+        }
+        return;
+    }
+    if (!top_less(&table->top[0], &entry)) {
+        return;
+    }
+    /* sift down */
+    table->top[0] = entry;
+    i = 0;
+    for (;;) {
+        child = 2 * i + 1;
+        if (child >= table->top_count) {
+            break;
+        }
+        if ((child + 1 < table->top_count) && top_less(&table->top[child + 1], &table->top[child])) {
+            child++;
+        }
+        if (!top_less(&table->top[child], &table->top[i])) {
+            break;
+        }
+        swap = table->top[i];
+        table->top[i] = table->top[child];
+        table->top[child] = swap;
+        i = child;
+    }
+    return;
+}
+
+static bool top_less (const flow_top_t *a, const flow_top_t *b) {
+    if (a->record.packets != b->record.packets) {
+        return a->record.packets < b->record.packets;
+    }
+    return memcmp(&a->key, &b->key, sizeof(flow_key_t)) > 0;
+}
+
+static int compare_top (const void *a, const void *b) {
+    if (top_less((const flow_top_t *) a, (const flow_top_t *) b)) {
+        return 1;
+    }
+    if (top_less((const flow_top_t *) b, (const flow_top_t *) a)) {
+        return -1;
+    }
+    return 0;
+}
+
+static uint32_t fold_address (const uint8_t *address) {
+    /* params */
+    flow_key_t key;     /* address as key, to reuse the key hash */
+
+    memcpy(&key, address, sizeof(flow_key_t));
+    return (uint32_t) (flow_key_hash(&key) >> 32);
+}
+
+/* @brief Flow of one packet
+ * @details link IAT is counted by another stage, flow table keeps microsecond
+ */
+static void flow_packet (const pipeline_packet_t *packet, void *arg) {
+    /* params */
+    flow_stage_t   *flows = (flow_stage_t *) arg;
+    flow_packet_t   flow;       /* flow of packet */
+
+    if ((packet->layer2 != NULL) && flow_packet_parse(packet->layer2, packet->linktype, packet->remaining, &flow)) {
+        flow_table_packet(&flows->table, &flow, packet->ts / 1000);
+    } else {
+        flows->table.untracked++;
+    }
+    return;
+}
+
+static ec_t flow_finish (uint64_t index, void *arg) {
+    /* params */
+    flow_stage_t *flows = (flow_stage_t *) arg;
+
+    (void) index;
+    flow_table_finish_all(&flows->table);
+    return flows->table.ec;
+}
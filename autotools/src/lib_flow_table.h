@@ -0,0 +1,378 @@
+/**
+ * @file lib_flow_table.h
+ * @brief Per-flow IAT: open-addressing flow table with idle-timeout eviction and slab-allocated log2 histograms
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ * @details
+ * Flows are unidirectional 5-tuples. Every flow takes one 32-byte slot of a linear-probing table, two per cache line:
+ * a 16-byte compact key, the timestamp of its last packet and the index of its record, so a packet of a known flow
+ * costs one hash and usually one cache line before its IAT is known. IPv6 addresses are folded into 32-bit hashes
+ * in the key, two IPv6 flows only collide if both folds and both ports are equal.
+ * A record holding packet count, IAT counters of power-of-2 buckets and the full addresses is only taken from a slab
+ * at the second packet, single-packet flows (scans, DNS) never need one. Records of finished flows go to a free list.
+ * A flow idle longer than the timeout is finished: its counters are added to the aggregate, it is offered to
+ * the top-N heap and its slot and record are released. A later packet of the same 5-tuple starts a new flow, so no
+ * per-flow IAT exceeds the timeout. The table is swept once every timeout of trace time, memory is bounded by
+ * the flows active within one timeout instead of every flow of the trace.
+ * Flow stage counts the packets of a pipeline into the table and prints aggregated per-flow IAT and the largest flows,
+ * options "-F", "-T" and "-N" are parsed by flow_option.
+ * Ref:
+ * 1. https://en.wikipedia.org/wiki/Linear_probing#Deletion
+ * 2. https://www.kernel.org/doc/gorman/html/understand/understand011.html
+ * 3. https://www.rfc-editor.org/rfc/rfc3954#section-3.2
+*/
+
+#ifndef FLOW_TABLE_H
+#define FLOW_TABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "libtrace.h"
+#include "lib_error.h"
+#include "lib_pipeline.h"
+
+#define FLOW_HISTOGRAM_BUCKETS  30          /* power-of-2 IAT buckets of a flow, the last one holds everything above */
+#define FLOW_SIZE_BUCKETS       65          /* power-of-2 buckets of packets per flow */
+#define FLOW_SLAB_BITS          12          /* log2 of records per slab */
+#define FLOW_TABLE_MIN_SLOTS    4096        /* initial slots, power of 2 */
+#define FLOW_NO_RECORD          UINT32_MAX  /* flow has seen one packet and has no record */
+#define FLOW_DEFAULT_TIMEOUT    60          /* default idle timeout (sec) */
+#define FLOW_DEFAULT_TOP        10          /* default number of largest flows to keep */
+#define FLOW_MAX_TOP            1000        /* maximum number of largest flows to keep */
+
+/**
+ * @brief Compact flow key, 16 bytes compared as two words
+ */
+typedef struct {
+    uint32_t    src;            ///< IPv4 source address, or 32-bit fold of IPv6 source address
+    uint32_t    dst;            ///< IPv4 destination address, or 32-bit fold of IPv6 destination address
+    uint16_t    src_port;       ///< source port, 0 unless TCP or UDP header is present
+    uint16_t    dst_port;       ///< destination port, 0 unless TCP or UDP header is present
+    uint8_t     protocol;       ///< transport protocol
+    uint8_t     version;        ///< IP version, 0 marks an empty slot
+    uint16_t    reserved;       ///< zero
+} flow_key_t;
+
+/**
+ * @brief Slot of flow table
+ */
+typedef struct {
+    flow_key_t  key;            ///< flow key
+    uint64_t    last;           ///< timestamp of last packet (usec)
+    uint32_t    record;         ///< index of flow record, FLOW_NO_RECORD after the first packet
+    uint32_t    reserved;       ///< zero
+} flow_slot_t;
+
+/**
+ * @brief Flow record, taken from a slab at the second packet
+ */
+typedef struct {
+    uint64_t    packets;                            ///< packets of flow, index of next free record while free
+    uint32_t    count[FLOW_HISTOGRAM_BUCKETS];      ///< IAT of power-of-2 buckets, saturates at UINT32_MAX
+    uint8_t     src[16];                            ///< source address, IPv4 in the first 4 bytes
+    uint8_t     dst[16];                            ///< destination address, IPv4 in the first 4 bytes
+} flow_record_t;
+
+/**
+ * @brief Finished flow kept in top-N heap
+ */
+typedef struct {
+    flow_key_t      key;        ///< flow key
+    flow_record_t   record;     ///< copy of flow record
+} flow_top_t;
+
+/**
+ * @brief Packet of flow, addresses point into the packet
+ */
+typedef struct {
+    flow_key_t      key;        ///< flow key
+    const uint8_t  *src;        ///< source address, 4 or 16 bytes
+    const uint8_t  *dst;        ///< destination address, 4 or 16 bytes
+} flow_packet_t;
+
+/**
+ * @brief Flow table and the distributions of finished flows
+ */
+typedef struct {
+    flow_slot_t    *slots;                          ///< slots, power of 2
+    uint64_t        mask;                           ///< slots minus 1
+    uint64_t        live;                           ///< flows in table
+    uint64_t        peak;                           ///< most flows in table at once
+    uint64_t        timeout;                        ///< idle timeout (usec)
+    uint64_t        next_sweep;                     ///< timestamp of next sweep (usec)
+    flow_record_t **slabs;                          ///< slabs of 2^FLOW_SLAB_BITS records
+    size_t          slab_count;                     ///< allocated slabs
+    uint32_t        next_record;                    ///< records handed out by slabs so far
+    uint32_t        free_record;                    ///< head of free record list, FLOW_NO_RECORD if empty
+    uint64_t        flows;                          ///< finished flows
+    uint64_t        evicted;                        ///< flows finished by idle timeout
+    uint64_t        negative;                       ///< negative IAT within flows, not in any bucket
+    uint64_t        untracked;                      ///< packets without IPv4 or IPv6 header
+    uint64_t        count[FLOW_HISTOGRAM_BUCKETS];  ///< IAT of finished flows
+    uint64_t        size[FLOW_SIZE_BUCKETS];        ///< finished flows by power-of-2 bucket of packets
+    flow_top_t     *top;                            ///< min-heap of largest finished flows
+    size_t          top_size;                       ///< capacity of top-N heap
+    size_t          top_count;                      ///< flows in top-N heap
+    ec_t            ec;                             ///< first allocation error, new flows are not tracked after it
+} flow_table_t;
+
+/**
+ * @brief Per-flow IAT stage
+ */
+typedef struct {
+    bool                enabled;        ///< "-F" count IAT within each flow
+    double              timeout;        ///< "-T" idle timeout of flow (sec)
+    long int            top;            ///< "-N" number of largest flows to print
+    flow_table_t        table;          ///< per-flow state
+} flow_stage_t;
+
+/**
+ * @brief Initialize flow table
+ * @param table Flow table
+ * @param timeout Idle timeout (usec)
+ * @param top Number of largest flows to keep, 0 for none
+ * @return EC_SUCCESS or EC_GEN_UNABLE_TO_MALLOC
+ */
+ec_t flow_table_init (flow_table_t *table, uint64_t timeout, size_t top);
+
+/**
+ * @brief Free flow table
+ * @param table Flow table
+ * @return void
+ */
+void flow_table_free (flow_table_t *table);
+
+/**
+ * @brief Find flow key and addresses of packet
+ * @param layer2 Layer 2 header
+ * @param linktype Link type of layer 2 header
+ * @param remaining Captured bytes from layer 2 header
+ * @param packet Flow key and addresses
+ * @return true if packet has IPv4 or IPv6 header
+ * @details VLAN and MPLS headers are skipped, same as pt_count_packet
+ */
+bool flow_packet_parse (void *layer2, libtrace_linktype_t linktype, uint32_t remaining, flow_packet_t *packet);
+
+/**
+ * @brief Finish every flow idle longer than timeout, called once every timeout of trace time
+ * @param table Flow table
+ * @param now Timestamp of current packet (usec)
+ * @return void
+ */
+void flow_table_sweep (flow_table_t *table, uint64_t now);
+
+/**
+ * @brief Finish every flow left in table, called once at the end of trace, then sort top-N heap by packets
+ * @param table Flow table
+ * @return void
+ */
+void flow_table_finish_all (flow_table_t *table);
+
+/**
+ * @brief Add new flow to table, growing it if needed
+ * @param table Flow table
+ * @param slot Empty slot found by probing
+ * @param packet Flow packet
+ * @param now Timestamp of packet (usec)
+ * @return void
+ */
+void flow_table_insert (flow_table_t *table, flow_slot_t *slot, const flow_packet_t *packet, uint64_t now);
+
+/**
+ * @brief Restart flow idle longer than timeout, the previous flow of the same key is finished
+ * @param table Flow table
+ * @param slot Slot of flow
+ * @param now Timestamp of packet (usec)
+ * @return void
+ */
+void flow_table_restart (flow_table_t *table, flow_slot_t *slot, uint64_t now);
+
+/**
+ * @brief Take record for flow at its second packet
+ * @param table Flow table
+ * @param packet Flow packet, addresses are copied into record
+ * @return Record index, FLOW_NO_RECORD if out of memory
+ */
+uint32_t flow_table_new_record (flow_table_t *table, const flow_packet_t *packet);
+
+/**
+ * @brief Get value at percentile of power-of-2 IAT buckets
+ * @param table Flow table, the last bucket ends at its timeout
+ * @param count IAT counters, FLOW_HISTOGRAM_BUCKETS
+ * @param percentile Percentile, 0 to 100
+ * @return Highest IAT of the bucket holding the percentile (usec), 0 if empty
+ */
+uint64_t flow_table_percentile (const flow_table_t *table, const uint64_t *count, double percentile);
+
+/**
+ * @brief Get power-of-2 bucket of value, 0 for 0, b for 2^(b-1) to 2^b-1
+ * @param value Value
+ * @return Bucket
+ */
+static inline uint32_t flow_bucket (uint64_t value) {
+    return (value == 0) ? 0 : (uint32_t) (64 - __builtin_clzll(value));
+}
+
+/**
+ * @brief Get lowest value of power-of-2 bucket
+ * @param bucket Bucket
+ * @return Lowest value
+ */
+static inline uint64_t flow_bucket_lowest (size_t bucket) {
+    return (bucket == 0) ? 0 : UINT64_C(1) << (bucket - 1);
+}
+
+/**
+ * @brief Get highest value of power-of-2 bucket
+ * @param bucket Bucket
+ * @return Highest value
+ */
+static inline uint64_t flow_bucket_highest (size_t bucket) {
+    return (bucket == 0) ? 0 : (UINT64_C(1) << (bucket - 1)) * 2 - 1;
+}
+
+/**
+ * @brief Get hash of flow key
+ * @param key Flow key
+ * @return Hash
+ */
+static inline uint64_t flow_key_hash (const flow_key_t *key) {
+    /* params */
+    uint64_t word[2];   /* key as words */
+    uint64_t hash;      /* hash */
+
+    __builtin_memcpy(word, key, sizeof(word));
+    /* murmur3 finalizer over both words */
+    hash = word[0] * 0x9e3779b97f4a7c15ULL ^ word[1];
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/**
+ * @brief Compare flow keys
+ * @param a Flow key
+ * @param b Flow key
+ * @return true if equal
+ */
+static inline bool flow_key_equal (const flow_key_t *a, const flow_key_t *b) {
+    /* params */
+    uint64_t word_a[2];     /* key a as words */
+    uint64_t word_b[2];     /* key b as words */
+
+    __builtin_memcpy(word_a, a, sizeof(word_a));
+    __builtin_memcpy(word_b, b, sizeof(word_b));
+    return ((word_a[0] ^ word_b[0]) | (word_a[1] ^ word_b[1])) == 0;
+}
+
+/**
+ * @brief Get flow record of index
+ * @param table Flow table
+ * @param index Record index
+ * @return Record
+ */
+static inline flow_record_t *flow_table_record (const flow_table_t *table, uint32_t index) {
+    return &table->slabs[index >> FLOW_SLAB_BITS][index & ((UINT32_C(1) << FLOW_SLAB_BITS) - 1)];
+}
+
+/**
+ * @brief Count IAT of one packet into its flow
+ * @param table Flow table
+ * @param packet Flow packet
+ * @param now Timestamp of packet (usec)
+ * @return void
+ * @details Only the probe and the counter update are inline, everything done once per flow is a function call
+ */
+static inline void flow_table_packet (flow_table_t *table, const flow_packet_t *packet, uint64_t now) {
+    /* params */
+    uint64_t        i;          /* slot iterator */
+    flow_slot_t    *slot;       /* slot of flow */
+    int64_t         iat;        /* IAT within flow (usec) */
+    flow_record_t  *record;     /* record of flow */
+    uint32_t        bucket;     /* IAT bucket */
+
+    if (now >= table->next_sweep) {
+        flow_table_sweep(table, now);
+    }
+    i = flow_key_hash(&packet->key) & table->mask;
+    for (;;) {
+        slot = &table->slots[i];
+        if (slot->key.version == 0) {
+            flow_table_insert(table, slot, packet, now);
+            return;
+        }
+        if (flow_key_equal(&slot->key, &packet->key)) {
+            break;
+        }
+        i = (i + 1) & table->mask;
+    }
+    iat = (int64_t) (now - slot->last);
+    if (iat > (int64_t) table->timeout) {
+        flow_table_restart(table, slot, now);
+        return;
+    }
+    slot->last = now;
+    if (slot->record == FLOW_NO_RECORD) {
+        slot->record = flow_table_new_record(table, packet);
+        if (slot->record == FLOW_NO_RECORD) {
+            return;
+        }
+    }
+    record = flow_table_record(table, slot->record);
+    record->packets++;
+    if (iat < 0) {
+        table->negative++;
+        return;
+    }
+    bucket = flow_bucket((uint64_t) iat);
+    if (bucket >= FLOW_HISTOGRAM_BUCKETS) {
+        bucket = FLOW_HISTOGRAM_BUCKETS - 1;
+    }
+    record->count[bucket] += (record->count[bucket] != UINT32_MAX);
+    return;
+}
+
+/**
+ * @brief Initialize stage, timeout and number of largest flows are set to default
+ * @param flows Flow stage
+ * @return void
+ */
+void flow_stage_init (flow_stage_t *flows);
+
+/**
+ * @brief Option parser of stage: -F, -T and -N
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @param i Index of option, moved to its value if it takes one
+ * @param arg Flow stage
+ * @return EC_SUCCESS, error of option, or EC_CLI_UNKNOWN_OPTION
+ */
+ec_t flow_option (int argc, char *argv[], int *i, void *arg);
+
+/**
+ * @brief Check options of stage and register it if enabled
+ * @param flows Flow stage
+ * @param pipeline Pipeline
+ * @return Error code
+ */
+ec_t flow_register (flow_stage_t *flows, pipeline_t *pipeline);
+
+/**
+ * @brief Allocate flow table
+ * @param flows Flow stage
+ * @return Error code
+ */
+ec_t flow_start (flow_stage_t *flows);
+
+/**
+ * @brief Print per-flow IAT, aggregated distributions and largest flows
+ * @param flows Flow stage
+ * @return void
+ */
+void flow_print (const flow_stage_t *flows);
+
+#endif // FLOW_TABLE_H
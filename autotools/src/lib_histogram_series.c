@@ -0,0 +1,452 @@
+/*
+ * @file lib_histogram_series.c
+ * @brief Histogram series library source file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <errno.h>
+
+#include "lib_histogram_series.h"
+
+/**
+ * @brief Write file header at current position
+ * @param series Writer
+ * @return Error code
+ */
+static ec_t write_header (histogram_series_t *series);
+
+/**
+ * @brief Encode unsigned LEB128 varint
+ * @param buffer Output, at least HISTOGRAM_SERIES_VARINT_SIZE bytes
+ * @param value Value
+ * @return Bytes written
+ */
+static inline size_t put_varint (uint8_t *buffer, uint64_t value);
+
+/**
+ * @brief Decode unsigned LEB128 varint from file
+ * @param file Input file
+ * @param value Value
+ * @return 0 if success, -1 if file ends or varint is too long
+ */
+static int get_varint (FILE *file, uint64_t *value);
+
+/**
+ * @brief Init callback of stage, first interval starts at origin
+ * @param origin Timestamp of first packet (nsec)
+ * @param arg Histogram series stage
+ * @return EC_SUCCESS
+ */
+static ec_t series_init (uint64_t origin, void *arg);
+
+/**
+ * @brief Interval callback of stage, write every interval before the one of next packet
+ * @param index Ended interval
+ * @param next Interval of next packet
+ * @param arg Histogram series stage
+ * @return void
+ */
+static void series_interval (uint64_t index, uint64_t next, void *arg);
+
+/**
+ * @brief Finish callback of stage, write the last interval before the first packet is removed from exceeded IAT
+ * @param index Interval of last packet
+ * @param arg Histogram series stage
+ * @return First write error
+ */
+static ec_t series_finish (uint64_t index, void *arg);
+
+/**
+ * @brief Write histogram of current interval to histogram series and start the next interval
+ * @param series Histogram series stage
+ * @return void
+ */
+static void close_series_interval (series_stage_t *series);
+
+ec_t histogram_series_open (histogram_series_t *series, const char *path, const histogram_series_info_t *info) {
+    memset(series, 0, sizeof(histogram_series_t));
+    series->info = *info;
+    series->info.interval_count = 0;
+    series->info.index_offset = 0;
+    /* every counter non-zero is the worst case of one record */
+    series->buffer = (uint8_t *) malloc((3 + 2 * (size_t) info->counter_count) * HISTOGRAM_SERIES_VARINT_SIZE);
+    if (series->buffer == NULL) {
+        perror("malloc");
+        return EC_GEN_UNABLE_TO_MALLOC;
+    }
+    series->file = fopen(path, "w");
+    if (series->file == NULL) {
+        perror("fopen");
+        return EC_GEN_UNABLE_TO_OPEN_DATA_FILE;
+    }
+    if (setvbuf(series->file, NULL, _IOFBF, HISTOGRAM_SERIES_BUFFER_SIZE) != 0) {
+        perror("setvbuf");
+    }
+    /* record offsets are spooled the same way as columns of lib_output_sink */
+    series->index = tmpfile();
+    if (series->index == NULL) {
+        perror("tmpfile");
+        return EC_GEN_UNABLE_TO_OPEN_DATA_FILE;
+    }
+    return EC_SUCCESS;
+}
+
+ec_t histogram_series_write (histogram_series_t *series, const uint64_t *count, uint64_t negative, uint64_t exceed) {
+    /* params */
+    ec_t        ec;             /* error code */
+    uint8_t    *pairs;          /* start of (gap, count) pairs in buffer */
+    uint8_t    *end;            /* end of encoded record */
+    uint64_t    nonzero = 0;    /* non-zero counters */
+    uint64_t    gap = 0;        /* empty counters since previous non-zero one */
+    uint64_t    offset;         /* little-endian offset of record */
+    size_t      size;           /* bytes of nonzero varint */
+    uint32_t    i;              /* iterator */
+
+    if (series->offset == 0) {
+        ec = write_header(series);
+        if (ec != EC_SUCCESS) {
+            return ec;
+        }
+        series->offset = HISTOGRAM_SERIES_HEADER_SIZE;
+    }
+
+    /* pairs are encoded after room for the largest nonzero varint, then moved behind the actual one */
+    pairs = series->buffer + 3 * HISTOGRAM_SERIES_VARINT_SIZE;
+    end = pairs;
+    for (i=0; i<series->info.counter_count; i++) {
+        if (count[i] == 0) {
+            gap++;
+            continue;
+        }
+        end += put_varint(end, gap);
+        end += put_varint(end, count[i]);
+        gap = 0;
+        nonzero++;
+    }
+    size = put_varint(series->buffer, negative);
+    size += put_varint(series->buffer + size, exceed);
+    size += put_varint(series->buffer + size, nonzero);
+    memmove(series->buffer + size, pairs, (size_t) (end - pairs));
+    size += (size_t) (end - pairs);
+
+    offset = htole64(series->offset);
+    if ((fwrite(&offset, sizeof(uint64_t), 1, series->index) != 1) || (fwrite(series->buffer, 1, size, series->file) != size)) {
+        return EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
+    }
+    series->offset += size;
+    series->info.interval_count++;
+    return EC_SUCCESS;
+}
+
+ec_t histogram_series_close (histogram_series_t *series) {
+    /* params */
+    ec_t        ec = EC_SUCCESS;    /* error code */
+    char        buffer[1 << 16];    /* copy buffer */
+    size_t      size;               /* bytes read into copy buffer */
+
+    if (series->file == NULL) {
+        free(series->buffer);
+        series->buffer = NULL;
+        return EC_SUCCESS;
+    }
+    if (series->offset == 0) {
+        ec = write_header(series);
+        series->offset = HISTOGRAM_SERIES_HEADER_SIZE;
+    }
+    if ((ec == EC_SUCCESS) && (series->index != NULL)) {
+        rewind(series->index);
+        while ((size = fread(buffer, 1, sizeof(buffer), series->index)) > 0) {
+            if (fwrite(buffer, 1, size, series->file) != size) {
+                ec = EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
+                break;
+            }
+        }
+    }
+    /* rewrite header with final count and index, output may be a pipe where rewinding is impossible */
+    if ((ec == EC_SUCCESS) && (fseek(series->file, 0, SEEK_SET) == 0)) {
+        series->info.index_offset = series->offset;
+        ec = write_header(series);
+    }
+    if (series->index != NULL) {
+        fclose(series->index);
+        series->index = NULL;
+    }
+    if ((fclose(series->file) != 0) && (ec == EC_SUCCESS)) {
+        perror("fclose");
+        ec = EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
+    }
+    series->file = NULL;
+    free(series->buffer);
+    series->buffer = NULL;
+    return ec;
+}
+
+ec_t histogram_series_open_reader (histogram_series_reader_t *reader, const char *path) {
+    /* params */
+    uint8_t     header[HISTOGRAM_SERIES_HEADER_SIZE];   /* file header */
+    uint32_t    u32[4];                                 /* version, counter count, quantize order, log digits */
+    uint64_t    u64[5];                                 /* ticks per second, start, interval, interval count, index offset */
+
+    memset(reader, 0, sizeof(histogram_series_reader_t));
+    reader->file = fopen(path, "r");
+    if (reader->file == NULL) {
+        perror("fopen");
+        return EC_GEN_UNABLE_TO_OPEN_DATA_FILE;
+    }
+    if ((fread(header, 1, sizeof(header), reader->file) != sizeof(header)) || (memcmp(header, "PTHIS", 6) != 0)) {
+        return EC_GEN_INVALID_HISTOGRAM_SERIES;
+    }
+    memcpy(u32, header + 8, sizeof(u32));
+    memcpy(u64, header + 8 + sizeof(u32), sizeof(u64));
+    if ((le32toh(u32[0]) != HISTOGRAM_SERIES_VERSION) || (le64toh(u64[4]) == 0)) {
+        return EC_GEN_INVALID_HISTOGRAM_SERIES;
+    }
+    reader->info.counter_count = le32toh(u32[1]);
+    reader->info.quantize_order = le32toh(u32[2]);
+    reader->info.log_digits = le32toh(u32[3]);
+    reader->info.ticks_per_sec = le64toh(u64[0]);
+    reader->info.start = le64toh(u64[1]);
+    reader->info.interval = le64toh(u64[2]);
+    reader->info.interval_count = le64toh(u64[3]);
+    reader->info.index_offset = le64toh(u64[4]);
+    return EC_SUCCESS;
+}
+
+ec_t histogram_series_read (histogram_series_reader_t *reader, uint64_t interval, uint64_t *count, uint64_t *negative, uint64_t *exceed) {
+    /* params */
+    uint64_t    offset;         /* offset of record */
+    uint64_t    nonzero;        /* non-zero counters */
+    uint64_t    gap;            /* empty counters before counter */
+    uint64_t    value;          /* count of counter */
+    uint64_t    next = 0;       /* index of next counter */
+    uint64_t    i;              /* iterator */
+
+    if (interval >= reader->info.interval_count) {
+        return EC_GEN_INVALID_HISTOGRAM_SERIES;
+    }
+    if ((fseek(reader->file, (long) (reader->info.index_offset + interval * sizeof(uint64_t)), SEEK_SET) != 0)
+        || (fread(&offset, sizeof(uint64_t), 1, reader->file) != 1)
+        || (fseek(reader->file, (long) le64toh(offset), SEEK_SET) != 0)) {
+        return EC_GEN_INVALID_HISTOGRAM_SERIES;
+    }
+    if ((get_varint(reader->file, negative) != 0) || (get_varint(reader->file, exceed) != 0) || (get_varint(reader->file, &nonzero) != 0)) {
+        return EC_GEN_INVALID_HISTOGRAM_SERIES;
+    }
+    memset(count, 0, reader->info.counter_count * sizeof(uint64_t));
+    for (i=0; i<nonzero; i++) {
+        if ((get_varint(reader->file, &gap) != 0) || (get_varint(reader->file, &value) != 0)) {
+            return EC_GEN_INVALID_HISTOGRAM_SERIES;
+        }
+        next += gap;
+        if (next >= reader->info.counter_count) {
+            return EC_GEN_INVALID_HISTOGRAM_SERIES;
+        }
+        count[next] = value;
+        next++;
+    }
+    return EC_SUCCESS;
+}
+
+void histogram_series_close_reader (histogram_series_reader_t *reader) {
+    if (reader->file != NULL) {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+    return;
+}
+
+void series_stage_init (series_stage_t *series) {
+    memset(series, 0, sizeof(series_stage_t));
+    return;
+}
+
+ec_t series_option (int argc, char *argv[], int *i, void *arg) {
+    /* params */
+    series_stage_t *series = (series_stage_t *) arg;
+    ec_t            ec = EC_SUCCESS;    /* error code */
+
+    if ((strcmp(argv[*i], "-H") == 0) || (strcmp(argv[*i], "--histogram-series") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            series->path = argv[*i];
+        } else {
+            ec = EC_CLI_NO_HISTOGRAM_SERIES_VALUE;
+        }
+    } else {
+        ec = EC_CLI_UNKNOWN_OPTION;
+    }
+    return ec;
+}
+
+/* @brief Register histogram series stage
+ * @details registered before the stage counting IAT, so its interval and finish callbacks read counters without the next packet.
+ *          Counters at the start of current interval are not saved in checkpoint, and chunks only keep totals
+ */
+ec_t series_register (series_stage_t *series, pipeline_t *pipeline) {
+    /* params */
+    pipeline_stage_t    stage;      /* stage registered to pipeline */
+
+    if (series->path == NULL) {
+        return EC_SUCCESS;
+    }
+    memset(&stage, 0, sizeof(pipeline_stage_t));
+    stage.name = "series";
+    stage.unsupported = EC_CLI_INVALID_HISTOGRAM_SERIES;
+    stage.arg = series;
+    stage.init = series_init;
+    stage.interval = series_interval;
+    stage.finish = series_finish;
+    return pipeline_add_stage(pipeline, &stage);
+}
+
+/* @brief Open series file
+ * @details the first packet is counted as exceeded IAT and removed at the end, so it is taken as counted before the first interval
+ */
+ec_t series_start (series_stage_t *series, const histogram_series_info_t *info, const uint64_t *count, const uint64_t *negative, const uint64_t *exceed) {
+    series->count = count;
+    series->negative = negative;
+    series->exceed = exceed;
+    series->start_negative = *negative;
+    series->start_exceed = *exceed + 1;
+    series->start = (uint64_t *) calloc(info->counter_count, sizeof(uint64_t));
+    if (series->start == NULL) {
+        perror("calloc");
+        return EC_GEN_UNABLE_TO_MALLOC;
+    }
+    memcpy(series->start, count, info->counter_count * sizeof(uint64_t));
+    return histogram_series_open(&series->writer, series->path, info);
+}
+
+ec_t series_close (series_stage_t *series) {
+    /* params */
+    ec_t ec = EC_SUCCESS;   /* error code */
+
+    if (histogram_series_close(&series->writer) != EC_SUCCESS) {
+        ec = EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
+    }
+    free(series->start);
+    series->start = NULL;
+    return ec;
+}
+
+static ec_t write_header (histogram_series_t *series) {
+    /* params */
+    char        magic[8];       /* file magic */
+    uint32_t    u32[4];         /* version, counter count, quantize order, log digits */
+    uint64_t    u64[5];         /* ticks per second, start, interval, interval count, index offset */
+
+    memset(magic, 0, sizeof(magic));
+    memcpy(magic, "PTHIS", 5);
+    u32[0] = htole32(HISTOGRAM_SERIES_VERSION);
+    u32[1] = htole32(series->info.counter_count);
+    u32[2] = htole32(series->info.quantize_order);
+    u32[3] = htole32(series->info.log_digits);
+    u64[0] = htole64(series->info.ticks_per_sec);
+    u64[1] = htole64(series->info.start);
+    u64[2] = htole64(series->info.interval);
+    u64[3] = htole64(series->info.interval_count);
+    u64[4] = htole64(series->info.index_offset);
+    fwrite(magic, 1, sizeof(magic), series->file);
+    fwrite(u32, sizeof(uint32_t), 4, series->file);
+    fwrite(u64, sizeof(uint64_t), 5, series->file);
+    if (ferror(series->file)) {
+        return EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
+    }
+    return EC_SUCCESS;
+}
+
+/* @brief Encode varint
+ * @details 7 bits per byte from the lowest, high bit set on every byte but the last
+ */
+static inline size_t put_varint (uint8_t *buffer, uint64_t value) {
+    /* params */
+    size_t size = 0;    /* bytes written */
+
+    while (value >= 0x80) {
+        buffer[size] = (uint8_t) (value | 0x80);
+        value >>= 7;
+        size++;
+    }
+    buffer[size] = (uint8_t) value;
+    return size + 1;
+}
+
+/* @brief Decode varint
+ */
+static int get_varint (FILE *file, uint64_t *value) {
+    /* params */
+    int         byte;       /* byte read */
+    unsigned    shift;      /* bit position of byte */
+
+    *value = 0;
+    for (shift=0; shift<64; shift+=7) {
+        byte = fgetc(file);
+        if (byte == EOF) {
+            return -1;
+        }
+        *value |= (uint64_t) (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* @brief First interval of stage
+ * @details start is in the tick of the header, which is nanosecond or microsecond
+ */
+static ec_t series_init (uint64_t origin, void *arg) {
+    /* params */
+    series_stage_t *series = (series_stage_t *) arg;
+
+    series->started = true;
+    series->writer.info.start = pipeline_ticks(origin, series->writer.info.ticks_per_sec == NSEC_PER_SEC);
+    return EC_SUCCESS;
+}
+
+static void series_interval (uint64_t index, uint64_t next, void *arg) {
+    /* params */
+    series_stage_t *series = (series_stage_t *) arg;
+
+    for (; index<next; index++) {
+        close_series_interval(series);
+    }
+    return;
+}
+
+static ec_t series_finish (uint64_t index, void *arg) {
+    /* params */
+    series_stage_t *series = (series_stage_t *) arg;
+
+    (void) index;
+    if (series->started) {
+        close_series_interval(series);
+    }
+    return series->ec;
+}
+
+/* @brief Close interval of histogram series
+ * @details counters are only read here, so the stage counting IAT pays nothing for the series,
+ *          start array is turned into the histogram of interval and then overwritten by the counters of next start
+ */
+static void close_series_interval (series_stage_t *series) {
+    /* params */
+    uint32_t    counter_count = series->writer.info.counter_count;     /* counters of each histogram */
+    uint32_t    i;      /* iterator */
+
+    if (series->ec != EC_SUCCESS) {
+        return;
+    }
+    for (i=0; i<counter_count; i++) {
+        series->start[i] = series->count[i] - series->start[i];
+    }
+    series->ec = histogram_series_write(&series->writer, series->start, *series->negative - series->start_negative, *series->exceed - series->start_exceed);
+    memcpy(series->start, series->count, counter_count * sizeof(uint64_t));
+    series->start_negative = *series->negative;
+    series->start_exceed = *series->exceed;
+    return;
+}
@@ -0,0 +1,188 @@
+/**
+ * @file lib_histogram_series.h
+ * @brief Time series of histograms, one per interval, in a compact binary file of sparse LEB128 (gap, count)
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ * @details
+ * File is little-endian:
+ *   char     magic[8]          "PTHIS", zero padded
+ *   uint32_t version           HISTOGRAM_SERIES_VERSION
+ *   uint32_t counter_count     counters of each histogram
+ *   uint32_t quantize_order    linear histogram: counter i counts IAT of [i, i + 1) * 2^quantize_order ticks
+ *   uint32_t log_digits        log-linear histogram: significant digits of lib_log_histogram, 0 if linear
+ *   uint64_t ticks_per_sec     tick of IAT and timestamps
+ *   uint64_t start             timestamp where first interval starts (tick)
+ *   uint64_t interval          length of interval (tick)
+ *   uint64_t interval_count    0 if the output could not be rewound (pipe), read records until EOF
+ *   uint64_t index_offset      byte offset of index from start of file, 0 if the output could not be rewound
+ * followed by interval_count records, one per interval including empty ones, of unsigned LEB128 varints:
+ *   negative, exceed, nonzero, then nonzero pairs of (gap, count)
+ * where gap is the number of empty counters skipped since the previous non-zero counter.
+ * Index of interval_count uint64_t record offsets is at the end, so one interval is read with two seeks
+ * without decoding the ones before it. Counters are not delta-encoded against the previous interval for the same reason.
+ * An interval of a few hundred non-zero counters takes about 2 bytes per counter instead of 8 per counter of the array.
+ * Series stage writes one histogram per interval of a pipeline as the difference of the IAT counters of another stage
+ * between the ends of the interval, so the stage counting IAT pays nothing for it. Option "-H" is parsed by series_option.
+ * Ref:
+ * 1. https://en.wikipedia.org/wiki/LEB128
+*/
+
+#ifndef HISTOGRAM_SERIES_H
+#define HISTOGRAM_SERIES_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lib_error.h"
+#include "lib_pipeline.h"
+
+#define HISTOGRAM_SERIES_VERSION        1           /* version of file header */
+#define HISTOGRAM_SERIES_HEADER_SIZE    64          /* size of file header (byte) */
+#define HISTOGRAM_SERIES_BUFFER_SIZE    (4 << 20)   /* size of write buffer of file */
+#define HISTOGRAM_SERIES_VARINT_SIZE    10          /* largest varint of uint64_t (byte) */
+
+/**
+ * @brief Fields of file header
+ */
+typedef struct {
+    uint32_t    counter_count;      ///< counters of each histogram
+    uint32_t    quantize_order;     ///< quantize time order of 2 of linear histogram
+    uint32_t    log_digits;         ///< significant digits of log-linear histogram, 0 if linear
+    uint64_t    ticks_per_sec;      ///< ticks per second
+    uint64_t    start;              ///< timestamp where first interval starts (tick)
+    uint64_t    interval;           ///< length of interval (tick)
+    uint64_t    interval_count;     ///< number of intervals
+    uint64_t    index_offset;       ///< byte offset of index, 0 if not written
+} histogram_series_info_t;
+
+/**
+ * @brief Writer of histogram series
+ */
+typedef struct {
+    FILE       *file;               ///< output file
+    FILE       *index;              ///< temporary file of record offsets, appended on close
+    uint8_t    *buffer;             ///< encoded record
+    uint64_t    offset;             ///< bytes written to file
+    histogram_series_info_t info;   ///< header, start must be set before the first interval is written
+} histogram_series_t;
+
+/**
+ * @brief Reader of histogram series
+ */
+typedef struct {
+    FILE       *file;               ///< input file
+    histogram_series_info_t info;   ///< header
+} histogram_series_reader_t;
+
+/**
+ * @brief Histogram series stage, histogram of an interval is the difference of IAT counters between its ends
+ */
+typedef struct {
+    const char         *path;           ///< "-H" series file, NULL if not written
+    const uint64_t     *count;          ///< IAT counters of a stage registered after this one, so they exclude the next packet
+    const uint64_t     *negative;       ///< negative IAT of that stage
+    const uint64_t     *exceed;         ///< exceeded IAT of that stage, which counts the first packet of trace
+    histogram_series_t  writer;         ///< series file
+    bool                started;        ///< first packet is passed, an interval is open
+    uint64_t           *start;          ///< IAT counters at start of current interval, histogram of interval while written
+    uint64_t            start_negative; ///< negative IAT at start of current interval
+    uint64_t            start_exceed;   ///< exceeded IAT at start of current interval
+    ec_t                ec;             ///< first write error, later intervals are not written
+} series_stage_t;
+
+/**
+ * @brief Open histogram series file, header is written with the first interval
+ * @param series Writer to initialize
+ * @param path Output path
+ * @param info Header, interval_count and index_offset are ignored
+ * @return Error code
+ */
+ec_t histogram_series_open (histogram_series_t *series, const char *path, const histogram_series_info_t *info);
+
+/**
+ * @brief Append histogram of one interval
+ * @param series Writer
+ * @param count counter_count counters of interval
+ * @param negative Count of negative IAT of interval
+ * @param exceed Count of IAT exceed the last counter of interval
+ * @return Error code
+ */
+ec_t histogram_series_write (histogram_series_t *series, const uint64_t *count, uint64_t negative, uint64_t exceed);
+
+/**
+ * @brief Append index, finalize header and close file
+ * @param series Writer
+ * @return Error code
+ */
+ec_t histogram_series_close (histogram_series_t *series);
+
+/**
+ * @brief Open histogram series file and read its header
+ * @param reader Reader to initialize
+ * @param path Input path
+ * @return EC_SUCCESS, EC_GEN_UNABLE_TO_OPEN_DATA_FILE or EC_GEN_INVALID_HISTOGRAM_SERIES if file has no index
+ */
+ec_t histogram_series_open_reader (histogram_series_reader_t *reader, const char *path);
+
+/**
+ * @brief Read histogram of one interval
+ * @param reader Reader
+ * @param interval Interval index, less than interval_count
+ * @param count counter_count counters of interval
+ * @param negative Count of negative IAT of interval
+ * @param exceed Count of IAT exceed the last counter of interval
+ * @return EC_SUCCESS or EC_GEN_INVALID_HISTOGRAM_SERIES
+ */
+ec_t histogram_series_read (histogram_series_reader_t *reader, uint64_t interval, uint64_t *count, uint64_t *negative, uint64_t *exceed);
+
+/**
+ * @brief Close reader
+ * @param reader Reader
+ * @return void
+ */
+void histogram_series_close_reader (histogram_series_reader_t *reader);
+
+/**
+ * @brief Initialize stage
+ * @param series Histogram series stage
+ * @return void
+ */
+void series_stage_init (series_stage_t *series);
+
+/**
+ * @brief Option parser of stage: -H
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @param i Index of option, moved to its value if it takes one
+ * @param arg Histogram series stage
+ * @return EC_SUCCESS, error of option, or EC_CLI_UNKNOWN_OPTION
+ */
+ec_t series_option (int argc, char *argv[], int *i, void *arg);
+
+/**
+ * @brief Register stage if enabled, before the stage counting IAT
+ * @param series Histogram series stage
+ * @param pipeline Pipeline
+ * @return Error code
+ */
+ec_t series_register (series_stage_t *series, pipeline_t *pipeline);
+
+/**
+ * @brief Open series file, counters are read at the end of each interval
+ * @param series Histogram series stage
+ * @param info Header, start is set by the first packet
+ * @param count info.counter_count IAT counters
+ * @param negative Count of negative IAT
+ * @param exceed Count of exceeded IAT, the first packet of trace is counted here and removed at the end
+ * @return Error code
+ */
+ec_t series_start (series_stage_t *series, const histogram_series_info_t *info, const uint64_t *count, const uint64_t *negative, const uint64_t *exceed);
+
+/**
+ * @brief Close series file and free counters of stage
+ * @param series Histogram series stage
+ * @return EC_SUCCESS or EC_GEN_UNABLE_TO_WRITE_DATA_FILE
+ */
+ec_t series_close (series_stage_t *series);
+
+#endif // HISTOGRAM_SERIES_H
@@ -0,0 +1,381 @@
+/*
+ * @file lib_input_list.c
+ * @brief Input list and worker pool library source file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <glob.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "libtrace.h"
+
+#include "lib_input_list.h"
+
+/**
+ * @brief Shared state of worker pool
+ */
+typedef struct {
+    pthread_mutex_t     mutex;          /* protects every field below */
+    pthread_cond_t      cond;           /* signaled when a file is taken, done or merged */
+    size_t              count;          /* number of files */
+    size_t              next;           /* next file to take by worker */
+    size_t              merged;         /* number of merged files */
+    size_t              window;         /* maximum files taken ahead of merger */
+    bool               *done;           /* file is processed by worker */
+    ec_t               *ec;             /* error code of each worker */
+    input_worker_t      worker;         /* worker */
+    void               *arg;            /* user argument */
+} input_pool_t;
+
+/**
+ * @brief Add value of one "-i" option to input list, errno is left as set by stat and glob
+ * @param list Input list
+ * @param value File path, glob pattern, or directory of trace files
+ * @return Error code
+ */
+static ec_t add_value (input_list_t *list, const char *value);
+
+/**
+ * @brief Append one path to input list
+ * @param list Input list
+ * @param path Path, copied
+ * @return Error code
+ */
+static ec_t append_path (input_list_t *list, const char *path);
+
+/**
+ * @brief scandir filter, keep trace files
+ * @param entry Directory entry
+ * @return Non-zero to keep entry
+ */
+static int filter_trace_file (const struct dirent *entry);
+
+/**
+ * @brief Worker thread of input pool
+ * @param arg Input pool
+ * @return NULL
+ */
+static void *pool_thread (void *arg);
+
+bool input_is_trace_file (const char *path) {
+    /* Valid file types: https://github.com/LibtraceTeam/libtrace/blob/cc98f68f72e24bf51e2dabc00af0dbc4ffe7bb3d/lib/trace.c#L242 */
+    return (strstr(path, ".pcap") != NULL) || (strstr(path, ".erf") != NULL);
+}
+
+ec_t input_list_add (input_list_t *list, const char *value) {
+    /* params */
+    int     saved_errno = errno;    /* errno before probing the value */
+    ec_t    ec;                     /* error code */
+
+    /* stat on a glob pattern fails by design, do not leave errno for the caller's strtol checks */
+    ec = add_value(list, value);
+    if (ec == EC_SUCCESS) {
+        errno = saved_errno;
+    }
+    return ec;
+}
+
+static ec_t add_value (input_list_t *list, const char *value) {
+    /* params */
+    ec_t            ec = EC_SUCCESS;    /* error code */
+    struct stat     st;                 /* file status */
+    glob_t          matches;            /* glob matches */
+    struct dirent **entries = NULL;     /* directory entries */
+    int             entry_count;        /* number of directory entries */
+    char            path[4096];         /* path of directory entry */
+    size_t          i;                  /* iterator */
+
+    /* directory, add every trace file in name order */
+    if ((stat(value, &st) == 0) && S_ISDIR(st.st_mode)) {
+        entry_count = scandir(value, &entries, filter_trace_file, alphasort);
+        if (entry_count < 0) {
+            perror("scandir");
+            return EC_CLI_INPUT_FILE_NOT_FOUND;
+        }
+        for (i=0; i<(size_t) entry_count; i++) {
+            snprintf(path, sizeof(path), "%s/%s", value, entries[i]->d_name);
+            if (ec == EC_SUCCESS) {
+                ec = append_path(list, path);
+            }
+            free(entries[i]);
+        }
+        free(entries);
+        if ((ec == EC_SUCCESS) && (entry_count == 0)) {
+            fprintf(stderr, "No trace file in directory: %s\n", value);
+            ec = EC_CLI_INPUT_FILE_NOT_FOUND;
+        }
+        return ec;
+    }
+
+    /* glob pattern, shell may leave it unexpanded when quoted */
+    if (strpbrk(value, "*?[") != NULL) {
+        if (glob(value, 0, NULL, &matches) != 0) {
+            fprintf(stderr, "No file matches: %s\n", value);
+            return EC_CLI_INPUT_FILE_NOT_FOUND;
+        }
+        for (i=0; (i<matches.gl_pathc) && (ec==EC_SUCCESS); i++) {
+            if (!input_is_trace_file(matches.gl_pathv[i])) {
+                fprintf(stderr, "Not a trace file: %s\n", matches.gl_pathv[i]);
+                ec = EC_CLI_INVALID_INPUT_FILE;
+            } else {
+                ec = append_path(list, matches.gl_pathv[i]);
+            }
+        }
+        globfree(&matches);
+        return ec;
+    }
+
+    /* single file */
+    if (!input_is_trace_file(value)) {
+        return EC_CLI_INVALID_INPUT_FILE;
+    }
+    if (access(value, F_OK) != 0) {
+        fprintf(stderr, "File inaccessable: %s\n", value);
+        return EC_CLI_INPUT_FILE_NOT_FOUND;
+    }
+    return append_path(list, value);
+}
+
+ec_t input_list_sort (input_list_t *list, reader_t reader) {
+    /* params */
+    ec_t        ec = EC_SUCCESS;    /* error code */
+    size_t      i;                  /* iterator */
+    size_t      j;                  /* iterator */
+    char       *path;               /* path being inserted */
+    uint64_t    first_nsec;         /* first timestamp being inserted */
+
+    for (i=0; (i<list->count) && (ec==EC_SUCCESS); i++) {
+        ec = input_get_first_timestamp(list->paths[i], reader, &list->first_nsec[i]);
+        if (ec != EC_SUCCESS) {
+            fprintf(stderr, "Unable to read first packet: %s\n", list->paths[i]);
+        }
+    }
+
+    /* insertion sort, stable and the list is usually ordered by name already */
+    for (i=1; (i<list->count) && (ec==EC_SUCCESS); i++) {
+        path = list->paths[i];
+        first_nsec = list->first_nsec[i];
+        for (j=i; (j>0) && (list->first_nsec[j - 1] > first_nsec); j--) {
+            list->paths[j] = list->paths[j - 1];
+            list->first_nsec[j] = list->first_nsec[j - 1];
+        }
+        list->paths[j] = path;
+        list->first_nsec[j] = first_nsec;
+    }
+    return ec;
+}
+
+void input_list_free (input_list_t *list) {
+    /* params */
+    size_t i;   /* iterator */
+
+    for (i=0; i<list->count; i++) {
+        free(list->paths[i]);
+    }
+    free(list->paths);
+    free(list->first_nsec);
+    memset(list, 0, sizeof(input_list_t));
+    return;
+}
+
+ec_t input_get_first_timestamp (const char *path, reader_t reader, uint64_t *first_nsec) {
+    /* params */
+    ec_t                ec = EC_GEN_UNSUPPORTED_MMAP_FORMAT; /* error code */
+    pcap_mmap_t         pcap;               /* mmap reader */
+    pcap_packet_view_t  view;               /* packet view of mmap reader */
+    libtrace_t         *trace = NULL;       /* trace file */
+    libtrace_packet_t  *packet = NULL;      /* packet */
+    struct timespec     ts;                 /* timestamp of first packet */
+    int                 rc;                 /* return code of reader */
+
+    *first_nsec = INPUT_EMPTY_TIMESTAMP;
+    if (reader != READER_LIBTRACE) {
+        ec = pcap_mmap_open(path, &pcap);
+        if (ec == EC_SUCCESS) {
+            rc = pcap_mmap_next(&pcap, &view);
+            if (rc > 0) {
+                *first_nsec = (uint64_t) view.ts.tv_sec * 1000000000 + (uint64_t) view.ts.tv_nsec;
+            } else if (rc < 0) {
+                ec = EC_GEN_TRACE_READ_PACKET_ERROR;
+            }
+            pcap_mmap_close(&pcap);
+            return ec;
+        }
+        if ((ec != EC_GEN_UNSUPPORTED_MMAP_FORMAT) || (reader == READER_MMAP)) {
+            return ec;
+        }
+    }
+
+    ec = EC_SUCCESS;
+    packet = trace_create_packet();
+    if (packet == NULL) {
+        perror("trace_create_packet");
+        ec = EC_GEN_UNABLE_TO_CREATE_PACKET;
+    }
+    if (ec == EC_SUCCESS) {
+        trace = trace_create(path);
+        if (trace_is_err(trace)) {
+            trace_perror(trace, "trace_create");
+            ec = EC_GEN_UNABLE_TO_CREATE_TRACE;
+        } else if (trace_start(trace) != 0) {
+            trace_perror(trace, "trace_start");
+            ec = EC_GEN_UNABLE_TO_START_TRACE;
+        }
+    }
+    if (ec == EC_SUCCESS) {
+        if (trace_read_packet(trace, packet) > 0) {
+            /* following line will result in -Waggregate-return warning, same as pt_count_packet */
+            ts = trace_get_timespec(packet);
+            *first_nsec = (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+        } else if (trace_is_err(trace)) {
+            trace_perror(trace, "Reading packets");
+            ec = EC_GEN_TRACE_READ_PACKET_ERROR;
+        }
+    }
+    if (trace != NULL) {
+        trace_destroy(trace);
+    }
+    if (packet != NULL) {
+        trace_destroy_packet(packet);
+    }
+    return ec;
+}
+
+ec_t input_pool_run (size_t count, int threads, input_worker_t worker, input_merger_t merger, void *arg) {
+    /* params */
+    ec_t            ec = EC_SUCCESS;    /* error code */
+    input_pool_t    pool;               /* shared pool state */
+    pthread_t      *tids = NULL;        /* worker threads */
+    int             started = 0;        /* number of started workers */
+    size_t          i;                  /* iterator */
+
+    memset(&pool, 0, sizeof(input_pool_t));
+    pool.count = count;
+    pool.window = 2 * (size_t) threads;
+    pool.worker = worker;
+    pool.arg = arg;
+    pool.done = (bool *) calloc(count, sizeof(bool));
+    pool.ec = (ec_t *) calloc(count, sizeof(ec_t));
+    tids = (pthread_t *) calloc((size_t) threads, sizeof(pthread_t));
+    if ((pool.done == NULL) || (pool.ec == NULL) || (tids == NULL)) {
+        perror("calloc");
+        ec = EC_GEN_UNABLE_TO_MALLOC;
+    }
+    if (ec == EC_SUCCESS) {
+        pthread_mutex_init(&pool.mutex, NULL);
+        pthread_cond_init(&pool.cond, NULL);
+        for (started=0; started<threads; started++) {
+            if (pthread_create(&tids[started], NULL, pool_thread, &pool) != 0) {
+                perror("pthread_create");
+                ec = EC_GEN_UNABLE_TO_CREATE_THREAD;
+                break;
+            }
+        }
+    }
+
+    /* merge in file order as soon as each file is done */
+    for (i=0; (i<count) && (ec==EC_SUCCESS) && (started>0); i++) {
+        pthread_mutex_lock(&pool.mutex);
+        while (!pool.done[i]) {
+            pthread_cond_wait(&pool.cond, &pool.mutex);
+        }
+        ec = pool.ec[i];
+        pthread_mutex_unlock(&pool.mutex);
+        if (ec == EC_SUCCESS) {
+            ec = merger(i, arg);
+        }
+        pthread_mutex_lock(&pool.mutex);
+        pool.merged = i + 1;
+        pthread_cond_broadcast(&pool.cond);
+        pthread_mutex_unlock(&pool.mutex);
+    }
+
+    /* stop taking new files, either finished or failed */
+    if ((pool.done != NULL) && (pool.ec != NULL) && (tids != NULL)) {
+        pthread_mutex_lock(&pool.mutex);
+        pool.next = count;
+        pthread_cond_broadcast(&pool.cond);
+        pthread_mutex_unlock(&pool.mutex);
+        for (i=0; i<(size_t) started; i++) {
+            pthread_join(tids[i], NULL);
+        }
+        pthread_cond_destroy(&pool.cond);
+        pthread_mutex_destroy(&pool.mutex);
+    }
+    free(tids);
+    free(pool.done);
+    free(pool.ec);
+    return ec;
+}
+
+static ec_t append_path (input_list_t *list, const char *path) {
+    /* params */
+    char      **paths;          /* resized paths */
+    uint64_t   *first_nsec;     /* resized first timestamps */
+    size_t      capacity;       /* new capacity */
+
+    if (list->count == list->capacity) {
+        capacity = (list->capacity == 0) ? 16 : list->capacity * 2;
+        paths = (char **) realloc(list->paths, capacity * sizeof(char *));
+        if (paths == NULL) {
+            perror("realloc");
+            return EC_GEN_UNABLE_TO_MALLOC;
+        }
+        list->paths = paths;
+        first_nsec = (uint64_t *) realloc(list->first_nsec, capacity * sizeof(uint64_t));
+        if (first_nsec == NULL) {
+            perror("realloc");
+            return EC_GEN_UNABLE_TO_MALLOC;
+        }
+        list->first_nsec = first_nsec;
+        list->capacity = capacity;
+    }
+    list->paths[list->count] = strdup(path);
+    if (list->paths[list->count] == NULL) {
+        perror("strdup");
+        return EC_GEN_UNABLE_TO_MALLOC;
+    }
+    list->first_nsec[list->count] = INPUT_EMPTY_TIMESTAMP;
+    list->count++;
+    return EC_SUCCESS;
+}
+
+static int filter_trace_file (const struct dirent *entry) {
+    return (entry->d_name[0] != '.') && input_is_trace_file(entry->d_name);
+}
+
+static void *pool_thread (void *arg) {
+    /* params */
+    input_pool_t   *pool = (input_pool_t *) arg;    /* shared pool state */
+    size_t          index;                          /* index of taken file */
+    ec_t            ec;                             /* error code of worker */
+
+    for (;;) {
+        pthread_mutex_lock(&pool->mutex);
+        while ((pool->next < pool->count) && (pool->next >= pool->merged + pool->window)) {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        }
+        if (pool->next >= pool->count) {
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+        index = pool->next++;
+        pthread_mutex_unlock(&pool->mutex);
+
+        ec = pool->worker(index, pool->arg);
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->ec[index] = ec;
+        pool->done[index] = true;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    return NULL;
+}
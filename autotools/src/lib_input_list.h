@@ -0,0 +1,104 @@
+/**
+ * @file lib_input_list.h
+ * @brief Input list of pt_* tools: files, glob patterns and directories, ordered by first timestamp,
+ *        and a worker pool processing files concurrently while results are merged in order
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ * Ref:
+ * 1. https://man7.org/linux/man-pages/man3/glob.3.html
+ * 2. https://man7.org/linux/man-pages/man3/scandir.3.html
+*/
+
+#ifndef INPUT_LIST_H
+#define INPUT_LIST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lib_error.h"
+#include "lib_pcap_mmap.h"
+
+#define INPUT_MAX_OPTIONS       64          /* maximum "-i" options of one command */
+#define INPUT_EMPTY_TIMESTAMP   UINT64_MAX  /* first timestamp of trace without packet, ordered last */
+
+/**
+ * @brief Expanded input files
+ */
+typedef struct {
+    char      **paths;          ///< file paths, ordered by first timestamp after input_list_sort
+    uint64_t   *first_nsec;     ///< timestamp of first packet of each file (nsec), valid after input_list_sort
+    size_t      count;          ///< number of files
+    size_t      capacity;       ///< allocated entries
+} input_list_t;
+
+/**
+ * @brief Worker of input pool, process one file and keep its result until merged
+ * @param index Index of file in input list
+ * @param arg User argument
+ * @return Error code
+ */
+typedef ec_t (*input_worker_t) (size_t index, void *arg);
+
+/**
+ * @brief Merger of input pool, called on the calling thread in file order
+ * @param index Index of file in input list
+ * @param arg User argument
+ * @return Error code
+ */
+typedef ec_t (*input_merger_t) (size_t index, void *arg);
+
+/**
+ * @brief Check if path is a trace file accepted by pt_* tools
+ * @param path File path or libtrace URI
+ * @return true if path contains ".pcap" or ".erf"
+ */
+bool input_is_trace_file (const char *path);
+
+/**
+ * @brief Add value of one "-i" option to input list
+ * @param list Input list, zero initialized before first call
+ * @param value File path, glob pattern, or directory of trace files
+ * @return Error code
+ * @details Trace files of a directory are added in name order, files not looking like trace are skipped
+ */
+ec_t input_list_add (input_list_t *list, const char *value);
+
+/**
+ * @brief Read timestamp of first packet of every file, and order files by it
+ * @param list Input list
+ * @param reader Reader used to read first packet
+ * @return Error code
+ * @details Processing files in this order is the same as processing one concatenated trace,
+ *          files with same first timestamp keep their order on command line
+ */
+ec_t input_list_sort (input_list_t *list, reader_t reader);
+
+/**
+ * @brief Free input list
+ * @param list Input list
+ * @return void
+ */
+void input_list_free (input_list_t *list);
+
+/**
+ * @brief Read timestamp of first packet of trace file
+ * @param path File path or libtrace URI
+ * @param reader Reader used to read first packet
+ * @param first_nsec Timestamp of first packet (nsec), INPUT_EMPTY_TIMESTAMP if trace has no packet
+ * @return Error code
+ */
+ec_t input_get_first_timestamp (const char *path, reader_t reader, uint64_t *first_nsec);
+
+/**
+ * @brief Process files on worker threads and merge their results in file order
+ * @param count Number of files
+ * @param threads Number of worker threads
+ * @param worker Worker, called once for each file on a worker thread
+ * @param merger Merger, called once for each file on calling thread, in file order
+ * @param arg User argument passed to worker and merger
+ * @return Error code of first failed worker or merger
+ * @details Workers run at most 2 * threads files ahead of merger, so unmerged results are bounded
+ */
+ec_t input_pool_run (size_t count, int threads, input_worker_t worker, input_merger_t merger, void *arg);
+
+#endif // INPUT_LIST_H
@@ -0,0 +1,30 @@
+/*
+ * @file lib_interval_bin.c
+ * @brief Fixed-point nanosecond interval binning library source file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "lib_interval_bin.h"
+
+ec_t interval_bin_init (interval_bin_t *bin, double time_interval) {
+    /* params */
+    double      interval_nsec = round(time_interval * (double) NSEC_PER_SEC);   /* interval (nsec) */
+
+    bin->origin_nsec = 0;
+    bin->interval_nsec = 0;
+    bin->shift = 0;
+    bin->pow2 = false;
+    /* the only floating point conversion, rounding avoids 0.001 becoming 999999 nsec */
+    if (!(interval_nsec >= 1) || (interval_nsec >= (double) UINT64_MAX)) {
+        return EC_CLI_INVALID_TIME_INTERVAL;
+    }
+    bin->interval_nsec = (uint64_t) interval_nsec;
+    if ((bin->interval_nsec & (bin->interval_nsec - 1)) == 0) {
+        bin->pow2 = true;
+        bin->shift = (uint32_t) __builtin_ctzll(bin->interval_nsec);
+    }
+    return EC_SUCCESS;
+}
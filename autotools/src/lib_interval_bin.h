@@ -0,0 +1,102 @@
+/**
+ * @file lib_interval_bin.h
+ * @brief Fixed-point nanosecond interval binning kernel
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ * @details
+ * Timestamps and interval are 64-bit nanosecond ticks, interval index of a packet is one division,
+ * or one shift if the interval is a power of two nanoseconds.
+ * Interval k covers (origin + k * interval, origin + (k + 1) * interval],
+ * a packet exactly on the boundary belongs to the ending interval,
+ * packets not later than origin belong to interval 0.
+*/
+
+#ifndef INTERVAL_BIN_H
+#define INTERVAL_BIN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "lib_error.h"
+
+#define NSEC_PER_SEC    ((uint64_t) 1000000000) /* nanoseconds per second */
+
+/**
+ * @brief Interval binning state, read-only once origin is set
+ */
+typedef struct {
+    uint64_t    origin_nsec;            ///< start of interval 0, timestamp of first packet
+    uint64_t    interval_nsec;          ///< interval length (nsec)
+    uint32_t    shift;                  ///< log2(interval_nsec), valid if pow2
+    bool        pow2;                   ///< interval_nsec is a power of two
+} interval_bin_t;
+
+/**
+ * @brief Convert interval in seconds to nanosecond ticks, rounded to the nearest nanosecond
+ * @param bin Binning state to initialize, origin is set to 0
+ * @param time_interval Time interval (sec)
+ * @return EC_SUCCESS or EC_CLI_INVALID_TIME_INTERVAL if interval is shorter than 1 nsec
+ */
+ec_t interval_bin_init (interval_bin_t *bin, double time_interval);
+
+/**
+ * @brief Convert timespec to nanoseconds since epoch
+ * @param ts Timestamp
+ * @return Timestamp (nsec)
+ */
+static inline uint64_t timespec_to_nsec (struct timespec ts) {
+    return (uint64_t) ts.tv_sec * NSEC_PER_SEC + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * @brief Offset of timestamp from origin, shifted by one so the boundary belongs to the ending interval
+ * @param bin Binning state
+ * @param time_nsec Timestamp (nsec)
+ * @return Offset (nsec), 0 for timestamps not later than origin
+ */
+static inline uint64_t interval_bin_offset (const interval_bin_t *bin, uint64_t time_nsec) {
+    return (time_nsec > bin->origin_nsec) ? time_nsec - bin->origin_nsec - 1 : 0;
+}
+
+/**
+ * @brief Interval index with one division, any interval length
+ * @param bin Binning state
+ * @param time_nsec Timestamp (nsec)
+ * @return Interval index
+ */
+static inline uint64_t interval_bin_index_div (const interval_bin_t *bin, uint64_t time_nsec) {
+    return interval_bin_offset(bin, time_nsec) / bin->interval_nsec;
+}
+
+/**
+ * @brief Interval index with one shift, interval length must be a power of two nanoseconds
+ * @param bin Binning state
+ * @param time_nsec Timestamp (nsec)
+ * @return Interval index
+ */
+static inline uint64_t interval_bin_index_pow2 (const interval_bin_t *bin, uint64_t time_nsec) {
+    return interval_bin_offset(bin, time_nsec) >> bin->shift;
+}
+
+/**
+ * @brief Interval index, shift if possible, otherwise division
+ * @param bin Binning state
+ * @param time_nsec Timestamp (nsec)
+ * @return Interval index
+ * @details The branch never changes within one trace, so it is always predicted
+ */
+static inline uint64_t interval_bin_index (const interval_bin_t *bin, uint64_t time_nsec) {
+    return bin->pow2 ? interval_bin_index_pow2(bin, time_nsec) : interval_bin_index_div(bin, time_nsec);
+}
+
+/**
+ * @brief End boundary of interval, timestamp printed for the interval
+ * @param bin Binning state
+ * @param index Interval index
+ * @return End of interval (nsec)
+ */
+static inline uint64_t interval_bin_end (const interval_bin_t *bin, uint64_t index) {
+    return bin->origin_nsec + (index + 1) * bin->interval_nsec;
+}
+
+#endif // INTERVAL_BIN_H
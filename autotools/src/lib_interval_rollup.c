@@ -0,0 +1,68 @@
+/*
+ * @file lib_interval_rollup.c
+ * @brief Multi-resolution interval aggregation library source file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "lib_interval_rollup.h"
+
+ec_t rollup_init (rollup_t *rollup, const uint64_t *interval_nsec, uint32_t levels, uint32_t width, rollup_writer_t writer, void *arg) {
+    /* params */
+    uint32_t level;     /* level iterator */
+
+    memset(rollup, 0, sizeof(rollup_t));
+    if ((levels == 0) || (levels > ROLLUP_MAX_LEVELS) || (width == 0) || (width > ROLLUP_MAX_WIDTH)) {
+        return EC_CLI_INVALID_TIME_INTERVAL;
+    }
+    for (level=0; level<levels; level++) {
+        rollup->interval_nsec[level] = interval_nsec[level];
+        rollup->ratio[level] = 1;
+        if (level == 0) {
+            continue;
+        }
+        /* a coarser interval must end on a boundary of the previous level, otherwise it can not be rolled up */
+        if ((interval_nsec[level] <= interval_nsec[level - 1]) || (interval_nsec[level] % interval_nsec[level - 1] != 0)) {
+            fprintf(stderr, "Interval %" PRIu64 " nsec is not a multiple of %" PRIu64 " nsec\n", interval_nsec[level], interval_nsec[level - 1]);
+            return EC_CLI_INVALID_TIME_INTERVAL;
+        }
+        rollup->ratio[level] = interval_nsec[level] / interval_nsec[level - 1];
+    }
+    rollup->levels = levels;
+    rollup->width = width;
+    rollup->writer = writer;
+    rollup->arg = arg;
+    return EC_SUCCESS;
+}
+
+void rollup_push (rollup_t *rollup, uint64_t end_nsec, const uint64_t *count) {
+    /* params */
+    uint32_t level;     /* level iterator */
+    uint32_t i;         /* counter iterator */
+
+    rollup->writer(0, end_nsec, count, rollup->arg);
+    /* carry finished interval up, stop at the first level whose interval is still open */
+    for (level=1; level<rollup->levels; level++) {
+        for (i=0; i<rollup->width; i++) {
+            rollup->count[level][i] += count[i];
+        }
+        if (level > 1) {
+            /* previous level is carried, start its next interval */
+            memset(rollup->count[level - 1], 0, sizeof(rollup->count[level - 1]));
+        }
+        rollup->filled[level]++;
+        if (rollup->filled[level] < rollup->ratio[level]) {
+            return;
+        }
+        rollup->writer(level, end_nsec, rollup->count[level], rollup->arg);
+        rollup->filled[level] = 0;
+        count = rollup->count[level];
+    }
+    /* every level is closed */
+    memset(rollup->count[rollup->levels - 1], 0, sizeof(rollup->count[rollup->levels - 1]));
+    return;
+}
@@ -0,0 +1,69 @@
+/**
+ * @file lib_interval_rollup.h
+ * @brief Multi-resolution interval aggregation: only the finest level is counted per packet,
+ *        each finished interval is rolled up into the coarser levels as they close
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ * @details
+ * Every level is aligned to the same origin, and each interval is an integer multiple of the previous level,
+ * so interval m of level l covers exactly ratio intervals of level l-1 and ends on the same nanosecond as the last one.
+ * Each level is therefore identical to a separate run at its own interval, including the empty intervals
+ * and the last incomplete interval, which is never written.
+*/
+
+#ifndef INTERVAL_ROLLUP_H
+#define INTERVAL_ROLLUP_H
+
+#include <stdint.h>
+
+#include "lib_error.h"
+
+#define ROLLUP_MAX_LEVELS       8           /* maximum resolutions of one aggregator */
+#define ROLLUP_MAX_WIDTH        16          /* maximum counters of one interval */
+
+/**
+ * @brief Writer of finished interval
+ * @param level Level, 0 is the finest
+ * @param end_nsec End of interval (nsec)
+ * @param count Counters of interval
+ * @param arg User argument
+ * @return void
+ */
+typedef void (*rollup_writer_t) (uint32_t level, uint64_t end_nsec, const uint64_t *count, void *arg);
+
+/**
+ * @brief Multi-resolution aggregator
+ */
+typedef struct {
+    uint32_t        levels;                                     ///< number of levels
+    uint32_t        width;                                      ///< counters of one interval
+    uint64_t        interval_nsec[ROLLUP_MAX_LEVELS];           ///< interval of each level (nsec)
+    uint64_t        ratio[ROLLUP_MAX_LEVELS];                   ///< intervals of previous level in one interval, 1 for level 0
+    uint64_t        filled[ROLLUP_MAX_LEVELS];                  ///< intervals of previous level added to current interval
+    uint64_t        count[ROLLUP_MAX_LEVELS][ROLLUP_MAX_WIDTH]; ///< counters of current interval of each coarser level
+    rollup_writer_t writer;                                     ///< writer of finished intervals
+    void           *arg;                                        ///< user argument of writer
+} rollup_t;
+
+/**
+ * @brief Initialize aggregator
+ * @param rollup Aggregator
+ * @param interval_nsec Interval of each level (nsec), finest first
+ * @param levels Number of levels
+ * @param width Counters of one interval
+ * @param writer Writer of finished intervals
+ * @param arg User argument of writer
+ * @return EC_SUCCESS, or EC_CLI_INVALID_TIME_INTERVAL if an interval is not a multiple of the previous one
+ */
+ec_t rollup_init (rollup_t *rollup, const uint64_t *interval_nsec, uint32_t levels, uint32_t width, rollup_writer_t writer, void *arg);
+
+/**
+ * @brief Push one finished interval of the finest level, intervals must be pushed in order without gap
+ * @param rollup Aggregator
+ * @param end_nsec End of interval (nsec)
+ * @param count Counters of interval
+ * @return void
+ * @details Interval is written as level 0, and every coarser level whose interval ends with it is written as well
+ */
+void rollup_push (rollup_t *rollup, uint64_t end_nsec, const uint64_t *count);
+
+#endif // INTERVAL_ROLLUP_H
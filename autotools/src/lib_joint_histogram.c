@@ -0,0 +1,262 @@
+/*
+ * @file lib_joint_histogram.c
+ * @brief Size and joint histogram library source file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+
+#include "lib_joint_histogram.h"
+
+#define JOINT_HISTOGRAM_BLOCK 256   /* counters converted to little-endian per write */
+
+/**
+ * @brief Write counters as little-endian
+ * @param file Output file
+ * @param count Counters
+ * @param length Number of counters
+ * @return 0 if success, -1 otherwise
+ */
+static int write_counters (FILE *file, const uint64_t *count, size_t length);
+
+/**
+ * @brief Read little-endian counters
+ * @param file Input file
+ * @param count Counters
+ * @param length Number of counters
+ * @return 0 if success, -1 if file ends
+ */
+static int read_counters (FILE *file, uint64_t *count, size_t length);
+
+/**
+ * @brief Packet callback of stage, count size of every packet, paired with IAT from the second packet on
+ * @param packet Decoded packet
+ * @param arg Joint stage
+ * @return void
+ */
+static void joint_packet (const pipeline_packet_t *packet, void *arg);
+
+ec_t joint_histogram_init (joint_histogram_t *histogram) {
+    memset(histogram, 0, sizeof(joint_histogram_t));
+    /* both sizes are multiples of the alignment as aligned_alloc requires */
+    histogram->size = (uint64_t *) aligned_alloc(JOINT_HISTOGRAM_ALIGN, JOINT_SIZE_BINS * sizeof(uint64_t));
+    histogram->joint = (uint64_t *) aligned_alloc(JOINT_HISTOGRAM_ALIGN, JOINT_ROWS * JOINT_COLUMNS * sizeof(uint64_t));
+    if ((histogram->size == NULL) || (histogram->joint == NULL)) {
+        perror("aligned_alloc");
+        return EC_GEN_UNABLE_TO_MALLOC;
+    }
+    memset(histogram->size, 0, JOINT_SIZE_BINS * sizeof(uint64_t));
+    memset(histogram->joint, 0, JOINT_ROWS * JOINT_COLUMNS * sizeof(uint64_t));
+    return EC_SUCCESS;
+}
+
+void joint_histogram_free (joint_histogram_t *histogram) {
+    free(histogram->size);
+    free(histogram->joint);
+    histogram->size = NULL;
+    histogram->joint = NULL;
+    return;
+}
+
+void joint_histogram_merge (joint_histogram_t *dst, const joint_histogram_t *src) {
+    /* params */
+    size_t i;   /* iterator */
+
+    for (i=0; i<JOINT_SIZE_BINS; i++) {
+        dst->size[i] += src->size[i];
+    }
+    for (i=0; i<JOINT_ROWS * JOINT_COLUMNS; i++) {
+        dst->joint[i] += src->joint[i];
+    }
+    dst->packets += src->packets;
+    dst->negative += src->negative;
+    return;
+}
+
+ec_t joint_histogram_write (const joint_histogram_t *histogram, const char *path, uint64_t ticks_per_sec) {
+    /* params */
+    FILE       *file;           /* output file */
+    char        magic[8];       /* file magic */
+    uint32_t    u32[6];         /* version, size bins, size shift, rows, columns, sub bits */
+    uint64_t    u64[4];         /* ticks per second, packets, negative, reserved */
+    int         rc = 0;         /* return code of writes */
+
+    file = fopen(path, "w");
+    if (file == NULL) {
+        perror("fopen");
+        return EC_GEN_UNABLE_TO_OPEN_DATA_FILE;
+    }
+    memset(magic, 0, sizeof(magic));
+    memcpy(magic, "PTJOINT", 7);
+    u32[0] = htole32(JOINT_HISTOGRAM_VERSION);
+    u32[1] = htole32(JOINT_SIZE_BINS);
+    u32[2] = htole32(JOINT_SIZE_SHIFT);
+    u32[3] = htole32(JOINT_ROWS);
+    u32[4] = htole32(JOINT_COLUMNS);
+    u32[5] = htole32(JOINT_SUB_BITS);
+    u64[0] = htole64(ticks_per_sec);
+    u64[1] = htole64(histogram->packets);
+    u64[2] = htole64(histogram->negative);
+    u64[3] = 0;
+    if ((fwrite(magic, 1, sizeof(magic), file) != sizeof(magic)) || (fwrite(u32, sizeof(uint32_t), 6, file) != 6)
+        || (fwrite(u64, sizeof(uint64_t), 4, file) != 4)) {
+        rc = -1;
+    }
+    if (rc == 0) {
+        rc = write_counters(file, histogram->size, JOINT_SIZE_BINS);
+    }
+    if (rc == 0) {
+        rc = write_counters(file, histogram->joint, JOINT_ROWS * JOINT_COLUMNS);
+    }
+    if ((fclose(file) != 0) || (rc != 0)) {
+        perror("fwrite");
+        return EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
+    }
+    return EC_SUCCESS;
+}
+
+/* @brief Read histogram file
+ * @details layout must be the one of this build, counters of another layout can not be merged
+ */
+ec_t joint_histogram_read (joint_histogram_t *histogram, const char *path, uint64_t *ticks_per_sec) {
+    /* params */
+    FILE       *file;                                   /* input file */
+    uint8_t     header[JOINT_HISTOGRAM_HEADER_SIZE];    /* file header */
+    uint32_t    u32[6];                                 /* version, size bins, size shift, rows, columns, sub bits */
+    uint64_t    u64[4];                                 /* ticks per second, packets, negative, reserved */
+    ec_t        ec = EC_SUCCESS;                        /* error code */
+
+    file = fopen(path, "r");
+    if (file == NULL) {
+        perror("fopen");
+        return EC_GEN_UNABLE_TO_OPEN_DATA_FILE;
+    }
+    if ((fread(header, 1, sizeof(header), file) != sizeof(header)) || (memcmp(header, "PTJOINT", 8) != 0)) {
+        ec = EC_GEN_INVALID_JOINT_HISTOGRAM;
+    }
+    if (ec == EC_SUCCESS) {
+        memcpy(u32, header + 8, sizeof(u32));
+        memcpy(u64, header + 8 + sizeof(u32), sizeof(u64));
+        if ((le32toh(u32[0]) != JOINT_HISTOGRAM_VERSION) || (le32toh(u32[1]) != JOINT_SIZE_BINS) || (le32toh(u32[2]) != JOINT_SIZE_SHIFT)
+            || (le32toh(u32[3]) != JOINT_ROWS) || (le32toh(u32[4]) != JOINT_COLUMNS) || (le32toh(u32[5]) != JOINT_SUB_BITS)) {
+            ec = EC_GEN_INVALID_JOINT_HISTOGRAM;
+        }
+    }
+    if (ec == EC_SUCCESS) {
+        *ticks_per_sec = le64toh(u64[0]);
+        histogram->packets = le64toh(u64[1]);
+        histogram->negative = le64toh(u64[2]);
+        if ((read_counters(file, histogram->size, JOINT_SIZE_BINS) != 0)
+            || (read_counters(file, histogram->joint, JOINT_ROWS * JOINT_COLUMNS) != 0)) {
+            ec = EC_GEN_INVALID_JOINT_HISTOGRAM;
+        }
+    }
+    fclose(file);
+    return ec;
+}
+
+void joint_stage_init (joint_stage_t *joint) {
+    memset(joint, 0, sizeof(joint_stage_t));
+    return;
+}
+
+ec_t joint_option (int argc, char *argv[], int *i, void *arg) {
+    /* params */
+    joint_stage_t  *joint = (joint_stage_t *) arg;
+    ec_t            ec = EC_SUCCESS;    /* error code */
+
+    if ((strcmp(argv[*i], "-J") == 0) || (strcmp(argv[*i], "--joint-histogram") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            joint->path = argv[*i];
+        } else {
+            ec = EC_CLI_NO_JOINT_HISTOGRAM_VALUE;
+        }
+    } else {
+        ec = EC_CLI_UNKNOWN_OPTION;
+    }
+    return ec;
+}
+
+/* @brief Register joint stage
+ * @details counted by each chunk and added by merger in multi-threaded mode, size and joint counters are not saved in checkpoint
+ */
+ec_t joint_register (joint_stage_t *joint, pipeline_t *pipeline, bool nsec) {
+    /* params */
+    pipeline_stage_t    stage;      /* stage registered to pipeline */
+
+    if (joint->path == NULL) {
+        return EC_SUCCESS;
+    }
+    joint->nsec = nsec;
+    memset(&stage, 0, sizeof(pipeline_stage_t));
+    stage.name = "joint";
+    stage.caps = PIPELINE_CAN_THREADS;
+    stage.unsupported = EC_CLI_INVALID_JOINT_HISTOGRAM;
+    stage.arg = joint;
+    stage.packet = joint_packet;
+    return pipeline_add_stage(pipeline, &stage);
+}
+
+ec_t joint_start (joint_stage_t *joint, bool verbose) {
+    if (verbose) {
+        fprintf(stderr, "Joint histogram: %u size bins and %u x %u (size, IAT) buckets, %zu KB\n", JOINT_SIZE_BINS, JOINT_ROWS, JOINT_COLUMNS,
+                (JOINT_SIZE_BINS + JOINT_ROWS * JOINT_COLUMNS) * sizeof(uint64_t) / 1024);
+    }
+    return joint_histogram_init(&joint->histogram);
+}
+
+ec_t joint_write (const joint_stage_t *joint) {
+    return joint_histogram_write(&joint->histogram, joint->path, pipeline_ticks_per_sec(joint->nsec));
+}
+
+static int write_counters (FILE *file, const uint64_t *count, size_t length) {
+    /* params */
+    uint64_t    block[JOINT_HISTOGRAM_BLOCK];   /* counters converted to little-endian */
+    size_t      size;                           /* counters of block */
+    size_t      i;                              /* iterator */
+
+    while (length != 0) {
+        size = (length < JOINT_HISTOGRAM_BLOCK) ? length : JOINT_HISTOGRAM_BLOCK;
+        for (i=0; i<size; i++) {
+            block[i] = htole64(count[i]);
+        }
+        if (fwrite(block, sizeof(uint64_t), size, file) != size) {
+            return -1;
+        }
+        count += size;
+        length -= size;
+    }
+    return 0;
+}
+
+static int read_counters (FILE *file, uint64_t *count, size_t length) {
+    /* params */
+    size_t i;   /* iterator */
+
+    if (fread(count, sizeof(uint64_t), length, file) != length) {
+        return -1;
+    }
+    for (i=0; i<length; i++) {
+        count[i] = le64toh(count[i]);
+    }
+    return 0;
+}
+
+static void joint_packet (const pipeline_packet_t *packet, void *arg) {
+    /* params */
+    joint_stage_t  *joint = (joint_stage_t *) arg;
+    uint64_t        ts = pipeline_ticks(packet->ts, joint->nsec);  /* packet timestamp (tick) */
+
+    if (joint->started) {
+        joint_histogram_packet(&joint->histogram, packet->wire_length, pipeline_iat(joint->last, ts));
+    } else {
+        joint_histogram_size(&joint->histogram, packet->wire_length);
+    }
+    joint->started = true;
+    joint->last = ts;
+    return;
+}
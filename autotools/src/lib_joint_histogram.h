@@ -0,0 +1,234 @@
+/**
+ * @file lib_joint_histogram.h
+ * @brief Packet size histogram and joint (size, IAT) histogram, counted in the same per-packet pass as IAT
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ * @details
+ * Size histogram counts wire length in bins of 2^JOINT_SIZE_SHIFT bytes, the last bin also counts every larger packet.
+ * Joint histogram is a matrix of JOINT_ROWS size buckets by JOINT_COLUMNS IAT buckets, the IAT of a packet is paired
+ * with its own size. Both axes are log buckets with 2^JOINT_SUB_BITS linear sub-buckets per power of 2:
+ * values below 2^JOINT_SUB_BITS have a bucket each, value v above has bucket (b - JOINT_SUB_BITS + 1) * 2^JOINT_SUB_BITS
+ * plus the JOINT_SUB_BITS bits below its highest bit b, so a bucket is at most 25% wide and found with one clz.
+ * The last row and column also count every larger value, rows reach 128 KB and columns 2^49 ticks (6.5 days in nsec).
+ * Matrix is one flat row-major array, rows are whole cache lines and the array is 64-byte aligned,
+ * so a packet is two increments in a few hundred KB. Histograms are merged by adding counters,
+ * chunks of multi-threaded mode are merged in trace order with the IAT across chunk boundary added by the merger.
+ * Joint stage counts the packets of a pipeline, option "-J" is parsed by joint_option.
+ * File is little-endian:
+ *   char     magic[8]          "PTJOINT", zero padded
+ *   uint32_t version           JOINT_HISTOGRAM_VERSION
+ *   uint32_t size_bins         JOINT_SIZE_BINS
+ *   uint32_t size_shift        JOINT_SIZE_SHIFT, size bin i counts wire length of [i, i + 1) * 2^size_shift bytes
+ *   uint32_t rows              JOINT_ROWS
+ *   uint32_t columns           JOINT_COLUMNS
+ *   uint32_t sub_bits          JOINT_SUB_BITS
+ *   uint64_t ticks_per_sec     tick of IAT
+ *   uint64_t packets           packets counted in size histogram
+ *   uint64_t negative          packets of negative IAT, counted in size histogram only
+ *   uint64_t reserved          0
+ * followed by size_bins uint64_t counters of size histogram and rows * columns uint64_t counters of joint histogram,
+ * row-major, so the matrix can be mmap-ed or read by numpy.fromfile with offset 64 + 8 * size_bins.
+ * Ref:
+ * 1. https://hdrhistogram.github.io/HdrHistogram/
+ * 2. https://en.wikipedia.org/wiki/Row-_and_column-major_order
+*/
+
+#ifndef JOINT_HISTOGRAM_H
+#define JOINT_HISTOGRAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "lib_error.h"
+#include "lib_pipeline.h"
+
+#define JOINT_HISTOGRAM_VERSION     1           /* version of file header */
+#define JOINT_HISTOGRAM_HEADER_SIZE 64          /* size of file header (byte) */
+#define JOINT_HISTOGRAM_ALIGN       64          /* alignment of counter arrays, one cache line (byte) */
+#define JOINT_SIZE_SHIFT            0           /* size bin is 2^JOINT_SIZE_SHIFT bytes wide */
+#define JOINT_SIZE_BINS             2048        /* size bins, 16 KB, last bin counts jumbo frames */
+#define JOINT_SUB_BITS              2           /* linear sub-buckets per power of 2 are 2^JOINT_SUB_BITS */
+#define JOINT_ROWS                  64          /* size buckets, up to 2^17 bytes */
+#define JOINT_COLUMNS               192         /* IAT buckets, up to 2^49 ticks, 24 cache lines per row */
+
+/**
+ * @brief Size and joint histogram
+ */
+typedef struct {
+    uint64_t   *size;           ///< JOINT_SIZE_BINS counters of wire length, 64-byte aligned
+    uint64_t   *joint;          ///< JOINT_ROWS x JOINT_COLUMNS counters of (size, IAT), row-major, 64-byte aligned
+    uint64_t    packets;        ///< packets counted in size histogram
+    uint64_t    negative;       ///< packets of negative IAT, not counted in joint histogram
+} joint_histogram_t;
+
+/**
+ * @brief Size and joint (size, IAT) histogram stage
+ */
+typedef struct {
+    const char         *path;           ///< "-J" matrix file, NULL if not counted
+    bool                nsec;           ///< tick is nanosecond, otherwise microsecond, set by joint_register
+    joint_histogram_t   histogram;      ///< size and joint histogram
+    bool                started;        ///< a packet is counted, last is valid
+    uint64_t            last;           ///< timestamp of previous packet (tick)
+} joint_stage_t;
+
+/**
+ * @brief Allocate zeroed histogram
+ * @param histogram Histogram
+ * @return EC_SUCCESS or EC_GEN_UNABLE_TO_MALLOC
+ */
+ec_t joint_histogram_init (joint_histogram_t *histogram);
+
+/**
+ * @brief Free histogram
+ * @param histogram Histogram
+ * @return void
+ */
+void joint_histogram_free (joint_histogram_t *histogram);
+
+/**
+ * @brief Add every counter of src to dst
+ * @param dst Histogram merged into
+ * @param src Histogram merged from, left as it is
+ * @return void
+ */
+void joint_histogram_merge (joint_histogram_t *dst, const joint_histogram_t *src);
+
+/**
+ * @brief Write histogram file
+ * @param histogram Histogram
+ * @param path Output path
+ * @param ticks_per_sec Tick of IAT
+ * @return EC_SUCCESS, EC_GEN_UNABLE_TO_OPEN_DATA_FILE or EC_GEN_UNABLE_TO_WRITE_DATA_FILE
+ */
+ec_t joint_histogram_write (const joint_histogram_t *histogram, const char *path, uint64_t ticks_per_sec);
+
+/**
+ * @brief Read histogram file into an initialized histogram, e.g. to merge histograms of several runs
+ * @param histogram Histogram, counters are replaced
+ * @param path Input path
+ * @param ticks_per_sec Tick of IAT
+ * @return EC_SUCCESS, EC_GEN_UNABLE_TO_OPEN_DATA_FILE or EC_GEN_INVALID_JOINT_HISTOGRAM
+ */
+ec_t joint_histogram_read (joint_histogram_t *histogram, const char *path, uint64_t *ticks_per_sec);
+
+/**
+ * @brief Log bucket of value
+ * @param value Value
+ * @param buckets Number of buckets, larger values are counted in the last one
+ * @return Bucket
+ */
+static inline uint32_t joint_histogram_bucket (uint64_t value, uint32_t buckets) {
+    /* params */
+    uint32_t    high;           /* highest bit of value */
+    uint32_t    bucket;         /* bucket of value */
+
+    if (value < (1U << JOINT_SUB_BITS)) {
+        return (uint32_t) value;
+    }
+    high = (uint32_t) (63 - __builtin_clzll(value));
+    bucket = ((high - JOINT_SUB_BITS + 1) << JOINT_SUB_BITS) + (uint32_t) ((value >> (high - JOINT_SUB_BITS)) & ((1U << JOINT_SUB_BITS) - 1));
+    return (bucket < buckets) ? bucket : buckets - 1;
+}
+
+/**
+ * @brief Lowest value of log bucket
+ * @param bucket Bucket
+ * @return Lowest value
+ */
+static inline uint64_t joint_histogram_lowest (uint32_t bucket) {
+    if (bucket < (1U << JOINT_SUB_BITS)) {
+        return bucket;
+    }
+    return (uint64_t) ((1U << JOINT_SUB_BITS) | (bucket & ((1U << JOINT_SUB_BITS) - 1))) << ((bucket >> JOINT_SUB_BITS) - 1);
+}
+
+/**
+ * @brief Count size of packet whose IAT is not known, the first packet of trace or chunk
+ * @param histogram Histogram
+ * @param wire_length Packet length on wire (byte)
+ * @return void
+ * @details Inlined as it is called once per packet
+ */
+static inline void joint_histogram_size (joint_histogram_t *histogram, uint32_t wire_length) {
+    /* params */
+    uint32_t    bin = wire_length >> JOINT_SIZE_SHIFT;  /* size bin */
+
+    histogram->size[(bin < JOINT_SIZE_BINS) ? bin : JOINT_SIZE_BINS - 1]++;
+    histogram->packets++;
+    return;
+}
+
+/**
+ * @brief Count (size, IAT) pair only, size of packet is already counted
+ * @param histogram Histogram
+ * @param wire_length Packet length on wire (byte)
+ * @param iat IAT ending at packet (tick)
+ * @return void
+ * @details Inlined as it is called once per packet
+ */
+static inline void joint_histogram_pair (joint_histogram_t *histogram, uint32_t wire_length, long int iat) {
+    if (iat < 0) {
+        histogram->negative++;
+        return;
+    }
+    histogram->joint[joint_histogram_bucket(wire_length, JOINT_ROWS) * JOINT_COLUMNS + joint_histogram_bucket((uint64_t) iat, JOINT_COLUMNS)]++;
+    return;
+}
+
+/**
+ * @brief Count size and (size, IAT) pair of packet
+ * @param histogram Histogram
+ * @param wire_length Packet length on wire (byte)
+ * @param iat IAT ending at packet (tick)
+ * @return void
+ * @details Inlined as it is called once per packet
+ */
+static inline void joint_histogram_packet (joint_histogram_t *histogram, uint32_t wire_length, long int iat) {
+    joint_histogram_size(histogram, wire_length);
+    joint_histogram_pair(histogram, wire_length, iat);
+    return;
+}
+
+/**
+ * @brief Initialize stage
+ * @param joint Joint stage
+ * @return void
+ */
+void joint_stage_init (joint_stage_t *joint);
+
+/**
+ * @brief Option parser of stage: -J
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @param i Index of option, moved to its value if it takes one
+ * @param arg Joint stage
+ * @return EC_SUCCESS, error of option, or EC_CLI_UNKNOWN_OPTION
+ */
+ec_t joint_option (int argc, char *argv[], int *i, void *arg);
+
+/**
+ * @brief Register stage if enabled
+ * @param joint Joint stage
+ * @param pipeline Pipeline
+ * @param nsec Tick is nanosecond, otherwise microsecond
+ * @return Error code
+ */
+ec_t joint_register (joint_stage_t *joint, pipeline_t *pipeline, bool nsec);
+
+/**
+ * @brief Allocate size and joint histogram
+ * @param joint Joint stage
+ * @param verbose Print size of histogram
+ * @return Error code
+ */
+ec_t joint_start (joint_stage_t *joint, bool verbose);
+
+/**
+ * @brief Write histogram of stage to its matrix file
+ * @param joint Joint stage
+ * @return Error code
+ */
+ec_t joint_write (const joint_stage_t *joint);
+
+#endif // JOINT_HISTOGRAM_H
@@ -0,0 +1,82 @@
+/*
+ * @file lib_log_histogram.c
+ * @brief Log-linear histogram library source file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "lib_log_histogram.h"
+
+ec_t log_histogram_init (log_histogram_t *histogram, uint32_t significant_digits, uint64_t highest) {
+    /* params */
+    uint64_t sub_buckets = 2;   /* sub-buckets needed for significant digits, 2 * 10^digits */
+    uint32_t i;                 /* iterator */
+
+    memset(histogram, 0, sizeof(log_histogram_t));
+    if ((significant_digits < LOG_HISTOGRAM_MIN_DIGITS) || (significant_digits > LOG_HISTOGRAM_MAX_DIGITS)) {
+        return EC_CLI_INVALID_LOG_DIGITS;
+    }
+    /* the upper half of a bucket must still keep the digits, so the whole bucket has twice as many sub-buckets */
+    for (i=0; i<significant_digits; i++) {
+        sub_buckets *= 10;
+    }
+    histogram->significant_digits = significant_digits;
+    histogram->sub_bucket_bits = (uint32_t) (64 - __builtin_clzll(sub_buckets - 1));
+    histogram->half_bits = histogram->sub_bucket_bits - 1;
+    histogram->sub_bucket_mask = (UINT64_C(1) << histogram->sub_bucket_bits) - 1;
+    histogram->length = log_histogram_index(histogram, highest) + 1;
+    histogram->highest = log_histogram_highest(histogram, histogram->length - 1);
+    return EC_SUCCESS;
+}
+
+uint64_t log_histogram_lowest (const log_histogram_t *histogram, size_t index) {
+    /* params */
+    uint32_t bucket;    /* power-of-2 bucket */
+
+    if (index <= histogram->sub_bucket_mask) {
+        return (uint64_t) index;
+    }
+    bucket = (uint32_t) (index >> histogram->half_bits) - 1;
+    return (uint64_t) (index - ((size_t) bucket << histogram->half_bits)) << bucket;
+}
+
+uint64_t log_histogram_highest (const log_histogram_t *histogram, size_t index) {
+    /* params */
+    uint32_t bucket;    /* power-of-2 bucket */
+
+    if (index <= histogram->sub_bucket_mask) {
+        return (uint64_t) index;
+    }
+    bucket = (uint32_t) (index >> histogram->half_bits) - 1;
+    return log_histogram_lowest(histogram, index) + (UINT64_C(1) << bucket) - 1;
+}
+
+uint64_t log_histogram_percentile (const log_histogram_t *histogram, const uint64_t *count, double percentile) {
+    /* params */
+    uint64_t    total = 0;  /* recorded values */
+    uint64_t    rank;       /* values at or below percentile */
+    uint64_t    seen = 0;   /* values in counters so far */
+    size_t      i;          /* iterator */
+
+    for (i=0; i<histogram->length; i++) {
+        total += count[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    rank = (uint64_t) ceil(percentile / 100.0 * (double) total);
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (i=0; i<histogram->length; i++) {
+        seen += count[i];
+        if (seen >= rank) {
+            return log_histogram_highest(histogram, i);
+        }
+    }
+    return histogram->highest;
+}
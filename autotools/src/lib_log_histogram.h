@@ -0,0 +1,90 @@
+/**
+ * @file lib_log_histogram.h
+ * @brief Log-linear (HDR-style) histogram layout: bounded relative error over a range of many orders of magnitude
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ * @details
+ * Values are split into buckets of power-of-2 magnitude, and every bucket into the same number of linear sub-buckets,
+ * enough to keep the given significant decimal digits, so the width of a counter is at most 10^-digits of its value.
+ * Bucket 0 holds values below the sub-bucket count with width 1, bucket b > 0 holds the upper half of its sub-buckets
+ * with width 2^b. Counter index is found with one clz and one shift, no loop and no floating point.
+ * This header only describes the layout, counters are a plain uint64_t array owned by the caller,
+ * so they are merged by adding arrays and saved like any other histogram.
+ * Memory of values up to 2^44 (about 4.9 hours in nsec, 203 days in usec): 1 digit 5 KB, 2 digits 38 KB, 3 digits 280 KB.
+ * Ref:
+ * 1. https://hdrhistogram.github.io/HdrHistogram/
+ * 2. https://github.com/HdrHistogram/HdrHistogram_c/blob/main/src/hdr_histogram.c
+*/
+
+#ifndef LOG_HISTOGRAM_H
+#define LOG_HISTOGRAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "lib_error.h"
+
+#define LOG_HISTOGRAM_MIN_DIGITS        1                           /* minimum significant digits */
+#define LOG_HISTOGRAM_MAX_DIGITS        5                           /* maximum significant digits */
+#define LOG_HISTOGRAM_DEFAULT_HIGHEST   ((UINT64_C(1) << 44) - 1)   /* default highest trackable value */
+
+/**
+ * @brief Layout of log-linear histogram
+ */
+typedef struct {
+    uint32_t    significant_digits;     ///< significant decimal digits kept by every counter
+    uint32_t    sub_bucket_bits;        ///< log2 of sub-buckets of bucket 0
+    uint32_t    half_bits;              ///< log2 of sub-buckets of bucket b > 0, sub_bucket_bits - 1
+    uint64_t    sub_bucket_mask;        ///< sub-buckets of bucket 0 minus 1
+    uint64_t    highest;                ///< highest trackable value, end of the last counter
+    size_t      length;                 ///< number of counters
+} log_histogram_t;
+
+/**
+ * @brief Initialize layout
+ * @param histogram Layout
+ * @param significant_digits Significant decimal digits, LOG_HISTOGRAM_MIN_DIGITS to LOG_HISTOGRAM_MAX_DIGITS
+ * @param highest Highest value to track, rounded up to the end of its counter
+ * @return EC_SUCCESS or EC_CLI_INVALID_LOG_DIGITS
+ */
+ec_t log_histogram_init (log_histogram_t *histogram, uint32_t significant_digits, uint64_t highest);
+
+/**
+ * @brief Get counter index of value
+ * @param histogram Layout
+ * @param value Value
+ * @return Index, length or more if value is above highest
+ */
+static inline size_t log_histogram_index (const log_histogram_t *histogram, uint64_t value) {
+    /* params */
+    uint32_t bucket;    /* power-of-2 bucket, 0 for values below sub-bucket count */
+
+    bucket = (uint32_t) (63 - __builtin_clzll(value | histogram->sub_bucket_mask)) - histogram->half_bits;
+    return ((size_t) bucket << histogram->half_bits) + (size_t) (value >> bucket);
+}
+
+/**
+ * @brief Get lowest value of counter
+ * @param histogram Layout
+ * @param index Counter index
+ * @return Lowest value counted by index
+ */
+uint64_t log_histogram_lowest (const log_histogram_t *histogram, size_t index);
+
+/**
+ * @brief Get highest value of counter
+ * @param histogram Layout
+ * @param index Counter index
+ * @return Highest value counted by index
+ */
+uint64_t log_histogram_highest (const log_histogram_t *histogram, size_t index);
+
+/**
+ * @brief Get value at percentile
+ * @param histogram Layout
+ * @param count Counters, length of layout
+ * @param percentile Percentile, 0 to 100
+ * @return Highest value of the counter holding the percentile, 0 if histogram is empty
+ */
+uint64_t log_histogram_percentile (const log_histogram_t *histogram, const uint64_t *count, double percentile);
+
+#endif // LOG_HISTOGRAM_H
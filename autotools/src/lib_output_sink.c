@@ -0,0 +1,231 @@
+/*
+ * @file lib_output_sink.c
+ * @brief Buffered output sink library source file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <endian.h>
+
+#include "lib_output_sink.h"
+
+/**
+ * @brief Write binary or columnar header at current position
+ * @param sink Sink
+ * @param offsets Byte offset of each column array, NULL for binary
+ * @return Error code
+ */
+static ec_t write_header (sink_t *sink, const uint64_t *offsets);
+
+/**
+ * @brief Get header size of binary or columnar file
+ * @param sink Sink
+ * @return Header size (bytes)
+ */
+static size_t get_header_size (const sink_t *sink);
+
+ec_t sink_get_format (const char *path, sink_format_t *format) {
+    const char *extension = strrchr(path, '.');
+    if (extension == NULL) {
+        return EC_CLI_INVALID_OUTPUT_FILE;
+    }
+    if (strcmp(extension, ".csv") == 0) {
+        *format = SINK_FORMAT_CSV;
+    } else if (strcmp(extension, ".bin") == 0) {
+        *format = SINK_FORMAT_BINARY;
+    } else if (strcmp(extension, ".col") == 0) {
+        *format = SINK_FORMAT_COLUMNAR;
+    } else {
+        return EC_CLI_INVALID_OUTPUT_FILE;
+    }
+    return EC_SUCCESS;
+}
+
+ec_t sink_open (sink_t *sink, const char *path, uint32_t column_count, const char * const *names) {
+    /* params */
+    ec_t        ec;     /* error code */
+    uint32_t    i;      /* iterator */
+
+    memset(sink, 0, sizeof(sink_t));
+    ec = sink_get_format(path, &sink->format);
+    if (ec != EC_SUCCESS) {
+        return ec;
+    }
+    if ((column_count == 0) || (column_count > SINK_MAX_COLUMNS)) {
+        return EC_GEN_UNABLE_TO_OPEN_DATA_FILE;
+    }
+    sink->column_count = column_count;
+    for (i=0; i<column_count; i++) {
+        strncpy(sink->names[i], names[i], SINK_COLUMN_NAME_SIZE - 1);
+    }
+
+    /* large stdio buffer turns one record per call into a few large writes */
+    sink->file = fopen(path, "w");
+    if (sink->file == NULL) {
+        perror("fopen");
+        return EC_GEN_UNABLE_TO_OPEN_DATA_FILE;
+    }
+    if (setvbuf(sink->file, NULL, _IOFBF, SINK_BUFFER_SIZE) != 0) {
+        perror("setvbuf");
+    }
+
+    switch (sink->format) {
+        case SINK_FORMAT_CSV:
+            for (i=0; i<column_count; i++) {
+                fprintf(sink->file, "%s%c", sink->names[i], (i + 1 < column_count) ? ',' : '\n');
+            }
+            break;
+        case SINK_FORMAT_BINARY:
+            /* row count is rewritten on close */
+            ec = write_header(sink, NULL);
+            break;
+        case SINK_FORMAT_COLUMNAR:
+            /* columns are spooled to temporary files and concatenated on close,
+             * so the row count does not have to be known in advance
+             */
+            for (i=0; (i<column_count) && (ec==EC_SUCCESS); i++) {
+                sink->columns[i] = tmpfile();
+                if (sink->columns[i] == NULL) {
+                    perror("tmpfile");
+                    ec = EC_GEN_UNABLE_TO_OPEN_DATA_FILE;
+                } else if (setvbuf(sink->columns[i], NULL, _IOFBF, SINK_BUFFER_SIZE) != 0) {
+                    perror("setvbuf");
+                }
+            }
+            break;
+        default:
+            ec = EC_CLI_INVALID_OUTPUT_FILE;
+            break;
+    }
+    if (ferror(sink->file)) {
+        ec = EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
+    }
+    return ec;
+}
+
+ec_t sink_write (sink_t *sink, const uint64_t *values) {
+    /* params */
+    uint64_t    record[SINK_MAX_COLUMNS];   /* little-endian record */
+    uint32_t    i;                          /* iterator */
+
+    switch (sink->format) {
+        case SINK_FORMAT_CSV:
+            for (i=0; i<sink->column_count; i++) {
+                fprintf(sink->file, "%" PRIu64 "%c", values[i], (i + 1 < sink->column_count) ? ',' : '\n');
+            }
+            break;
+        case SINK_FORMAT_BINARY:
+            for (i=0; i<sink->column_count; i++) {
+                record[i] = htole64(values[i]);
+            }
+            if (fwrite(record, sizeof(uint64_t), sink->column_count, sink->file) != sink->column_count) {
+                return EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
+            }
+            break;
+        case SINK_FORMAT_COLUMNAR:
+            for (i=0; i<sink->column_count; i++) {
+                record[i] = htole64(values[i]);
+                if (fwrite(&record[i], sizeof(uint64_t), 1, sink->columns[i]) != 1) {
+                    return EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
+                }
+            }
+            break;
+        default:
+            return EC_CLI_INVALID_OUTPUT_FILE;
+    }
+    sink->row_count++;
+    return EC_SUCCESS;
+}
+
+ec_t sink_close (sink_t *sink) {
+    /* params */
+    ec_t        ec = EC_SUCCESS;                /* error code */
+    uint64_t    offsets[SINK_MAX_COLUMNS];      /* byte offset of each column array */
+    char        buffer[1 << 16];                /* copy buffer */
+    size_t      size;                           /* bytes read into copy buffer */
+    uint32_t    i;                              /* iterator */
+
+    if (sink->file == NULL) {
+        return EC_SUCCESS;
+    }
+    switch (sink->format) {
+        case SINK_FORMAT_CSV:
+            break;
+        case SINK_FORMAT_BINARY:
+            /* rewrite header with final row count, output may be a pipe where rewinding is impossible */
+            if (fseek(sink->file, 0, SEEK_SET) == 0) {
+                ec = write_header(sink, NULL);
+            }
+            break;
+        case SINK_FORMAT_COLUMNAR:
+            offsets[0] = (uint64_t) get_header_size(sink);
+            for (i=1; i<sink->column_count; i++) {
+                offsets[i] = offsets[i - 1] + sink->row_count * sizeof(uint64_t);
+            }
+            ec = write_header(sink, offsets);
+            for (i=0; (i<sink->column_count) && (ec==EC_SUCCESS); i++) {
+                rewind(sink->columns[i]);
+                while ((size = fread(buffer, 1, sizeof(buffer), sink->columns[i])) > 0) {
+                    if (fwrite(buffer, 1, size, sink->file) != size) {
+                        ec = EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
+                        break;
+                    }
+                }
+            }
+            break;
+        default:
+            ec = EC_CLI_INVALID_OUTPUT_FILE;
+            break;
+    }
+    for (i=0; i<SINK_MAX_COLUMNS; i++) {
+        if (sink->columns[i] != NULL) {
+            fclose(sink->columns[i]);
+            sink->columns[i] = NULL;
+        }
+    }
+    if ((fclose(sink->file) != 0) && (ec == EC_SUCCESS)) {
+        perror("fclose");
+        ec = EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
+    }
+    sink->file = NULL;
+    return ec;
+}
+
+static size_t get_header_size (const sink_t *sink) {
+    size_t size = 8 + sizeof(uint32_t) * 2 + sizeof(uint64_t) + sink->column_count * SINK_COLUMN_NAME_SIZE;
+    if (sink->format == SINK_FORMAT_COLUMNAR) {
+        size += sink->column_count * sizeof(uint64_t);
+    }
+    return size;
+}
+
+static ec_t write_header (sink_t *sink, const uint64_t *offsets) {
+    /* params */
+    char        magic[8];       /* file magic */
+    uint32_t    u32[2];         /* version, column count */
+    uint64_t    u64;            /* row count or offset */
+    uint32_t    i;              /* iterator */
+
+    memset(magic, 0, sizeof(magic));
+    memcpy(magic, (sink->format == SINK_FORMAT_COLUMNAR) ? "PTCOL" : "PTBIN", 5);
+    u32[0] = htole32(SINK_FILE_VERSION);
+    u32[1] = htole32(sink->column_count);
+    u64 = htole64(sink->row_count);
+    fwrite(magic, 1, sizeof(magic), sink->file);
+    fwrite(u32, sizeof(uint32_t), 2, sink->file);
+    fwrite(&u64, sizeof(uint64_t), 1, sink->file);
+    if (offsets != NULL) {
+        for (i=0; i<sink->column_count; i++) {
+            u64 = htole64(offsets[i]);
+            fwrite(&u64, sizeof(uint64_t), 1, sink->file);
+        }
+    }
+    fwrite(sink->names, SINK_COLUMN_NAME_SIZE, sink->column_count, sink->file);
+    if (ferror(sink->file)) {
+        return EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
+    }
+    return EC_SUCCESS;
+}
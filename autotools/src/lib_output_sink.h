@@ -0,0 +1,84 @@
+/**
+ * @file lib_output_sink.h
+ * @brief Buffered output sink of fixed-column uint64 records: CSV, binary record and columnar file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ * @details
+ * Binary (.bin) and columnar (.col) files are little-endian and share the same header:
+ *   char     magic[8]          "PTBIN" or "PTCOL", zero padded
+ *   uint32_t version           SINK_FILE_VERSION
+ *   uint32_t column_count
+ *   uint64_t row_count         0 if the output could not be rewound (pipe), read until EOF
+ *   uint64_t offset[column_count]  columnar only, byte offset of each column array from start of file
+ *   char     name[column_count][SINK_COLUMN_NAME_SIZE]
+ * Binary file is followed by row_count records of column_count uint64_t.
+ * Columnar file is followed by column_count arrays of row_count uint64_t, each array can be mmap-ed directly.
+*/
+
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lib_error.h"
+
+#define SINK_FILE_VERSION       1           /* version of binary and columnar header */
+#define SINK_MAX_COLUMNS        16          /* maximum columns of one sink */
+#define SINK_COLUMN_NAME_SIZE   16          /* size of column name in header, including NUL */
+#define SINK_BUFFER_SIZE        (4 << 20)   /* size of write buffer of each stream */
+
+/**
+ * @brief Output format, selected by file extension
+ */
+typedef enum {
+    SINK_FORMAT_CSV,        ///< ".csv", one line per record with column name header
+    SINK_FORMAT_BINARY,     ///< ".bin", fixed-width little-endian records
+    SINK_FORMAT_COLUMNAR    ///< ".col", one little-endian array per column
+} sink_format_t;
+
+/**
+ * @brief Output sink
+ */
+typedef struct {
+    sink_format_t   format;                                         ///< output format
+    FILE           *file;                                           ///< output file
+    FILE           *columns[SINK_MAX_COLUMNS];                      ///< temporary file of each column, columnar only
+    uint32_t        column_count;                                   ///< number of columns
+    uint64_t        row_count;                                      ///< number of written records
+    char            names[SINK_MAX_COLUMNS][SINK_COLUMN_NAME_SIZE]; ///< column names
+} sink_t;
+
+/**
+ * @brief Get output format from file extension
+ * @param path Output path
+ * @param format Output format
+ * @return EC_SUCCESS or EC_CLI_INVALID_OUTPUT_FILE
+ */
+ec_t sink_get_format (const char *path, sink_format_t *format);
+
+/**
+ * @brief Open output sink, format is selected by file extension
+ * @param sink Sink to initialize
+ * @param path Output path
+ * @param column_count Number of columns
+ * @param names Column names
+ * @return Error code
+ */
+ec_t sink_open (sink_t *sink, const char *path, uint32_t column_count, const char * const *names);
+
+/**
+ * @brief Append one record
+ * @param sink Sink
+ * @param values column_count values
+ * @return Error code
+ */
+ec_t sink_write (sink_t *sink, const uint64_t *values);
+
+/**
+ * @brief Flush buffered records, finalize header and close sink
+ * @param sink Sink
+ * @return Error code
+ */
+ec_t sink_close (sink_t *sink);
+
+#endif // OUTPUT_SINK_H
@@ -0,0 +1,426 @@
+/*
+ * @file lib_packet_count.c
+ * @brief Packet count stage library source file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "lib_packet_count.h"
+#include "lib_stats.h"
+
+const char * const metric_names[METRIC_COUNT] = {"packets", "bytes", "capture", "ipv4", "ipv6", "tcp", "udp", "mpls", "vlan"};
+const char * const metric_titles[METRIC_COUNT] = {"Packets", "Bytes", "Capture", "IPv4", "IPv6", "TCP", "UDP", "MPLS", "VLAN"};
+
+/**
+ * @brief Parse metric list of "-m" option
+ * @param value Comma separated metric names, or "all"
+ * @param metrics Bit mask of metric_t
+ * @return Error code
+ */
+static ec_t parse_metrics (const char *value, uint32_t *metrics);
+
+/**
+ * @brief Get output path of one level, interval is inserted before file extension
+ * @param buffer Output path of level
+ * @param size Size of buffer
+ * @param output_file Output file given by "-o"
+ * @param interval_nsec Interval of level (nsec)
+ * @return void
+ */
+static void get_level_path (char *buffer, size_t size, const char *output_file, uint64_t interval_nsec);
+
+/**
+ * @brief Write one finished interval of one level to its output sink, or print it to stdout
+ * @param level Level, 0 is the finest
+ * @param end_nsec End of interval (nsec)
+ * @param counters Metrics of interval
+ * @param arg Stage
+ * @return void
+ */
+static void write_level (uint32_t level, uint64_t end_nsec, const uint64_t *counters, void *arg);
+
+/**
+ * @brief Init callback of stage, print stdout header
+ * @param origin Timestamp of first packet (nsec)
+ * @param arg Stage
+ * @return EC_SUCCESS
+ */
+static ec_t count_init (uint64_t origin, void *arg);
+
+/**
+ * @brief Interval callback of stage, write finished intervals including empty ones
+ * @param index Finished interval
+ * @param next Interval of next packet
+ * @param arg Stage
+ * @return void
+ */
+static void count_interval (uint64_t index, uint64_t next, void *arg);
+
+/**
+ * @brief Packet callback of stage
+ * @param packet Decoded packet, from either libtrace or mmap reader
+ * @param arg Stage
+ * @return void
+ */
+static void count_packet (const pipeline_packet_t *packet, void *arg);
+
+void count_stage_init (count_stage_t *count) {
+    memset(count, 0, sizeof(count_stage_t));
+    return;
+}
+
+/* @brief Option parser of stage
+ * @details metrics are kept in the stage as every callback reads them
+ */
+ec_t count_option (int argc, char *argv[], int *i, void *arg) {
+    /* params */
+    count_stage_t  *count = (count_stage_t *) arg;
+    ec_t            ec = EC_SUCCESS;    /* error code */
+
+    if ((strcmp(argv[*i], "-o") == 0) || (strcmp(argv[*i], "--output") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            count->output_file = argv[*i];
+        } else {
+            ec = EC_CLI_NO_OUTPUT_FILE_VALUE;
+        }
+    } else if ((strcmp(argv[*i], "-m") == 0) || (strcmp(argv[*i], "--metrics") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            ec = parse_metrics(argv[*i], &count->metrics);
+        } else {
+            ec = EC_CLI_NO_METRICS_VALUE;
+        }
+    } else {
+        ec = EC_CLI_UNKNOWN_OPTION;
+    }
+    return ec;
+}
+
+/* @brief Check options of stage
+ * @details each level streams to its own file, so only a single level can be printed to stdout.
+ *          Default keeps the original stdout format and adds bytes to output file
+ */
+ec_t count_check (count_stage_t *count, const pipeline_options_t *options) {
+    /* params */
+    ec_t            ec = EC_SUCCESS;    /* error code */
+    uint32_t        level;              /* level iterator */
+    interval_bin_t  level_bin;          /* binning state of coarser level, only for validation */
+
+    if ((options->levels > 1) && (count->output_file == NULL)) {
+        return EC_CLI_NO_OUTPUT_OPTION;
+    }
+    if (count->output_file != NULL) {
+        ec = sink_get_format(count->output_file, &count->sinks[0].format);
+    }
+    if ((ec == EC_SUCCESS) && (count->metrics == 0)) {
+        count->metrics = (count->output_file != NULL) ? METRIC_DEFAULT_SINK : METRIC_DEFAULT_TEXT;
+    }
+    interval_bin_init(&count->bin, options->time_intervals[0]);
+    count->levels = options->levels;
+    for (level=0; (level<options->levels) && (ec==EC_SUCCESS); level++) {
+        interval_bin_init(&level_bin, options->time_intervals[level]);
+        count->interval_nsec[level] = level_bin.interval_nsec;
+    }
+    if (ec == EC_SUCCESS) {
+        ec = rollup_init(&count->rollup, count->interval_nsec, count->levels, METRIC_COUNT, write_level, count);
+    }
+    return ec;
+}
+
+ec_t count_open (count_stage_t *count, bool verbose) {
+    /* params */
+    ec_t            ec = EC_SUCCESS;    /* error code */
+    const char     *columns[METRIC_COUNT + 1]; /* output columns */
+    uint32_t        column_count = 1;   /* number of output columns */
+    uint32_t        metric;             /* metric iterator */
+    uint32_t        level;              /* level iterator */
+    uint32_t        i;                  /* iterator */
+    char            level_path[4096];   /* output file of level */
+
+    if (count->output_file == NULL) {
+        return EC_SUCCESS;
+    }
+    columns[0] = "time_nsec";
+    for (metric=0; metric<METRIC_COUNT; metric++) {
+        if (count->metrics & METRIC_BIT(metric)) {
+            columns[column_count++] = metric_names[metric];
+        }
+    }
+    for (level=0; level<count->levels; level++) {
+        if (count->levels == 1) {
+            snprintf(level_path, sizeof(level_path), "%s", count->output_file);
+        } else {
+            get_level_path(level_path, sizeof(level_path), count->output_file, count->interval_nsec[level]);
+        }
+        ec = sink_open(&count->sinks[level], level_path, column_count, columns);
+        if (ec != EC_SUCCESS) {
+            fprintf(stderr, "Unable to open output file: %s\n", level_path);
+            for (i=0; i<=level; i++) {
+                sink_close(&count->sinks[i]);
+            }
+            return ec;
+        }
+        if (verbose) {
+            fprintf(stderr, "Interval %" PRIu64 " nsec is written to %s\n", count->interval_nsec[level], level_path);
+        }
+    }
+    count->sink = count->sinks;
+    return EC_SUCCESS;
+}
+
+ec_t count_close (count_stage_t *count) {
+    /* params */
+    ec_t            ec = EC_SUCCESS;    /* error code */
+    uint32_t        level;              /* level iterator */
+
+    if (count->sink == NULL) {
+        return EC_SUCCESS;
+    }
+    for (level=0; level<count->levels; level++) {
+        if ((sink_close(&count->sink[level]) != EC_SUCCESS) && (ec == EC_SUCCESS)) {
+            ec = EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
+        }
+    }
+    count->sink = NULL;
+    return ec;
+}
+
+/* @brief Packet fields needed by enabled metrics
+ * @details wire length is always retrieved, it is also the byte rate of stats
+ */
+uint32_t count_needs (const count_stage_t *count) {
+    /* params */
+    uint32_t needs = 0;     /* bit mask of PIPELINE_NEED_* */
+
+    if (count->metrics & METRIC_BIT(METRIC_CAPTURE)) {
+        needs |= PIPELINE_NEED_CAPTURE;
+    }
+    if (count->metrics & METRIC_PROTOCOL) {
+        needs |= PIPELINE_NEED_LAYER2;
+    }
+    return needs;
+}
+
+/* @brief Add metrics of one packet to interval counters
+ * @details Header walking follows codedemo/headerdemo.c, each layer is only parsed if a metric needs it
+ */
+void count_metrics (const count_stage_t *count, const pipeline_packet_t *packet, uint64_t *counters) {
+    /* params */
+    void       *nexthdr;            /* current header */
+    uint16_t    ethertype;          /* type of current header */
+    uint32_t    remaining;          /* captured bytes from current header */
+    uint8_t     protocol;           /* transport protocol */
+    bool        vlan = false;       /* VLAN tag seen */
+    bool        mpls = false;       /* MPLS label seen */
+
+    counters[METRIC_PACKETS]++;
+    counters[METRIC_BYTES] += packet->wire_length;
+    counters[METRIC_CAPTURE] += packet->capture_length;
+    if (packet->layer2 == NULL) {
+        return;
+    }
+
+    /* layer 2 and layer 2.5 headers */
+    remaining = packet->remaining;
+    nexthdr = trace_get_payload_from_layer2(packet->layer2, packet->linktype, &ethertype, &remaining);
+    while ((nexthdr != NULL) && (remaining > 0)) {
+        if ((ethertype == 0x8100) || (ethertype == 0x88A8)) {           /* VLAN, QinQ */
+            vlan = true;
+            nexthdr = trace_get_payload_from_vlan(nexthdr, &ethertype, &remaining);
+        } else if (ethertype == 0x8847) {                               /* MPLS */
+            mpls = true;
+            nexthdr = trace_get_payload_from_mpls(nexthdr, &ethertype, &remaining);
+        } else {
+            break;
+        }
+    }
+    counters[METRIC_VLAN] += vlan;
+    counters[METRIC_MPLS] += mpls;
+    if ((nexthdr == NULL) || !(count->metrics & METRIC_LAYER3)) {
+        return;
+    }
+
+    /* layer 3 header, transport protocol is only looked up if TCP or UDP is counted */
+    if ((ethertype == 0x0800) && (remaining >= sizeof(libtrace_ip_t))) {          /* IPv4 */
+        counters[METRIC_IPV4]++;
+        protocol = ((libtrace_ip_t *) nexthdr)->ip_p;
+    } else if ((ethertype == 0x86DD) && (remaining >= sizeof(libtrace_ip6_t))) {  /* IPv6 */
+        counters[METRIC_IPV6]++;
+        protocol = 0;
+        if (count->metrics & METRIC_LAYER4) {
+            /* skip extension headers */
+            trace_get_payload_from_ip6((libtrace_ip6_t *) nexthdr, &protocol, &remaining);
+        }
+    } else {
+        return;
+    }
+    counters[METRIC_TCP] += (protocol == 6);
+    counters[METRIC_UDP] += (protocol == 17);
+    return;
+}
+
+void count_print_header (const count_stage_t *count) {
+    /* params */
+    uint32_t metric;                    /* metric iterator */
+
+    printf("\nTime(Sec)\tTime(nSec)");
+    for (metric=0; metric<METRIC_COUNT; metric++) {
+        if (count->metrics & METRIC_BIT(metric)) {
+            printf("\t%s", metric_titles[metric]);
+        }
+    }
+    printf("\n");
+    return;
+}
+
+/* @brief Write one finished interval of the finest level
+ * @details A single level is written directly by rollup_push
+ */
+void count_write (count_stage_t *count, uint64_t end_nsec, const uint64_t *counters) {
+    rollup_push(&count->rollup, end_nsec, counters);
+    return;
+}
+
+ec_t count_register (count_stage_t *count, pipeline_t *pipeline) {
+    /* params */
+    pipeline_stage_t    stage;      /* stage registered to pipeline */
+
+    memset(&stage, 0, sizeof(pipeline_stage_t));
+    stage.name = "count";
+    stage.needs = count_needs(count);
+    stage.unsupported = EC_CLI_INVALID_COUNT_STAGE;
+    stage.arg = count;
+    stage.init = count_init;
+    stage.packet = count_packet;
+    stage.interval = count_interval;
+    return pipeline_add_stage(pipeline, &stage);
+}
+
+/* @brief Parse metric list
+ * @param value Comma separated metric names, or "all"
+ * @param metrics Bit mask of metric_t
+ * @return Error code
+ */
+static ec_t parse_metrics (const char *value, uint32_t *metrics) {
+    /* params */
+    const char *name = value;       /* start of current name */
+    size_t      length;             /* length of current name */
+    uint32_t    metric;             /* metric iterator */
+
+    if (strcmp(value, "all") == 0) {
+        *metrics = METRIC_ALL;
+        return EC_SUCCESS;
+    }
+    *metrics = 0;
+    while (*name != '\0') {
+        length = strcspn(name, ",");
+        for (metric=0; metric<METRIC_COUNT; metric++) {
+            if ((strlen(metric_names[metric]) == length) && (strncmp(name, metric_names[metric], length) == 0)) {
+                break;
+            }
+        }
+        if (metric == METRIC_COUNT) {
+            fprintf(stderr, "Unknown metric: %.*s\n", (int) length, name);
+            return EC_CLI_INVALID_METRICS;
+        }
+        *metrics |= METRIC_BIT(metric);
+        name += length;
+        if (*name == ',') {
+            name++;
+        }
+    }
+    if (*metrics == 0) {
+        return EC_CLI_INVALID_METRICS;
+    }
+    return EC_SUCCESS;
+}
+
+/* @brief Get output path of one level
+ * @details "out.csv" with 10 ms interval becomes "out_10000000ns.csv"
+ */
+static void get_level_path (char *buffer, size_t size, const char *output_file, uint64_t interval_nsec) {
+    /* params */
+    const char *extension = strrchr(output_file, '.');  /* file extension, checked by sink_get_format */
+
+    snprintf(buffer, size, "%.*s_%" PRIu64 "ns%s", (int) (extension - output_file), output_file, interval_nsec, extension);
+    return;
+}
+
+/* @brief Write one finished interval of one level
+ * @details Text output keeps the original format, sink receives the boundary as one nsec timestamp
+ */
+static void write_level (uint32_t level, uint64_t end_nsec, const uint64_t *counters, void *arg) {
+    /* params */
+    count_stage_t  *count = (count_stage_t *) arg;
+    uint64_t        record[METRIC_COUNT + 1];   /* time_nsec and enabled metrics */
+    uint32_t        column = 1;                 /* column iterator */
+    uint32_t        metric;                     /* metric iterator */
+    stats_thread_t *stats = stats_thread();     /* stats slot of writing thread */
+    uint64_t        begin = stats_output_begin(stats); /* cycles at start of output, 0 if not sampled */
+
+    if (count->sink == NULL) {
+        printf("%" PRIu64 " \t%" PRIu64, end_nsec / NSEC_PER_SEC, end_nsec % NSEC_PER_SEC);
+        for (metric=0; metric<METRIC_COUNT; metric++) {
+            if (count->metrics & METRIC_BIT(metric)) {
+                printf(" \t%" PRIu64, counters[metric]);
+            }
+        }
+        printf("\n");
+        stats_output_end(stats, begin);
+        return;
+    }
+    record[0] = end_nsec;
+    for (metric=0; metric<METRIC_COUNT; metric++) {
+        if (count->metrics & METRIC_BIT(metric)) {
+            record[column++] = counters[metric];
+        }
+    }
+    sink_write(&count->sink[level], record);
+    stats_output_end(stats, begin);
+    return;
+}
+
+/* @brief Init callback of stage
+ * @details first packet in trace, intervals are aligned to it
+ */
+static ec_t count_init (uint64_t origin, void *arg) {
+    /* params */
+    count_stage_t  *count = (count_stage_t *) arg;
+
+    count->bin.origin_nsec = origin;
+    if (count->sink == NULL) {
+        count_print_header(count);
+    }
+    return EC_SUCCESS;
+}
+
+/* @brief Interval callback of stage
+ * @details every interval until the one of next packet is written, even if no packet is observed in it
+ */
+static void count_interval (uint64_t index, uint64_t next, void *arg) {
+    /* params */
+    count_stage_t  *count = (count_stage_t *) arg;
+
+    while (index < next) {
+        count_write(count, interval_bin_end(&count->bin, index), count->count);
+        memset(count->count, 0, sizeof(count->count));
+        index++;
+    }
+    return;
+}
+
+/* @brief Packet callback of stage
+ * @details packet earlier than current interval is counted into current interval
+ */
+static void count_packet (const pipeline_packet_t *packet, void *arg) {
+    /* params */
+    count_stage_t  *count = (count_stage_t *) arg;
+
+    count_metrics(count, packet, count->count);
+    return;
+}
@@ -0,0 +1,149 @@
+/**
+ * @file lib_packet_count.h
+ * @brief Packet count stage: packet, byte and protocol counters of each interval, written to stdout or output sinks
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ * @details
+ * Stage counts the enabled metrics of every packet into the finest interval, each finished interval is rolled up
+ * into the coarser levels, and every level is written to its own output file, or the finest one to stdout as text.
+ * pt_count_packet runs it alone, pt_quantize_iat adds it to its analysis stages so both cost one read of the trace.
+ * Options "-m" and "-o" are parsed by count_option, intervals are the shared "-t" of pipeline_option.
+ * Multi-threaded modes of pt_count_packet count into their own intervals and write them with count_write.
+*/
+
+#ifndef PACKET_COUNT_H
+#define PACKET_COUNT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lib_error.h"
+#include "lib_output_sink.h"
+#include "lib_interval_bin.h"
+#include "lib_interval_rollup.h"
+#include "lib_pipeline.h"
+
+/**
+ * @brief Metrics counted in each interval, also the column order of output
+ */
+typedef enum {
+    METRIC_PACKETS,                     /* packet count */
+    METRIC_BYTES,                       /* wire length sum */
+    METRIC_CAPTURE,                     /* capture length sum */
+    METRIC_IPV4,                        /* IPv4 packet count */
+    METRIC_IPV6,                        /* IPv6 packet count */
+    METRIC_TCP,                         /* TCP packet count */
+    METRIC_UDP,                         /* UDP packet count */
+    METRIC_MPLS,                        /* packet count with MPLS label */
+    METRIC_VLAN,                        /* packet count with VLAN tag */
+    METRIC_COUNT                        /* number of metrics */
+} metric_t;
+
+#define METRIC_BIT(metric)      (1U << (metric))
+#define METRIC_ALL              (METRIC_BIT(METRIC_COUNT) - 1)
+#define METRIC_DEFAULT_TEXT     (METRIC_BIT(METRIC_PACKETS))                            /* stdout keeps its original format */
+#define METRIC_DEFAULT_SINK     (METRIC_BIT(METRIC_PACKETS) | METRIC_BIT(METRIC_BYTES))
+#define METRIC_LAYER3           (METRIC_BIT(METRIC_IPV4) | METRIC_BIT(METRIC_IPV6) | METRIC_BIT(METRIC_TCP) | METRIC_BIT(METRIC_UDP))
+#define METRIC_LAYER4           (METRIC_BIT(METRIC_TCP) | METRIC_BIT(METRIC_UDP))
+#define METRIC_PROTOCOL         (METRIC_LAYER3 | METRIC_BIT(METRIC_MPLS) | METRIC_BIT(METRIC_VLAN))
+
+/* metric names used by "-m" and output column names */
+extern const char * const metric_names[METRIC_COUNT];
+/* metric names used by stdout header */
+extern const char * const metric_titles[METRIC_COUNT];
+
+/**
+ * @brief Packet count stage
+ */
+typedef struct {
+    uint32_t        metrics;                            ///< bit mask of metric_t, default is selected by count_check
+    const char     *output_file;                        ///< output file of "-o", print text to stdout if NULL
+    interval_bin_t  bin;                                ///< binning of finest level, origin is set by first packet
+    uint64_t        count[METRIC_COUNT];                ///< metrics of current interval
+    uint32_t        levels;                             ///< number of levels of "-t"
+    uint64_t        interval_nsec[ROLLUP_MAX_LEVELS];   ///< interval of each level (nsec)
+    sink_t          sinks[ROLLUP_MAX_LEVELS];           ///< output sink of each level
+    sink_t         *sink;                               ///< opened sinks, NULL if text is printed to stdout
+    rollup_t        rollup;                             ///< finished intervals are rolled up into coarser levels
+} count_stage_t;
+
+/**
+ * @brief Initialize stage, metrics and output are set by count_option and count_check
+ * @param count Stage
+ * @return void
+ */
+void count_stage_init (count_stage_t *count);
+
+/**
+ * @brief Option parser of stage: -m and -o
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @param i Index of option, moved to its value
+ * @param arg Stage
+ * @return EC_SUCCESS, error of option, or EC_CLI_UNKNOWN_OPTION
+ */
+ec_t count_option (int argc, char *argv[], int *i, void *arg);
+
+/**
+ * @brief Check options of stage, select default metrics and set up the intervals of every level
+ * @param count Stage
+ * @param options Shared options, intervals are checked by pipeline_options_check
+ * @return EC_SUCCESS, EC_CLI_NO_OUTPUT_OPTION if several levels go to stdout, or error of output format or intervals
+ */
+ec_t count_check (count_stage_t *count, const pipeline_options_t *options);
+
+/**
+ * @brief Open output file of each level, a single level writes to output file as given
+ * @param count Stage
+ * @param verbose Print output file of each level
+ * @return Error code, sinks already opened are closed on error
+ */
+ec_t count_open (count_stage_t *count, bool verbose);
+
+/**
+ * @brief Close output files
+ * @param count Stage
+ * @return EC_SUCCESS or EC_GEN_UNABLE_TO_WRITE_DATA_FILE
+ */
+ec_t count_close (count_stage_t *count);
+
+/**
+ * @brief Packet fields needed by enabled metrics
+ * @param count Stage
+ * @return Bit mask of PIPELINE_NEED_*
+ */
+uint32_t count_needs (const count_stage_t *count);
+
+/**
+ * @brief Add metrics of one packet to interval counters
+ * @param count Stage, only enabled metrics are read
+ * @param packet Decoded packet
+ * @param counters Interval counters
+ * @return void
+ */
+void count_metrics (const count_stage_t *count, const pipeline_packet_t *packet, uint64_t *counters);
+
+/**
+ * @brief Print header line of stdout text output
+ * @param count Stage
+ * @return void
+ */
+void count_print_header (const count_stage_t *count);
+
+/**
+ * @brief Write one finished interval of the finest level, coarser levels are rolled up from it
+ * @param count Stage
+ * @param end_nsec End of interval (nsec)
+ * @param counters Metrics of interval
+ * @return void
+ */
+void count_write (count_stage_t *count, uint64_t end_nsec, const uint64_t *counters);
+
+/**
+ * @brief Register stage to pipeline, needs are taken from metrics selected by count_check
+ * @param count Stage
+ * @param pipeline Pipeline
+ * @return Error code
+ */
+ec_t count_register (count_stage_t *count, pipeline_t *pipeline);
+
+#endif
@@ -0,0 +1,173 @@
+/*
+ * @file lib_pcap_mmap.c
+ * @brief Zero-copy pcap reader library source file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lib_pcap_mmap.h"
+
+/**
+ * @brief Check if a plausible record header starts at offset
+ * @param pcap Reader
+ * @param offset Offset of record header
+ * @param first_sec Timestamp of first record of file (sec)
+ * @return Offset after record, 0 if header is not plausible or record exceeds file
+ */
+static size_t check_record (const pcap_mmap_t *pcap, size_t offset, int64_t first_sec);
+
+ec_t parse_reader (const char *value, reader_t *reader) {
+    if (strcmp(value, "auto") == 0) {
+        *reader = READER_AUTO;
+    } else if (strcmp(value, "mmap") == 0) {
+        *reader = READER_MMAP;
+    } else if (strcmp(value, "libtrace") == 0) {
+        *reader = READER_LIBTRACE;
+    } else {
+        return EC_CLI_INVALID_READER;
+    }
+    return EC_SUCCESS;
+}
+
+ec_t pcap_mmap_open (const char *path, pcap_mmap_t *pcap) {
+    /* params */
+    struct stat st;         /* file status */
+    uint32_t    header[6];  /* file header: magic, version, thiszone, sigfigs, snaplen, linktype */
+    void       *base;       /* start of mapping */
+
+    memset(pcap, 0, sizeof(pcap_mmap_t));
+    pcap->fd = open(path, O_RDONLY);
+    if (pcap->fd == -1) {
+        perror("open");
+        return EC_GEN_UNABLE_TO_MMAP_TRACE;
+    }
+    if (fstat(pcap->fd, &st) == -1) {
+        perror("fstat");
+        close(pcap->fd);
+        return EC_GEN_UNABLE_TO_MMAP_TRACE;
+    }
+    if (!S_ISREG(st.st_mode) || ((size_t) st.st_size < PCAP_FILE_HEADER_SIZE)) {
+        close(pcap->fd);
+        return EC_GEN_UNSUPPORTED_MMAP_FORMAT;
+    }
+
+    /* check file header before mapping,
+     * compressed file or pcapng has different magic number and is left to libtrace
+     */
+    if (pread(pcap->fd, header, sizeof(header), 0) != (ssize_t) sizeof(header)) {
+        close(pcap->fd);
+        return EC_GEN_UNSUPPORTED_MMAP_FORMAT;
+    }
+    switch (header[0]) {
+        case PCAP_MAGIC_USEC:
+            break;
+        case PCAP_MAGIC_NSEC:
+            pcap->nsec = true;
+            break;
+        case PCAP_MAGIC_USEC_SWAPPED:
+            pcap->swapped = true;
+            break;
+        case PCAP_MAGIC_NSEC_SWAPPED:
+            pcap->nsec = true;
+            pcap->swapped = true;
+            break;
+        default:
+            close(pcap->fd);
+            return EC_GEN_UNSUPPORTED_MMAP_FORMAT;
+    }
+    pcap->linktype = pcap_mmap_u32(pcap, header[5]);
+    pcap->fcs_length = (pcap->linktype == PCAP_LINKTYPE_ETHERNET) ? 4 : 0;
+
+    /* map the whole file read-only
+     *
+     * file is walked exactly once from start to end, MADV_SEQUENTIAL makes kernel read ahead aggressively
+     * and drop pages behind, huge page is only a hint and ignored by filesystems without support
+     */
+    pcap->size = (size_t) st.st_size;
+    base = mmap(NULL, pcap->size, PROT_READ, MAP_PRIVATE, pcap->fd, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        close(pcap->fd);
+        return EC_GEN_UNABLE_TO_MMAP_TRACE;
+    }
+    (void) madvise(base, pcap->size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    (void) madvise(base, pcap->size, MADV_HUGEPAGE);
+#endif
+    pcap->base = (const uint8_t *) base;
+    pcap->offset = PCAP_FILE_HEADER_SIZE;
+    return EC_SUCCESS;
+}
+
+void pcap_mmap_close (pcap_mmap_t *pcap) {
+    if (pcap->base != NULL) {
+        munmap((void *) (uintptr_t) pcap->base, pcap->size);
+        close(pcap->fd);
+        pcap->base = NULL;
+        pcap->fd = -1;
+    }
+    return;
+}
+
+size_t pcap_mmap_sync (const pcap_mmap_t *pcap, size_t offset) {
+    /* params */
+    uint32_t    header[4];      /* first record header */
+    int64_t     first_sec;      /* timestamp of first record (sec) */
+    size_t      next;           /* offset after checked record */
+    uint32_t    records;        /* plausible records from candidate */
+
+    if (offset <= PCAP_FILE_HEADER_SIZE) {
+        return PCAP_FILE_HEADER_SIZE;
+    }
+    if (pcap->size < PCAP_FILE_HEADER_SIZE + PCAP_RECORD_HEADER_SIZE) {
+        return pcap->size;
+    }
+    memcpy(header, pcap->base + PCAP_FILE_HEADER_SIZE, sizeof(header));
+    first_sec = (int64_t) pcap_mmap_u32(pcap, header[0]);
+    for (; offset + PCAP_RECORD_HEADER_SIZE <= pcap->size; offset++) {
+        next = offset;
+        for (records=0; records<PCAP_SYNC_RECORDS; records++) {
+            next = check_record(pcap, next, first_sec);
+            if ((next == 0) || (next == pcap->size)) {
+                break;
+            }
+        }
+        if (next != 0) {
+            return offset;
+        }
+    }
+    return pcap->size;
+}
+
+static size_t check_record (const pcap_mmap_t *pcap, size_t offset, int64_t first_sec) {
+    /* params */
+    uint32_t    header[4];      /* record header: ts_sec, ts_frac, incl_len, orig_len */
+    int64_t     sec;            /* timestamp (sec) */
+    uint32_t    fraction;       /* timestamp fraction */
+    uint32_t    capture;        /* captured length */
+    uint32_t    wire;           /* wire length */
+
+    if (offset + PCAP_RECORD_HEADER_SIZE > pcap->size) {
+        return 0;
+    }
+    memcpy(header, pcap->base + offset, sizeof(header));
+    sec = (int64_t) pcap_mmap_u32(pcap, header[0]);
+    fraction = pcap_mmap_u32(pcap, header[1]);
+    capture = pcap_mmap_u32(pcap, header[2]);
+    wire = pcap_mmap_u32(pcap, header[3]);
+    if ((fraction >= (pcap->nsec ? 1000000000U : 1000000U)) || (capture > wire) || (wire > PCAP_MAX_RECORD_LENGTH)
+            || (sec < first_sec - PCAP_SYNC_MAX_SKEW)) {
+        return 0;
+    }
+    if (offset + PCAP_RECORD_HEADER_SIZE + capture > pcap->size) {
+        return 0;
+    }
+    return offset + PCAP_RECORD_HEADER_SIZE + capture;
+}
@@ -0,0 +1,145 @@
+/**
+ * @file lib_pcap_mmap.h
+ * @brief Zero-copy reader of uncompressed classic pcap file through mmap
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ * Ref:
+ * 1. https://wiki.wireshark.org/Development/LibpcapFileFormat
+ * 2. https://man7.org/linux/man-pages/man2/madvise.2.html
+ * 3. https://github.com/LibtraceTeam/libtrace/blob/master/lib/format_pcapfile.c
+*/
+
+#ifndef PCAP_MMAP_H
+#define PCAP_MMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "lib_error.h"
+
+/* pcap magic numbers */
+#define PCAP_MAGIC_USEC             0xa1b2c3d4  /* microsecond timestamp */
+#define PCAP_MAGIC_NSEC             0xa1b23c4d  /* nanosecond timestamp */
+#define PCAP_MAGIC_USEC_SWAPPED     0xd4c3b2a1  /* microsecond timestamp, opposite byte order */
+#define PCAP_MAGIC_NSEC_SWAPPED     0x4d3cb2a1  /* nanosecond timestamp, opposite byte order */
+#define PCAP_FILE_HEADER_SIZE       24          /* size of pcap file header */
+#define PCAP_RECORD_HEADER_SIZE     16          /* size of pcap record header */
+#define PCAP_LINKTYPE_ETHERNET      1           /* DLT_EN10MB */
+#define PCAP_MAX_RECORD_LENGTH      262144      /* largest plausible captured or wire length, libpcap MAXIMUM_SNAPLEN */
+#define PCAP_SYNC_RECORDS           16          /* consecutive plausible records that accept a boundary found by scanning */
+#define PCAP_SYNC_MAX_SKEW          86400       /* records found by scanning are at most this much earlier than first record (sec) */
+
+/**
+ * @brief Reader selection of pt_* tools
+ */
+typedef enum {
+    READER_AUTO,        ///< use mmap for classic pcap, libtrace otherwise
+    READER_MMAP,        ///< mmap only, fail if the file is not classic pcap
+    READER_LIBTRACE     ///< libtrace only
+} reader_t;
+
+/**
+ * @brief Lightweight view of one packet, points into the mapped file
+ */
+typedef struct {
+    struct timespec ts;             ///< timestamp
+    uint32_t        capture_length; ///< captured length
+    uint32_t        wire_length;    ///< wire length, same as trace_get_wire_length
+    const uint8_t  *data;           ///< packet data, valid until pcap_mmap_close
+} pcap_packet_view_t;
+
+/**
+ * @brief Mapped pcap file and its read cursor
+ */
+typedef struct {
+    int             fd;             ///< file descriptor
+    const uint8_t  *base;           ///< start of mapping
+    size_t          size;           ///< size of mapping
+    size_t          offset;         ///< offset of next record header
+    bool            nsec;           ///< timestamp fraction is nanosecond
+    bool            swapped;        ///< file byte order differs from host
+    uint32_t        linktype;       ///< link type of file header
+    uint32_t        fcs_length;     ///< bytes added to wire length, libtrace counts the missing ethernet FCS
+} pcap_mmap_t;
+
+/**
+ * @brief Parse reader selection from CLI value
+ * @param value CLI value, one of "auto", "mmap" or "libtrace"
+ * @param reader Parsed reader
+ * @return EC_SUCCESS or EC_CLI_INVALID_READER
+ */
+ec_t parse_reader (const char *value, reader_t *reader);
+
+/**
+ * @brief Map pcap file into memory, only uncompressed classic pcap is accepted
+ * @param path Path of pcap file
+ * @param pcap Reader to initialize
+ * @return EC_SUCCESS, EC_GEN_UNSUPPORTED_MMAP_FORMAT if libtrace should be used instead, or EC_GEN_UNABLE_TO_MMAP_TRACE
+ */
+ec_t pcap_mmap_open (const char *path, pcap_mmap_t *pcap);
+
+/**
+ * @brief Unmap pcap file
+ * @param pcap Reader
+ * @return void
+ */
+void pcap_mmap_close (pcap_mmap_t *pcap);
+
+/**
+ * @brief Find first record boundary at or after offset by scanning, used to split file into chunks
+ * @param pcap Reader, offset is left unchanged
+ * @param offset Offset to start scanning from
+ * @return Offset of record header, or size of file if none is found
+ * @details pcap has no sync marker, a boundary is accepted if PCAP_SYNC_RECORDS plausible record headers
+ *          follow each other from it, or plausible records end exactly at end of file.
+ *          A plausible header has fraction below one second, captured length not above wire length
+ *          and PCAP_MAX_RECORD_LENGTH, and a timestamp at most PCAP_SYNC_MAX_SKEW earlier than the first record,
+ *          which rejects zero-filled payload.
+ *          This is a heuristic, callers that need an exact result check the boundary against the end of the previous chunk.
+ *          The result only depends on file content and offset, and never decreases as offset grows.
+ */
+size_t pcap_mmap_sync (const pcap_mmap_t *pcap, size_t offset);
+
+/**
+ * @brief Swap byte order of 32-bit value when file byte order differs from host
+ * @param pcap Reader
+ * @param value Value read from file
+ * @return Value in host byte order
+ */
+static inline uint32_t pcap_mmap_u32 (const pcap_mmap_t *pcap, uint32_t value) {
+    return pcap->swapped ? __builtin_bswap32(value) : value;
+}
+
+/**
+ * @brief Walk to the next record header in place
+ * @param pcap Reader
+ * @param view View filled with next packet
+ * @return 1 if a packet is read, 0 at end of file, -1 if the last record is truncated
+ * @details Inlined as it is called once per packet, no error message is printed here
+ */
+static inline int pcap_mmap_next (pcap_mmap_t *pcap, pcap_packet_view_t *view) {
+    /* params */
+    uint32_t header[4];     /* record header: ts_sec, ts_frac, incl_len, orig_len */
+
+    if (pcap->offset + PCAP_RECORD_HEADER_SIZE > pcap->size) {
+        return (pcap->offset == pcap->size) ? 0 : -1;
+    }
+    /* record headers are not aligned in general, copy is turned into plain loads by the compiler */
+    __builtin_memcpy(header, pcap->base + pcap->offset, sizeof(header));
+    view->ts.tv_sec = (time_t) pcap_mmap_u32(pcap, header[0]);
+    view->ts.tv_nsec = (long int) pcap_mmap_u32(pcap, header[1]);
+    if (!pcap->nsec) {
+        view->ts.tv_nsec *= 1000;
+    }
+    view->capture_length = pcap_mmap_u32(pcap, header[2]);
+    view->wire_length = pcap_mmap_u32(pcap, header[3]) + pcap->fcs_length;
+    view->data = pcap->base + pcap->offset + PCAP_RECORD_HEADER_SIZE;
+    pcap->offset += PCAP_RECORD_HEADER_SIZE + (size_t) view->capture_length;
+    if (pcap->offset > pcap->size) {
+        return -1;
+    }
+    return 1;
+}
+
+#endif // PCAP_MMAP_H
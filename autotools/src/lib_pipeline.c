@@ -0,0 +1,373 @@
+/*
+ * @file lib_pipeline.c
+ * @brief Per-packet analysis pipeline library source file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "lib_pipeline.h"
+#include "lib_signal_handler.h"
+#include "lib_stats.h"
+
+ec_t pipeline_source_open (pipeline_source_t *source, const char *path, reader_t reader, uint32_t needs, bool verbose) {
+    /* params */
+    ec_t ec = EC_SUCCESS;   /* error code */
+
+    memset(source, 0, sizeof(pipeline_source_t));
+    source->path = path;
+    source->needs = needs;
+
+    /* uncompressed classic pcap is walked in place, everything else falls back to libtrace */
+    if (reader != READER_LIBTRACE) {
+        ec = pcap_mmap_open(path, &source->pcap);
+        if (ec == EC_SUCCESS) {
+            source->use_mmap = true;
+        }
+        /* headers are walked from ethernet, leave other link types to libtrace */
+        if ((ec == EC_SUCCESS) && (needs & PIPELINE_NEED_LAYER2) && (source->pcap.linktype != PCAP_LINKTYPE_ETHERNET)) {
+            pcap_mmap_close(&source->pcap);
+            source->use_mmap = false;
+            ec = EC_GEN_UNSUPPORTED_MMAP_FORMAT;
+        }
+        if ((ec == EC_GEN_UNSUPPORTED_MMAP_FORMAT) && (reader == READER_AUTO)) {
+            ec = EC_SUCCESS;
+        }
+    }
+    if ((ec == EC_SUCCESS) && !source->use_mmap) {
+        source->packet = trace_create_packet();
+        if (source->packet == NULL) {
+            perror("trace_create_packet");
+            ec = EC_GEN_UNABLE_TO_CREATE_PACKET;
+        }
+    }
+    if ((ec == EC_SUCCESS) && !source->use_mmap) {
+        source->trace = trace_create(path);
+        if (trace_is_err(source->trace)) {
+            trace_perror(source->trace, "trace_create");
+            ec = EC_GEN_UNABLE_TO_CREATE_TRACE;
+        } else if (trace_start(source->trace) != 0) {
+            trace_perror(source->trace, "trace_start");
+            ec = EC_GEN_UNABLE_TO_START_TRACE;
+        }
+    }
+    if ((ec == EC_SUCCESS) && verbose) {
+        fprintf(stderr, "Trace file %s opened with %s reader\n", path, source->use_mmap ? "mmap" : "libtrace");
+    }
+    return ec;
+}
+
+ec_t pipeline_source_end (pipeline_source_t *source) {
+    if (source->use_mmap && (source->rc < 0)) {
+        fprintf(stderr, "Truncated record at offset %zu of %s\n", source->pcap.offset, source->path);
+        return EC_GEN_TRACE_READ_PACKET_ERROR;
+    }
+    if (!source->use_mmap && (source->trace != NULL) && trace_is_err(source->trace)) {
+        /* only check for error after all file proccessed */
+        trace_perror(source->trace, "Reading packets");
+        return EC_GEN_TRACE_READ_PACKET_ERROR;
+    }
+    return EC_SUCCESS;
+}
+
+void pipeline_source_close (pipeline_source_t *source) {
+    if (source->use_mmap) {
+        pcap_mmap_close(&source->pcap);
+        source->use_mmap = false;
+    }
+    if (source->trace != NULL) {
+        trace_destroy(source->trace);
+        source->trace = NULL;
+    }
+    if (source->packet != NULL) {
+        trace_destroy_packet(source->packet);
+        source->packet = NULL;
+    }
+    return;
+}
+
+void pipeline_init (pipeline_t *pipeline, reader_t reader, const interval_bin_t *bin, bool verbose) {
+    memset(pipeline, 0, sizeof(pipeline_t));
+    pipeline->reader = reader;
+    pipeline->bin = *bin;
+    pipeline->verbose = verbose;
+    return;
+}
+
+ec_t pipeline_add_stage (pipeline_t *pipeline, const pipeline_stage_t *stage) {
+    if (pipeline->stage_count == PIPELINE_MAX_STAGES) {
+        return EC_GEN_TOO_MANY_STAGES;
+    }
+    pipeline->stages[pipeline->stage_count] = *stage;
+    pipeline->stage_count++;
+    pipeline->needs |= stage->needs;
+    if (pipeline->verbose) {
+        fprintf(stderr, "Pipeline stage %zu: %s\n", pipeline->stage_count, stage->name);
+    }
+    return EC_SUCCESS;
+}
+
+ec_t pipeline_set_origin (pipeline_t *pipeline, uint64_t origin) {
+    /* params */
+    ec_t    ec = EC_SUCCESS;    /* error code */
+    size_t  i;                  /* iterator */
+
+    pipeline->bin.origin_nsec = origin;
+    pipeline->interval_index = 0;
+    pipeline->started = true;
+    for (i=0; (i<pipeline->stage_count) && (ec==EC_SUCCESS); i++) {
+        if (pipeline->stages[i].init != NULL) {
+            ec = pipeline->stages[i].init(origin, pipeline->stages[i].arg);
+        }
+    }
+    return ec;
+}
+
+ec_t pipeline_require (const pipeline_t *pipeline, uint32_t modes) {
+    /* params */
+    uint32_t    missing;        /* modes the stage does not support */
+    size_t      i;              /* iterator */
+
+    for (i=0; i<pipeline->stage_count; i++) {
+        missing = modes & ~pipeline->stages[i].caps;
+        if (missing != 0) {
+            fprintf(stderr, "Stage %s does not support %s\n", pipeline->stages[i].name,
+                    (missing & PIPELINE_CAN_THREADS) ? "threads" : "checkpoint");
+            return pipeline->stages[i].unsupported;
+        }
+    }
+    return EC_SUCCESS;
+}
+
+ec_t pipeline_resume (pipeline_t *pipeline, uint64_t origin, uint64_t interval_index) {
+    /* params */
+    ec_t    ec;                 /* error code */
+
+    ec = pipeline_set_origin(pipeline, origin);
+    pipeline->interval_index = interval_index;
+    return ec;
+}
+
+/* @brief Read one trace file through every stage
+ * @details stages may move the opened trace forward before the first read, e.g. to resume from checkpoint
+ */
+ec_t pipeline_run (pipeline_t *pipeline, const char *path) {
+    /* params */
+    ec_t                ec;                 /* error code */
+    pipeline_source_t   source;             /* opened trace */
+    pipeline_packet_t   packet;             /* decoded packet */
+    size_t              i;                  /* iterator */
+    stats_thread_t     *stats = stats_thread(); /* stats slot of calling thread */
+
+    ec = pipeline_source_open(&source, path, pipeline->reader, pipeline->needs, pipeline->verbose);
+    for (i=0; (i<pipeline->stage_count) && (ec==EC_SUCCESS); i++) {
+        if (pipeline->stages[i].open != NULL) {
+            ec = pipeline->stages[i].open(&source, pipeline->stages[i].arg);
+        }
+    }
+    if (ec == EC_SUCCESS) {
+        memset(&packet, 0, sizeof(pipeline_packet_t));
+        packet.linktype = TRACE_TYPE_ETH;
+        stats_read_begin(stats);
+        while ((signal_stop_requested() == 0) && pipeline_source_next(&source, &packet)) {
+            stats_read_end(stats);
+            ec = pipeline_push(pipeline, &packet);
+            if (ec != EC_SUCCESS) {
+                break;
+            }
+            stats_packet_end(stats, packet.wire_length);
+        }
+        if (ec == EC_SUCCESS) {
+            ec = pipeline_source_end(&source);
+        }
+    }
+    pipeline_source_close(&source);
+    return ec;
+}
+
+ec_t pipeline_finish (pipeline_t *pipeline) {
+    /* params */
+    ec_t    ec = EC_SUCCESS;    /* error code */
+    size_t  i;                  /* iterator */
+
+    for (i=0; (i<pipeline->stage_count) && (ec==EC_SUCCESS); i++) {
+        if (pipeline->stages[i].finish != NULL) {
+            ec = pipeline->stages[i].finish(pipeline->interval_index, pipeline->stages[i].arg);
+        }
+    }
+    return ec;
+}
+
+void pipeline_options_init (pipeline_options_t *options) {
+    memset(options, 0, sizeof(pipeline_options_t));
+    options->threads = 1;
+    options->reader = READER_AUTO;
+    return;
+}
+
+/* @brief Parse interval list of "-t" option
+ * @param value Comma separated intervals (sec), finest first
+ * @param options Shared options, time_intervals and levels are set
+ * @return Error code
+ */
+static ec_t parse_time_intervals (const char *value, pipeline_options_t *options) {
+    /* params */
+    const char *start = value;      /* start of current interval */
+    char       *endptr;             /* string to double conversion pointer */
+
+    options->levels = 0;
+    options->time_intervals[0] = 0;
+    do {
+        if (options->levels == ROLLUP_MAX_LEVELS) {
+            fprintf(stderr, "At most %d time intervals\n", ROLLUP_MAX_LEVELS);
+            return EC_CLI_INVALID_TIME_INTERVAL;
+        }
+        options->time_intervals[options->levels] = strtod(start, &endptr);
+        if (errno != EC_SUCCESS) {
+            perror("strtod");
+            fprintf(stderr, "errno = %d -> %s\n", errno, strerror(errno));
+            return EC_CLI_INVALID_TIME_INTERVAL;
+        }
+        if (endptr == start) {
+            fprintf(stderr, "No digits were found\n");
+            return EC_CLI_INVALID_TIME_INTERVAL;
+        }
+        options->levels++;
+        start = endptr + 1;
+    } while (*endptr == ',');
+    if (*endptr != '\0') {
+        return EC_CLI_INVALID_TIME_INTERVAL;
+    }
+    return EC_SUCCESS;
+}
+
+ec_t pipeline_option (int argc, char *argv[], int *i, void *arg) {
+    /* params */
+    pipeline_options_t *options = (pipeline_options_t *) arg;
+    ec_t                ec = EC_SUCCESS;    /* error code */
+    char               *endptr;             /* string to int conversion pointer */
+
+    if ((strcmp(argv[*i], "-i") == 0) || (strcmp(argv[*i], "--input") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            /* "-i" can be repeated, each value is a file, glob pattern or directory */
+            if (options->input_options == INPUT_MAX_OPTIONS) {
+                ec = EC_CLI_MAX_INPUTS;
+            } else {
+                options->input_options++;
+                ec = input_list_add(&options->inputs, argv[*i]);
+            }
+        } else {
+            ec = EC_CLI_NO_INPUT_FILE_VALUE;
+        }
+    } else if ((strcmp(argv[*i], "-t") == 0) || (strcmp(argv[*i], "--time-interval") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            /* several intervals are counted in one pass, each coarser level is rolled up from the finest */
+            ec = parse_time_intervals(argv[*i], options);
+        } else {
+            ec = EC_CLI_NO_TIME_INTERVAL_VALUE;
+        }
+    } else if ((strcmp(argv[*i], "-n") == 0) || (strcmp(argv[*i], "--threads") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            options->threads = strtol(argv[*i], &endptr, 10);
+            if (errno != EC_SUCCESS) {
+                perror("strtol");
+                fprintf(stderr, "errno = %d -> %s\n", errno, strerror(errno));
+                ec = EC_CLI_INVALID_THREADS;
+            }
+            if (endptr == argv[*i]) {
+                fprintf(stderr, "No digits were found\n");
+                ec = EC_CLI_INVALID_THREADS;
+            }
+        } else {
+            ec = EC_CLI_NO_THREADS_VALUE;
+        }
+    } else if ((strcmp(argv[*i], "-r") == 0) || (strcmp(argv[*i], "--reader") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            ec = parse_reader(argv[*i], &options->reader);
+        } else {
+            ec = EC_CLI_NO_READER_VALUE;
+        }
+    } else if ((strcmp(argv[*i], "-S") == 0) || (strcmp(argv[*i], "--stats") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            options->stats_target = argv[*i];
+        } else {
+            ec = EC_CLI_NO_STATS_VALUE;
+        }
+    } else if ((strcmp(argv[*i], "-v") == 0) || (strcmp(argv[*i], "--verbose") == 0)) {
+        options->verbose = true;
+    } else {
+        ec = EC_CLI_UNKNOWN_OPTION;
+    }
+    return ec;
+}
+
+/* @brief Parse every CLI argument
+ * @details an option is offered to parsers in order until one does not return EC_CLI_UNKNOWN_OPTION
+ */
+ec_t pipeline_parse_options (int argc, char *argv[], const pipeline_option_t *parsers, void * const *args, size_t count) {
+    /* params */
+    ec_t    ec = EC_SUCCESS;    /* error code */
+    int     i;                  /* argument iterator */
+    size_t  k;                  /* parser iterator */
+
+    for (i=1; (i<argc) && (ec==EC_SUCCESS); i++) {
+        ec = EC_CLI_UNKNOWN_OPTION;
+        for (k=0; (k<count) && (ec==EC_CLI_UNKNOWN_OPTION); k++) {
+            ec = parsers[k](argc, argv, &i, args[k]);
+        }
+        if (ec == EC_CLI_UNKNOWN_OPTION) {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+        }
+    }
+    return ec;
+}
+
+void pipeline_options_print (const pipeline_options_t *options) {
+    /* params */
+    size_t      input_index;    /* input file iterator */
+    uint32_t    level;          /* level iterator */
+
+    for (input_index=0; input_index<options->inputs.count; input_index++) {
+        fprintf(stderr, "    Input file:     %s\n", options->inputs.paths[input_index]);
+    }
+    for (level=0; level<options->levels; level++) {
+        fprintf(stderr, "    Time interval:  %lf\n", options->time_intervals[level]);
+    }
+    fprintf(stderr, "    Threads:        %ld\n", options->threads);
+    fprintf(stderr, "    Reader:         %d\n", options->reader);
+    fprintf(stderr, "    Stats:          %s\n", (options->stats_target != NULL) ? options->stats_target : "none");
+    return;
+}
+
+/* @brief Check shared options
+ * @details input files are validated by input_list_add, each interval must be at least 1 nsec
+ */
+ec_t pipeline_options_check (const pipeline_options_t *options) {
+    /* params */
+    interval_bin_t  bin;        /* binning state, only for validation */
+    uint32_t        level;      /* level iterator */
+
+    if (options->inputs.count == 0) {
+        return EC_CLI_NO_INPUT_OPTION;
+    }
+    if (options->levels == 0) {
+        return EC_CLI_NO_TIME_INTERVAL_OPTION;
+    }
+    if ((options->threads < 1) || (options->threads > INT32_MAX)) {
+        return EC_CLI_INVALID_THREADS;
+    }
+    for (level=0; level<options->levels; level++) {
+        if (interval_bin_init(&bin, options->time_intervals[level]) != EC_SUCCESS) {
+            return EC_CLI_INVALID_TIME_INTERVAL;
+        }
+    }
+    return EC_SUCCESS;
+}
@@ -0,0 +1,382 @@
+/**
+ * @file lib_pipeline.h
+ * @brief Per-packet analysis pipeline: trace source decoded once and fanned out to registered stages
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ * @details
+ * Source opens a trace with the mmap reader if possible, otherwise libtrace, and decodes each packet once
+ * into pipeline_packet_t. Only fields some stage needs are retrieved from libtrace, see PIPELINE_NEED_*.
+ * Timestamps of both readers are nanoseconds since epoch, libtrace timestamps are taken from the ERF timestamp,
+ * which is exact in every format and needs no struct return.
+ * Driver passes every packet to each stage in registration order. Intervals are aligned to the first packet
+ * unless the origin is set before, and an interval callback is made once per boundary crossed,
+ * so a stage decides itself whether empty intervals in between are written out.
+ * A stage holding packets back, like the reorder stage of lib_reorder_buffer, pushes them to a pipeline of its own
+ * stages with pipeline_push. Each stage declares the modes it supports, so a tool checks the stages of a run
+ * once with pipeline_require instead of checking every pair of options.
+ * Options shared by every tool (inputs, intervals, threads, reader, stats and verbose) are parsed by pipeline_option,
+ * tools and stages add their own parsers to the same loop of pipeline_parse_options.
+ * Ref:
+ * 1. https://github.com/LibtraceTeam/libtrace/blob/cc98f68f72e24bf51e2dabc00af0dbc4ffe7bb3d/lib/trace.c#L1399
+ * 2. https://wiki.wireshark.org/Development/LibpcapFileFormat
+*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "libtrace.h"
+#include "lib_error.h"
+#include "lib_pcap_mmap.h"
+#include "lib_interval_bin.h"
+#include "lib_interval_rollup.h"
+#include "lib_input_list.h"
+
+#define PIPELINE_MAX_STAGES         8           /* stages of one pipeline */
+#define PIPELINE_NEED_LAYER2        (1U << 0)   /* layer 2 header, mmap reader is only used for ethernet */
+#define PIPELINE_NEED_CAPTURE       (1U << 1)   /* capture length, always known to mmap reader */
+#define PIPELINE_CAN_THREADS        (1U << 0)   /* stage state of workers is merged, runs with several threads */
+#define PIPELINE_CAN_CHECKPOINT     (1U << 1)   /* stage state is saved in checkpoint and restored on resume */
+
+/**
+ * @brief One decoded packet passed to every stage
+ */
+typedef struct {
+    uint64_t            ts;             ///< timestamp since epoch (nsec)
+    uint32_t            wire_length;    ///< packet length on wire (byte)
+    uint32_t            capture_length; ///< captured length (byte), only retrieved from libtrace if PIPELINE_NEED_CAPTURE
+    void               *layer2;         ///< layer 2 header, NULL unless PIPELINE_NEED_LAYER2
+    libtrace_linktype_t linktype;       ///< link type of layer 2 header
+    uint32_t            remaining;      ///< captured bytes from layer 2 header
+    uint64_t            offset;         ///< offset of next record of mmap reader, 0 if read by libtrace
+} pipeline_packet_t;
+
+/**
+ * @brief Opened trace file, read by pipeline_source_next
+ */
+typedef struct {
+    const char         *path;           ///< trace file
+    uint32_t            needs;          ///< bit mask of PIPELINE_NEED_*
+    bool                use_mmap;       ///< read through mmap instead of libtrace
+    int                 rc;             ///< last return code of reader
+    pcap_mmap_t         pcap;           ///< mmap reader
+    libtrace_t         *trace;          ///< libtrace trace, NULL if mmap reader is used
+    libtrace_packet_t  *packet;         ///< libtrace packet, NULL if mmap reader is used
+} pipeline_source_t;
+
+/**
+ * @brief Analysis registered to pipeline, any callback may be NULL
+ */
+typedef struct {
+    const char *name;                   ///< name of stage
+    uint32_t    needs;                  ///< bit mask of PIPELINE_NEED_*
+    uint32_t    caps;                   ///< bit mask of PIPELINE_CAN_*, modes the stage supports
+    ec_t        unsupported;            ///< error code reported by pipeline_require if a mode is not supported
+    void       *arg;                    ///< argument of callbacks
+    ec_t      (*init) (uint64_t origin, void *arg);                     ///< origin of interval 0 is known (nsec)
+    ec_t      (*open) (pipeline_source_t *source, void *arg);           ///< trace file opened, nothing read yet
+    void      (*packet) (const pipeline_packet_t *packet, void *arg);   ///< one packet
+    void      (*interval) (uint64_t index, uint64_t next, void *arg);   ///< interval index ended, next packet is in interval next
+    ec_t      (*finish) (uint64_t index, void *arg);                    ///< trace ended in interval index, which is not complete
+} pipeline_stage_t;
+
+/**
+ * @brief Pipeline driver state, kept across trace files so they are processed as one trace
+ */
+typedef struct {
+    pipeline_stage_t    stages[PIPELINE_MAX_STAGES];    ///< registered stages
+    size_t              stage_count;    ///< number of registered stages
+    uint32_t            needs;          ///< needs of every stage
+    reader_t            reader;         ///< trace reader
+    interval_bin_t      bin;            ///< interval binning state
+    uint64_t            interval_index; ///< index of current interval
+    bool                started;        ///< origin is set
+    bool                verbose;        ///< verbose output
+} pipeline_t;
+
+/**
+ * @brief Options shared by every tool, parsed by pipeline_option
+ */
+typedef struct {
+    input_list_t        inputs;         ///< input files of "-i"
+    int                 input_options;  ///< number of "-i" options
+    double              time_intervals[ROLLUP_MAX_LEVELS];  ///< intervals of "-t" (sec), finest first
+    uint32_t            levels;         ///< number of intervals, 0 unless "-t" is given or a default is set
+    long int            threads;        ///< number of threads of "-n"
+    reader_t            reader;         ///< trace reader of "-r"
+    const char         *stats_target;   ///< stats file or shared memory of "-S", NULL if not published
+    bool                verbose;        ///< verbose output of "-v"
+} pipeline_options_t;
+
+/**
+ * @brief Option parser of a tool or stage, called by pipeline_parse_options for every option
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @param i Index of option, moved to its value if it takes one
+ * @param arg Options to fill
+ * @return EC_SUCCESS, error of option, or EC_CLI_UNKNOWN_OPTION if the option belongs to another parser
+ */
+typedef ec_t (*pipeline_option_t) (int argc, char *argv[], int *i, void *arg);
+
+/**
+ * @brief Open trace file with selected reader
+ * @param source Source to initialize
+ * @param path Trace file
+ * @param reader Trace reader
+ * @param needs Bit mask of PIPELINE_NEED_*
+ * @param verbose Print the reader used
+ * @return Error code
+ */
+ec_t pipeline_source_open (pipeline_source_t *source, const char *path, reader_t reader, uint32_t needs, bool verbose);
+
+/**
+ * @brief Check how reading ended
+ * @param source Source
+ * @return EC_SUCCESS or EC_GEN_TRACE_READ_PACKET_ERROR
+ */
+ec_t pipeline_source_end (pipeline_source_t *source);
+
+/**
+ * @brief Close trace file
+ * @param source Source
+ * @return void
+ */
+void pipeline_source_close (pipeline_source_t *source);
+
+/**
+ * @brief Convert ERF timestamp to nanoseconds
+ * @param erf ERF timestamp, 32.32 fixed point seconds
+ * @return Timestamp (nsec)
+ * @details Fraction is rounded to nanosecond, which restores the exact nanosecond or microsecond libtrace converted from
+ */
+static inline uint64_t pipeline_erf_to_nsec (uint64_t erf) {
+    return (erf >> 32) * NSEC_PER_SEC + (((erf & 0xFFFFFFFF) * NSEC_PER_SEC + 0x80000000) >> 32);
+}
+
+/**
+ * @brief Convert timestamp to tick of stages counting IAT
+ * @param ts Timestamp (nsec)
+ * @param nsec Tick is nanosecond, otherwise microsecond
+ * @return Timestamp (tick), microsecond is truncated the same as trace_get_timeval
+ */
+static inline uint64_t pipeline_ticks (uint64_t ts, bool nsec) {
+    return nsec ? ts : ts / 1000;
+}
+
+/**
+ * @brief Get ticks per second
+ * @param nsec Tick is nanosecond, otherwise microsecond
+ * @return Ticks per second
+ */
+static inline uint64_t pipeline_ticks_per_sec (bool nsec) {
+    return nsec ? NSEC_PER_SEC : NSEC_PER_SEC / 1000;
+}
+
+/**
+ * @brief Get IAT between two timestamps of the same tick
+ * @param from Earlier timestamp (tick)
+ * @param to Later timestamp (tick)
+ * @return IAT (tick), difference wraps around as unsigned and is negative as signed when to is earlier
+ */
+static inline long int pipeline_iat (uint64_t from, uint64_t to) {
+    return (long int) (to - from);
+}
+
+/**
+ * @brief Decode libtrace packet, also used by callbacks of libtrace parallel API
+ * @param packet Libtrace packet
+ * @param needs Bit mask of PIPELINE_NEED_*
+ * @param decoded Decoded packet, fields not needed are left as they are
+ * @return void
+ */
+static inline void pipeline_decode_libtrace (libtrace_packet_t *packet, uint32_t needs, pipeline_packet_t *decoded) {
+    decoded->ts = pipeline_erf_to_nsec(trace_get_erf_timestamp(packet));
+    decoded->wire_length = (uint32_t) trace_get_wire_length(packet);
+    if (needs & PIPELINE_NEED_CAPTURE) {
+        decoded->capture_length = (uint32_t) trace_get_capture_length(packet);
+    }
+    if (needs & PIPELINE_NEED_LAYER2) {
+        decoded->layer2 = trace_get_layer2(packet, &decoded->linktype, &decoded->remaining);
+    }
+    return;
+}
+
+/**
+ * @brief Read and decode next packet
+ * @param source Source
+ * @param packet Decoded packet, layer2 points into the trace until the next call
+ * @return True if a packet is read, otherwise check pipeline_source_end
+ * @details Inlined as it is called once per packet
+ */
+static inline bool pipeline_source_next (pipeline_source_t *source, pipeline_packet_t *packet) {
+    /* params */
+    pcap_packet_view_t  view;           /* packet view of mmap reader */
+
+    if (source->use_mmap) {
+        source->rc = pcap_mmap_next(&source->pcap, &view);
+        if (source->rc <= 0) {
+            return false;
+        }
+        packet->ts = timespec_to_nsec(view.ts);
+        packet->wire_length = view.wire_length;
+        packet->capture_length = view.capture_length;
+        packet->offset = source->pcap.offset;
+        if (source->needs & PIPELINE_NEED_LAYER2) {
+            packet->layer2 = (void *) (uintptr_t) view.data;
+            packet->linktype = TRACE_TYPE_ETH;
+            packet->remaining = view.capture_length;
+        }
+        return true;
+    }
+    source->rc = trace_read_packet(source->trace, source->packet);
+    if (source->rc <= 0) {
+        return false;
+    }
+    pipeline_decode_libtrace(source->packet, source->needs, packet);
+    return true;
+}
+
+/**
+ * @brief Set origin of interval 0 before the first packet, init of every stage is called
+ * @param pipeline Pipeline
+ * @param origin Start of interval 0 (nsec)
+ * @return Error code of the first failed init
+ */
+ec_t pipeline_set_origin (pipeline_t *pipeline, uint64_t origin);
+
+/**
+ * @brief Pass one packet to every stage, after the interval callbacks of the boundaries it crossed
+ * @param pipeline Pipeline
+ * @param packet Decoded packet
+ * @return EC_SUCCESS, or error of init if the packet is the first one
+ * @details Interval index is one division (or shift) of integer nanoseconds, and each stage is told once
+ *          how many boundaries the packet crossed, packet earlier than current interval is passed to current interval.
+ *          Inlined as it is called once per packet, also by stages pushing held packets to stages of their own
+ */
+static inline ec_t pipeline_push (pipeline_t *pipeline, const pipeline_packet_t *packet) {
+    /* params */
+    ec_t                ec;                 /* error code */
+    pipeline_stage_t   *stages = pipeline->stages;
+    size_t              count = pipeline->stage_count;
+    uint64_t            index;              /* interval index of packet */
+    size_t              i;                  /* iterator */
+
+    /* first packet in trace, intervals are aligned to it */
+    if (!pipeline->started) {
+        ec = pipeline_set_origin(pipeline, packet->ts);
+        if (ec != EC_SUCCESS) {
+            return ec;
+        }
+    }
+    index = interval_bin_index(&pipeline->bin, packet->ts);
+    if (index > pipeline->interval_index) {
+        for (i=0; i<count; i++) {
+            if (stages[i].interval != NULL) {
+                stages[i].interval(pipeline->interval_index, index, stages[i].arg);
+            }
+        }
+        pipeline->interval_index = index;
+    }
+    for (i=0; i<count; i++) {
+        if (stages[i].packet != NULL) {
+            stages[i].packet(packet, stages[i].arg);
+        }
+    }
+    return EC_SUCCESS;
+}
+
+/**
+ * @brief Initialize pipeline with no stage
+ * @param pipeline Pipeline to initialize
+ * @param reader Trace reader
+ * @param bin Interval binning state, origin is set by the first packet unless pipeline_set_origin is called
+ * @param verbose Verbose output
+ * @return void
+ */
+void pipeline_init (pipeline_t *pipeline, reader_t reader, const interval_bin_t *bin, bool verbose);
+
+/**
+ * @brief Register stage, packets are passed to stages in registration order
+ * @param pipeline Pipeline
+ * @param stage Stage, copied
+ * @return EC_SUCCESS or EC_GEN_TOO_MANY_STAGES
+ */
+ec_t pipeline_add_stage (pipeline_t *pipeline, const pipeline_stage_t *stage);
+
+/**
+ * @brief Check that every stage supports the modes of this run
+ * @param pipeline Pipeline
+ * @param modes Bit mask of PIPELINE_CAN_* the run uses
+ * @return EC_SUCCESS, or unsupported error code of the first stage lacking a mode
+ */
+ec_t pipeline_require (const pipeline_t *pipeline, uint32_t modes);
+
+/**
+ * @brief Restore origin and current interval of a pipeline resumed from checkpoint, init of every stage is called
+ * @param pipeline Pipeline
+ * @param origin Start of interval 0 (nsec)
+ * @param interval_index Interval of the last packet before checkpoint
+ * @return Error code of the first failed init
+ */
+ec_t pipeline_resume (pipeline_t *pipeline, uint64_t origin, uint64_t interval_index);
+
+/**
+ * @brief Read every packet of one trace file and pass it to every stage, until stop is requested
+ * @param pipeline Pipeline
+ * @param path Trace file
+ * @return Error code
+ */
+ec_t pipeline_run (pipeline_t *pipeline, const char *path);
+
+/**
+ * @brief Call finish of every stage after the last trace file
+ * @param pipeline Pipeline
+ * @return Error code of the first failed finish
+ */
+ec_t pipeline_finish (pipeline_t *pipeline);
+
+/**
+ * @brief Initialize shared options to their defaults, no interval and one thread
+ * @param options Options to initialize
+ * @return void
+ */
+void pipeline_options_init (pipeline_options_t *options);
+
+/**
+ * @brief Option parser of shared options: -i, -t, -n, -r, -S and -v
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @param i Index of option, moved to its value if it takes one
+ * @param arg Shared options
+ * @return EC_SUCCESS, error of option, or EC_CLI_UNKNOWN_OPTION
+ */
+ec_t pipeline_option (int argc, char *argv[], int *i, void *arg);
+
+/**
+ * @brief Parse every CLI argument with the first parser accepting it
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @param parsers Option parsers, tried in order
+ * @param args Argument of each parser
+ * @param count Number of parsers
+ * @return Error code of the first invalid option, or EC_CLI_UNKNOWN_OPTION if no parser accepts it
+ */
+ec_t pipeline_parse_options (int argc, char *argv[], const pipeline_option_t *parsers, void * const *args, size_t count);
+
+/**
+ * @brief Print shared options to stderr, part of verbose output
+ * @param options Shared options
+ * @return void
+ */
+void pipeline_options_print (const pipeline_options_t *options);
+
+/**
+ * @brief Check shared options, inputs and interval are required
+ * @param options Shared options
+ * @return Error code
+ */
+ec_t pipeline_options_check (const pipeline_options_t *options);
+
+#endif // PIPELINE_H
@@ -0,0 +1,438 @@
+/*
+ * @file lib_quantile_sketch.c
+ * @brief Mergeable streaming quantile sketch library source file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+
+#include "lib_quantile_sketch.h"
+
+/**
+ * @brief Compare centroids by mean for qsort
+ * @param a First centroid
+ * @param b Second centroid
+ * @return Negative, zero or positive
+ */
+static int compare_centroid (const void *a, const void *b);
+
+/**
+ * @brief Weighted average of two values, kept within them
+ * @param x1 First value
+ * @param w1 Weight of first value
+ * @param x2 Second value
+ * @param w2 Weight of second value
+ * @return Average
+ */
+static double weighted_average (double x1, double w1, double x2, double w2);
+
+/**
+ * @brief Interval callback of stage, close every interval before the one of next packet
+ * @param index Ended interval
+ * @param next Interval of next packet
+ * @param arg Quantile stage
+ * @return void
+ */
+static void quantile_interval (uint64_t index, uint64_t next, void *arg);
+
+/**
+ * @brief Packet callback of stage, add IAT and size of one packet to current interval
+ * @param packet Decoded packet
+ * @param arg Quantile stage
+ * @return void
+ */
+static void quantile_packet (const pipeline_packet_t *packet, void *arg);
+
+/**
+ * @brief Finish callback of stage, close the last interval
+ * @param index Interval of last packet
+ * @param arg Quantile stage
+ * @return EC_SUCCESS
+ */
+static ec_t quantile_finish (uint64_t index, void *arg);
+
+ec_t quantile_sketch_init (quantile_sketch_t *sketch, uint32_t compression) {
+    memset(sketch, 0, sizeof(quantile_sketch_t));
+    if (compression < QUANTILE_SKETCH_MIN_COMPRESSION) {
+        compression = QUANTILE_SKETCH_MIN_COMPRESSION;
+    }
+    sketch->compression = (double) compression;
+    sketch->capacity = compression * (QUANTILE_SKETCH_BUFFER_FACTOR + 1) + 1;
+    sketch->centroids = (quantile_centroid_t *) malloc(sketch->capacity * sizeof(quantile_centroid_t));
+    if (sketch->centroids == NULL) {
+        perror("malloc");
+        return EC_GEN_UNABLE_TO_MALLOC;
+    }
+    return EC_SUCCESS;
+}
+
+void quantile_sketch_free (quantile_sketch_t *sketch) {
+    free(sketch->centroids);
+    sketch->centroids = NULL;
+    return;
+}
+
+void quantile_sketch_reset (quantile_sketch_t *sketch) {
+    sketch->merged = 0;
+    sketch->used = 0;
+    sketch->total = 0;
+    sketch->min = 0;
+    sketch->max = 0;
+    return;
+}
+
+void quantile_sketch_compress (quantile_sketch_t *sketch) {
+    /* params */
+    quantile_centroid_t *c = sketch->centroids;
+    double      total = 0;      /* weight of all centroids */
+    double      growth;         /* odds q / (1 - q) grow by this factor per unit of k */
+    double      so_far = 0;     /* weight of centroids before current one */
+    double      limit;          /* weight the current centroid may reach, one unit of k after so_far */
+    uint32_t    out = 0;        /* current output centroid */
+    uint32_t    i;              /* iterator */
+
+    if (sketch->used == sketch->merged) {
+        return;
+    }
+    /* total is summed as merge appends centroids before it adds the total of source */
+    for (i=0; i<sketch->used; i++) {
+        total += (double) c[i].weight;
+    }
+    qsort(c, sketch->used, sizeof(quantile_centroid_t), compare_centroid);
+    /* k = normalizer * log(q / (1 - q)), one unit of k multiplies the odds by exp(1 / normalizer) */
+    growth = exp((4 * log(fmax(total / sketch->compression, 1)) + 24) / sketch->compression);
+    /* the first centroid starts at q = 0, whose odds stay 0, so it is a single value */
+    limit = 0;
+    for (i=1; i<sketch->used; i++) {
+        if (so_far + (double) (c[out].weight + c[i].weight) <= limit) {
+            c[out].weight += c[i].weight;
+            c[out].mean += (c[i].mean - c[out].mean) * (double) c[i].weight / (double) c[out].weight;
+        } else {
+            so_far += (double) c[out].weight;
+            /* q of limit has odds of so_far times growth, solved for the weight */
+            limit = total * so_far * growth / (total - so_far + so_far * growth);
+            out++;
+            c[out] = c[i];
+        }
+    }
+    sketch->merged = out + 1;
+    sketch->used = out + 1;
+    return;
+}
+
+void quantile_sketch_merge (quantile_sketch_t *sketch, const quantile_sketch_t *source) {
+    /* params */
+    uint32_t i;     /* iterator */
+
+    if (source->total == 0) {
+        return;
+    }
+    for (i=0; i<source->used; i++) {
+        if (sketch->used == sketch->capacity) {
+            quantile_sketch_compress(sketch);
+        }
+        sketch->centroids[sketch->used] = source->centroids[i];
+        sketch->used++;
+    }
+    if ((sketch->total == 0) || (source->min < sketch->min)) {
+        sketch->min = source->min;
+    }
+    if ((sketch->total == 0) || (source->max > sketch->max)) {
+        sketch->max = source->max;
+    }
+    sketch->total += source->total;
+    return;
+}
+
+double quantile_sketch_quantile (quantile_sketch_t *sketch, double quantile) {
+    /* params */
+    const quantile_centroid_t *c;   /* centroids */
+    double      total = (double) sketch->total;     /* weight of all centroids */
+    double      index;              /* rank of quantile */
+    double      so_far;             /* rank of center of current centroid */
+    double      gap;                /* rank between centers of current and next centroid */
+    double      left;               /* rank of single value of left centroid, not interpolated */
+    double      right;              /* rank of single value of right centroid, not interpolated */
+    double      w;                  /* weight of current centroid */
+    uint32_t    n;                  /* number of centroids */
+    uint32_t    i;                  /* iterator */
+
+    if (sketch->total == 0) {
+        return 0;
+    }
+    quantile_sketch_compress(sketch);
+    c = sketch->centroids;
+    n = sketch->merged;
+    if ((quantile <= 0) || (n == 1)) {
+        return (quantile <= 0) ? sketch->min : c[0].mean;
+    }
+    if (quantile >= 1) {
+        return sketch->max;
+    }
+    index = quantile * total;
+
+    /* between minimum and center of first centroid */
+    w = (double) c[0].weight;
+    if (index < 1) {
+        return sketch->min;
+    }
+    if ((c[0].weight > 1) && (index < w / 2)) {
+        return sketch->min + (index - 1) / (w / 2 - 1) * (c[0].mean - sketch->min);
+    }
+
+    /* between centers of centroids, a centroid of one value is that value */
+    so_far = w / 2;
+    for (i=0; i<n-1; i++) {
+        gap = (double) (c[i].weight + c[i + 1].weight) / 2;
+        if (so_far + gap > index) {
+            left = 0;
+            if (c[i].weight == 1) {
+                if (index - so_far < 0.5) {
+                    return c[i].mean;
+                }
+                left = 0.5;
+            }
+            right = 0;
+            if (c[i + 1].weight == 1) {
+                if (so_far + gap - index <= 0.5) {
+                    return c[i + 1].mean;
+                }
+                right = 0.5;
+            }
+            return weighted_average(c[i].mean, so_far + gap - index - right, c[i + 1].mean, index - so_far - left);
+        }
+        so_far += gap;
+    }
+
+    /* between center of last centroid and maximum */
+    w = (double) c[n - 1].weight;
+    if (index > total - 1) {
+        return sketch->max;
+    }
+    return weighted_average(c[n - 1].mean, total - index - 1, sketch->max, index - (total - w / 2));
+}
+
+ec_t interval_quantiles_init (interval_quantiles_t *quantiles, uint64_t index, uint32_t compression) {
+    /* params */
+    ec_t ec;    /* error code */
+
+    memset(quantiles, 0, sizeof(interval_quantiles_t));
+    quantiles->index = index;
+    ec = quantile_sketch_init(&quantiles->iat, compression);
+    if (ec == EC_SUCCESS) {
+        ec = quantile_sketch_init(&quantiles->size, compression);
+    }
+    return ec;
+}
+
+void interval_quantiles_free (interval_quantiles_t *quantiles) {
+    quantile_sketch_free(&quantiles->iat);
+    quantile_sketch_free(&quantiles->size);
+    return;
+}
+
+/* @brief Print quantiles
+ * @details interpolated quantiles are rounded to integer tick and byte, an interval without IAT prints 0
+ */
+void interval_quantiles_print (const char *name, interval_quantiles_t *quantiles, const char *unit) {
+    printf("%s: packets %lu, IAT p50 %.0lf p99 %.0lf p99.9 %.0lf p99.99 %.0lf %s, size p50 %.0lf p99 %.0lf p99.9 %.0lf p99.99 %.0lf byte\n",
+           name, quantiles->packets,
+           quantile_sketch_quantile(&quantiles->iat, 0.5), quantile_sketch_quantile(&quantiles->iat, 0.99),
+           quantile_sketch_quantile(&quantiles->iat, 0.999), quantile_sketch_quantile(&quantiles->iat, 0.9999), unit,
+           quantile_sketch_quantile(&quantiles->size, 0.5), quantile_sketch_quantile(&quantiles->size, 0.99),
+           quantile_sketch_quantile(&quantiles->size, 0.999), quantile_sketch_quantile(&quantiles->size, 0.9999));
+    return;
+}
+
+void quantile_stage_init (quantile_stage_t *quantiles) {
+    memset(quantiles, 0, sizeof(quantile_stage_t));
+    quantiles->compression = QUANTILE_SKETCH_DEFAULT_COMPRESSION;
+    return;
+}
+
+ec_t quantile_option (int argc, char *argv[], int *i, void *arg) {
+    /* params */
+    quantile_stage_t   *quantiles = (quantile_stage_t *) arg;
+    ec_t                ec = EC_SUCCESS;    /* error code */
+    char               *endptr;             /* string to int conversion pointer */
+
+    if ((strcmp(argv[*i], "-C") == 0) || (strcmp(argv[*i], "--quantile-compression") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            quantiles->compression = strtol(argv[*i], &endptr, 10);
+            if (errno != EC_SUCCESS) {
+                perror("strtol");
+                ec = EC_CLI_INVALID_QUANTILE_COMPRESSION;
+            }
+            if (endptr == argv[*i]) {
+                fprintf(stderr, "No digits were found\n");
+                ec = EC_CLI_INVALID_QUANTILE_COMPRESSION;
+            }
+        } else {
+            ec = EC_CLI_NO_QUANTILE_COMPRESSION_VALUE;
+        }
+    } else if ((strcmp(argv[*i], "-Q") == 0) || (strcmp(argv[*i], "--quantiles") == 0)) {
+        quantiles->enabled = true;
+    } else {
+        ec = EC_CLI_UNKNOWN_OPTION;
+    }
+    return ec;
+}
+
+/* @brief Register quantile stage
+ * @details sketches of current interval and whole trace are not saved in checkpoint,
+ *          chunks of multi-threaded mode are sketched per interval and merged by the tool
+ */
+ec_t quantile_register (quantile_stage_t *quantiles, pipeline_t *pipeline, bool nsec) {
+    /* params */
+    pipeline_stage_t    stage;      /* stage registered to pipeline */
+
+    if ((quantiles->compression < QUANTILE_SKETCH_MIN_COMPRESSION) || (quantiles->compression > QUANTILE_SKETCH_MAX_COMPRESSION)) {
+        return EC_CLI_INVALID_QUANTILE_COMPRESSION;
+    }
+    if (!quantiles->enabled) {
+        return EC_SUCCESS;
+    }
+    quantiles->nsec = nsec;
+    memset(&stage, 0, sizeof(pipeline_stage_t));
+    stage.name = "quantiles";
+    stage.caps = PIPELINE_CAN_THREADS;
+    stage.unsupported = EC_CLI_INVALID_QUANTILES;
+    stage.arg = quantiles;
+    stage.packet = quantile_packet;
+    stage.interval = quantile_interval;
+    stage.finish = quantile_finish;
+    return pipeline_add_stage(pipeline, &stage);
+}
+
+ec_t quantile_start (quantile_stage_t *quantiles, bool verbose) {
+    /* params */
+    ec_t    ec;     /* error code */
+
+    ec = interval_quantiles_init(&quantiles->interval, 0, (uint32_t) quantiles->compression);
+    if (ec == EC_SUCCESS) {
+        ec = interval_quantiles_init(&quantiles->trace, 0, (uint32_t) quantiles->compression);
+    }
+    if ((ec == EC_SUCCESS) && verbose) {
+        fprintf(stderr, "Quantile sketches: 2 x %u centroids (%zu KB) per interval\n", quantiles->interval.iat.capacity,
+                2 * quantiles->interval.iat.capacity * sizeof(quantile_centroid_t) / 1024);
+    }
+    return ec;
+}
+
+/* @brief Close interval
+ * @details empty intervals are printed as well, so line index is interval index
+ */
+void quantile_close_interval (quantile_stage_t *quantiles) {
+    /* params */
+    interval_quantiles_t   *interval = &quantiles->interval;
+    interval_quantiles_t   *trace = &quantiles->trace;
+    char                    name[64];   /* line name */
+
+    snprintf(name, sizeof(name), "Interval quantiles[%05lu]", interval->index);
+    interval_quantiles_print(name, interval, quantiles->nsec ? "nsec" : "usec");
+    quantile_sketch_merge(&trace->iat, &interval->iat);
+    quantile_sketch_merge(&trace->size, &interval->size);
+    trace->packets += interval->packets;
+    quantile_sketch_reset(&interval->iat);
+    quantile_sketch_reset(&interval->size);
+    interval->packets = 0;
+    interval->index++;
+    return;
+}
+
+void quantile_print (quantile_stage_t *quantiles) {
+    interval_quantiles_print("Trace quantiles", &quantiles->trace, quantiles->nsec ? "nsec" : "usec");
+    return;
+}
+
+void quantile_stage_free (quantile_stage_t *quantiles) {
+    interval_quantiles_free(&quantiles->interval);
+    interval_quantiles_free(&quantiles->trace);
+    return;
+}
+
+/* @brief Compare centroids
+ */
+static int compare_centroid (const void *a, const void *b) {
+    /* params */
+    double x = ((const quantile_centroid_t *) a)->mean;     /* mean of first centroid */
+    double y = ((const quantile_centroid_t *) b)->mean;     /* mean of second centroid */
+
+    return (x > y) - (x < y);
+}
+
+/* @brief Weighted average
+ * @details weights are clamped at 0, the result is clamped to the two values against rounding
+ */
+static double weighted_average (double x1, double w1, double x2, double w2) {
+    /* params */
+    double low = (x1 < x2) ? x1 : x2;   /* smaller value */
+    double high = (x1 < x2) ? x2 : x1;  /* larger value */
+    double average;                     /* weighted average */
+
+    w1 = (w1 > 0) ? w1 : 0;
+    w2 = (w2 > 0) ? w2 : 0;
+    if (w1 + w2 <= 0) {
+        return x1;
+    }
+    average = (x1 * w1 + x2 * w2) / (w1 + w2);
+    if (average < low) {
+        return low;
+    }
+    return (average > high) ? high : average;
+}
+
+/* @brief Close intervals of quantile stage
+ * @details empty intervals in between are closed as well, so line index is interval index
+ */
+static void quantile_interval (uint64_t index, uint64_t next, void *arg) {
+    /* params */
+    quantile_stage_t *quantiles = (quantile_stage_t *) arg;
+
+    (void) index;
+    while (quantiles->interval.index < next) {
+        quantile_close_interval(quantiles);
+    }
+    return;
+}
+
+/* @brief Quantiles of one packet
+ * @details negative IAT is only counted by histogram
+ */
+static void quantile_packet (const pipeline_packet_t *packet, void *arg) {
+    /* params */
+    quantile_stage_t   *quantiles = (quantile_stage_t *) arg;
+    uint64_t            ts = pipeline_ticks(packet->ts, quantiles->nsec);  /* packet timestamp (tick) */
+    long int            iat;                                                /* IAT of packet (tick) */
+
+    if (quantiles->started) {
+        iat = pipeline_iat(quantiles->last, ts);
+        if (iat >= 0) {
+            quantile_sketch_add(&quantiles->interval.iat, (double) iat);
+        }
+    }
+    quantile_sketch_add(&quantiles->interval.size, (double) packet->wire_length);
+    quantiles->interval.packets++;
+    quantiles->started = true;
+    quantiles->last = ts;
+    return;
+}
+
+/* @brief Finish quantile stage
+ * @details last interval is closed like the others, nothing is printed if no packet was read
+ */
+static ec_t quantile_finish (uint64_t index, void *arg) {
+    /* params */
+    quantile_stage_t *quantiles = (quantile_stage_t *) arg;
+
+    (void) index;
+    if ((quantiles->interval.index != 0) || (quantiles->interval.packets != 0)) {
+        quantile_close_interval(quantiles);
+    }
+    return EC_SUCCESS;
+}
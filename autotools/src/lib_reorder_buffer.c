@@ -0,0 +1,280 @@
+/*
+ * @file lib_reorder_buffer.c
+ * @brief Timestamp reorder buffer library source file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "lib_reorder_buffer.h"
+
+/**
+ * @brief Compare held packets
+ * @param a First packet
+ * @param b Second packet
+ * @return True if a is released before b
+ */
+static inline bool entry_before (const reorder_entry_t *a, const reorder_entry_t *b);
+
+/**
+ * @brief Packet callback of stage, pass packet through reorder buffer to the stages behind it
+ * @param packet Decoded packet
+ * @param arg Reorder stage
+ * @return void
+ */
+static void reorder_packet (const pipeline_packet_t *packet, void *arg);
+
+/**
+ * @brief Finish callback of stage, release every held packet and finish the stages behind it
+ * @param index Interval of last packet read
+ * @param arg Reorder stage
+ * @return Error code
+ */
+static ec_t reorder_finish (uint64_t index, void *arg);
+
+/**
+ * @brief Pass packets released by reorder buffer to the stages behind it
+ * @param reorder Reorder stage
+ * @param flush Release every held packet
+ * @return void
+ */
+static void release_packets (reorder_stage_t *reorder, bool flush);
+
+ec_t reorder_buffer_init (reorder_buffer_t *buffer, uint64_t window, size_t capacity) {
+    memset(buffer, 0, sizeof(reorder_buffer_t));
+    buffer->window = window;
+    buffer->capacity = capacity;
+    buffer->heap = (reorder_entry_t *) malloc(capacity * sizeof(reorder_entry_t));
+    if (buffer->heap == NULL) {
+        perror("malloc");
+        return EC_GEN_UNABLE_TO_MALLOC;
+    }
+    return EC_SUCCESS;
+}
+
+void reorder_buffer_free (reorder_buffer_t *buffer) {
+    free(buffer->heap);
+    buffer->heap = NULL;
+    return;
+}
+
+/* @brief Push packet
+ * @details sift up from the last leaf
+ */
+void reorder_buffer_push (reorder_buffer_t *buffer, uint64_t ts, uint32_t wire_length) {
+    /* params */
+    reorder_entry_t *heap = buffer->heap;
+    reorder_entry_t  entry;             /* new packet */
+    size_t           i = buffer->count; /* position of new packet */
+    size_t           parent;            /* parent position */
+
+    if (ts < buffer->released) {
+        buffer->late++;
+    } else if (ts < buffer->newest) {
+        buffer->reordered++;
+    } else {
+        buffer->newest = ts;
+    }
+    entry.ts = ts;
+    entry.seq = buffer->seq++;
+    entry.wire_length = wire_length;
+    entry.reserved = 0;
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (!entry_before(&entry, &heap[parent])) {
+            break;
+        }
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = entry;
+    buffer->count++;
+    if (buffer->count > buffer->peak) {
+        buffer->peak = buffer->count;
+    }
+    return;
+}
+
+/* @brief Pop packet
+ * @details the last leaf is sifted down from the root
+ */
+bool reorder_buffer_pop (reorder_buffer_t *buffer, reorder_entry_t *entry, bool flush) {
+    /* params */
+    reorder_entry_t *heap = buffer->heap;
+    reorder_entry_t  last;      /* last leaf */
+    size_t           i = 0;     /* position of last leaf */
+    size_t           child;     /* earlier child */
+
+    if (buffer->count == 0) {
+        return false;
+    }
+    if (!flush && (heap[0].ts + buffer->window > buffer->newest)) {
+        if (buffer->count < buffer->capacity) {
+            return false;
+        }
+        buffer->overflow++;
+    }
+    *entry = heap[0];
+    if (entry->ts > buffer->released) {
+        buffer->released = entry->ts;
+    }
+    buffer->count--;
+    last = heap[buffer->count];
+    while ((child = 2 * i + 1) < buffer->count) {
+        if ((child + 1 < buffer->count) && entry_before(&heap[child + 1], &heap[child])) {
+            child++;
+        }
+        if (!entry_before(&heap[child], &last)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return true;
+}
+
+void reorder_stage_init (reorder_stage_t *reorder) {
+    memset(reorder, 0, sizeof(reorder_stage_t));
+    return;
+}
+
+ec_t reorder_option (int argc, char *argv[], int *i, void *arg) {
+    /* params */
+    reorder_stage_t    *reorder = (reorder_stage_t *) arg;
+    ec_t                ec = EC_SUCCESS;    /* error code */
+    char               *endptr;             /* string to double conversion pointer */
+
+    if ((strcmp(argv[*i], "-W") == 0) || (strcmp(argv[*i], "--reorder-window") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            reorder->enabled = true;
+            reorder->window = strtod(argv[*i], &endptr);
+            if (errno != EC_SUCCESS) {
+                perror("strtod");
+                ec = EC_CLI_INVALID_REORDER_WINDOW;
+            }
+            if (endptr == argv[*i]) {
+                fprintf(stderr, "No digits were found\n");
+                ec = EC_CLI_INVALID_REORDER_WINDOW;
+            }
+        } else {
+            ec = EC_CLI_NO_REORDER_WINDOW_VALUE;
+        }
+    } else {
+        ec = EC_CLI_UNKNOWN_OPTION;
+    }
+    return ec;
+}
+
+/* @brief Register reorder stage
+ * @details held packets span chunks, keep no header and are not saved in checkpoint,
+ *          so no stage behind the buffer may need a header
+ */
+ec_t reorder_register (reorder_stage_t *reorder, pipeline_t *pipeline, bool nsec) {
+    /* params */
+    pipeline_stage_t    stage;      /* stage registered to pipeline */
+
+    if (!reorder->enabled) {
+        return EC_SUCCESS;
+    }
+    if ((reorder->window < 1e-9) || (reorder->window > 3600) || (!nsec && (reorder->window < 1e-6))) {
+        return EC_CLI_INVALID_REORDER_WINDOW;
+    }
+    if (reorder->downstream.needs & PIPELINE_NEED_LAYER2) {
+        return EC_CLI_INVALID_REORDER;
+    }
+    reorder->nsec = nsec;
+    memset(&stage, 0, sizeof(pipeline_stage_t));
+    stage.name = "reorder";
+    stage.unsupported = EC_CLI_INVALID_REORDER;
+    stage.arg = reorder;
+    stage.packet = reorder_packet;
+    stage.finish = reorder_finish;
+    return pipeline_add_stage(pipeline, &stage);
+}
+
+/* @brief Allocate reorder stage
+ * @details heap is allocated once, packets only go through it after the first out-of-order one.
+ *          Window is kept in nanoseconds as packets are pushed on with their own timestamps
+ */
+ec_t reorder_start (reorder_stage_t *reorder) {
+    return reorder_buffer_init(&reorder->buffer, (uint64_t) (reorder->window * (double) NSEC_PER_SEC), REORDER_DEFAULT_CAPACITY);
+}
+
+void reorder_print (const reorder_stage_t *reorder) {
+    /* params */
+    const reorder_buffer_t *buffer = &reorder->buffer;
+
+    printf("Reorder window %lu %s: reordered %lu, late %lu, overflow %lu, peak held %zu%s\n", pipeline_ticks(buffer->window, reorder->nsec),
+           reorder->nsec ? "nsec" : "usec", buffer->reordered, buffer->late, buffer->overflow, buffer->peak, buffer->active ? "" : ", input in order");
+    return;
+}
+
+/* @brief Compare held packets
+ */
+static inline bool entry_before (const reorder_entry_t *a, const reorder_entry_t *b) {
+    return (a->ts < b->ts) || ((a->ts == b->ts) && (a->seq < b->seq));
+}
+
+/* @brief Reorder packet
+ * @details ordered input is passed on after one comparison, and the heap is only used after the first out-of-order packet
+ */
+static void reorder_packet (const pipeline_packet_t *packet, void *arg) {
+    /* params */
+    reorder_stage_t    *reorder = (reorder_stage_t *) arg;
+    ec_t                ec;     /* error code */
+
+    if (reorder_buffer_bypass(&reorder->buffer, packet->ts)) {
+        ec = pipeline_push(&reorder->downstream, packet);
+        if ((ec != EC_SUCCESS) && (reorder->ec == EC_SUCCESS)) {
+            reorder->ec = ec;
+        }
+        return;
+    }
+    if (reorder->buffer.count == reorder->buffer.capacity) {
+        release_packets(reorder, false);
+    }
+    reorder_buffer_push(&reorder->buffer, packet->ts, packet->wire_length);
+    release_packets(reorder, false);
+    return;
+}
+
+/* @brief Finish reorder stage
+ * @details held packets span files and are only released at the end of the last one
+ */
+static ec_t reorder_finish (uint64_t index, void *arg) {
+    /* params */
+    reorder_stage_t *reorder = (reorder_stage_t *) arg;
+
+    (void) index;
+    release_packets(reorder, true);
+    if (reorder->ec != EC_SUCCESS) {
+        return reorder->ec;
+    }
+    return pipeline_finish(&reorder->downstream);
+}
+
+/* @brief Release packets
+ */
+static void release_packets (reorder_stage_t *reorder, bool flush) {
+    /* params */
+    reorder_entry_t     entry;      /* released packet */
+    pipeline_packet_t   packet;     /* packet pushed to stages behind buffer */
+    ec_t                ec;         /* error code */
+
+    memset(&packet, 0, sizeof(pipeline_packet_t));
+    packet.linktype = TRACE_TYPE_ETH;
+    while (reorder_buffer_pop(&reorder->buffer, &entry, flush)) {
+        packet.ts = entry.ts;
+        packet.wire_length = entry.wire_length;
+        ec = pipeline_push(&reorder->downstream, &packet);
+        if ((ec != EC_SUCCESS) && (reorder->ec == EC_SUCCESS)) {
+            reorder->ec = ec;
+        }
+    }
+    return;
+}
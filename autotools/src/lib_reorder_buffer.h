@@ -0,0 +1,166 @@
+/**
+ * @file lib_reorder_buffer.h
+ * @brief Bounded timestamp reorder buffer: min-heap of packets held for a lateness window
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ * @details
+ * Interfaces of a multi-port capture are interleaved slightly out of order, which turns real IAT into negative ones.
+ * A packet is held until the newest timestamp seen is one window past it, then released in timestamp order,
+ * packets of the same timestamp keep their arrival order. Only timestamp and wire length are held, no header.
+ * A packet earlier than one already released is late: it is released at once and still gives a negative IAT.
+ * When the heap is full its earliest packet is released before the window passed, which is counted as overflow.
+ * Until the first packet earlier than its predecessor, packets bypass the heap with one comparison,
+ * so ordered input costs nothing. That first packet is late as its predecessors are already released.
+ * Reorder stage passes the packets of a pipeline through the buffer and pushes released ones to a pipeline of its own,
+ * so the stages behind it see timestamp order. Option "-W" is parsed by reorder_option.
+ * Ref:
+ * 1. https://en.wikipedia.org/wiki/Binary_heap
+*/
+
+#ifndef REORDER_BUFFER_H
+#define REORDER_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "lib_error.h"
+#include "lib_pipeline.h"
+
+#define REORDER_DEFAULT_CAPACITY    (1 << 18)   /* packets held at most, 6 MB */
+
+/**
+ * @brief Packet held in buffer
+ */
+typedef struct {
+    uint64_t    ts;             ///< timestamp (tick)
+    uint64_t    seq;            ///< arrival order, orders packets of the same timestamp
+    uint32_t    wire_length;    ///< packet length on wire (byte)
+    uint32_t    reserved;       ///< zero
+} reorder_entry_t;
+
+/**
+ * @brief Reorder buffer
+ */
+typedef struct {
+    reorder_entry_t *heap;      ///< min-heap by timestamp and arrival order
+    size_t      count;          ///< packets in heap
+    size_t      capacity;       ///< maximum packets in heap
+    uint64_t    window;         ///< lateness window (tick)
+    uint64_t    newest;         ///< largest timestamp seen (tick)
+    uint64_t    released;       ///< largest timestamp released (tick)
+    uint64_t    seq;            ///< arrival order of next packet
+    bool        active;         ///< an out-of-order packet was seen, packets go through heap
+    uint64_t    reordered;      ///< packets earlier than a previous one, released in order
+    uint64_t    late;           ///< packets earlier than a released one, beyond window
+    uint64_t    overflow;       ///< packets released before window passed as heap was full
+    size_t      peak;           ///< largest number of packets held
+} reorder_buffer_t;
+
+/**
+ * @brief Reorder stage, packets held for lateness window are pushed in timestamp order to the stages behind it
+ */
+typedef struct {
+    bool                enabled;        ///< "-W" pass packets through reorder buffer
+    double              window;         ///< lateness window (sec)
+    bool                nsec;           ///< tick of printed window is nanosecond, otherwise microsecond, set by reorder_register
+    reorder_buffer_t    buffer;         ///< held packets, timestamps are in nanoseconds
+    pipeline_t          downstream;     ///< stages fed with released packets
+    ec_t                ec;             ///< first error of downstream stages
+} reorder_stage_t;
+
+/**
+ * @brief Initialize reorder buffer
+ * @param buffer Reorder buffer
+ * @param window Lateness window (tick)
+ * @param capacity Maximum packets held
+ * @return EC_SUCCESS or EC_GEN_UNABLE_TO_MALLOC
+ */
+ec_t reorder_buffer_init (reorder_buffer_t *buffer, uint64_t window, size_t capacity);
+
+/**
+ * @brief Free reorder buffer
+ * @param buffer Reorder buffer
+ * @return void
+ */
+void reorder_buffer_free (reorder_buffer_t *buffer);
+
+/**
+ * @brief Hold one packet, heap must not be full
+ * @param buffer Reorder buffer
+ * @param ts Timestamp (tick)
+ * @param wire_length Packet length on wire (byte)
+ * @return void
+ */
+void reorder_buffer_push (reorder_buffer_t *buffer, uint64_t ts, uint32_t wire_length);
+
+/**
+ * @brief Release earliest packet if the window has passed it, or heap is full, or buffer is flushed
+ * @param buffer Reorder buffer
+ * @param entry Released packet
+ * @param flush Release every packet, at end of trace
+ * @return True if a packet is released
+ */
+bool reorder_buffer_pop (reorder_buffer_t *buffer, reorder_entry_t *entry, bool flush);
+
+/**
+ * @brief Check if packet bypasses heap
+ * @param buffer Reorder buffer
+ * @param ts Timestamp (tick)
+ * @return True if packet is passed on at once, either input is ordered so far or it is the first out-of-order packet
+ * @details Inlined as it is called once per packet
+ */
+static inline bool reorder_buffer_bypass (reorder_buffer_t *buffer, uint64_t ts) {
+    if (buffer->active) {
+        return false;
+    }
+    if (ts < buffer->newest) {
+        buffer->active = true;
+        buffer->late++;
+        return true;
+    }
+    buffer->newest = ts;
+    buffer->released = ts;
+    return true;
+}
+
+/**
+ * @brief Initialize stage
+ * @param reorder Reorder stage
+ * @return void
+ */
+void reorder_stage_init (reorder_stage_t *reorder);
+
+/**
+ * @brief Option parser of stage: -W
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @param i Index of option, moved to its value if it takes one
+ * @param arg Reorder stage
+ * @return EC_SUCCESS, error of option, or EC_CLI_UNKNOWN_OPTION
+ */
+ec_t reorder_option (int argc, char *argv[], int *i, void *arg);
+
+/**
+ * @brief Check options of stage and register it if enabled, after the stages behind it
+ * @param reorder Reorder stage, downstream has its stages
+ * @param pipeline Pipeline reading the trace
+ * @param nsec Tick is nanosecond, otherwise microsecond
+ * @return Error code
+ */
+ec_t reorder_register (reorder_stage_t *reorder, pipeline_t *pipeline, bool nsec);
+
+/**
+ * @brief Allocate heap of stage
+ * @param reorder Reorder stage
+ * @return Error code
+ */
+ec_t reorder_start (reorder_stage_t *reorder);
+
+/**
+ * @brief Print packets reordered, late and overflowed
+ * @param reorder Reorder stage
+ * @return void
+ */
+void reorder_print (const reorder_stage_t *reorder);
+
+#endif // REORDER_BUFFER_H
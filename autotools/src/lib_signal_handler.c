@@ -8,27 +8,63 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <string.h>
+#include <unistd.h>
 #include "lib_signal_handler.h"
 #include "lib_output_format.h"
 
+#define SIGNAL_MESSAGE_SIZE 128     /* size of prepared message of one signal */
+
+volatile sig_atomic_t signal_stop = 0;
+
+/* "Signal nn -> name received" of each signal, formatted before any signal arrives */
+static char signal_messages[NSIG][SIGNAL_MESSAGE_SIZE];
+
+/**
+ * @brief Write message to stderr, async-signal-safe
+ * @param message Message
+ * @return void
+ */
+static void write_message (const char *message);
+
 void signal_handler (int signum) {
-    output_format format;
+    /* only async-signal-safe calls are allowed here, printf and exit may deadlock or flush half-written buffers */
+    if (((signum == SIGINT) || (signum == SIGTERM)) && (signal_stop == 0)) {
+        signal_stop = signum;
+        write_message(signal_messages[signum]);
+        write_message(", stopping and writing results, send it again to exit immediately.\n");
+        return;
+    }
+    write_message(signal_messages[signum]);
+    write_message(".\n");
+    _exit(signum);
+}
+
+void register_all_signal_handlers (void) {
+    /* params */
+    output_format       format;         /* output format */
+    struct sigaction    action;         /* signal action */
+    const int           signums[] = { SIGINT, SIGILL, SIGABRT, SIGFPE, SIGSEGV, SIGTERM };
+    size_t              i;              /* iterator */
+
     get_format(&format);
-    char *signal_name = strsignal(signum);
-    printf("\n%sSignal %2d -> %s received.\n", format.status.warning, signum, signal_name);
-    exit(signum);
+    memset(&action, 0, sizeof(struct sigaction));
+    action.sa_handler = signal_handler;
+    sigemptyset(&action.sa_mask);
+    /* interrupted reads are restarted, the read loop notices the stop request at the next packet */
+    action.sa_flags = SA_RESTART;
+    for (i=0; i<sizeof(signums)/sizeof(signums[0]); i++) {
+        snprintf(signal_messages[signums[i]], SIGNAL_MESSAGE_SIZE, "\n%sSignal %2d -> %s received", format.status.warning, signums[i], strsignal(signums[i]));
+        sigaction(signums[i], &action, NULL);
+    }
+    // SIGHUP, SIGQUIT and SIGTRAP keep their default action
     return;
 }
 
-void register_all_signal_handlers (void) {
-    // signal(SIGHUP, signal_handler);
-    signal(SIGINT, signal_handler);
-    // signal(SIGQUIT, signal_handler);
-    signal(SIGILL, signal_handler);
-    // signal(SIGTRAP, signal_handler);
-    signal(SIGABRT, signal_handler);
-    signal(SIGFPE, signal_handler);
-    signal(SIGSEGV, signal_handler);
-    signal(SIGTERM, signal_handler);
+static void write_message (const char *message) {
+    /* params */
+    ssize_t rc;     /* return code of write, nothing can be done about a failed write here */
+
+    rc = write(STDERR_FILENO, message, strlen(message));
+    (void) rc;
     return;
 }
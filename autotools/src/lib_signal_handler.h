@@ -2,6 +2,12 @@
  * @file lib_signal_handler.h
  * @brief Defines custom signal handler.
  * @author belongtothenight / Da-Chuan Chen / 2024
+ * @details
+ * The first SIGINT or SIGTERM only requests a graceful stop: read loops poll signal_stop_requested,
+ * stop reading, and the program writes every result and stats as if the trace ended there.
+ * A second SIGINT or SIGTERM, or any fault signal, exits immediately.
+ * Messages are prepared when handlers are registered, the handler itself only calls write and _exit,
+ * which are async-signal-safe.
  * Ref:
  * 1. https://stackoverflow.com/questions/554138/catching-segfaults-in-c
  * 2. https://linuxhint.com/signal_handlers_c_programming_language/
@@ -10,6 +16,7 @@
  * 5. https://chromium.googlesource.com/chromiumos/docs/+/master/constants/signals.md
  * 6. https://stackoverflow.com/questions/16509614/signal-number-to-name
  * 7. https://openbooks.sourceforge.net/books/wga/dealing-with-libraries.html
+ * 8. https://man7.org/linux/man-pages/man7/signal-safety.7.html
 */
 
 #ifndef SIGNAL_HANDLER_H
@@ -17,6 +24,11 @@
 
 #include <signal.h>
 
+/**
+ * @brief Signal number of requested graceful stop, 0 if none
+ */
+extern volatile sig_atomic_t signal_stop;
+
 /**
  * @brief Signal handler for all signals.
  * @param signum:   int
@@ -30,4 +42,12 @@ void signal_handler (int signum);
 */
 void register_all_signal_handlers (void);
 
+/**
+ * @brief Check if graceful stop is requested, cheap enough to be polled once per packet
+ * @return Signal number which requested stop, 0 if none
+ */
+static inline int signal_stop_requested (void) {
+    return (int) signal_stop;
+}
+
 #endif // SIGNAL_HANDLER_H
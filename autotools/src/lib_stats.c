@@ -0,0 +1,346 @@
+/*
+ * @file lib_stats.c
+ * @brief Runtime throughput statistics library source file
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lib_stats.h"
+
+/**
+ * @brief Publisher state
+ */
+typedef struct {
+    pthread_t           thread;             /* publisher thread */
+    pthread_mutex_t     mutex;              /* protects stop */
+    pthread_cond_t      cond;               /* signaled by stats_stop */
+    bool                running;            /* publisher thread is started */
+    bool                stop;               /* publisher should publish final snapshot and exit */
+    const char         *path;               /* stats file, NULL if shared memory */
+    stats_snapshot_t   *shm;                /* mapped shared-memory snapshot, NULL if stats file */
+    uint64_t            period_nsec;        /* snapshot period (nsec) */
+    ec_t                ec;                 /* error code of last publishing */
+    uint64_t            last_nsec;          /* elapsed time of previous snapshot (nsec) */
+    uint64_t            last_packets;       /* packets of previous snapshot */
+    uint64_t            last_bytes;         /* bytes of previous snapshot */
+} stats_publisher_t;
+
+static stats_thread_t       slots[STATS_MAX_THREADS];   /* slot of each reading thread */
+static stats_thread_t       shared_slot;                /* slot of threads beyond STATS_MAX_THREADS, not published */
+static uint32_t             slot_count = 0;             /* claimed slots */
+static __thread stats_thread_t *local_slot = NULL;      /* slot of calling thread */
+static uint64_t             start_cycles = 0;           /* cycles at stats_start */
+static uint64_t             start_nsec = 0;             /* monotonic time at stats_start (nsec) */
+static stats_publisher_t    publisher;                  /* publisher state */
+
+/**
+ * @brief Get monotonic time
+ * @return Time (nsec)
+ */
+static uint64_t get_monotonic_nsec (void);
+
+/**
+ * @brief Publisher thread, publish snapshot every period until stopped
+ * @param arg Unused
+ * @return NULL
+ */
+static void *publisher_thread (void *arg);
+
+/**
+ * @brief Collect and publish one snapshot to stats file or shared memory
+ * @return Error code
+ */
+static ec_t publish_snapshot (void);
+
+/**
+ * @brief Get upper bound of the histogram bucket holding given percentile
+ * @param snapshot Snapshot
+ * @param percentile Percentile (0-1)
+ * @return Cycles
+ */
+static uint64_t get_percentile (const stats_snapshot_t *snapshot, double percentile);
+
+ec_t stats_start (const char *target, double period) {
+    /* params */
+    int fd;     /* shared-memory file descriptor */
+
+    memset(&publisher, 0, sizeof(stats_publisher_t));
+    start_nsec = get_monotonic_nsec();
+    start_cycles = stats_cycles();
+    if (target == NULL) {
+        return EC_SUCCESS;
+    }
+    publisher.period_nsec = (uint64_t) (period * 1e9);
+    if (publisher.period_nsec == 0) {
+        publisher.period_nsec = 1;
+    }
+
+    if (strncmp(target, STATS_SHM_PREFIX, strlen(STATS_SHM_PREFIX)) == 0) {
+        fd = shm_open(target + strlen(STATS_SHM_PREFIX), O_CREAT | O_RDWR, 0644);
+        if (fd < 0) {
+            perror("shm_open");
+            return EC_GEN_UNABLE_TO_OPEN_STATS;
+        }
+        if (ftruncate(fd, sizeof(stats_snapshot_t)) != 0) {
+            perror("ftruncate");
+            close(fd);
+            return EC_GEN_UNABLE_TO_OPEN_STATS;
+        }
+        publisher.shm = (stats_snapshot_t *) mmap(NULL, sizeof(stats_snapshot_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (publisher.shm == MAP_FAILED) {
+            perror("mmap");
+            publisher.shm = NULL;
+            return EC_GEN_UNABLE_TO_OPEN_STATS;
+        }
+        memset(publisher.shm, 0, sizeof(stats_snapshot_t));
+    } else {
+        publisher.path = target;
+    }
+
+    /* publish once so a watcher sees the segment or file right away */
+    publisher.ec = publish_snapshot();
+    if (publisher.ec != EC_SUCCESS) {
+        return publisher.ec;
+    }
+    pthread_mutex_init(&publisher.mutex, NULL);
+    pthread_cond_init(&publisher.cond, NULL);
+    if (pthread_create(&publisher.thread, NULL, publisher_thread, NULL) != 0) {
+        perror("pthread_create");
+        return EC_GEN_UNABLE_TO_CREATE_THREAD;
+    }
+    publisher.running = true;
+    return EC_SUCCESS;
+}
+
+ec_t stats_stop (void) {
+    if (publisher.running) {
+        pthread_mutex_lock(&publisher.mutex);
+        publisher.stop = true;
+        pthread_cond_signal(&publisher.cond);
+        pthread_mutex_unlock(&publisher.mutex);
+        pthread_join(publisher.thread, NULL);
+        pthread_cond_destroy(&publisher.cond);
+        pthread_mutex_destroy(&publisher.mutex);
+        publisher.running = false;
+    }
+    if (publisher.shm != NULL) {
+        munmap(publisher.shm, sizeof(stats_snapshot_t));
+        publisher.shm = NULL;
+    }
+    return publisher.ec;
+}
+
+stats_thread_t *stats_thread (void) {
+    /* params */
+    uint32_t index; /* claimed slot */
+
+    if (local_slot == NULL) {
+        index = __atomic_fetch_add(&slot_count, 1, __ATOMIC_RELAXED);
+        local_slot = (index < STATS_MAX_THREADS) ? &slots[index] : &shared_slot;
+        local_slot->countdown = STATS_SAMPLE_PERIOD;
+        local_slot->output_countdown = STATS_SAMPLE_PERIOD;
+        local_slot->random = 0x9E3779B97F4A7C15ULL ^ index;
+    }
+    return local_slot;
+}
+
+void stats_collect (stats_snapshot_t *snapshot) {
+    /* params */
+    uint64_t    now_nsec = get_monotonic_nsec();    /* monotonic time (nsec) */
+    uint64_t    now_cycles = stats_cycles();        /* cycles */
+    uint64_t    read_cycles = 0;                    /* read cycles of sampled packets */
+    uint64_t    process_cycles = 0;                 /* per_packet cycles of sampled packets */
+    uint64_t    output_cycles = 0;                  /* output cycles */
+    uint32_t    threads;                            /* published slots */
+    uint32_t    i;                                  /* slot iterator */
+    uint32_t    b;                                  /* bucket iterator */
+    struct timespec ts;                             /* wall clock */
+
+    memcpy(snapshot->magic, STATS_MAGIC, sizeof(snapshot->magic));
+    snapshot->version = STATS_VERSION;
+    threads = __atomic_load_n(&slot_count, __ATOMIC_RELAXED);
+    if (threads > STATS_MAX_THREADS) {
+        threads = STATS_MAX_THREADS;
+    }
+    snapshot->threads = threads;
+    snapshot->packets = 0;
+    snapshot->bytes = 0;
+    snapshot->sampled = 0;
+    memset(snapshot->histogram, 0, sizeof(snapshot->histogram));
+    for (i=0; i<threads; i++) {
+        snapshot->packets += __atomic_load_n(&slots[i].packets, __ATOMIC_RELAXED);
+        snapshot->bytes += __atomic_load_n(&slots[i].bytes, __ATOMIC_RELAXED);
+        snapshot->sampled += __atomic_load_n(&slots[i].sampled, __ATOMIC_RELAXED);
+        read_cycles += __atomic_load_n(&slots[i].read_cycles, __ATOMIC_RELAXED);
+        process_cycles += __atomic_load_n(&slots[i].process_cycles, __ATOMIC_RELAXED);
+        output_cycles += __atomic_load_n(&slots[i].output_cycles, __ATOMIC_RELAXED);
+        for (b=0; b<STATS_CYCLE_BUCKETS; b++) {
+            snapshot->histogram[b] += __atomic_load_n(&slots[i].histogram[b], __ATOMIC_RELAXED);
+        }
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    snapshot->time_nsec = (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+    snapshot->elapsed_nsec = now_nsec - start_nsec;
+    /* rdtsc runs at a constant rate on current x86, calibrate it against monotonic clock over the whole run */
+    snapshot->cycles_per_nsec = 1.0;
+    if (snapshot->elapsed_nsec > 0) {
+        snapshot->cycles_per_nsec = (double) (now_cycles - start_cycles) / (double) snapshot->elapsed_nsec;
+    }
+    /* sampled cycles stand for STATS_SAMPLE_PERIOD packets or writes each */
+    snapshot->read_nsec = (uint64_t) ((double) read_cycles * STATS_SAMPLE_PERIOD / snapshot->cycles_per_nsec);
+    snapshot->process_nsec = (uint64_t) ((double) process_cycles * STATS_SAMPLE_PERIOD / snapshot->cycles_per_nsec);
+    snapshot->output_nsec = (uint64_t) ((double) output_cycles * STATS_SAMPLE_PERIOD / snapshot->cycles_per_nsec);
+    snapshot->cycles_p50 = get_percentile(snapshot, 0.50);
+    snapshot->cycles_p90 = get_percentile(snapshot, 0.90);
+    snapshot->cycles_p99 = get_percentile(snapshot, 0.99);
+    snapshot->packets_per_sec = 0;
+    snapshot->bytes_per_sec = 0;
+    if (snapshot->elapsed_nsec > 0) {
+        snapshot->packets_per_sec = (double) snapshot->packets * 1e9 / (double) snapshot->elapsed_nsec;
+        snapshot->bytes_per_sec = (double) snapshot->bytes * 1e9 / (double) snapshot->elapsed_nsec;
+    }
+    return;
+}
+
+void stats_print (FILE *stream) {
+    /* params */
+    stats_snapshot_t    snapshot;   /* current snapshot */
+
+    stats_collect(&snapshot);
+    fprintf(stream, "Stats: %" PRIu64 " packets, %" PRIu64 " bytes, %.0lf packets/s, %.0lf bytes/s, %u thread(s)\n",
+            snapshot.packets, snapshot.bytes, snapshot.packets_per_sec, snapshot.bytes_per_sec, snapshot.threads);
+    /* output is written from per_packet in single-threaded mode, so it is part of per_packet there */
+    fprintf(stream, "Time (estimated, summed over threads): read %.3lf sec, per_packet %.3lf sec, output %.3lf sec\n",
+            (double) snapshot.read_nsec / 1e9, (double) snapshot.process_nsec / 1e9, (double) snapshot.output_nsec / 1e9);
+    fprintf(stream, "Per-packet cycles: p50 < %" PRIu64 ", p90 < %" PRIu64 ", p99 < %" PRIu64 " (%" PRIu64 " samples, %.2lf cycles/nsec)\n",
+            snapshot.cycles_p50, snapshot.cycles_p90, snapshot.cycles_p99, snapshot.sampled, snapshot.cycles_per_nsec);
+    return;
+}
+
+static uint64_t get_monotonic_nsec (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+static void *publisher_thread (void *arg) {
+    /* params */
+    struct timespec deadline;   /* wake up time */
+    ec_t            ec;         /* error code of publishing */
+
+    (void) arg;
+    pthread_mutex_lock(&publisher.mutex);
+    while (!publisher.stop) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += (time_t) (publisher.period_nsec / 1000000000);
+        deadline.tv_nsec += (long int) (publisher.period_nsec % 1000000000);
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        while (!publisher.stop && (pthread_cond_timedwait(&publisher.cond, &publisher.mutex, &deadline) != ETIMEDOUT)) {
+            /* spurious wake up */
+        }
+        pthread_mutex_unlock(&publisher.mutex);
+        ec = publish_snapshot();
+        pthread_mutex_lock(&publisher.mutex);
+        if (ec != EC_SUCCESS) {
+            publisher.ec = ec;
+        }
+    }
+    pthread_mutex_unlock(&publisher.mutex);
+    return NULL;
+}
+
+static ec_t publish_snapshot (void) {
+    /* params */
+    stats_snapshot_t    snapshot;       /* current snapshot */
+    uint64_t            delta_nsec;     /* time since previous snapshot (nsec) */
+    char                path[4096];     /* temporary stats file */
+    FILE               *file;           /* temporary stats file */
+    uint32_t            b;              /* bucket iterator */
+
+    memset(&snapshot, 0, sizeof(stats_snapshot_t));
+    stats_collect(&snapshot);
+    /* rates of snapshot are recent, summary keeps the average */
+    delta_nsec = snapshot.elapsed_nsec - publisher.last_nsec;
+    if (delta_nsec > 0) {
+        snapshot.packets_per_sec = (double) (snapshot.packets - publisher.last_packets) * 1e9 / (double) delta_nsec;
+        snapshot.bytes_per_sec = (double) (snapshot.bytes - publisher.last_bytes) * 1e9 / (double) delta_nsec;
+    }
+    publisher.last_nsec = snapshot.elapsed_nsec;
+    publisher.last_packets = snapshot.packets;
+    publisher.last_bytes = snapshot.bytes;
+
+    if (publisher.shm != NULL) {
+        snapshot.sequence = publisher.shm->sequence + 1;
+        __atomic_store_n(&publisher.shm->sequence, snapshot.sequence, __ATOMIC_RELEASE);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        memcpy((char *) publisher.shm + sizeof(uint64_t), (const char *) &snapshot + sizeof(uint64_t), sizeof(stats_snapshot_t) - sizeof(uint64_t));
+        __atomic_store_n(&publisher.shm->sequence, snapshot.sequence + 1, __ATOMIC_RELEASE);
+        return EC_SUCCESS;
+    }
+
+    snprintf(path, sizeof(path), "%s.tmp", publisher.path);
+    file = fopen(path, "w");
+    if (file == NULL) {
+        perror("fopen");
+        return EC_GEN_UNABLE_TO_OPEN_STATS;
+    }
+    fprintf(file, "time_nsec %" PRIu64 "\n", snapshot.time_nsec);
+    fprintf(file, "elapsed_nsec %" PRIu64 "\n", snapshot.elapsed_nsec);
+    fprintf(file, "threads %u\n", snapshot.threads);
+    fprintf(file, "packets %" PRIu64 "\n", snapshot.packets);
+    fprintf(file, "bytes %" PRIu64 "\n", snapshot.bytes);
+    fprintf(file, "packets_per_sec %.0lf\n", snapshot.packets_per_sec);
+    fprintf(file, "bytes_per_sec %.0lf\n", snapshot.bytes_per_sec);
+    fprintf(file, "read_nsec %" PRIu64 "\n", snapshot.read_nsec);
+    fprintf(file, "process_nsec %" PRIu64 "\n", snapshot.process_nsec);
+    fprintf(file, "output_nsec %" PRIu64 "\n", snapshot.output_nsec);
+    fprintf(file, "sampled %" PRIu64 "\n", snapshot.sampled);
+    fprintf(file, "cycles_per_nsec %.3lf\n", snapshot.cycles_per_nsec);
+    fprintf(file, "cycles_p50 %" PRIu64 "\n", snapshot.cycles_p50);
+    fprintf(file, "cycles_p90 %" PRIu64 "\n", snapshot.cycles_p90);
+    fprintf(file, "cycles_p99 %" PRIu64 "\n", snapshot.cycles_p99);
+    for (b=0; b<STATS_CYCLE_BUCKETS; b++) {
+        fprintf(file, "cycles_lt_%" PRIu64 " %" PRIu64 "\n", (uint64_t) 1 << b, snapshot.histogram[b]);
+    }
+    if ((fclose(file) != 0) || (rename(path, publisher.path) != 0)) {
+        perror("rename");
+        return EC_GEN_UNABLE_TO_OPEN_STATS;
+    }
+    return EC_SUCCESS;
+}
+
+static uint64_t get_percentile (const stats_snapshot_t *snapshot, double percentile) {
+    /* params */
+    uint64_t    rank = (uint64_t) ((double) snapshot->sampled * percentile);   /* samples at or below percentile */
+    uint64_t    seen = 0;       /* samples in buckets so far */
+    uint32_t    b;              /* bucket iterator */
+
+    if (snapshot->sampled == 0) {
+        return 0;
+    }
+    for (b=0; b<STATS_CYCLE_BUCKETS; b++) {
+        seen += snapshot->histogram[b];
+        if (seen > rank) {
+            break;
+        }
+    }
+    if (b == STATS_CYCLE_BUCKETS) {
+        b = STATS_CYCLE_BUCKETS - 1;
+    }
+    return (uint64_t) 1 << b;
+}
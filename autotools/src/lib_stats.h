@@ -0,0 +1,244 @@
+/**
+ * @file lib_stats.h
+ * @brief Runtime throughput statistics of pt_* tools: packet and byte rate, time split between trace read,
+ *        per_packet and output, and distribution of per-packet cycles, published periodically
+ * @author belongtothenight / Da-Chuan Chen / 2024
+ * @details
+ * Every reading thread counts into its own slot, so the hot path never shares a cache line.
+ * Packets and bytes are counted for every packet, cycles are only sampled with rdtsc on one packet out of STATS_SAMPLE_PERIOD
+ * on average, and read and per_packet time are estimated from the samples. Output is sampled the same way on its own,
+ * since an interval can close more often than a packet arrives. The gap between samples is random,
+ * a fixed gap aliases with periodic work such as output of every n-th packet.
+ * Times are statistical estimates, they carry the cost of rdtsc itself and are noisy on short runs.
+ * A publisher thread sums the slots every period and writes a snapshot to either:
+ *   - a stats file, "key value" text lines, replaced by rename so a reader never sees a partial file
+ *   - a shared-memory segment "shm:/<name>", one stats_snapshot_t guarded by a sequence number,
+ *     which is odd while the publisher writes, a reader retries until it reads the same even number before and after copying
+ * The snapshot is left in place after the program ends, remove the file or /dev/shm/<name> when no longer watched.
+ * Ref:
+ * 1. https://man7.org/linux/man-pages/man3/shm_open.3.html
+ * 2. https://www.intel.com/content/dam/www/public/us/en/documents/white-papers/ia-32-ia-64-benchmark-code-execution-paper.pdf
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "lib_error.h"
+
+#define STATS_MAGIC             "PTSTATS"   /* magic of shared-memory snapshot */
+#define STATS_VERSION           1           /* version of shared-memory snapshot */
+#define STATS_SHM_PREFIX        "shm:"      /* target prefix of shared-memory segment */
+#define STATS_MAX_THREADS       64          /* maximum reading threads with their own slot */
+#define STATS_SAMPLE_PERIOD     64          /* on average one packet out of this is timed with rdtsc */
+#define STATS_CYCLE_BUCKETS     32          /* log2 buckets of per-packet cycles */
+#define STATS_DEFAULT_PERIOD    1.0         /* snapshot period (sec) */
+
+/**
+ * @brief Counters of one reading thread, only written by its owner
+ */
+typedef struct {
+    uint64_t    packets;                            ///< packets
+    uint64_t    bytes;                              ///< wire length sum
+    uint64_t    sampled;                            ///< packets timed with rdtsc
+    uint64_t    read_cycles;                        ///< cycles in trace read of sampled packets
+    uint64_t    process_cycles;                     ///< cycles in per_packet of sampled packets, including output
+    uint64_t    output_cycles;                      ///< cycles in output of sampled writes
+    uint64_t    histogram[STATS_CYCLE_BUCKETS];     ///< read and per_packet cycles of sampled packets, log2 buckets
+    uint64_t    mark;                               ///< rdtsc at start of current step of sampled packet
+    uint64_t    read;                               ///< read cycles of current sampled packet
+    uint64_t    random;                             ///< xorshift state of sample gap
+    uint32_t    countdown;                          ///< packets until next sample
+    uint32_t    output_countdown;                   ///< writes until next sample
+    bool        sampling;                           ///< current packet is sampled
+} __attribute__((aligned(64))) stats_thread_t;
+
+/**
+ * @brief Snapshot published to shared memory, also the fields of stats file
+ */
+typedef struct {
+    volatile uint64_t sequence;                     ///< odd while snapshot is written
+    char        magic[8];                           ///< STATS_MAGIC
+    uint32_t    version;                            ///< STATS_VERSION
+    uint32_t    threads;                            ///< reading threads
+    uint64_t    time_nsec;                          ///< wall clock of snapshot (nsec)
+    uint64_t    elapsed_nsec;                       ///< time since stats_start (nsec)
+    uint64_t    packets;                            ///< packets
+    uint64_t    bytes;                              ///< wire length sum
+    double      packets_per_sec;                    ///< packet rate since previous snapshot
+    double      bytes_per_sec;                      ///< byte rate since previous snapshot
+    uint64_t    read_nsec;                          ///< estimated time in trace read, summed over threads
+    uint64_t    process_nsec;                       ///< estimated time in per_packet including output, summed over threads
+    uint64_t    output_nsec;                        ///< estimated time in output, summed over threads
+    uint64_t    sampled;                            ///< packets timed with rdtsc
+    double      cycles_per_nsec;                    ///< calibrated rdtsc rate
+    uint64_t    cycles_p50;                         ///< median per-packet cycles, upper bound of bucket
+    uint64_t    cycles_p90;                         ///< 90th percentile per-packet cycles, upper bound of bucket
+    uint64_t    cycles_p99;                         ///< 99th percentile per-packet cycles, upper bound of bucket
+    uint64_t    histogram[STATS_CYCLE_BUCKETS];     ///< bucket b counts samples with 2^(b-1) <= cycles < 2^b
+} stats_snapshot_t;
+
+/**
+ * @brief Read time stamp counter, monotonic nanoseconds if rdtsc is not available
+ * @return Cycles
+ */
+static inline uint64_t stats_cycles (void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return (uint64_t) __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Add to counter read by publisher thread, owner is the only writer so no atomic add is needed
+ */
+#define STATS_ADD(counter, value) __atomic_store_n(&(counter), (counter) + (value), __ATOMIC_RELAXED)
+
+/**
+ * @brief Get random gap to next sample
+ * @param stats Slot of calling thread
+ * @return Gap, uniform in [1, 2 * STATS_SAMPLE_PERIOD - 1], mean is STATS_SAMPLE_PERIOD
+ */
+static inline uint32_t stats_next_gap (stats_thread_t *stats) {
+    stats->random ^= stats->random << 13;
+    stats->random ^= stats->random >> 7;
+    stats->random ^= stats->random << 17;
+    return (uint32_t) (stats->random % (2 * STATS_SAMPLE_PERIOD - 1)) + 1;
+}
+
+/**
+ * @brief Start collecting statistics, and publishing snapshots if target is given
+ * @param target Stats file, "shm:/<name>" for shared memory, or NULL to collect only
+ * @param period Snapshot period (sec)
+ * @return Error code
+ */
+ec_t stats_start (const char *target, double period);
+
+/**
+ * @brief Stop publisher thread after publishing final snapshot
+ * @return Error code of publishing
+ */
+ec_t stats_stop (void);
+
+/**
+ * @brief Get slot of calling thread, claimed on first call
+ * @return Slot, threads beyond STATS_MAX_THREADS share one slot which is not published
+ */
+stats_thread_t *stats_thread (void);
+
+/**
+ * @brief Sum slots into snapshot
+ * @param snapshot Snapshot, sequence is left untouched
+ * @return void
+ */
+void stats_collect (stats_snapshot_t *snapshot);
+
+/**
+ * @brief Print summary of current snapshot
+ * @param stream Output stream
+ * @return void
+ */
+void stats_print (FILE *stream);
+
+/**
+ * @brief Mark start of reading one packet, decide if it is sampled
+ * @param stats Slot of calling thread
+ * @return void
+ */
+static inline void stats_read_begin (stats_thread_t *stats) {
+    /* a sample left open by previous trace restarts here */
+    if (stats->sampling) {
+        stats->mark = stats_cycles();
+        return;
+    }
+    if (--stats->countdown == 0) {
+        stats->countdown = stats_next_gap(stats);
+        stats->sampling = true;
+        stats->mark = stats_cycles();
+    }
+    return;
+}
+
+/**
+ * @brief Mark end of reading one packet and start of per_packet
+ * @param stats Slot of calling thread
+ * @return void
+ */
+static inline void stats_read_end (stats_thread_t *stats) {
+    /* params */
+    uint64_t now;   /* current cycles */
+
+    if (stats->sampling) {
+        now = stats_cycles();
+        stats->read = now - stats->mark;
+        stats->mark = now;
+    }
+    return;
+}
+
+/**
+ * @brief Mark end of per_packet, count packet, and start reading next packet
+ * @param stats Slot of calling thread
+ * @param bytes Wire length of packet
+ * @return void
+ */
+static inline void stats_packet_end (stats_thread_t *stats, uint64_t bytes) {
+    /* params */
+    uint64_t process;   /* per_packet cycles of sampled packet */
+    uint32_t bucket;    /* histogram bucket */
+
+    STATS_ADD(stats->packets, 1);
+    STATS_ADD(stats->bytes, bytes);
+    if (stats->sampling) {
+        stats->sampling = false;
+        process = stats_cycles() - stats->mark;
+        bucket = (stats->read + process == 0) ? 0 : (uint32_t) (64 - __builtin_clzll(stats->read + process));
+        if (bucket >= STATS_CYCLE_BUCKETS) {
+            bucket = STATS_CYCLE_BUCKETS - 1;
+        }
+        STATS_ADD(stats->sampled, 1);
+        STATS_ADD(stats->read_cycles, stats->read);
+        STATS_ADD(stats->process_cycles, process);
+        STATS_ADD(stats->histogram[bucket], 1);
+    }
+    stats_read_begin(stats);
+    return;
+}
+
+/**
+ * @brief Mark start of output, returned cycles are passed to stats_output_end
+ * @param stats Slot of calling thread
+ * @return Cycles, 0 if this write is not sampled
+ */
+static inline uint64_t stats_output_begin (stats_thread_t *stats) {
+    if (--stats->output_countdown != 0) {
+        return 0;
+    }
+    stats->output_countdown = stats_next_gap(stats);
+    return stats_cycles();
+}
+
+/**
+ * @brief Mark end of output
+ * @param stats Slot of calling thread
+ * @param begin Cycles returned by stats_output_begin
+ * @return void
+ */
+static inline void stats_output_end (stats_thread_t *stats, uint64_t begin) {
+    if (begin != 0) {
+        STATS_ADD(stats->output_cycles, stats_cycles() - begin);
+    }
+    return;
+}
+
+#endif // STATS_H
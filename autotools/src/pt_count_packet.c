@@ -21,14 +21,59 @@
 #include "lib_output_format.h"
 #include "lib_signal_handler.h"
 #include "lib_error.h"
+#include "lib_pcap_mmap.h"
+#include "lib_output_sink.h"
+#include "lib_interval_bin.h"
+#include "lib_input_list.h"
+#include "lib_interval_rollup.h"
+#include "lib_stats.h"
+#include "lib_pipeline.h"
+#include "lib_packet_count.h"
 
 /* Constants */
-#define CLI_MAX_INPUTS 7
+#define CLI_MAX_INPUTS 17
 
-/* Global variables */
-uint64_t packet_count = 0;
-time_t   next_interval_time_sec = 0;
-long int next_interval_time_nsec = 0;
+/**
+ * @brief Shared state of parallel mode, passed to every thread as global blob
+ */
+typedef struct {
+    interval_bin_t bin;                 /* interval binning state, origin is the first packet in trace */
+    bool           stopping;            /* trace_pstop is called on stop request, set by the first thread noticing it */
+    uint64_t       late;                /* packets earlier than the interval of their thread, summed at thread stop */
+    count_stage_t *counter;             /* enabled metrics and output of every level */
+} count_global_t;
+
+/**
+ * @brief Per-thread interval counter of parallel mode, used by both worker and reporter
+ */
+typedef struct {
+    uint64_t interval_index;            /* index of the interval currently counted */
+    uint64_t count[METRIC_COUNT];       /* metrics of current interval */
+    uint64_t late;                      /* packets of parallel mode earlier than interval_index, not published */
+} count_local_t;
+
+/**
+ * @brief Non-empty intervals of one input file, counted by a file worker and merged in file order
+ */
+typedef struct {
+    count_local_t   local;              /* interval currently counted */
+    count_local_t  *intervals;          /* finished intervals */
+    size_t          length;             /* number of finished intervals */
+    size_t          capacity;           /* allocated intervals */
+    ec_t            ec;                 /* EC_GEN_UNABLE_TO_MALLOC if an interval could not be stored */
+    const count_stage_t *counter;       /* enabled metrics */
+} file_intervals_t;
+
+/**
+ * @brief Shared state of multi-file mode
+ */
+typedef struct {
+    const input_list_t *inputs;         /* input files, ordered by first timestamp */
+    reader_t            reader;         /* trace reader */
+    count_global_t      global;         /* binning state, origin is the first packet of first file */
+    count_local_t       report;         /* merged interval */
+    file_intervals_t   *files;          /* intervals of each file */
+} file_pool_t;
 
 /**
  * @brief Print help message
@@ -36,12 +81,90 @@ long int next_interval_time_nsec = 0;
 static void print_help_message (void);
 
 /**
- * @brief Per-packet processing function, return 0 if success, otherwise return error code
- * @param packet Packet
- * @param time_interval Time interval
+ * @brief Option parser of pt_count_packet: -h, shared options are parsed by pipeline_option and count options by count_option
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @param i Index of option
+ * @param arg Unused
+ * @return EC_CLI_UNKNOWN_OPTION unless it is "-h"
+ */
+static ec_t help_option (int argc, char *argv[], int *i, void *arg);
+
+/**
+ * @brief Merge interval published by a per-packet thread or a file worker into reporter interval
+ * @param global Shared parallel state
+ * @param report Reporter interval, intervals before the merged one are written
+ * @param sent Interval to merge
+ * @return void
+ */
+static void merge_interval (const count_global_t *global, count_local_t *report, const count_local_t *sent);
+
+/**
+ * @brief Parallel mode, count packet with libtrace parallel API and merge intervals in reporter thread
+ * @param counter Count stage, finished intervals are written by it
+ * @param input_file Input file
+ * @param threads Number of per-packet threads
+ * @return Error code
+ */
+static ec_t process_trace_parallel (count_stage_t *counter, const char *input_file, int threads);
+
+/**
+ * @brief Multi-file mode, count each file on a worker pool and merge intervals in file order
+ * @param counter Count stage, finished intervals are written by it
+ * @param inputs Input files, ordered by first timestamp
+ * @param reader Trace reader
+ * @param threads Number of worker threads
+ * @return Error code
+ */
+static ec_t process_files_parallel (count_stage_t *counter, const input_list_t *inputs, reader_t reader, int threads);
+
+/**
+ * @brief Keep finished interval of file worker
+ * @param file Intervals of file
+ * @return void
+ */
+static void store_interval (file_intervals_t *file);
+
+/**
+ * @brief Interval callback of file worker stage
+ * @param index Finished interval
+ * @param next Interval of next packet
+ * @param arg Intervals of file
+ * @return void
+ */
+static void file_interval (uint64_t index, uint64_t next, void *arg);
+
+/**
+ * @brief Packet callback of file worker stage
+ * @param packet Decoded packet
+ * @param arg Intervals of file
  * @return void
  */
-static void per_packet (libtrace_packet_t *packet, double time_interval);
+static void file_packet (const pipeline_packet_t *packet, void *arg);
+
+/**
+ * @brief Finish callback of file worker stage, keep the last interval
+ * @param index Interval of last packet
+ * @param arg Intervals of file
+ * @return Error code of storing intervals
+ */
+static ec_t file_finish (uint64_t index, void *arg);
+
+/**
+ * @brief Worker of input pool, count one file
+ * @param index Index of file
+ * @param arg Multi-file state
+ * @return Error code
+ */
+static ec_t file_worker (size_t index, void *arg);
+
+/**
+ * @brief Merger of input pool, merge intervals of one file
+ * @param index Index of file
+ * @param arg Multi-file state
+ * @return Error code
+ */
+static ec_t file_merger (size_t index, void *arg);
 
 /**
  * @brief Main function, parse trace file and extract packet count, and display to stdout
@@ -49,119 +172,82 @@ static void per_packet (libtrace_packet_t *packet, double time_interval);
  * @param argv Argument vector
  * @return Error code
  * @details
- * Normal usage:            ./tp_count_packet -i <input_file> -t <time_interval> [-v]
+ * Normal usage:            ./tp_count_packet -i <input_file> [-i <input_file> ...] -t <time_interval>[,<time_interval> ...] [-m <metrics>] [-o <output_file>] [-n <threads>] [-r <reader>] [-S <stats_target>] [-v]
  * Display help message:    ./tp_count_packet -h
  */
 int main (int argc, char *argv[]) {
     /* params */
                         errno = 0;          /* error number */
     ec_t                ec = 0;             /* error code */
-    int                 i;                  /* iterator */
-    bool                verbose = false;    /* verbose output */
-    char               *endptr;             /* string to double conversion pointer */
-    const char         *input_file = NULL;  /* input file */
-    double              time_interval = 0;  /* time interval (sec) */
-    libtrace_t         *trace = NULL;       /* trace file */
-    libtrace_packet_t  *packet = NULL;      /* packet */
+    pipeline_options_t  options;            /* shared options */
+    input_list_t       *inputs = &options.inputs; /* input files */
+    size_t              input_index;        /* input file iterator */
+    count_stage_t       counter;            /* interval counter and output of every level */
+    pipeline_option_t   parsers[3] = { pipeline_option, count_option, help_option };  /* option parsers, shared options first */
+    void               *parser_args[3] = { &options, &counter, NULL };               /* argument of each parser */
+    pipeline_t          pipeline;           /* serial mode driver */
     struct timespec     start_time;         /* start processing time */
     struct timespec     end_time;           /* end processing time */
     time_t              elapsed_time_sec;   /* elapsed time (sec) */
     long int            elapsed_time_nsec;  /* elapsed time (nsec) */
 
     /* initialize */
+    pipeline_options_init(&options);
+    count_stage_init(&counter);
     register_all_signal_handlers();
     if (errno != EC_SUCCESS) {
         perror("signal");
-        printf("errno = %d -> %s\n", errno, strerror(errno));
+        fprintf(stderr, "errno = %d -> %s\n", errno, strerror(errno));
         exit(EXIT_FAILURE);
     }
-    ec = setvbuf(stdout, 0, _IONBF, 0); /* output may be going through pipe to log file */
+    /* progress and diagnostics go to unbuffered stderr, only interval data goes to stdout,
+     * so stdout can be fully buffered even when it goes through pipe to log file
+     */
+    ec = setvbuf(stdout, NULL, _IOFBF, SINK_BUFFER_SIZE);
     if ((ec != EC_SUCCESS) || (errno != EC_SUCCESS)) {
         perror("setvbuf");
-        printf("errno = %d -> %s\n", errno, strerror(errno));
+        fprintf(stderr, "errno = %d -> %s\n", errno, strerror(errno));
         exit(EXIT_FAILURE);
     }
 
     /* check CLI argument count */
     if (argc < 2) {
         ec = EC_CLI_NO_INPUTS;
-    } else if (argc > CLI_MAX_INPUTS) {
+    } else if (argc > CLI_MAX_INPUTS + 2 * (INPUT_MAX_OPTIONS - 1)) {
         ec = EC_CLI_MAX_INPUTS;
     }
 
     /* parse CLI arguments */
-    for (i=1 ; (i<argc) && (ec==0) ; i++) {
-        /* Check for argument pairs */
-        if ((strcmp(argv[i], "-i") == 0) || (strcmp(argv[i], "--input") == 0)) {
-            i++;
-            if (i < argc) {
-                input_file = argv[i];
-            } else {
-                ec = EC_CLI_NO_INPUT_FILE_VALUE;
-            }
-        } else if ((strcmp(argv[i], "-t") == 0) || (strcmp(argv[i], "--time-interval") == 0)) {
-            i++;
-            if (i < argc) {
-                time_interval = strtod(argv[i], &endptr);
-                if (errno != EC_SUCCESS) {
-                    perror("strtod");
-                    printf("errno = %d -> %s\n", errno, strerror(errno));
-                    ec = EC_CLI_INVALID_TIME_INTERVAL;
-                }
-                if (endptr == argv[i]) {
-                    printf("No digits were found\n");
-                    ec = EC_CLI_INVALID_TIME_INTERVAL;
-                }
-            } else {
-                ec = EC_CLI_NO_TIME_INTERVAL_VALUE;
-            }
-        /* Check for single arguments */
-        } else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "--help") == 0)) {
-            print_help_message();
-            exit(EXIT_SUCCESS);
-        } else if ((strcmp(argv[i], "-v") == 0) || (strcmp(argv[i], "--verbose") == 0)) {
-            verbose = true;
-        } else {
-            ec = EC_CLI_UNKNOWN_OPTION;
-        }
-        if (ec != EC_SUCCESS) {
-            break;
-        }
+    if (ec == EC_SUCCESS) {
+        ec = pipeline_parse_options(argc, argv, parsers, parser_args, 3);
     }
-    if ((ec == EC_SUCCESS) && verbose) {
-        printf("Arguments parsed:\n");
-        printf("    Input file:     %s\n", input_file);
-        printf("    Time interval:  %lf\n", time_interval);
+    if ((ec == EC_SUCCESS) && options.verbose) {
+        fprintf(stderr, "Arguments parsed:\n");
+        pipeline_options_print(&options);
+        fprintf(stderr, "    Output file:    %s\n", (counter.output_file != NULL) ? counter.output_file : "stdout");
+        fprintf(stderr, "    Metrics:        0x%x\n", counter.metrics);
     }
 
     /* check for required arguments */
     if (ec == EC_SUCCESS) {
-        if (input_file == NULL) {
-            ec = EC_CLI_NO_INPUT_OPTION;
-        }
-        if (time_interval <= 0) {
-            ec = EC_CLI_NO_TIME_INTERVAL_OPTION;
-        }
+        ec = pipeline_options_check(&options);
     }
-    if ((ec == EC_SUCCESS) && verbose) {
-        printf("Required arguments checked\n");
+    if ((ec == EC_SUCCESS) && options.verbose) {
+        fprintf(stderr, "Required arguments checked\n");
     }
 
     /* check for valid arguments */
     if (ec == EC_SUCCESS) {
-        if (strstr(input_file, ".pcap") == NULL) {
-            /* Valid file types: https://github.com/LibtraceTeam/libtrace/blob/cc98f68f72e24bf51e2dabc00af0dbc4ffe7bb3d/lib/trace.c#L242 */
-            ec = EC_CLI_INVALID_INPUT_FILE;
-        } else if (time_interval <= 0) {
-            ec = EC_CLI_INVALID_TIME_INTERVAL;
-        }
-        if (access(input_file, F_OK) != 0) {
-            printf("File inaccessable: %s\n", input_file);
-            ec = EC_CLI_INPUT_FILE_NOT_FOUND;
+        /* input files and intervals are validated by pipeline_options_check */
+        if ((options.threads > 1) && (options.reader == READER_MMAP) && (inputs->count == 1)) {
+            /* mmap reader is single-threaded, only multi-file mode can use it with threads */
+            ec = EC_CLI_INVALID_READER;
+        } else {
+            ec = count_check(&counter, &options);
         }
     }
-    if ((ec == EC_SUCCESS) && verbose) {
-        printf("Valid arguments checked\n");
+    if ((ec == EC_SUCCESS) && options.verbose) {
+        fprintf(stderr, "Valid arguments checked\n");
     }
 
     /* end of CLI argument parsing
@@ -169,57 +255,73 @@ int main (int argc, char *argv[]) {
      * exit if there are any errors
      */
     if (ec != EC_SUCCESS) {
+        input_list_free(inputs);
         print_ec_message(ec);
         print_help_message();
         exit(EXIT_FAILURE);
     }
 
-    /* open trace file */
-    if (ec == EC_SUCCESS) {
-        packet = trace_create_packet();
-        if (packet == NULL) {
-            perror("trace_create_packet");
-            ec = EC_GEN_UNABLE_TO_CREATE_PACKET;
-        }
+    /* open output file of each level */
+    ec = count_open(&counter, options.verbose);
+    if (ec != EC_SUCCESS) {
+        input_list_free(inputs);
+        print_ec_message(ec);
+        exit(EXIT_FAILURE);
     }
-    if (ec == EC_SUCCESS) {
-        trace = trace_create(input_file);
-        if (trace_is_err(trace)) {
-            trace_perror(trace, "trace_create");
-            ec = EC_GEN_UNABLE_TO_CREATE_TRACE;
-        }
-        if (trace_start(trace) != 0) {
-            trace_perror(trace, "trace_start");
-            ec = EC_GEN_UNABLE_TO_START_TRACE;
+
+    /* order input files, processing them in this order is the same as processing one concatenated trace */
+    if ((ec == EC_SUCCESS) && (inputs->count > 1)) {
+        ec = input_list_sort(inputs, options.reader);
+        if ((ec == EC_SUCCESS) && options.verbose) {
+            fprintf(stderr, "Input files ordered by first timestamp:\n");
+            for (input_index=0; input_index<inputs->count; input_index++) {
+                fprintf(stderr, "    %s\n", inputs->paths[input_index]);
+            }
         }
     }
-    if ((ec == EC_SUCCESS) && verbose) {
-        printf("Trace file opened\n");
-    }
 
-    /* process trace file */
-    printf("Processing trace file ...\n");
+    /* process trace files
+     *
+     * one file with threads uses libtrace parallel API,
+     * several files with threads are counted file by file on a worker pool,
+     * otherwise files are read one after another as one trace
+     */
     if (ec == EC_SUCCESS) {
+        if (options.threads > 1) {
+            fprintf(stderr, "Processing %zu trace file(s) with %ld threads ...\n", inputs->count, options.threads);
+        } else {
+            fprintf(stderr, "Processing %zu trace file(s) ...\n", inputs->count);
+        }
         if (clock_gettime(CLOCK_REALTIME, &start_time) == -1) {
             perror("clock_gettime");
-            printf("errno = %d -> %s\n", errno, strerror(errno));
+            fprintf(stderr, "errno = %d -> %s\n", errno, strerror(errno));
             ec = EC_GEN_CLOCK_GETTIME_ERROR;
         }
     }
     if (ec == EC_SUCCESS) {
-        while (trace_read_packet(trace, packet) > 0) {
-            per_packet(packet, time_interval);
+        ec = stats_start(options.stats_target, STATS_DEFAULT_PERIOD);
+    }
+    if ((ec == EC_SUCCESS) && (options.threads > 1) && (inputs->count == 1)) {
+        ec = process_trace_parallel(&counter, inputs->paths[0], (int) options.threads);
+    } else if ((ec == EC_SUCCESS) && (options.threads > 1)) {
+        ec = process_files_parallel(&counter, inputs, options.reader, (int) options.threads);
+    } else if (ec == EC_SUCCESS) {
+        pipeline_init(&pipeline, options.reader, &counter.bin, options.verbose);
+        ec = count_register(&counter, &pipeline);
+        for (input_index=0; (input_index<inputs->count) && (ec==EC_SUCCESS) && (signal_stop_requested()==0); input_index++) {
+            ec = pipeline_run(&pipeline, inputs->paths[input_index]);
         }
-        if (trace_is_err(trace)) {
-            /* only check for error after all file proccessed */
-            trace_perror(trace, "Reading packets");
-            ec = EC_GEN_TRACE_READ_PACKET_ERROR;
+        if (ec == EC_SUCCESS) {
+            ec = pipeline_finish(&pipeline);
         }
     }
+    if ((stats_stop() != EC_SUCCESS) && (ec == EC_SUCCESS)) {
+        ec = EC_GEN_UNABLE_TO_OPEN_STATS;
+    }
     if (ec == EC_SUCCESS) {
         if (clock_gettime(CLOCK_REALTIME, &end_time) == -1) {
             perror("clock_gettime");
-            printf("errno = %d -> %s\n", errno, strerror(errno));
+            fprintf(stderr, "errno = %d -> %s\n", errno, strerror(errno));
             ec = EC_GEN_CLOCK_GETTIME_ERROR;
         }
     }
@@ -230,81 +332,488 @@ int main (int argc, char *argv[]) {
             elapsed_time_sec--;
             elapsed_time_nsec += 1000000000;
         }
-        printf("Elapsed time: %ld.%09ld sec\n", elapsed_time_sec, elapsed_time_nsec);
+        fprintf(stderr, "Elapsed time: %ld.%09ld sec\n", elapsed_time_sec, elapsed_time_nsec);
+        if (options.verbose || (options.stats_target != NULL)) {
+            stats_print(stderr);
+        }
     }
 
     /* free resources */
-    trace_destroy(trace);
-    trace_destroy_packet(packet);
+    input_list_free(inputs);
+    if ((count_close(&counter) != EC_SUCCESS) && (ec == EC_SUCCESS)) {
+        ec = EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
+    }
+    fflush(stdout);
 
     /* exit */
     if (ec != EC_SUCCESS) {
         print_ec_message(ec);
         exit(EXIT_FAILURE);
     }
-    printf("Program ended successfully!\n");
+    if (signal_stop_requested() != 0) {
+        fprintf(stderr, "Stopped by signal %d, results cover the packets read before it\n", signal_stop_requested());
+        exit(signal_stop_requested());
+    }
+    fprintf(stderr, "Program ended successfully!\n");
     exit(EXIT_SUCCESS);
 }
 
 static void print_help_message (void) {
-    printf("Usage: ./tp_packet_count -i <input_file> -t <time_interval> [-v]\n");
+    printf("Usage: ./tp_packet_count -i <input_file> [-i <input_file> ...] -t <time_interval>[,<time_interval> ...] [-m <metrics>] [-o <output_file>] [-n <threads>] [-r <reader>] [-S <stats_target>] [-v]\n");
     printf("       ./tp_packet_count -h\n");
     printf("Options:\n");
-    printf("  -i, --input <input_file>              Input file\n");
-    printf("  -t, --time-interval <time_interval>   Time interval (sec)\n");
-    printf("  -v, --verbose                         Verbose output\n");
+    printf("  -i, --input <input_file>              Input file, glob pattern (quoted) or directory, repeatable,\n");
+    printf("                                        files are ordered by first timestamp and counted as one trace\n");
+    printf("  -t, --time-interval <time_interval>   Time interval (sec), rounded to nsec, a power of two nsec (e.g. 0.001048576) is binned with shift,\n");
+    printf("                                        comma separated intervals (e.g. 0.001,0.01,0.1,1,60) are counted in one pass,\n");
+    printf("                                        each a multiple of the previous one, and each written to <output_file> with \"_<nsec>ns\" inserted\n");
+    printf("  -m, --metrics <metrics>               (optional) Comma separated metrics counted in one pass, or \"all\":\n");
+    printf("                                        packets,bytes,capture,ipv4,ipv6,tcp,udp,mpls,vlan\n");
+    printf("                                        default=packets for stdout, packets,bytes for output file\n");
+    printf("  -o, --output <output_file>            (optional) Write intervals (time_nsec and metrics) to .csv, .bin (little-endian records) or .col (columnar), default=stdout text\n");
+    printf("  -n, --threads <threads>               (optional) Number of threads, default=1, if > 1 one file uses libtrace parallel API,\n");
+    printf("                                        identical to 1 thread if timestamps never decrease,\n");
+    printf("                                        several files are counted concurrently, one file per thread\n");
+    printf("  -r, --reader <reader>                 (optional) auto|mmap|libtrace, default=auto, auto uses mmap for uncompressed classic pcap\n");
+    printf("  -S, --stats <stats_target>            (optional) Publish throughput stats every second to a file, or to shared memory with \"shm:/<name>\"\n");
+    printf("  -v, --verbose                         Verbose output, also print stats summary\n");
     printf("  -h, --help                            Display help message\n");
     return;
 }
 
-/* @brief per_packet function to process each packet 
- * @param packet Packet to process
- * @param time_interval Time interval
+/* @brief Option parser of pt_count_packet
+ * @details "-m" and "-o" belong to count_option
+ */
+static ec_t help_option (int argc, char *argv[], int *i, void *arg) {
+    (void) argc;
+    (void) arg;
+    if ((strcmp(argv[*i], "-h") == 0) || (strcmp(argv[*i], "--help") == 0)) {
+        print_help_message();
+        exit(EXIT_SUCCESS);
+    }
+    return EC_CLI_UNKNOWN_OPTION;
+}
+
+/* @brief Write one finished interval, same output as serial mode
+ * @param global Shared parallel state
+ * @param local Finished interval
+ * @return void
+ */
+static void write_interval_index (const count_global_t *global, const count_local_t *local) {
+    count_write(global->counter, interval_bin_end(&global->bin, local->interval_index), local->count);
+    return;
+}
+
+/* @brief Publish finished interval of per-packet thread to reporter
+ * @param trace Trace
+ * @param thread Thread
+ * @param local Finished interval, copied since the reporter frees it
  * @return void
- * @details No error handling is done here as the error is already handled in the main function
- *          Also, if check is done here, excess CPU cycles will be used
  */
-static void per_packet (libtrace_packet_t *packet, double time_interval) {
+static void publish_interval (libtrace_t *trace, libtrace_thread_t *thread, const count_local_t *local) {
     /* params */
-    struct timespec ts;                 /* timestamp */
+    libtrace_generic_t  value;              /* published value */
 
-    /* retrieve data from packet 
-     *
-     * https://github.com/LibtraceTeam/libtrace/blob/cc98f68f72e24bf51e2dabc00af0dbc4ffe7bb3d/lib/trace.c#L1438
-     *
-     * following line will result in -Waggregate-return warning
-     * but it is safe to ignore as the struct is small and it is the intended practice
-     */
-    ts = trace_get_timespec(packet);
+    value.ptr = malloc(sizeof(count_local_t));
+    if (value.ptr == NULL) {
+        perror("malloc");
+        return;
+    }
+    memcpy(value.ptr, local, sizeof(count_local_t));
+    trace_publish_result(trace, thread, local->interval_index, value, RESULT_USER);
+    return;
+}
 
-    /* first packet in trace 
-     *
-     * set next_interval_time_sec to the first time interval
-     *
-     * entire time = ts.tv_sec + ts.tv_nsec
-     * https://en.cppreference.com/w/c/chrono/timespec
-     */
-    if (next_interval_time_sec == 0) {
-        next_interval_time_sec = ts.tv_sec + (time_t) (time_interval);
-        next_interval_time_nsec = ts.tv_nsec + (long int) ((time_interval - (time_t) time_interval) * 1000000000);
-        printf("\nTime(Sec)\tTime(nSec)\tPackets\n");
+/* @brief Starting callback of both per-packet and reporter threads, allocate interval counter
+ * @param trace Trace
+ * @param thread Thread
+ * @param global Shared parallel state
+ * @return Thread local interval counter
+ */
+static void *parallel_start (libtrace_t *trace, libtrace_thread_t *thread, void *global) {
+    (void) trace;
+    (void) thread;
+    (void) global;
+    stats_read_begin(stats_thread());
+    return calloc(1, sizeof(count_local_t));
+}
+
+/* @brief Per-packet callback, count packet into its interval and publish finished intervals
+ * @param trace Trace
+ * @param thread Thread
+ * @param global Shared parallel state
+ * @param tls Thread local interval counter
+ * @param packet Packet
+ * @return Packet, handed back to libtrace for reuse
+ * @details Results must be published in key order for the ordered combiner,
+ *          so a packet out of order within this thread is counted into the current interval of this thread.
+ *          Serial mode takes the running maximum over the whole trace instead, which a thread can not see,
+ *          so output is identical to serial mode only if timestamps never decrease. Such packets are counted
+ *          and reported after the run, a packet out of order across threads only is not detected
+ */
+static libtrace_packet_t *parallel_packet (libtrace_t *trace, libtrace_thread_t *thread, void *global, void *tls, libtrace_packet_t *packet) {
+    /* params */
+    count_global_t     *g = (count_global_t *) global;
+    count_local_t      *local = (count_local_t *) tls;
+    uint64_t            index;              /* interval index of packet */
+    pipeline_packet_t   decoded;            /* decoded packet */
+    stats_thread_t     *stats = stats_thread(); /* stats slot of per-packet thread */
+
+    /* time between callbacks is spent reading packet in libtrace */
+    stats_read_end(stats);
+    /* packets already read are still delivered after trace_pstop, and counted as usual */
+    if ((signal_stop_requested() != 0) && !__atomic_exchange_n(&g->stopping, true, __ATOMIC_RELAXED)) {
+        trace_pstop(trace);
+    }
+    decoded.capture_length = 0;
+    decoded.layer2 = NULL;
+    pipeline_decode_libtrace(packet, count_needs(g->counter), &decoded);
+    index = interval_bin_index(&g->bin, decoded.ts);
+    if (index > local->interval_index) {
+        if (local->count[METRIC_PACKETS] != 0) {
+            publish_interval(trace, thread, local);
+        }
+        local->interval_index = index;
+        memset(local->count, 0, sizeof(local->count));
+    } else if (index < local->interval_index) {
+        local->late++;
     }
+    count_metrics(g->counter, &decoded, local->count);
+    stats_packet_end(stats, decoded.wire_length);
+    return packet;
+}
 
-    /* When time interval is reached 
-     *
-     * Use while loop to ensure even if no packet is observed in the time interval
+/* @brief Stopping callback of per-packet threads, publish the last interval
+ * @param trace Trace
+ * @param thread Thread
+ * @param global Shared parallel state
+ * @param tls Thread local interval counter
+ * @return void
+ */
+static void parallel_stop (libtrace_t *trace, libtrace_thread_t *thread, void *global, void *tls) {
+    /* params */
+    count_global_t     *g = (count_global_t *) global;
+    count_local_t      *local = (count_local_t *) tls;
+
+    if (local->count[METRIC_PACKETS] != 0) {
+        publish_interval(trace, thread, local);
+    }
+    __atomic_fetch_add(&g->late, local->late, __ATOMIC_RELAXED);
+    free(local);
+    return;
+}
+
+/* @brief Result callback of reporter thread, sum the counts of each interval across threads
+ * @param trace Trace
+ * @param sender Thread which published the result
+ * @param global Shared parallel state
+ * @param tls Reporter interval counter
+ * @param result Result, key is interval index and value points to the interval counter of sender
+ * @return void
+ * @details The ordered combiner delivers results in key order
+ */
+static void parallel_result (libtrace_t *trace, libtrace_thread_t *sender, void *global, void *tls, libtrace_result_t *result) {
+    /* params */
+    count_global_t *g = (count_global_t *) global;
+    count_local_t  *local = (count_local_t *) tls;
+    count_local_t  *sent;                   /* interval counter published by sender */
+
+    (void) trace;
+    (void) sender;
+    /* following line will result in -Waggregate-return warning, libtrace_generic_t is a small union */
+    sent = (count_local_t *) libtrace_result_get_value(result).ptr;
+    sent->interval_index = libtrace_result_get_key(result);
+    merge_interval(g, local, sent);
+    free(sent);
+    return;
+}
+
+/* @brief Merge one interval into reporter interval
+ * @param global Shared parallel state
+ * @param report Reporter interval
+ * @param sent Interval to merge
+ * @return void
+ * @details Intervals arrive in index order, so reporter interval is complete once a larger index arrives.
+ *          Intervals without any packet are printed as 0, and an interval earlier than reporter interval
+ *          is added to reporter interval, same as serial mode does with out of order packet
+ */
+static void merge_interval (const count_global_t *global, count_local_t *report, const count_local_t *sent) {
+    /* params */
+    uint32_t        metric;                 /* metric iterator */
+
+    while (sent->interval_index > report->interval_index) {
+        write_interval_index(global, report);
+        report->interval_index++;
+        memset(report->count, 0, sizeof(report->count));
+    }
+    for (metric=0; metric<METRIC_COUNT; metric++) {
+        report->count[metric] += sent->count[metric];
+    }
+    return;
+}
+
+/* @brief Stopping callback of reporter thread
+ * @param trace Trace
+ * @param thread Thread
+ * @param global Shared parallel state
+ * @param tls Reporter interval counter
+ * @return void
+ * @details The last interval is left unprinted since it is not complete, same as serial mode
+ */
+static void parallel_report_stop (libtrace_t *trace, libtrace_thread_t *thread, void *global, void *tls) {
+    (void) trace;
+    (void) thread;
+    (void) global;
+    free(tls);
+    return;
+}
+
+static ec_t process_trace_parallel (count_stage_t *counter, const char *input_file, int threads) {
+    /* params */
+    ec_t                     ec = EC_SUCCESS;   /* error code */
+    count_global_t           global;            /* shared parallel state */
+    libtrace_t              *trace = NULL;      /* trace file */
+    libtrace_callback_set_t *processing = NULL; /* per-packet thread callbacks */
+    libtrace_callback_set_t *reporter = NULL;   /* reporter thread callbacks */
+    libtrace_generic_t       combiner_config;   /* combiner config, unused by ordered combiner */
+
+    /* interval boundaries are aligned to the first packet in trace,
+     * read it ahead so every thread agrees on the same interval index
      */
-    while (((time_t) ts.tv_sec > next_interval_time_sec) && ((long int) ts.tv_nsec > next_interval_time_nsec)) {
-        printf("%lu \t%ld \t%" PRIu64 "\n", next_interval_time_sec, next_interval_time_nsec, packet_count);
-        packet_count = 0;
-        next_interval_time_sec += (time_t) (time_interval);
-        next_interval_time_nsec += (long int) ((time_interval - (time_t) time_interval) * 1000000000);
-        if (next_interval_time_nsec >= 1000000000) {
-            next_interval_time_sec++;
-            next_interval_time_nsec -= 1000000000;
+    global.bin = counter->bin;
+    global.stopping = false;
+    global.late = 0;
+    global.counter = counter;
+    ec = input_get_first_timestamp(input_file, READER_LIBTRACE, &global.bin.origin_nsec);
+    if ((ec == EC_SUCCESS) && (global.bin.origin_nsec == INPUT_EMPTY_TIMESTAMP)) {
+        ec = EC_GEN_EMPTY_TRACE;
+    }
+    if ((ec == EC_SUCCESS) && (counter->sink == NULL)) {
+        count_print_header(counter);
+    }
+
+    /* create callback sets */
+    if (ec == EC_SUCCESS) {
+        processing = trace_create_callback_set();
+        reporter = trace_create_callback_set();
+        if ((processing == NULL) || (reporter == NULL)) {
+            ec = EC_GEN_UNABLE_TO_CREATE_CALLBACK;
+        }
+    }
+    if (ec == EC_SUCCESS) {
+        trace_set_starting_cb(processing, parallel_start);
+        trace_set_packet_cb(processing, parallel_packet);
+        trace_set_stopping_cb(processing, parallel_stop);
+        trace_set_starting_cb(reporter, parallel_start);
+        trace_set_result_cb(reporter, parallel_result);
+        trace_set_stopping_cb(reporter, parallel_report_stop);
+    }
+
+    /* open and run trace file */
+    if (ec == EC_SUCCESS) {
+        trace = trace_create(input_file);
+        if (trace_is_err(trace)) {
+            trace_perror(trace, "trace_create");
+            ec = EC_GEN_UNABLE_TO_CREATE_TRACE;
+        }
+    }
+    if (ec == EC_SUCCESS) {
+        combiner_config.uint64 = 0;
+        trace_set_perpkt_threads(trace, threads);
+        trace_set_combiner(trace, &combiner_ordered, combiner_config);
+        if (trace_pstart(trace, &global, processing, reporter) != 0) {
+            trace_perror(trace, "trace_pstart");
+            ec = EC_GEN_UNABLE_TO_START_TRACE;
+        }
+    }
+    if (ec == EC_SUCCESS) {
+        trace_join(trace);
+        if (trace_is_err(trace)) {
+            /* only check for error after all file proccessed */
+            trace_perror(trace, "Reading packets");
+            ec = EC_GEN_TRACE_READ_PACKET_ERROR;
+        }
+    }
+    if (global.late != 0) {
+        fprintf(stderr, "Warning: %" PRIu64 " packets out of timestamp order, intervals may differ from single-threaded mode\n", global.late);
+    }
+
+    /* free resources */
+    if (trace != NULL) {
+        trace_destroy(trace);
+    }
+    if (processing != NULL) {
+        trace_destroy_callback_set(processing);
+    }
+    if (reporter != NULL) {
+        trace_destroy_callback_set(reporter);
+    }
+    return ec;
+}
+
+/* @brief Keep finished interval of file worker
+ * @param file Intervals of file
+ * @return void
+ */
+static void store_interval (file_intervals_t *file) {
+    /* params */
+    count_local_t      *intervals;          /* resized intervals */
+
+    if (file->length == file->capacity) {
+        intervals = (count_local_t *) realloc(file->intervals, ((file->capacity == 0) ? 1024 : file->capacity * 2) * sizeof(count_local_t));
+        if (intervals == NULL) {
+            file->ec = EC_GEN_UNABLE_TO_MALLOC;
+            return;
         }
+        file->intervals = intervals;
+        file->capacity = (file->capacity == 0) ? 1024 : file->capacity * 2;
+    }
+    file->intervals[file->length++] = file->local;
+    return;
+}
+
+/* @brief Interval callback of file worker stage, same as parallel_packet but keeps finished intervals in memory
+ * @param index Finished interval
+ * @param next Interval of next packet
+ * @param arg Intervals of file
+ * @return void
+ * @details empty intervals are left to merger
+ */
+static void file_interval (uint64_t index, uint64_t next, void *arg) {
+    /* params */
+    file_intervals_t   *file = (file_intervals_t *) arg;
+
+    (void) index;
+    if (file->local.count[METRIC_PACKETS] != 0) {
+        store_interval(file);
     }
-    
-    packet_count++;
+    file->local.interval_index = next;
+    memset(file->local.count, 0, sizeof(file->local.count));
     return;
 }
+
+/* @brief Packet callback of file worker stage
+ * @param packet Decoded packet
+ * @param arg Intervals of file
+ * @return void
+ */
+static void file_packet (const pipeline_packet_t *packet, void *arg) {
+    /* params */
+    file_intervals_t   *file = (file_intervals_t *) arg;
+
+    count_metrics(file->counter, packet, file->local.count);
+    return;
+}
+
+/* @brief Finish callback of file worker stage
+ * @param index Interval of last packet
+ * @param arg Intervals of file
+ * @return Error code of storing intervals
+ * @details the last interval of file may continue in the next file, merger adds them up
+ */
+static ec_t file_finish (uint64_t index, void *arg) {
+    /* params */
+    file_intervals_t   *file = (file_intervals_t *) arg;
+
+    (void) index;
+    if (file->local.count[METRIC_PACKETS] != 0) {
+        store_interval(file);
+    }
+    return file->ec;
+}
+
+/* @brief Worker of input pool, count one file into its own interval list
+ * @param index Index of file
+ * @param arg Multi-file state
+ * @return Error code
+ * @details each worker drives its own pipeline, binning state is read-only while the pool runs
+ *          and every pipeline is aligned to the first packet of the first file
+ */
+static ec_t file_worker (size_t index, void *arg) {
+    /* params */
+    file_pool_t        *pool = (file_pool_t *) arg;
+    file_intervals_t   *file = &pool->files[index];
+    ec_t                ec = EC_SUCCESS;    /* error code */
+    pipeline_t          pipeline;           /* driver of this file */
+    pipeline_stage_t    stage;              /* interval counter of this file */
+
+    memset(&stage, 0, sizeof(pipeline_stage_t));
+    stage.name = "count";
+    stage.needs = count_needs(file->counter);
+    stage.arg = file;
+    stage.packet = file_packet;
+    stage.interval = file_interval;
+    stage.finish = file_finish;
+    pipeline_init(&pipeline, pool->reader, &pool->global.bin, false);
+    ec = pipeline_add_stage(&pipeline, &stage);
+    if (ec == EC_SUCCESS) {
+        ec = pipeline_set_origin(&pipeline, pool->global.bin.origin_nsec);
+    }
+    /* files not started before stop request are left empty */
+    if ((ec == EC_SUCCESS) && (signal_stop_requested() == 0)) {
+        ec = pipeline_run(&pipeline, pool->inputs->paths[index]);
+    }
+    if (ec == EC_SUCCESS) {
+        ec = pipeline_finish(&pipeline);
+    }
+    return ec;
+}
+
+/* @brief Merger of input pool, merge intervals of one file in file order
+ * @param index Index of file
+ * @param arg Multi-file state
+ * @return Error code
+ * @details Interval index of a packet within its file is the running maximum of the file,
+ *          and the concatenated trace takes the maximum with previous files as well,
+ *          so intervals earlier than reporter interval are added to it, same as serial mode
+ */
+static ec_t file_merger (size_t index, void *arg) {
+    /* params */
+    file_pool_t        *pool = (file_pool_t *) arg;
+    file_intervals_t   *file = &pool->files[index];
+    size_t              i;                  /* iterator */
+
+    for (i=0; i<file->length; i++) {
+        merge_interval(&pool->global, &pool->report, &file->intervals[i]);
+    }
+    free(file->intervals);
+    file->intervals = NULL;
+    return EC_SUCCESS;
+}
+
+static ec_t process_files_parallel (count_stage_t *counter, const input_list_t *inputs, reader_t reader, int threads) {
+    /* params */
+    ec_t                ec = EC_SUCCESS;    /* error code */
+    file_pool_t         pool;               /* multi-file state */
+    size_t              i;                  /* iterator */
+
+    /* intervals are aligned to the first packet of the first file, same as the concatenated trace */
+    memset(&pool, 0, sizeof(file_pool_t));
+    pool.inputs = inputs;
+    pool.reader = reader;
+    pool.global.bin = counter->bin;
+    pool.global.bin.origin_nsec = inputs->first_nsec[0];
+    pool.global.counter = counter;
+    pool.files = (file_intervals_t *) calloc(inputs->count, sizeof(file_intervals_t));
+    if (pool.files == NULL) {
+        perror("calloc");
+        ec = EC_GEN_UNABLE_TO_MALLOC;
+    }
+    for (i=0; (i<inputs->count) && (ec==EC_SUCCESS); i++) {
+        pool.files[i].counter = counter;
+    }
+    if ((ec == EC_SUCCESS) && (counter->sink == NULL) && (inputs->first_nsec[0] != INPUT_EMPTY_TIMESTAMP)) {
+        count_print_header(counter);
+    }
+    if (ec == EC_SUCCESS) {
+        ec = input_pool_run(inputs->count, threads, file_worker, file_merger, &pool);
+    }
+    /* the last interval is left unprinted since it is not complete, same as serial mode */
+    if (pool.files != NULL) {
+        for (i=0; i<inputs->count; i++) {
+            free(pool.files[i].intervals);
+        }
+        free(pool.files);
+    }
+    return ec;
+}
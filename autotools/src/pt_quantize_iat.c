@@ -1,8 +1,13 @@
 /*
  * @file pt_quantize_iat.c
- * @brief Main function, parse trace file and extract IAT, 
+ * @brief Main function, parse trace file and extract IAT,
  *        quantize them by time duration, then write count of each category into a PNG histogram
  * @author belongtothenight / Da-Chuan Chen / 2024
+ * @details
+ * Each analysis is a stage of lib_pipeline with its options and state in one struct passed as callback argument,
+ * so the trace is read once however many analyses run. Stage order is series, IAT, joint, burst, quantiles and flow,
+ * behind the reorder buffer in reorder mode. Every stage but IAT lives in the lib module it wraps, so this file
+ * wires their options and runs the IAT histogram, checkpoints and the chunks of multi-threaded mode.
  */
 
 /* System libraries */
@@ -23,22 +28,154 @@
 #include "lib_output_format.h"
 #include "lib_signal_handler.h"
 #include "lib_error.h"
+#include "lib_pcap_mmap.h"
+#include "lib_input_list.h"
+#include "lib_stats.h"
+#include "lib_checkpoint.h"
+#include "lib_log_histogram.h"
+#include "lib_flow_table.h"
+#include "lib_quantile_sketch.h"
+#include "lib_histogram_series.h"
+#include "lib_reorder_buffer.h"
+#include "lib_pipeline.h"
+#include "lib_burst_detector.h"
+#include "lib_joint_histogram.h"
+#include "lib_packet_count.h"
 
 /* Constants */
-#define CLI_MAX_INPUTS 11
-
-/* Global variables */
-time_t      next_interval_time_sec = 0;
-time_t      initial_time_sec = 0;
-suseconds_t initial_time_usec = 0;
-time_t      current_time_sec = 0;
-suseconds_t current_time_usec = 0;
-time_t      iat_sec = 0;
-suseconds_t iat_usec = 0;
-long int    quantized_iat = 0;
-uint64_t    negtive_iat_count = 0;      /* count of negtive IAT */
-uint64_t    exceed_max_iat_count = 0;   /* count of IAT exceed max quantized IAT (IAT >= 2^quantized_time_order*iat_count_size+1) */
-uint64_t   *quantized_iat_count = NULL; /* count of quantized IAT, dynamically allocated */
+#define CLI_MAX_INPUTS 29
+#define CHECKPOINT_CHECK_PACKETS 65536  /* packets between checks of checkpoint period, power of 2 */
+#define CHECKPOINT_LAYOUT 2             /* layout of iat_checkpoint_t, checkpoints of other layouts are rejected */
+#define CHUNK_MIN_SIZE (1 << 20)        /* smallest chunk of pcap file read by mmap reader (byte) */
+#define CHUNKS_PER_THREAD 4             /* chunks per worker thread, so one slow chunk does not hold the others back */
+#define IAT_DEFAULT_TIME_INTERVAL 10    /* default progress display and quantile interval (sec) */
+#define IAT_PARSERS 9                   /* option parsers, shared options and one per stage */
+
+/**
+ * @brief Quantization parameters, shared by stages and chunks
+ */
+typedef struct {
+    uint64_t    quantize_time_order;    /* quantize time order of 2 */
+    uint64_t    iat_count_size;         /* size of quantized_iat_count */
+    uint32_t    log_digits;             /* significant digits of log-linear mode, 0 for linear mode */
+    log_histogram_t log_histogram;      /* counter layout of log-linear mode */
+    bool        nsec;                   /* tick of timestamps and IAT is nanosecond, otherwise microsecond */
+    uint64_t    ticks_per_sec;          /* ticks per second */
+    interval_bin_t bin;                 /* progress display and quantile interval, origin is only set here by multi-threaded mode */
+    uint64_t    interval_ticks;         /* progress display time interval (tick) */
+} iat_config_t;
+
+/**
+ * @brief Read position of serial mode, saved in checkpoint
+ */
+typedef struct {
+    uint64_t        file_index;         /* input file being read */
+    uint64_t        packets;            /* packets of file passed to handler */
+    uint64_t        offset;             /* offset of next record of mmap reader, 0 if read by libtrace */
+    uint64_t        last;               /* timestamp of last packet passed to handler (tick) */
+    uint64_t        same;               /* packets ending at last with the same timestamp as last */
+    bool            ordered;            /* timestamps of file never decreased so far */
+} trace_cursor_t;
+
+/**
+ * @brief Checkpoint settings of this run
+ */
+typedef struct {
+    const char     *path;               /* checkpoint file, NULL if disabled */
+    double          period;             /* wall clock period of checkpoints (sec) */
+    double          next;               /* monotonic time of next checkpoint (sec) */
+    uint64_t        fingerprint;        /* hash of input files and quantization options */
+    uint8_t        *buffer;             /* iat_checkpoint_t followed by histogram */
+    size_t          size;               /* size of buffer */
+    ec_t            ec;                 /* first error of serial mode checkpoint, no checkpoint is taken after it */
+} iat_checkpointer_t;
+
+/**
+ * @brief IAT histogram stage, the read position of checkpoints advances with the packets it counts
+ */
+typedef struct {
+    iat_config_t        config;         /* quantization parameters */
+    long int            log_digits;     /* "-L" significant digits of log-linear mode, 0 for linear mode */
+    const char         *histogram_path; /* "-p" path of histogram, NULL if not plotted */
+    bool                log_scale;      /* "-l" histogram log scale */
+    bool                resume;         /* "-R" resume from checkpoint */
+    bool                parallel;       /* counters are merged from chunks by multi-threaded mode, not passed by pipeline */
+    uint64_t           *count;          /* count of quantized IAT */
+    uint64_t            negative;       /* count of negtive IAT */
+    uint64_t            exceed;         /* count of IAT exceed max quantized IAT (IAT >= 2^quantized_time_order*iat_count_size) */
+    bool                started;        /* first packet is passed, origin and initial are valid */
+    uint64_t            origin;         /* timestamp of first packet, start of interval 0 (nsec) */
+    uint64_t            initial;        /* timestamp of first packet (tick) */
+    uint64_t            current;        /* timestamp of previous packet (tick) */
+    uint64_t            interval_index; /* interval of previous packet */
+    trace_cursor_t      cursor;         /* read position of serial mode */
+    iat_checkpointer_t  checkpointer;   /* "-k", "-K" checkpoint settings */
+} iat_stage_t;
+
+/**
+ * @brief Quantized IAT of one chunk in multi-threaded mode, a whole file or a range of records of pcap file read by mmap
+ */
+typedef struct {
+    size_t          file_index;         /* input file of chunk */
+    bool            ranged;             /* range of records read by mmap reader, otherwise the whole file */
+    bool            exact;              /* begin is a record boundary, otherwise the boundary is found by scanning from it */
+    bool            file_end;           /* chunk ends at end of file */
+    size_t          begin;              /* offset where chunk begins */
+    size_t          end;                /* offset where chunk ends, scanned the same way as begin of next chunk */
+    size_t          start;              /* offset of first record read */
+    size_t          stop;               /* offset after last record read */
+    bool            truncated;          /* last record read crosses end of file, reported by merger once start is checked */
+    uint64_t       *count;              /* count of quantized IAT within chunk */
+    uint64_t        negative;           /* count of negative IAT within chunk */
+    uint64_t        exceed;             /* count of IAT exceed max quantized IAT within chunk */
+    uint64_t        packets;            /* packet count, first and last are valid if non-zero */
+    bool            complete;           /* whole chunk is read, not cut by stop request */
+    uint64_t        first;              /* timestamp of first packet (tick) */
+    uint64_t        last;               /* timestamp of last packet (tick) */
+    uint32_t        first_length;       /* wire length of first packet, paired with IAT across chunk boundary by merger (byte) */
+    bool            joint;              /* count size and joint histogram */
+    joint_histogram_t joint_histogram;  /* size and joint histogram within chunk, counters are NULL unless joint */
+    uint32_t        compression;        /* compression of quantile sketches, 0 unless quantiles are sketched */
+    interval_quantiles_t *intervals;    /* quantiles of each interval within chunk, in trace order */
+    size_t          interval_count;     /* number of intervals */
+    size_t          interval_capacity;  /* allocated intervals */
+    ec_t            ec;                 /* error of quantile sketches, reported by worker */
+    const iat_config_t *config;         /* quantization parameters */
+} iat_chunk_t;
+
+/**
+ * @brief Shared state of multi-threaded mode
+ */
+typedef struct {
+    const input_list_t *inputs;         /* input files, ordered by first timestamp */
+    reader_t            reader;         /* trace reader */
+    iat_stage_t        *iat;            /* IAT stage, merged chunks are added to its counters */
+    quantile_stage_t   *quantiles;      /* quantile stage, NULL unless quantile mode */
+    joint_stage_t      *joint;          /* joint stage, NULL unless joint mode */
+    iat_chunk_t        *chunks;         /* chunks from cursor to the end of last file, in trace order */
+    size_t              chunk_count;    /* number of chunks */
+    trace_cursor_t      cursor;         /* end of merged chunks, file boundary or offset of mmap reader */
+    size_t              skip_file;      /* chunks of this file were read again by merger, SIZE_MAX if none */
+    bool                started;        /* a merged chunk had packets, last is valid */
+    bool                stopped;        /* a chunk cut by stop request is merged, no checkpoint is valid after it */
+    uint64_t            last;           /* timestamp of last packet of merged chunks (tick) */
+} iat_pool_t;
+
+/**
+ * @brief Analysis state saved in checkpoint, followed by quantized_iat_count
+ */
+typedef struct {
+    uint64_t        fingerprint;        /* hash of input files and quantization options */
+    bool            parallel;           /* written by multi-threaded mode, cursor is at a chunk boundary */
+    trace_cursor_t  cursor;             /* read position */
+    bool            started;            /* serial mode: first packet is passed, multi-threaded mode: a merged chunk had packets */
+    uint64_t        last;               /* multi-threaded mode: timestamp of last packet of merged chunks (tick) */
+    uint64_t        origin;             /* serial mode: start of interval 0 (nsec) */
+    uint64_t        interval_index;     /* serial mode: interval of last packet */
+    uint64_t        current_time;       /* timestamp of last packet (tick) */
+    uint64_t        negative;           /* count of negative IAT */
+    uint64_t        exceed;             /* count of IAT exceed max quantized IAT */
+} iat_checkpoint_t;
 
 /**
  * @brief Print help message
@@ -46,14 +183,245 @@ uint64_t   *quantized_iat_count = NULL; /* count of quantized IAT, dynamically a
 void print_help_message (void);
 
 /**
- * @brief Per-packet processing function, return 0 if success, otherwise return error code
- * @param packet Packet
- * @param time_interval Time interval
- * @param quantize_time_order Quantize time order of 2
- * @param iat_count_size Size of quantized_iat_count
+ * @brief Option parser of IAT stage: -q, -s, -L, -E, -p, -l, -k, -K, -R and -h
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @param i Index of option, moved to its value if it takes one
+ * @param arg IAT stage
+ * @return EC_SUCCESS, error of option, or EC_CLI_UNKNOWN_OPTION
+ */
+static ec_t iat_option (int argc, char *argv[], int *i, void *arg);
+
+/**
+ * @brief Check options of IAT stage and set quantization parameters
+ * @param iat IAT stage
+ * @param options Shared options, only one time interval is used
+ * @return Error code
+ */
+static ec_t iat_check (iat_stage_t *iat, const pipeline_options_t *options);
+
+/**
+ * @brief Register IAT stage
+ * @param iat IAT stage
+ * @param pipeline Pipeline
+ * @return Error code
+ */
+static ec_t iat_register (iat_stage_t *iat, pipeline_t *pipeline);
+
+/**
+ * @brief Allocate histogram and checkpoint buffer of IAT stage
+ * @param iat IAT stage
+ * @param inputs Input files, ordered, part of checkpoint fingerprint
+ * @param verbose Verbose output
+ * @return Error code
+ */
+static ec_t iat_start (iat_stage_t *iat, const input_list_t *inputs, bool verbose);
+
+/**
+ * @brief Open histogram series of IAT counters
+ * @param iat IAT stage, counters are allocated
+ * @param series Histogram series stage
+ * @return Error code
+ */
+static ec_t iat_series_start (const iat_stage_t *iat, series_stage_t *series);
+
+/**
+ * @brief Stage callback, origin of interval 0 is known
+ * @param origin Timestamp of first packet (nsec)
+ * @param arg IAT stage
+ * @return EC_SUCCESS
+ */
+static ec_t iat_init (uint64_t origin, void *arg);
+
+/**
+ * @brief Stage callback, move opened trace to the read position of checkpoint
+ * @param source Opened trace
+ * @param arg IAT stage
+ * @return Error code
+ */
+static ec_t iat_open (pipeline_source_t *source, void *arg);
+
+/**
+ * @brief Stage callback, display the processing progress once an interval ends
+ * @param index Ended interval
+ * @param next Interval of next packet
+ * @param arg IAT stage
+ * @return void
+ */
+static void iat_interval (uint64_t index, uint64_t next, void *arg);
+
+/**
+ * @brief Stage callback, quantize IAT of one packet and advance read position
+ * @param packet Decoded packet
+ * @param arg IAT stage
+ * @return void
+ */
+static void iat_packet (const pipeline_packet_t *packet, void *arg);
+
+/**
+ * @brief Stage callback, save final checkpoint and remove the first packet from exceeded IAT
+ * @param index Interval of last packet
+ * @param arg IAT stage
+ * @return Error code of checkpoints
+ */
+static ec_t iat_finish (uint64_t index, void *arg);
+
+/**
+ * @brief Print IAT histogram, linear or log-linear with percentiles
+ * @param iat IAT stage
+ * @return void
+ */
+static void print_histogram (const iat_stage_t *iat);
+
+/**
+ * @brief Write IAT histogram to dat file and plot it with gnuplot
+ * @param iat IAT stage
+ * @return Error code
+ */
+static ec_t plot_histogram (const iat_stage_t *iat);
+
+/**
+ * @brief Move opened trace to the position of cursor
+ * @param cursor Read position
+ * @param source Opened trace
+ * @param nsec Timestamps of cursor are in nanoseconds, otherwise microseconds
+ * @return EC_SUCCESS, or EC_GEN_INVALID_CHECKPOINT if trace ends before the position
+ */
+static ec_t resume_trace (const trace_cursor_t *cursor, pipeline_source_t *source, bool nsec);
+
+/**
+ * @brief Convert tick to the earliest ERF timestamp converted back to it by pipeline_erf_to_nsec
+ * @param ticks Timestamp (tick)
+ * @param nsec Tick is nanosecond, otherwise microsecond
+ * @return ERF timestamp
+ */
+static uint64_t ticks_to_erf (uint64_t ticks, bool nsec);
+
+/**
+ * @brief Advance cursor over one packet passed to IAT stage, and take checkpoint if due
+ * @param iat IAT stage, checkpointer.ec is set if checkpoint fails
+ * @param ts Packet timestamp (tick)
+ * @param offset Offset of next record of mmap reader, 0 if read by libtrace
+ * @return void
+ */
+static inline void advance_cursor (iat_stage_t *iat, uint64_t ts, uint64_t offset);
+
+/**
+ * @brief Take checkpoint if checkpoint period has passed since the last one
+ * @param iat IAT stage
+ * @param cursor Read position
+ * @param pool Multi-threaded state, NULL in serial mode
+ * @return Error code
+ */
+static ec_t checkpoint_if_due (iat_stage_t *iat, const trace_cursor_t *cursor, const iat_pool_t *pool);
+
+/**
+ * @brief Save analysis state and read position to checkpoint file
+ * @param iat IAT stage
+ * @param cursor Read position
+ * @param pool Multi-threaded state, NULL in serial mode
+ * @return Error code
+ */
+static ec_t save_checkpoint (const iat_stage_t *iat, const trace_cursor_t *cursor, const iat_pool_t *pool);
+
+/**
+ * @brief Restore analysis state and read position from checkpoint file
+ * @param iat IAT stage, counters and cursor are restored
+ * @param parallel Resumed by multi-threaded mode
+ * @param started Serial mode: first packet was passed, multi-threaded mode: a merged chunk had packets
+ * @param last Multi-threaded mode: timestamp of last packet of merged chunks (tick)
+ * @return Error code
+ */
+static ec_t load_checkpoint (iat_stage_t *iat, bool parallel, bool *started, uint64_t *last);
+
+/**
+ * @brief Quantize one IAT into histogram, linear or log-linear
+ * @param iat IAT (tick)
+ * @param config Quantization parameters
+ * @param count Count of quantized IAT
+ * @param negative Count of negative IAT
+ * @param exceed Count of IAT exceed max quantized IAT
+ * @return void
+ */
+static inline void quantize_iat (long int iat, const iat_config_t *config, uint64_t *count, uint64_t *negative, uint64_t *exceed);
+
+/**
+ * @brief Stage callback of chunk worker, quantize IAT within chunk
+ * @param packet Decoded packet
+ * @param arg Quantized IAT of chunk
+ * @return void
+ */
+static void chunk_packet (const pipeline_packet_t *packet, void *arg);
+
+/**
+ * @brief Add one packet of chunk to quantiles of its interval, a new interval is appended once the packet passes the last one
+ * @param chunk Chunk, ec is set if allocation fails
+ * @param packet Decoded packet
+ * @param ts Packet timestamp (tick)
+ * @return void
+ */
+static void chunk_quantiles (iat_chunk_t *chunk, const pipeline_packet_t *packet, uint64_t ts);
+
+/**
+ * @brief Merge quantiles of chunk into current interval, closing intervals before each of them, with the IAT across chunk boundary
+ * @param pool Multi-threaded state, started and last are not yet updated by chunk
+ * @param chunk Chunk, its quantiles are freed
+ * @return void
+ */
+static void merge_quantiles (const iat_pool_t *pool, iat_chunk_t *chunk);
+
+/**
+ * @brief Free quantiles of chunk
+ * @param chunk Chunk
  * @return void
  */
-static void per_packet (libtrace_packet_t *packet, double time_interval, uint64_t quantize_time_order, uint64_t iat_count_size);
+static void free_chunk_quantiles (iat_chunk_t *chunk);
+
+/**
+ * @brief Read records of chunk with mmap reader, from its first record boundary up to the boundary at its end
+ * @param input_file Trace file
+ * @param chunk Chunk, start, stop and truncated are set
+ */
+static ec_t read_chunk (const char *input_file, iat_chunk_t *chunk);
+
+/**
+ * @brief Worker of input pool, quantize IAT of one chunk
+ * @param index Index of chunk
+ * @param arg Multi-threaded state
+ * @return Error code
+ */
+static ec_t chunk_worker (size_t index, void *arg);
+
+/**
+ * @brief Merger of input pool, add histogram of one chunk and the IAT across previous chunk boundary
+ * @param index Index of chunk
+ * @param arg Multi-threaded state
+ * @return Error code
+ */
+static ec_t chunk_merger (size_t index, void *arg);
+
+/**
+ * @brief Split files from cursor into chunks, pcap files read by mmap into byte ranges and other files as a whole
+ * @param pool Multi-threaded state, chunks and chunk_count are set
+ * @param threads Number of worker threads
+ * @return Error code
+ */
+static ec_t plan_chunks (iat_pool_t *pool, int threads);
+
+/**
+ * @brief Multi-threaded mode, quantize IAT of each chunk on a worker pool and merge them in trace order into the stages
+ * @param inputs Input files, ordered by first timestamp
+ * @param reader Trace reader
+ * @param iat IAT stage, starts from its cursor, file boundary or offset of mmap reader, 0 unless resumed
+ * @param quantiles Quantile stage, NULL unless quantile mode
+ * @param joint Joint stage, NULL unless joint mode
+ * @param threads Number of worker threads
+ * @param started A merged chunk before cursor had packets
+ * @param last Timestamp of last packet before cursor (tick)
+ * @return Error code
+ */
+static ec_t process_files_parallel (const input_list_t *inputs, reader_t reader, iat_stage_t *iat, quantile_stage_t *quantiles, joint_stage_t *joint,
+                                    int threads, bool started, uint64_t last);
 
 /**
  * @brief Main function, parse trace file and extract IAT, then write to CSV file
@@ -61,157 +429,175 @@ static void per_packet (libtrace_packet_t *packet, double time_interval, uint64_
  * @param argv Argument vector
  * @return Error code
  * @details
- * Normal usage:            ./pt_quantize_iat -i <input_file> -q <quantize_time_order_of_2> [-s <iat_count_size>] [-p <path_of_histogram>] [-l] [-v]
+ * Normal usage:            ./pt_quantize_iat -i <input_file> [-i <input_file> ...] -q <quantize_time_order_of_2> [-s <iat_count_size>] [-E] [-t <time_interval>] [-Q [-C <compression>]] [-H <series_file>] [-W <reorder_window>] [-B <packets>,<burst_window>] [-J <joint_file>] [-m <metrics> -o <output_file>] [-p <path_of_histogram>] [-n <threads>] [-r <reader>] [-S <stats_target>] [-k <checkpoint_file> [-K <checkpoint_period>] [-R]] [-l] [-v]
+ * Log-linear histogram:    ./pt_quantize_iat -i <input_file> [-i <input_file> ...] -L <significant_digits> [-E] [-p <path_of_histogram>] [-n <threads>] [-r <reader>] [-S <stats_target>] [-k <checkpoint_file> [-K <checkpoint_period>] [-R]] [-l] [-v]
+ * Per-flow IAT:            ./pt_quantize_iat -i <input_file> [-i <input_file> ...] -q <quantize_time_order_of_2> | -L <significant_digits> -F [-T <flow_timeout>] [-N <top_flows>] [-p <path_of_histogram>] [-r <reader>] [-S <stats_target>] [-l] [-v]
  * Display help message:    ./pt_quantize_iat -h
  */
 int main (int argc, char *argv[]) {
     /* params */
                         errno = 0;                      /* error number */
     ec_t                ec = 0;                         /* error code */
-    int                 i;                              /* iterator */
-    char               *endptr;                         /* string to int conversion pointer */
-    double              time_interval = 10;             /* progress display time interval (sec) */
-    libtrace_t         *trace = NULL;                   /* trace file */
-    libtrace_packet_t  *packet = NULL;                  /* packet */
+    pipeline_options_t  options;                        /* shared options */
+    input_list_t       *inputs = &options.inputs;       /* input files */
+    size_t              input_index;                    /* input file iterator */
+    iat_stage_t         iat;                            /* IAT histogram and checkpoints */
+    quantile_stage_t    quantiles;                      /* quantile sketches */
+    series_stage_t      series;                         /* histogram series */
+    reorder_stage_t     reorder;                        /* reorder buffer */
+    burst_stage_t       bursts;                         /* micro-burst detector */
+    joint_stage_t       joint;                          /* size and joint histogram */
+    flow_stage_t        flows;                          /* per-flow IAT */
+    count_stage_t       counter;                        /* packet count of each interval */
+    pipeline_option_t   parsers[IAT_PARSERS] = { pipeline_option, iat_option, quantile_option, series_option,
+                                                 reorder_option, burst_option, joint_option, flow_option,
+                                                 count_option };    /* option parsers, shared options first */
+    void               *parser_args[IAT_PARSERS] = { &options, &iat, &quantiles, &series,
+                                                     &reorder, &bursts, &joint, &flows, &counter };  /* argument of each parser */
+    pipeline_t          pipeline;                       /* driver of packets read from trace */
+    pipeline_t         *analysis = &pipeline;           /* pipeline of analysis stages, behind reorder buffer in reorder mode */
+    uint32_t            modes = 0;                      /* bit mask of PIPELINE_CAN_* used by this run */
+    uint64_t            first_nsec;                     /* timestamp of first packet of trace (nsec) */
+    bool                started = false;                /* a packet before checkpoint was passed, or a chunk before it had packets */
+    uint64_t            last = 0;                       /* multi-threaded mode: timestamp of last packet before cursor (tick) */
     struct timespec     start_time;                     /* start processing time */
     struct timespec     end_time;                       /* end processing time */
     time_t              elapsed_time_sec;               /* elapsed time (sec) */
     long int            elapsed_time_nsec;              /* elapsed time (nsec) */
-    FILE               *gnuplot = NULL;                 /* gnuplot pipe */
-    char                filename_buf[1024];             /* filename buffer */
-    FILE               *data_file = NULL;               /* data file */
-    const char         *input_file = NULL;              /* input file */
-    uint64_t            quantize_time_order = 0;        /* quantize time order of 2 */
-    uint64_t            iat_count_size = 20;            /* size of quantized_iat_count */
-    const char         *histogram_path = NULL;          /* path of histogram */
-    bool                histogram_log_scale = false;    /* histogram log scale */
-    bool                verbose = false;                /* verbose output */
 
     /* initialize */
+    pipeline_options_init(&options);
+    options.time_intervals[0] = IAT_DEFAULT_TIME_INTERVAL;
+    options.levels = 1;
+    memset(&iat, 0, sizeof(iat_stage_t));
+    iat.config.iat_count_size = 20;
+    iat.checkpointer.period = 60;
+    iat.cursor.ordered = true;
+    quantile_stage_init(&quantiles);
+    series_stage_init(&series);
+    reorder_stage_init(&reorder);
+    burst_stage_init(&bursts);
+    joint_stage_init(&joint);
+    flow_stage_init(&flows);
+    count_stage_init(&counter);
     register_all_signal_handlers();
     if (errno != EC_SUCCESS) {
         perror("signal");
-        printf("errno = %d -> %s\n", errno, strerror(errno));
+        fprintf(stderr, "errno = %d -> %s\n", errno, strerror(errno));
         exit(EXIT_FAILURE);
     }
-    ec = setvbuf(stdout, 0, _IONBF, 0); /* output may be going through pipe to log file */
+    /* progress and diagnostics go to unbuffered stderr, only histogram data goes to stdout,
+     * so stdout can be fully buffered even when it goes through pipe to log file
+     */
+    ec = setvbuf(stdout, NULL, _IOFBF, 1 << 20);
     if ((ec != EC_SUCCESS) || (errno != EC_SUCCESS)) {
         perror("setvbuf");
-        printf("errno = %d -> %s\n", errno, strerror(errno));
+        fprintf(stderr, "errno = %d -> %s\n", errno, strerror(errno));
         exit(EXIT_FAILURE);
     }
 
     /* check CLI argument count */
     if (argc < 2) {
         ec = EC_CLI_NO_INPUTS;
-    } else if (argc > CLI_MAX_INPUTS) {
+    } else if (argc > CLI_MAX_INPUTS + 2 * (INPUT_MAX_OPTIONS - 1)) {
         ec = EC_CLI_MAX_INPUTS;
     }
 
-    /* parse CLI arguments */
-    for (i=1 ; (i<argc) && (ec==0) ; i++) {
-        /* Check for argument pairs */
-        if ((strcmp(argv[i], "-i") == 0) || (strcmp(argv[i], "--input") == 0)) {
-            i++;
-            if (i < argc) {
-                input_file = argv[i];
-            } else {
-                ec = EC_CLI_NO_INPUT_FILE_VALUE;
-            }
-        } else if ((strcmp(argv[i], "-q") == 0) || (strcmp(argv[i], "--quantize-time") == 0)) {
-            i++;
-            if (i < argc) {
-                /* following line will result in a -Wsign-conversion warning, from signed to unsigned
-                 * but it is safe to ignore since the value should always be positive
-                 */
-                quantize_time_order = (long int) strtol(argv[i], &endptr, 10);
-                if (errno != EC_SUCCESS) {
-                    perror("strtol");
-                    ec = EC_CLI_INVALID_QUANTIZE_TIME;
-                }
-                if (endptr == argv[i]) {
-                    printf("No digits were found\n");
-                    ec = EC_CLI_INVALID_QUANTIZE_TIME;
-                }
-            } else {
-                ec = EC_CLI_NO_QUANTIZE_TIME_VALUE;
-            }
-        /* Check for optional arguments */
-        } else if ((strcmp(argv[i], "-s") == 0) || (strcmp(argv[i], "--count-size") == 0)) {
-            i++;
-            if (i < argc) {
-                /* following line will result in a -Wsign-conversion warning, from signed to unsigned
-                 * but it is safe to ignore since the value should always be positive
-                 */
-                iat_count_size = (long int) strtol(argv[i], &endptr, 10);
-                if (errno != EC_SUCCESS) {
-                    perror("strtol");
-                    ec = EC_CLI_INVALID_COUNT_SIZE;
-                }
-                if (endptr == argv[i]) {
-                    printf("No digits were found\n");
-                    ec = EC_CLI_INVALID_COUNT_SIZE;
-                }
-            } else {
-                ec = EC_CLI_NO_COUNT_SIZE_VALUE;
-            }
-        } else if ((strcmp(argv[i], "-p") == 0) || (strcmp(argv[i], "--histogram-path") == 0)) {
-            i++;
-            if (i < argc) {
-                histogram_path = argv[i];
-            } else {
-                ec = EC_CLI_NO_HISTOGRAM_PATH_VALUE;
-            }
-        /* Check for optional single arguments */
-        } else if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "--help") == 0)) {
-            print_help_message();
-            exit(EXIT_SUCCESS);
-        } else if ((strcmp(argv[i], "-v") == 0) || (strcmp(argv[i], "--verbose") == 0)) {
-            verbose = true;
-        } else if ((strcmp(argv[i], "-l") == 0) || (strcmp(argv[i], "--log-scale") == 0)) {
-            histogram_log_scale = true;
-        } else {
-            ec = EC_CLI_UNKNOWN_OPTION;
-            printf("Unknown option: %s\n", argv[i]);
-        }
-        if (ec != EC_SUCCESS) {
-            break;
-        }
+    /* parse CLI arguments, each stage parses its own options */
+    if (ec == EC_SUCCESS) {
+        ec = pipeline_parse_options(argc, argv, parsers, parser_args, IAT_PARSERS);
     }
-    if ((ec == EC_SUCCESS) && verbose) {
-        printf("Arguments parsed:\n");
-        printf("    Input file:     %s\n", input_file);
-        printf("    Quantize time:  %ld\n", quantize_time_order);
-        printf("    Count size:     %ld\n", iat_count_size);
-        printf("    Histogram path: %s\n", histogram_path);
+    if ((ec == EC_SUCCESS) && options.verbose) {
+        fprintf(stderr, "Arguments parsed:\n");
+        pipeline_options_print(&options);
+        fprintf(stderr, "    Quantize time:  %ld\n", iat.config.quantize_time_order);
+        fprintf(stderr, "    Count size:     %ld\n", iat.config.iat_count_size);
+        fprintf(stderr, "    Log-linear:     %ld\n", iat.log_digits);
+        fprintf(stderr, "    Nanosecond:     %d\n", iat.config.nsec);
+        fprintf(stderr, "    Quantiles:      %d\n", quantiles.enabled);
+        fprintf(stderr, "    Compression:    %ld\n", quantiles.compression);
+        fprintf(stderr, "    Hist. series:   %s\n", (series.path != NULL) ? series.path : "none");
+        fprintf(stderr, "    Reorder window: %lf\n", reorder.window);
+        fprintf(stderr, "    Burst:          %ld packets in %lf\n", bursts.threshold, bursts.window);
+        fprintf(stderr, "    Joint hist.:    %s\n", (joint.path != NULL) ? joint.path : "none");
+        fprintf(stderr, "    Histogram path: %s\n", iat.histogram_path);
+        fprintf(stderr, "    Checkpoint:     %s\n", (iat.checkpointer.path != NULL) ? iat.checkpointer.path : "none");
+        fprintf(stderr, "    Ckpt. period:   %lf\n", iat.checkpointer.period);
+        fprintf(stderr, "    Resume:         %d\n", iat.resume);
+        fprintf(stderr, "    Per-flow:       %d\n", flows.enabled);
+        fprintf(stderr, "    Flow timeout:   %lf\n", flows.timeout);
+        fprintf(stderr, "    Top flows:      %ld\n", flows.top);
+        fprintf(stderr, "    Count output:   %s\n", (counter.output_file != NULL) ? counter.output_file : "none");
+        fprintf(stderr, "    Count metrics:  0x%x\n", counter.metrics);
     }
 
     /* check for required arguments */
     if (ec == EC_SUCCESS) {
-        if (input_file == NULL) {
-            ec = EC_CLI_NO_INPUT_OPTION;
-        } else if (quantize_time_order == 0) {
-            ec = EC_CLI_NO_QUANTIZE_TIME_OPTION;
-        }
+        ec = pipeline_options_check(&options);
+    }
+    if (ec == EC_SUCCESS) {
+        ec = iat_check(&iat, &options);
+    }
+    /* packet count goes to output files so stdout keeps the IAT report, only it rolls up coarser intervals */
+    if ((ec == EC_SUCCESS) && (counter.output_file != NULL)) {
+        ec = count_check(&counter, &options);
+    } else if ((ec == EC_SUCCESS) && (counter.metrics != 0)) {
+        ec = EC_CLI_NO_OUTPUT_OPTION;
+    } else if ((ec == EC_SUCCESS) && (options.levels > 1)) {
+        ec = EC_CLI_INVALID_TIME_INTERVAL;
     }
-    if ((ec == EC_SUCCESS) && verbose) {
-        printf("Required arguments checked\n");
+    if ((ec == EC_SUCCESS) && options.verbose) {
+        fprintf(stderr, "Required arguments checked\n");
     }
 
-    /* check for valid arguments */
+    /* check for valid arguments
+     *
+     * each stage checks its own options and is registered if enabled,
+     * then every stage must support the modes of this run instead of checking each pair of options
+     */
     if (ec == EC_SUCCESS) {
-        if (strstr(input_file, ".pcap") == NULL) {
-            ec = EC_CLI_INVALID_INPUT_FILE;
-        } else if (quantize_time_order < 1) {
-            ec = EC_CLI_INVALID_QUANTIZE_TIME;
-        }
-        if (access(input_file, F_OK) != 0) {
-            printf("File inaccessable: %s\n", input_file);
-            ec = EC_CLI_INPUT_FILE_NOT_FOUND;
+        pipeline_init(&pipeline, options.reader, &iat.config.bin, options.verbose);
+        pipeline_init(&reorder.downstream, options.reader, &iat.config.bin, options.verbose);
+        if (reorder.enabled) {
+            analysis = &reorder.downstream;
         }
+        ec = series_register(&series, analysis);
+    }
+    if (ec == EC_SUCCESS) {
+        ec = iat_register(&iat, analysis);
+    }
+    if (ec == EC_SUCCESS) {
+        ec = joint_register(&joint, analysis, iat.config.nsec);
+    }
+    if (ec == EC_SUCCESS) {
+        ec = burst_register(&bursts, analysis, iat.config.nsec);
+    }
+    if (ec == EC_SUCCESS) {
+        ec = quantile_register(&quantiles, analysis, iat.config.nsec);
+    }
+    if (ec == EC_SUCCESS) {
+        ec = flow_register(&flows, analysis);
+    }
+    if ((ec == EC_SUCCESS) && (counter.output_file != NULL)) {
+        ec = count_register(&counter, analysis);
+    }
+    if (ec == EC_SUCCESS) {
+        ec = reorder_register(&reorder, &pipeline, iat.config.nsec);
+    }
+    if (options.threads > 1) {
+        modes |= PIPELINE_CAN_THREADS;
+    }
+    if (iat.checkpointer.path != NULL) {
+        modes |= PIPELINE_CAN_CHECKPOINT;
+    }
+    if (ec == EC_SUCCESS) {
+        ec = pipeline_require(&pipeline, modes);
     }
-    if ((ec == EC_SUCCESS) && verbose) {
-        printf("Valid arguments checked\n");
+    if ((ec == EC_SUCCESS) && reorder.enabled) {
+        ec = pipeline_require(&reorder.downstream, modes);
+    }
+    if ((ec == EC_SUCCESS) && options.verbose) {
+        fprintf(stderr, "Valid arguments checked\n");
     }
 
     /* end of CLI argument parsing
@@ -219,56 +605,116 @@ int main (int argc, char *argv[]) {
      * exit if there are any errors
      */
     if (ec != EC_SUCCESS) {
-        printf("errno = %d -> %s\n", errno, strerror(errno));
+        fprintf(stderr, "errno = %d -> %s\n", errno, strerror(errno));
+        input_list_free(inputs);
         print_ec_message(ec);
         print_help_message();
         exit(EXIT_FAILURE);
     }
 
-    /* open trace file */
-    quantized_iat_count = (uint64_t *) malloc(iat_count_size * sizeof(uint64_t));
-    if (ec == EC_SUCCESS) {
-        packet = trace_create_packet();
-        if (packet == NULL) {
-            perror("trace_create_packet");
-            ec = EC_GEN_UNABLE_TO_CREATE_PACKET;
+    /* order input files, processing them in this order is the same as processing one concatenated trace */
+    if (inputs->count > 1) {
+        ec = input_list_sort(inputs, options.reader);
+        if ((ec == EC_SUCCESS) && options.verbose) {
+            fprintf(stderr, "Input files ordered by first timestamp:\n");
+            for (input_index=0; input_index<inputs->count; input_index++) {
+                fprintf(stderr, "    %s\n", inputs->paths[input_index]);
+            }
         }
     }
+
+    /* allocate state of each stage */
     if (ec == EC_SUCCESS) {
-        trace = trace_create(input_file);
-        if (trace_is_err(trace)) {
-            trace_perror(trace, "trace_create");
-            ec = EC_GEN_UNABLE_TO_CREATE_TRACE;
+        ec = iat_start(&iat, inputs, options.verbose);
+    }
+    if ((ec == EC_SUCCESS) && quantiles.enabled) {
+        ec = quantile_start(&quantiles, options.verbose);
+    }
+    if ((ec == EC_SUCCESS) && (series.path != NULL)) {
+        ec = iat_series_start(&iat, &series);
+    }
+    if ((ec == EC_SUCCESS) && reorder.enabled) {
+        ec = reorder_start(&reorder);
+    }
+    if ((ec == EC_SUCCESS) && (bursts.threshold != 0)) {
+        ec = burst_start(&bursts);
+    }
+    if ((ec == EC_SUCCESS) && (joint.path != NULL)) {
+        ec = joint_start(&joint, options.verbose);
+    }
+    if ((ec == EC_SUCCESS) && flows.enabled) {
+        ec = flow_start(&flows);
+    }
+    if ((ec == EC_SUCCESS) && (counter.output_file != NULL)) {
+        ec = count_open(&counter, options.verbose);
+    }
+
+    /* workers of multi-threaded mode place packets into intervals by trace time since the first packet,
+     * which serial mode takes from the packet itself
+     */
+    if ((ec == EC_SUCCESS) && quantiles.enabled && (options.threads > 1)) {
+        if (inputs->count > 1) {
+            first_nsec = inputs->first_nsec[0];
+        } else {
+            ec = input_get_first_timestamp(inputs->paths[0], options.reader, &first_nsec);
         }
-        if (trace_start(trace) != 0) {
-            trace_perror(trace, "trace_start");
-            ec = EC_GEN_UNABLE_TO_START_TRACE;
+        if ((ec == EC_SUCCESS) && (first_nsec != INPUT_EMPTY_TIMESTAMP)) {
+            iat.config.bin.origin_nsec = first_nsec;
         }
     }
-    if ((ec == EC_SUCCESS) && verbose) {
-        printf("Trace file opened\n");
+
+    /* stages resumed in serial mode are given the origin and interval of the last packet before checkpoint */
+    if ((ec == EC_SUCCESS) && iat.resume) {
+        ec = load_checkpoint(&iat, options.threads > 1, &started, &last);
+    }
+    if ((ec == EC_SUCCESS) && started && (options.threads == 1)) {
+        ec = pipeline_resume(&pipeline, iat.origin, iat.interval_index);
     }
 
-    /* process trace file */
+    /* process trace files
+     *
+     * with threads, files and chunks of pcap files are quantized on a worker pool and merged in trace order,
+     * otherwise files are read one after another as one trace
+     */
     if (ec == EC_SUCCESS) {
-        printf("Processing trace file ...\n");
+        fprintf(stderr, "Processing %zu trace file(s) ...\n", inputs->count);
         if (clock_gettime(CLOCK_REALTIME, &start_time) == -1) {
             perror("clock_gettime");
             ec = EC_GEN_CLOCK_GETTIME_ERROR;
         }
     }
     if (ec == EC_SUCCESS) {
-        while (trace_read_packet(trace, packet) > 0) {
-            per_packet(packet, time_interval, quantize_time_order, iat_count_size);
-        }
-        exceed_max_iat_count--; /* remove error count caused by first packet */
-        printf("\n");
-        if (trace_is_err(trace)) {
-            /* only check for error after all file proccessed */
-            trace_perror(trace, "Reading packets");
-            ec = EC_GEN_TRACE_READ_PACKET_ERROR;
+        ec = stats_start(options.stats_target, STATS_DEFAULT_PERIOD);
+    }
+    if ((ec == EC_SUCCESS) && (options.threads > 1)) {
+        ec = process_files_parallel(inputs, options.reader, &iat, quantiles.enabled ? &quantiles : NULL, (joint.path != NULL) ? &joint : NULL,
+                                    (int) options.threads, started, last);
+    } else if (ec == EC_SUCCESS) {
+        for (input_index=(size_t) iat.cursor.file_index; (input_index<inputs->count) && (ec==EC_SUCCESS); input_index++) {
+            iat.cursor.file_index = input_index;
+            ec = pipeline_run(&pipeline, inputs->paths[input_index]);
+            if (signal_stop_requested() != 0) {
+                break;
+            }
+            /* next file starts from its first packet */
+            memset(&iat.cursor, 0, sizeof(trace_cursor_t));
+            iat.cursor.ordered = true;
+            iat.cursor.file_index = input_index + 1;
         }
     }
+    /* held packets, the last burst and the last intervals are only finished at the end of the last file */
+    if (ec == EC_SUCCESS) {
+        ec = pipeline_finish(&pipeline);
+    }
+    fprintf(stderr, "\n");
+    if ((ec == EC_SUCCESS) && flows.enabled && options.verbose) {
+        fprintf(stderr, "Flow table: %lu slots (%lu KB), %zu slabs of flow records (%zu KB)\n", flows.table.mask + 1,
+                (flows.table.mask + 1) * sizeof(flow_slot_t) / 1024, flows.table.slab_count,
+                (flows.table.slab_count * sizeof(flow_record_t)) << FLOW_SLAB_BITS >> 10);
+    }
+    if ((stats_stop() != EC_SUCCESS) && (ec == EC_SUCCESS)) {
+        ec = EC_GEN_UNABLE_TO_OPEN_STATS;
+    }
     if (ec == EC_SUCCESS) {
         if (clock_gettime(CLOCK_REALTIME, &end_time) == -1) {
             perror("clock_gettime");
@@ -282,202 +728,1193 @@ int main (int argc, char *argv[]) {
             elapsed_time_sec--;
             elapsed_time_nsec += 1000000000;
         }
-        printf("Elapsed time: %ld.%09ld sec\n", elapsed_time_sec, elapsed_time_nsec);
-    }
-    if (ec == EC_SUCCESS) {
-        for (i=0; i<(int) iat_count_size; i++) {
-            printf("Quantized IAT[%02d]: %ld\n", i, quantized_iat_count[i]);
+        fprintf(stderr, "Elapsed time: %ld.%09ld sec\n", elapsed_time_sec, elapsed_time_nsec);
+        if (options.verbose || (options.stats_target != NULL)) {
+            stats_print(stderr);
         }
     }
 
-    /* free trace resources */
-    trace_destroy(trace);
-    trace_destroy_packet(packet);
-
-    /* write count to dat file */
-    if ((ec == EC_SUCCESS) && (histogram_path != NULL)) {
-        snprintf(filename_buf, sizeof(filename_buf), "%s.dat", histogram_path);
-        data_file = fopen(filename_buf, "w");
-        if ((data_file == NULL) || ferror(data_file)) {
-            perror("fopen");
-            ec = EC_GEN_UNABLE_TO_OPEN_DATA_FILE;
-        }
+    /* report of each stage */
+    if (ec == EC_SUCCESS) {
+        print_histogram(&iat);
     }
-    if ((ec == EC_SUCCESS) && (histogram_path != NULL)) {
-        for (i=0; i<(int) iat_count_size; i++) {
-            fprintf(data_file, "%ld\n", quantized_iat_count[i]);
-        }
-        if ((errno != EC_SUCCESS) && errno != EIO) {
-            perror("fprintf");
-            ec = EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
-        }
-        if (errno == EIO) {
-            perror("fprintf");
-            printf("It is expected to have frequent EIO error in WSL2\n");
-        }
+    if ((ec == EC_SUCCESS) && quantiles.enabled) {
+        quantile_print(&quantiles);
     }
-    if (ec == EC_SUCCESS) {
-        printf("Histogram data written to %s\n", filename_buf);
+    if ((ec == EC_SUCCESS) && reorder.enabled) {
+        reorder_print(&reorder);
     }
-    /* write histogram file 
-     *
-     * https://gnuplot.sourceforge.net/demo/histograms.html
-     * http://www.gnuplot.info/docs/loc5395.html
-     */
-    if ((ec == EC_SUCCESS) && (histogram_path != NULL)) {
-        gnuplot = popen("gnuplot -persist", "w");
-        if (gnuplot == NULL) {
-            perror("popen");
-            ec = EC_GEN_UNABLE_TO_USE_GNUPLOT;
+    if ((ec == EC_SUCCESS) && (bursts.threshold != 0)) {
+        burst_print(&bursts);
+    }
+    if (series.path != NULL) {
+        if ((series_close(&series) != EC_SUCCESS) && (ec == EC_SUCCESS)) {
+            ec = EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
         }
-        fprintf(gnuplot, "set terminal pngcairo font \"%s,%d\" size %d,%d\n", "Arial", 20, 1920, 1080);
-        fprintf(gnuplot, "set output \"%s.png\"\n", histogram_path);
-        fprintf(gnuplot, "set title \"Histogram of Quantized IAT\"\n");
-        fprintf(gnuplot, "set xlabel \"Quantized IAT\"\n");
-        if (histogram_log_scale) {
-            fprintf(gnuplot, "set ylabel \"Count (log-scaled)\"\n");
-        } else {
-            fprintf(gnuplot, "set ylabel \"Count\"\n");
+        if (ec == EC_SUCCESS) {
+            fprintf(stderr, "Histogram series of %lu intervals written to %s\n", series.writer.info.interval_count, series.path);
         }
-        fprintf(gnuplot, "set boxwidth 0.9 absolute\n");
-        fprintf(gnuplot, "set style fill solid 1.00 border lt -1\n");
-        fprintf(gnuplot, "set key fixed right top vertical Right noreverse noenhanced autotitle nobox\n");
-        fprintf(gnuplot, "set style histogram clustered gap 1 title textcolor lt -1\n");
-        fprintf(gnuplot, "set datafile missing '-'\n");
-        fprintf(gnuplot, "set style data histograms\n");
-        fprintf(gnuplot, "set xrange [-1:%d] noreverse writeback\n", (int) iat_count_size + 1);
-        if (histogram_log_scale) {
-            fprintf(gnuplot, "set logscale y\n");
+    }
+    if (counter.sink != NULL) {
+        if ((count_close(&counter) != EC_SUCCESS) && (ec == EC_SUCCESS)) {
+            ec = EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
         }
-        fprintf(gnuplot, "plot newhistogram, '%s' using 1\n", filename_buf);
-        //if (ferror(gnuplot)) { // debug - gnuplot will definitely show error message in this case
-        if (ferror(gnuplot) || ((errno != 0) && (errno != EIO))) { // often errno is 5
-            perror("fprintf");
-            ec = EC_GEN_GNUPLOT_ERROR;
+        if (ec == EC_SUCCESS) {
+            fprintf(stderr, "Packet count of %u interval(s) written to %s\n", counter.levels, counter.output_file);
         }
-        if (errno == EIO) {
-            perror("fprintf");
-            printf("It is expected to have frequent EIO error in WSL2\n");
+    }
+    if ((ec == EC_SUCCESS) && (joint.path != NULL)) {
+        ec = joint_write(&joint);
+        if (ec == EC_SUCCESS) {
+            fprintf(stderr, "Size and joint histogram of %lu packets written to %s\n", joint.histogram.packets, joint.path);
         }
     }
-    if (ec == EC_SUCCESS) {
-        printf("Histogram file written to %s.png\n", histogram_path);
+    if ((ec == EC_SUCCESS) && flows.enabled) {
+        flow_print(&flows);
     }
 
-    /* free memory */
-    if (data_file != NULL) {
-        fclose(data_file);
-    }
-    if (gnuplot != NULL) {
-        pclose(gnuplot);
+    /* free trace resources */
+    input_list_free(inputs);
+
+    /* write count to dat file and histogram file */
+    if ((ec == EC_SUCCESS) && (iat.histogram_path != NULL)) {
+        ec = plot_histogram(&iat);
     }
-    free(quantized_iat_count);
+
+    /* free memory */
+    free(iat.count);
+    free(iat.checkpointer.buffer);
+    flow_table_free(&flows.table);
+    quantile_stage_free(&quantiles);
+    reorder_buffer_free(&reorder.buffer);
+    burst_detector_free(&bursts.detector);
+    joint_histogram_free(&joint.histogram);
 
     /* exit */
     if (ec != EC_SUCCESS) {
-        printf("errno = %d -> %s\n", errno, strerror(errno));
+        fprintf(stderr, "errno = %d -> %s\n", errno, strerror(errno));
         print_ec_message(ec);
         exit(EXIT_FAILURE);
     }
-    printf("Program ended successfully!\n");
+    if (signal_stop_requested() != 0) {
+        fprintf(stderr, "Stopped by signal %d, results cover the packets read before it\n", signal_stop_requested());
+        exit(signal_stop_requested());
+    }
+    fprintf(stderr, "Program ended successfully!\n");
     exit(EXIT_SUCCESS);
 }
 
+
 void print_help_message (void) {
-    printf("Usage: pt_quantize_iat -i <input_file> -q <quantize_time> [-s <count_size>] [-p <path_of_histogram>] [-l] [-v]\n");
+    printf("Usage: pt_quantize_iat -i <input_file> [-i <input_file> ...] -q <quantize_time> [-s <count_size>] [-t <time_interval>] [-Q [-C <compression>]] [-H <series_file>] [-W <reorder_window>] [-B <packets>,<burst_window>] [-J <joint_file>] [-m <metrics> -o <output_file>] [-p <path_of_histogram>] [-n <threads>] [-r <reader>] [-S <stats_target>] [-k <checkpoint_file> [-K <checkpoint_period>] [-R]] [-l] [-v]\n");
+    printf("       pt_quantize_iat -i <input_file> [-i <input_file> ...] -L <significant_digits> [-p <path_of_histogram>] ...\n");
+    printf("       pt_quantize_iat -i <input_file> [-i <input_file> ...] -q <quantize_time> | -L <significant_digits> -F [-T <flow_timeout>] [-N <top_flows>] ...\n");
     printf("       pt_quantize_iat -h\n");
     printf("Options:\n");
-    printf("  -i, --input           Input file\n");
-    printf("  -q, --quantize-time   Time interval to quantize the packets, 2 to the power of t micro second\n");
+    printf("  -i, --input           Input file, glob pattern (quoted) or directory, repeatable,\n");
+    printf("                        files are ordered by first timestamp and IAT continues across files\n");
+    printf("  -q, --quantize-time   Time interval to quantize the packets, 2 to the power of t micro second, or nano second with -E, 1-63\n");
     printf("  -s, --count-size      (optional) Number of quantized IAT to count, default=20, correspond to -q=4 or 5\n");
+    printf("  -L, --log-linear      (optional) Log-linear histogram keeping 1-5 significant digits of IAT up to 203 days (4.9 hours with -E),\n");
+    printf("                        replaces -q and -s, prints non-empty counters and percentiles\n");
+    printf("  -t, --time-interval   (optional) Seconds of trace time between progress displays and quantile intervals, default=10,\n");
+    printf("                        comma separated intervals (e.g. 1,10,60) are only allowed with -o, IAT uses the first one\n");
+    printf("  -Q, --quantiles       (optional) Sketch IAT and packet size quantiles (p50, p99, p99.9, p99.99) of each interval and whole trace\n");
+    printf("                        in fixed memory, can not be combined with -k\n");
+    printf("  -C, --quantile-compression (optional) Compression of -Q sketches, 10-100000, default=200, memory and accuracy grow with it,\n");
+    printf("                        each sketch holds 6 x compression + 1 centroids of 16 bytes\n");
+    printf("  -H, --histogram-series (optional) Write IAT histogram of each interval of -t to a binary file of sparse LEB128 (gap, count),\n");
+    printf("                        reads files serially, can not be combined with -k\n");
+    printf("  -W, --reorder-window  (optional) Hold packets for this many seconds of trace time and release them in timestamp order,\n");
+    printf("                        for interfaces of multi-port captures interleaved out of order, reads files serially without -F and -k\n");
+    printf("  -B, --burst           (optional) Print micro-bursts of at least <packets> packets within <burst_window> seconds, e.g. 32,0.00001,\n");
+    printf("                        with start, duration, packets, bytes and peak rate, reads files serially, can not be combined with -k\n");
+    printf("  -J, --joint-histogram (optional) Write packet size histogram and joint (size, IAT) histogram of log buckets to a binary matrix file,\n");
+    printf("                        counted in the same pass as IAT, can not be combined with -k\n");
+    printf("  -o, --output          (optional) Count packets of each interval of -t in the same pass as IAT, written to .csv, .bin or .col,\n");
+    printf("                        each interval to <output_file> with \"_<nsec>ns\" inserted if several, reads files serially, can not be combined with -k\n");
+    printf("  -m, --metrics         (optional) Comma separated metrics of -o, or \"all\": packets,bytes,capture,ipv4,ipv6,tcp,udp,mpls,vlan,\n");
+    printf("                        default=packets,bytes\n");
+    printf("  -E, --nsec            (optional) Quantize IAT in nano second, from ERF timestamp of libtrace or nanosecond pcap,\n");
+    printf("                        -q and -L apply to nano second, per-flow IAT stays in micro second\n");
     printf("  -p, --histogram-path  (optional) Path to save the histogram file, export if specified. Require gnuplot. Do not include file extension\n");
+    printf("  -n, --threads         (optional) Number of threads quantizing files concurrently, pcap files read by mmap are also split into chunks, default=1\n");
+    printf("  -r, --reader          (optional) auto|mmap|libtrace, default=auto, auto uses mmap for uncompressed classic pcap\n");
+    printf("  -S, --stats           (optional) Publish throughput stats every second to a file, or to shared memory with \"shm:/<name>\"\n");
+    printf("  -k, --checkpoint      (optional) Checkpoint file, analysis state is saved periodically and at the end\n");
+    printf("  -K, --checkpoint-period (optional) Wall clock seconds between checkpoints, default=60\n");
+    printf("  -R, --resume          (optional) Resume from checkpoint file given by -k, inputs and -q/-s must be the same\n");
+    printf("  -F, --per-flow        (optional) Count IAT within each 5-tuple flow as well, prints aggregated per-flow IAT and largest flows,\n");
+    printf("                        reads files serially, can not be combined with -k\n");
+    printf("  -T, --flow-timeout    (optional) Seconds of trace time after which an idle flow is finished, default=60\n");
+    printf("  -N, --top-flows       (optional) Number of largest flows to print, 0-1000, default=10\n");
     printf("  -l, --log-scale       (optional) Logarithmic scale for y-axis\n");
     printf("  -v, --verbose         (optional )Display verbose output\n");
     printf("  -h, --help            Display this help message\n");
     return;
 }
 
-/* @brief per_packet function to process each packet 
- * @param packet Packet to process
- * @param time_interval Time interval to update the processing progress
- * @param quantize_time_order Time interval to quantize the packets, 2 to the power of t microsecond
- * @param iat_count_size Number of quantized IAT to count
- * @return void
- * @details No error handling is done here as the error is already handled in the main function
- *          Also, if check is done here, excess CPU cycles will be used
+/* @brief Option parser of IAT stage
+ * @details "-h" is handled here as every run has an IAT stage
  */
-static void per_packet (libtrace_packet_t *packet, double time_interval, uint64_t quantize_time_order, uint64_t iat_count_size) {
+static ec_t iat_option (int argc, char *argv[], int *i, void *arg) {
     /* params */
-    struct timeval ts;                  /* timestamp */
-
-    /* retrieve data from packet 
-     *
-     * since IAT in practice only have microsecond precision, use timeval instead of timespec
-     *
-     * https://github.com/LibtraceTeam/libtrace/blob/cc98f68f72e24bf51e2dabc00af0dbc4ffe7bb3d/lib/trace.c#L1399
-     *
-     * following line will result in -Waggregate-return warning
-     * but it is safe to ignore as the struct is small and it is the intended practice
-     */
-    ts = trace_get_timeval(packet);
-
-    /* first packet in trace 
-     *
-     * set next_interval_time_sec to the first time interval
-     *
-     * set initial_time_sec to the first time interval
-     */
-    if (next_interval_time_sec == 0) {
-        next_interval_time_sec = ts.tv_sec + (time_t) (time_interval);
-        initial_time_sec = ts.tv_sec;
-        initial_time_usec = ts.tv_usec;
-    }
-
-    /* When time interval is reached, display the processing progress
-     *
-     * Use while loop to ensure even if no packet is observed in the time interval
-     *
-     * the initial packet will add exceed_max_iat_count by 1, so subtract 1,
-     * unsigned variable is used to contain the most amount of packets, so initialize with -1 doesn't work
-     * instead of adding logic to skip the first packet, which will be processed in every packet
-     */
-    while ((time_t) ts.tv_sec > next_interval_time_sec) {
-        printf("\33[2K\rProcessed %lu seconds of packets", ts.tv_sec - initial_time_sec);
-        next_interval_time_sec += (time_t) (time_interval);
-        printf("\t| negative IAT: %lu\t| exceed max IAT: %lu", negtive_iat_count, exceed_max_iat_count-1);
-    }
+    iat_stage_t    *iat = (iat_stage_t *) arg;
+    ec_t            ec = EC_SUCCESS;    /* error code */
+    char           *endptr;             /* string to int conversion pointer */
 
-    /* IAT calculation 
-     *
-     * use previously stored time to calculate the IAT, and store the current time
-     *
-     * no need to check for iat_sec is negative
-     *
-     * unify iat time to microseconds (iat_usec) for easier processing
-     */
-    if (next_interval_time_sec != 0) {
-        iat_sec = ts.tv_sec - current_time_sec;
-        iat_usec = ts.tv_usec - current_time_usec;
-        iat_usec += iat_sec * 1000000;
+    if ((strcmp(argv[*i], "-q") == 0) || (strcmp(argv[*i], "--quantize-time") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            /* following line will result in a -Wsign-conversion warning, from signed to unsigned
+             * but it is safe to ignore since the value should always be positive
+             */
+            iat->config.quantize_time_order = (long int) strtol(argv[*i], &endptr, 10);
+            if (errno != EC_SUCCESS) {
+                perror("strtol");
+                ec = EC_CLI_INVALID_QUANTIZE_TIME;
+            }
+            if (endptr == argv[*i]) {
+                fprintf(stderr, "No digits were found\n");
+                ec = EC_CLI_INVALID_QUANTIZE_TIME;
+            }
+        } else {
+            ec = EC_CLI_NO_QUANTIZE_TIME_VALUE;
+        }
+    } else if ((strcmp(argv[*i], "-s") == 0) || (strcmp(argv[*i], "--count-size") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            /* following line will result in a -Wsign-conversion warning, from signed to unsigned
+             * but it is safe to ignore since the value should always be positive
+             */
+            iat->config.iat_count_size = (long int) strtol(argv[*i], &endptr, 10);
+            if (errno != EC_SUCCESS) {
+                perror("strtol");
+                ec = EC_CLI_INVALID_COUNT_SIZE;
+            }
+            if (endptr == argv[*i]) {
+                fprintf(stderr, "No digits were found\n");
+                ec = EC_CLI_INVALID_COUNT_SIZE;
+            }
+        } else {
+            ec = EC_CLI_NO_COUNT_SIZE_VALUE;
+        }
+    } else if ((strcmp(argv[*i], "-L") == 0) || (strcmp(argv[*i], "--log-linear") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            iat->log_digits = strtol(argv[*i], &endptr, 10);
+            if (errno != EC_SUCCESS) {
+                perror("strtol");
+                ec = EC_CLI_INVALID_LOG_DIGITS;
+            }
+            if (endptr == argv[*i]) {
+                fprintf(stderr, "No digits were found\n");
+                ec = EC_CLI_INVALID_LOG_DIGITS;
+            }
+        } else {
+            ec = EC_CLI_NO_LOG_DIGITS_VALUE;
+        }
+    } else if ((strcmp(argv[*i], "-p") == 0) || (strcmp(argv[*i], "--histogram-path") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            iat->histogram_path = argv[*i];
+        } else {
+            ec = EC_CLI_NO_HISTOGRAM_PATH_VALUE;
+        }
+    } else if ((strcmp(argv[*i], "-k") == 0) || (strcmp(argv[*i], "--checkpoint") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            iat->checkpointer.path = argv[*i];
+        } else {
+            ec = EC_CLI_NO_CHECKPOINT_VALUE;
+        }
+    } else if ((strcmp(argv[*i], "-K") == 0) || (strcmp(argv[*i], "--checkpoint-period") == 0)) {
+        (*i)++;
+        if (*i < argc) {
+            iat->checkpointer.period = strtod(argv[*i], &endptr);
+            if (errno != EC_SUCCESS) {
+                perror("strtod");
+                ec = EC_CLI_INVALID_CHECKPOINT_PERIOD;
+            }
+            if (endptr == argv[*i]) {
+                fprintf(stderr, "No digits were found\n");
+                ec = EC_CLI_INVALID_CHECKPOINT_PERIOD;
+            }
+        } else {
+            ec = EC_CLI_NO_CHECKPOINT_PERIOD_VALUE;
+        }
+    } else if ((strcmp(argv[*i], "-h") == 0) || (strcmp(argv[*i], "--help") == 0)) {
+        print_help_message();
+        exit(EXIT_SUCCESS);
+    } else if ((strcmp(argv[*i], "-l") == 0) || (strcmp(argv[*i], "--log-scale") == 0)) {
+        iat->log_scale = true;
+    } else if ((strcmp(argv[*i], "-R") == 0) || (strcmp(argv[*i], "--resume") == 0)) {
+        iat->resume = true;
+    } else if ((strcmp(argv[*i], "-E") == 0) || (strcmp(argv[*i], "--nsec") == 0)) {
+        iat->config.nsec = true;
+    } else {
+        ec = EC_CLI_UNKNOWN_OPTION;
     }
-    current_time_sec = ts.tv_sec;
-    current_time_usec = ts.tv_usec;
+    return ec;
+}
 
-    /* quantize the IAT 
-     *
-     * also count the negative and max value exceed IAT
-     */
-    if (iat_usec < 0) {
-        negtive_iat_count++;
+/* @brief Check options of IAT stage
+ * @details log-linear mode replaces -q and -s by its own layout, counters are still one array
+ */
+static ec_t iat_check (iat_stage_t *iat, const pipeline_options_t *options) {
+    /* params */
+    iat_config_t   *config = &iat->config;
+
+    if ((config->quantize_time_order == 0) && (iat->log_digits == 0)) {
+        return EC_CLI_NO_QUANTIZE_TIME_OPTION;
+    }
+    if (iat->resume && (iat->checkpointer.path == NULL)) {
+        return EC_CLI_NO_CHECKPOINT_OPTION;
+    }
+    /* IAT is a 64-bit tick, shifting it by 64 or more is undefined */
+    if (((config->quantize_time_order < 1) || (config->quantize_time_order > 63)) && (iat->log_digits == 0)) {
+        return EC_CLI_INVALID_QUANTIZE_TIME;
+    }
+    if ((iat->log_digits != 0) && ((iat->log_digits < LOG_HISTOGRAM_MIN_DIGITS) || (iat->log_digits > LOG_HISTOGRAM_MAX_DIGITS))) {
+        return EC_CLI_INVALID_LOG_DIGITS;
+    }
+    if (iat->checkpointer.period <= 0) {
+        return EC_CLI_INVALID_CHECKPOINT_PERIOD;
+    }
+    /* only the finest interval is used, coarser ones are rolled up by packet count */
+    if ((options->time_intervals[0] < 1e-6) || (options->time_intervals[0] > 1e9)) {
+        return EC_CLI_INVALID_TIME_INTERVAL;
+    }
+    config->log_digits = (uint32_t) iat->log_digits;
+    config->ticks_per_sec = pipeline_ticks_per_sec(config->nsec);
+    interval_bin_init(&config->bin, options->time_intervals[0]);
+    config->interval_ticks = config->nsec ? config->bin.interval_nsec : config->bin.interval_nsec / 1000;
+    if (iat->log_digits != 0) {
+        log_histogram_init(&config->log_histogram, config->log_digits, LOG_HISTOGRAM_DEFAULT_HIGHEST);
+        config->iat_count_size = (uint64_t) config->log_histogram.length;
+    }
+    iat->parallel = (options->threads > 1);
+    return EC_SUCCESS;
+}
+
+static ec_t iat_register (iat_stage_t *iat, pipeline_t *pipeline) {
+    /* params */
+    pipeline_stage_t    stage;      /* stage registered to pipeline */
+
+    memset(&stage, 0, sizeof(pipeline_stage_t));
+    stage.name = "iat";
+    stage.caps = PIPELINE_CAN_THREADS | PIPELINE_CAN_CHECKPOINT;
+    stage.arg = iat;
+    stage.init = iat_init;
+    stage.open = iat_open;
+    stage.packet = iat_packet;
+    stage.interval = iat_interval;
+    stage.finish = iat_finish;
+    return pipeline_add_stage(pipeline, &stage);
+}
+
+/* @brief Allocate IAT stage
+ * @details histogram is zeroed as every count starts from 0.
+ *          A checkpoint only matches a run over the same ordered files with the same histogram,
+ *          reader and threads may differ as long as serial and multi-threaded mode are not mixed
+ */
+static ec_t iat_start (iat_stage_t *iat, const input_list_t *inputs, bool verbose) {
+    /* params */
+    const iat_config_t *config = &iat->config;
+    iat_checkpointer_t *checkpointer = &iat->checkpointer;
+    size_t              input_index;    /* input file iterator */
+    struct timespec     now;            /* current monotonic time */
+    uint32_t            layout = CHECKPOINT_LAYOUT; /* layout of checkpoint state */
+
+    if (verbose && (config->log_digits != 0)) {
+        fprintf(stderr, "Log-linear histogram: %zu counters up to %lu %s, %zu KB\n", config->log_histogram.length,
+                config->log_histogram.highest, config->nsec ? "nsec" : "usec", config->log_histogram.length * sizeof(uint64_t) / 1024);
+    }
+    iat->count = (uint64_t *) calloc(config->iat_count_size, sizeof(uint64_t));
+    if (iat->count == NULL) {
+        perror("calloc");
+        return EC_GEN_UNABLE_TO_MALLOC;
+    }
+    if (checkpointer->path == NULL) {
+        return EC_SUCCESS;
+    }
+    checkpointer->fingerprint = checkpoint_hash(CHECKPOINT_HASH_INIT, &layout, sizeof(layout));
+    checkpointer->fingerprint = checkpoint_hash(checkpointer->fingerprint, &config->quantize_time_order, sizeof(config->quantize_time_order));
+    checkpointer->fingerprint = checkpoint_hash(checkpointer->fingerprint, &config->iat_count_size, sizeof(config->iat_count_size));
+    checkpointer->fingerprint = checkpoint_hash(checkpointer->fingerprint, &config->log_digits, sizeof(config->log_digits));
+    checkpointer->fingerprint = checkpoint_hash(checkpointer->fingerprint, &config->nsec, sizeof(config->nsec));
+    for (input_index=0; input_index<inputs->count; input_index++) {
+        checkpointer->fingerprint = checkpoint_hash(checkpointer->fingerprint, inputs->paths[input_index], strlen(inputs->paths[input_index]) + 1);
+    }
+    checkpointer->size = sizeof(iat_checkpoint_t) + config->iat_count_size * sizeof(uint64_t);
+    checkpointer->buffer = (uint8_t *) malloc(checkpointer->size);
+    if (checkpointer->buffer == NULL) {
+        perror("malloc");
+        return EC_GEN_UNABLE_TO_MALLOC;
+    }
+    if (clock_gettime(CLOCK_MONOTONIC, &now) == -1) {
+        perror("clock_gettime");
+        return EC_GEN_CLOCK_GETTIME_ERROR;
+    }
+    checkpointer->next = (double) now.tv_sec + (double) now.tv_nsec / 1e9 + checkpointer->period;
+    return EC_SUCCESS;
+}
+
+/* @brief Open histogram series of IAT counters
+ * @details header describes quantization of IAT stage, intervals are the progress display interval
+ */
+static ec_t iat_series_start (const iat_stage_t *iat, series_stage_t *series) {
+    /* params */
+    const iat_config_t     *config = &iat->config;
+    histogram_series_info_t info;       /* header of histogram series */
+
+    memset(&info, 0, sizeof(histogram_series_info_t));
+    info.counter_count = (uint32_t) config->iat_count_size;
+    info.quantize_order = (uint32_t) config->quantize_time_order;
+    info.log_digits = config->log_digits;
+    info.ticks_per_sec = config->ticks_per_sec;
+    info.interval = config->interval_ticks;
+    return series_start(series, &info, iat->count, &iat->negative, &iat->exceed);
+}
+
+/* @brief Origin of IAT stage
+ * @details called again with the saved origin on resume, counters are left as restored
+ */
+static ec_t iat_init (uint64_t origin, void *arg) {
+    /* params */
+    iat_stage_t *iat = (iat_stage_t *) arg;
+
+    iat->started = true;
+    iat->origin = origin;
+    iat->initial = pipeline_ticks(origin, iat->config.nsec);
+    return EC_SUCCESS;
+}
+
+static ec_t iat_open (pipeline_source_t *source, void *arg) {
+    /* params */
+    iat_stage_t *iat = (iat_stage_t *) arg;
+
+    if (iat->cursor.packets == 0) {
+        return EC_SUCCESS;
+    }
+    fprintf(stderr, "Resuming %s after packet %lu\n", source->path, iat->cursor.packets);
+    return resume_trace(&iat->cursor, source, iat->config.nsec);
+}
+
+/* @brief Display the processing progress
+ * @details the first packet adds exceed by 1, which is removed at the end, so 1 is subtracted here
+ */
+static void iat_interval (uint64_t index, uint64_t next, void *arg) {
+    /* params */
+    iat_stage_t *iat = (iat_stage_t *) arg;
+
+    (void) index;
+    iat->interval_index = next;
+    fprintf(stderr, "\33[2K\rProcessed %lu seconds of packets", next * iat->config.bin.interval_nsec / NSEC_PER_SEC);
+    fprintf(stderr, "\t| negative IAT: %lu\t| exceed max IAT: %lu", iat->negative, iat->exceed - 1);
+    return;
+}
+
+/* @brief IAT of one packet
+ * @details use previously stored time to calculate the IAT, and store the current time.
+ *          The first packet is counted as exceeded IAT from timestamp 0, instead of adding logic to skip it
+ *          which would be processed in every packet, and removed by iat_finish.
+ *          Timestamps are integer ticks, so IAT is one subtraction without carry between seconds and fraction
+ */
+static void iat_packet (const pipeline_packet_t *packet, void *arg) {
+    /* params */
+    iat_stage_t    *iat = (iat_stage_t *) arg;
+    uint64_t        ts = pipeline_ticks(packet->ts, iat->config.nsec);  /* packet timestamp (tick) */
+
+    quantize_iat(pipeline_iat(iat->current, ts), &iat->config, iat->count, &iat->negative, &iat->exceed);
+    iat->current = ts;
+    if (iat->checkpointer.path != NULL) {
+        advance_cursor(iat, ts, packet->offset);
+    }
+    return;
+}
+
+/* @brief Finish IAT stage
+ * @details final checkpoint is past the last file and resuming it only prints the result again,
+ *          unless the run is stopped by signal, then it is where reading stopped.
+ *          Multi-threaded mode saves its own at the last chunk boundary and never counts the first packet
+ */
+static ec_t iat_finish (uint64_t index, void *arg) {
+    /* params */
+    iat_stage_t    *iat = (iat_stage_t *) arg;
+    ec_t            ec = iat->checkpointer.ec;  /* error code */
+
+    (void) index;
+    if ((ec == EC_SUCCESS) && (iat->checkpointer.path != NULL) && !iat->parallel) {
+        ec = save_checkpoint(iat, &iat->cursor, NULL);
+    }
+    if (iat->started) {
+        iat->exceed--;  /* remove error count caused by first packet */
+    }
+    return ec;
+}
+
+/* @brief Print histogram
+ * @details log-linear mode only prints non-empty counters, most of thousands of counters are empty
+ */
+static void print_histogram (const iat_stage_t *iat) {
+    /* params */
+    const iat_config_t *config = &iat->config;
+    const char         *unit = config->nsec ? "nsec" : "usec";  /* unit of printed IAT */
+    size_t              index;      /* histogram iterator */
+
+    if (config->log_digits == 0) {
+        for (index=0; index<config->iat_count_size; index++) {
+            printf("Quantized IAT[%02d]: %ld\n", (int) index, iat->count[index]);
+        }
+        return;
+    }
+    for (index=0; index<config->log_histogram.length; index++) {
+        if (iat->count[index] != 0) {
+            printf("Log-linear IAT[%05zu] %lu-%lu %s: %lu\n", index, log_histogram_lowest(&config->log_histogram, index),
+                   log_histogram_highest(&config->log_histogram, index), unit, iat->count[index]);
+        }
+    }
+    printf("IAT p50: %lu %s\n", log_histogram_percentile(&config->log_histogram, iat->count, 50), unit);
+    printf("IAT p90: %lu %s\n", log_histogram_percentile(&config->log_histogram, iat->count, 90), unit);
+    printf("IAT p99: %lu %s\n", log_histogram_percentile(&config->log_histogram, iat->count, 99), unit);
+    printf("IAT p99.9: %lu %s\n", log_histogram_percentile(&config->log_histogram, iat->count, 99.9), unit);
+    printf("IAT p99.99: %lu %s\n", log_histogram_percentile(&config->log_histogram, iat->count, 99.99), unit);
+    printf("IAT max: %lu %s\n", log_histogram_percentile(&config->log_histogram, iat->count, 100), unit);
+    printf("IAT negative: %lu, exceed max: %lu\n", iat->negative, iat->exceed);
+    return;
+}
+
+/* @brief Plot histogram
+ * @details
+ * https://gnuplot.sourceforge.net/demo/histograms.html
+ * http://www.gnuplot.info/docs/loc5395.html
+ */
+static ec_t plot_histogram (const iat_stage_t *iat) {
+    /* params */
+    const iat_config_t *config = &iat->config;
+    ec_t                ec = EC_SUCCESS;    /* error code */
+    FILE               *gnuplot = NULL;     /* gnuplot pipe */
+    char                filename_buf[1024]; /* filename buffer */
+    FILE               *data_file = NULL;   /* data file */
+    size_t              index;              /* histogram iterator */
+
+    /* write count to dat file */
+    snprintf(filename_buf, sizeof(filename_buf), "%s.dat", iat->histogram_path);
+    data_file = fopen(filename_buf, "w");
+    if ((data_file == NULL) || ferror(data_file)) {
+        perror("fopen");
+        ec = EC_GEN_UNABLE_TO_OPEN_DATA_FILE;
+    }
+    if ((ec == EC_SUCCESS) && (config->log_digits == 0)) {
+        for (index=0; index<config->iat_count_size; index++) {
+            fprintf(data_file, "%ld\n", iat->count[index]);
+        }
+    } else if (ec == EC_SUCCESS) {
+        /* lowest IAT and count of non-empty counters, plotted on log-scaled x-axis */
+        for (index=0; index<config->log_histogram.length; index++) {
+            if (iat->count[index] != 0) {
+                fprintf(data_file, "%lu %lu\n", log_histogram_lowest(&config->log_histogram, index), iat->count[index]);
+            }
+        }
+    }
+    if (ec == EC_SUCCESS) {
+        if ((errno != EC_SUCCESS) && errno != EIO) {
+            perror("fprintf");
+            ec = EC_GEN_UNABLE_TO_WRITE_DATA_FILE;
+        }
+        if (errno == EIO) {
+            perror("fprintf");
+            fprintf(stderr, "It is expected to have frequent EIO error in WSL2\n");
+        }
+    }
+    if (ec == EC_SUCCESS) {
+        fprintf(stderr, "Histogram data written to %s\n", filename_buf);
+    }
+
+    /* write histogram file */
+    if (ec == EC_SUCCESS) {
+        gnuplot = popen("gnuplot -persist", "w");
+        if (gnuplot == NULL) {
+            perror("popen");
+            ec = EC_GEN_UNABLE_TO_USE_GNUPLOT;
+        }
+        fprintf(gnuplot, "set terminal pngcairo font \"%s,%d\" size %d,%d\n", "Arial", 20, 1920, 1080);
+        fprintf(gnuplot, "set output \"%s.png\"\n", iat->histogram_path);
+        fprintf(gnuplot, "set title \"Histogram of Quantized IAT\"\n");
+        if (config->log_digits == 0) {
+            fprintf(gnuplot, "set xlabel \"Quantized IAT\"\n");
+        } else {
+            fprintf(gnuplot, "set xlabel \"IAT (%s, log-scaled)\"\n", config->nsec ? "nsec" : "usec");
+        }
+        if (iat->log_scale) {
+            fprintf(gnuplot, "set ylabel \"Count (log-scaled)\"\n");
+        } else {
+            fprintf(gnuplot, "set ylabel \"Count\"\n");
+        }
+        fprintf(gnuplot, "set key fixed right top vertical Right noreverse noenhanced autotitle nobox\n");
+        if (iat->log_scale) {
+            fprintf(gnuplot, "set logscale y\n");
+        }
+        if (config->log_digits == 0) {
+            fprintf(gnuplot, "set boxwidth 0.9 absolute\n");
+            fprintf(gnuplot, "set style fill solid 1.00 border lt -1\n");
+            fprintf(gnuplot, "set style histogram clustered gap 1 title textcolor lt -1\n");
+            fprintf(gnuplot, "set datafile missing '-'\n");
+            fprintf(gnuplot, "set style data histograms\n");
+            fprintf(gnuplot, "set xrange [-1:%d] noreverse writeback\n", (int) config->iat_count_size + 1);
+            fprintf(gnuplot, "plot newhistogram, '%s' using 1\n", filename_buf);
+        } else {
+            /* counters are of different width, one impulse at the lowest IAT of each */
+            fprintf(gnuplot, "set logscale x\n");
+            fprintf(gnuplot, "plot '%s' using ($1 + 1):2 with impulses lw 2\n", filename_buf);
+        }
+        if (ferror(gnuplot) || ((errno != 0) && (errno != EIO))) { // often errno is 5
+            perror("fprintf");
+            ec = EC_GEN_GNUPLOT_ERROR;
+        }
+        if (errno == EIO) {
+            perror("fprintf");
+            fprintf(stderr, "It is expected to have frequent EIO error in WSL2\n");
+        }
+    }
+    if (ec == EC_SUCCESS) {
+        fprintf(stderr, "Histogram file written to %s.png\n", iat->histogram_path);
+    }
+    if (data_file != NULL) {
+        fclose(data_file);
+    }
+    if (gnuplot != NULL) {
+        pclose(gnuplot);
+    }
+    return ec;
+}
+
+/* @brief Move opened trace to the position of cursor
+ * @details mmap reader jumps to the saved offset, libtrace seeks to the last timestamp if the format supports it,
+ *          otherwise the packets before the position are read and dropped
+ */
+static ec_t resume_trace (const trace_cursor_t *cursor, pipeline_source_t *source, bool nsec) {
+    /* params */
+    uint64_t            skip = cursor->packets; /* packets to read and drop */
+    pcap_mmap_t        *pcap = &source->pcap;   /* mmap reader */
+    pcap_packet_view_t  view;                   /* packet view of mmap reader */
+
+    if (source->use_mmap) {
+        /* offset is only known if the checkpoint was taken by mmap reader */
+        if (cursor->offset != 0) {
+            if ((cursor->offset < PCAP_FILE_HEADER_SIZE) || (cursor->offset > pcap->size)) {
+                fprintf(stderr, "Checkpoint offset %lu is out of trace file\n", cursor->offset);
+                return EC_GEN_INVALID_CHECKPOINT;
+            }
+            pcap->offset = (size_t) cursor->offset;
+            return EC_SUCCESS;
+        }
+        while ((skip > 0) && (pcap_mmap_next(pcap, &view) > 0)) {
+            skip--;
+        }
+    } else {
+        /* seek lands on the first packet not earlier than last, which is the first of the packets sharing its timestamp
+         * as long as timestamps never decreased before it, so only those are left to drop
+         */
+        if (cursor->ordered && (trace_seek_erf_timestamp(source->trace, ticks_to_erf(cursor->last, nsec)) == 0)) {
+            skip = cursor->same;
+        }
+        while ((skip > 0) && (trace_read_packet(source->trace, source->packet) > 0)) {
+            skip--;
+        }
+    }
+    if (skip != 0) {
+        fprintf(stderr, "Trace file ended %lu packets before checkpoint position\n", skip);
+        return EC_GEN_INVALID_CHECKPOINT;
+    }
+    return EC_SUCCESS;
+}
+
+/* @brief Convert tick to ERF timestamp
+ * @details the earliest fraction rounded to nanosecond n is ceil((n - 0.5) * 2^32 / 10^9),
+ *          3 * 10^9 is added to keep the dividend positive for n = 0, as 2^31 is larger than 2 * 10^9,
+ *          and the quotient is reduced by 3 again
+ */
+static uint64_t ticks_to_erf (uint64_t ticks, bool nsec) {
+    /* params */
+    uint64_t ns = nsec ? ticks : ticks * 1000;  /* timestamp (nsec) */
+    uint64_t fraction = ns % NSEC_PER_SEC;      /* nanosecond within second */
+    uint64_t dividend;                          /* (2 * fraction - 1) * 2^31 + 3 * 10^9 */
+
+    dividend = (2 * fraction) * 0x80000000 + 3 * (uint64_t) NSEC_PER_SEC - 0x80000000;
+    return ((ns / NSEC_PER_SEC) << 32) + (dividend + NSEC_PER_SEC - 1) / NSEC_PER_SEC - 3;
+}
+
+/* @brief Advance cursor over one packet
+ * @details clock is only checked every CHECKPOINT_CHECK_PACKETS packets.
+ *          Packet callbacks cannot fail, so a checkpoint error is kept and returned by iat_finish,
+ *          the rest of trace is still counted as no checkpoint is taken after it
+ */
+static inline void advance_cursor (iat_stage_t *iat, uint64_t ts, uint64_t offset) {
+    /* params */
+    trace_cursor_t *cursor = &iat->cursor;
+
+    if ((cursor->packets != 0) && (ts == cursor->last)) {
+        cursor->same++;
+    } else {
+        if ((cursor->packets != 0) && (ts < cursor->last)) {
+            cursor->ordered = false;
+        }
+        cursor->same = 1;
+    }
+    cursor->packets++;
+    cursor->offset = offset;
+    cursor->last = ts;
+    if (((cursor->packets & (CHECKPOINT_CHECK_PACKETS - 1)) != 0) || (iat->checkpointer.ec != EC_SUCCESS)) {
+        return;
+    }
+    iat->checkpointer.ec = checkpoint_if_due(iat, cursor, NULL);
+    if (iat->checkpointer.ec != EC_SUCCESS) {
+        fprintf(stderr, "\nCheckpoint %s failed, no further checkpoint is taken\n", iat->checkpointer.path);
+    }
+    return;
+}
+
+/* @brief Take checkpoint if due
+ */
+static ec_t checkpoint_if_due (iat_stage_t *iat, const trace_cursor_t *cursor, const iat_pool_t *pool) {
+    /* params */
+    struct timespec now;        /* current monotonic time */
+    double          now_sec;    /* current monotonic time (sec) */
+
+    if (clock_gettime(CLOCK_MONOTONIC, &now) == -1) {
+        perror("clock_gettime");
+        return EC_GEN_CLOCK_GETTIME_ERROR;
+    }
+    now_sec = (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+    if (now_sec < iat->checkpointer.next) {
+        return EC_SUCCESS;
+    }
+    iat->checkpointer.next = now_sec + iat->checkpointer.period;
+    return save_checkpoint(iat, cursor, pool);
+}
+
+/* @brief Save checkpoint
+ * @details state is copied from IAT stage, which is only written by its packet callback and chunk_merger on the calling thread
+ */
+static ec_t save_checkpoint (const iat_stage_t *iat, const trace_cursor_t *cursor, const iat_pool_t *pool) {
+    /* params */
+    const iat_checkpointer_t   *checkpointer = &iat->checkpointer;
+    iat_checkpoint_t           *state = (iat_checkpoint_t *) checkpointer->buffer; /* state in front of histogram */
+
+    /* padding is zeroed so the same state always has the same checksum */
+    memset(state, 0, sizeof(iat_checkpoint_t));
+    state->fingerprint = checkpointer->fingerprint;
+    state->parallel = (pool != NULL);
+    state->cursor = *cursor;
+    if (pool != NULL) {
+        state->started = pool->started;
+        state->last = pool->last;
+    } else {
+        state->started = iat->started;
+    }
+    state->origin = iat->origin;
+    state->interval_index = iat->interval_index;
+    state->current_time = iat->current;
+    state->negative = iat->negative;
+    state->exceed = iat->exceed;
+    memcpy(checkpointer->buffer + sizeof(iat_checkpoint_t), iat->count, checkpointer->size - sizeof(iat_checkpoint_t));
+    return checkpoint_write(checkpointer->path, checkpointer->buffer, checkpointer->size);
+}
+
+/* @brief Load checkpoint
+ * @details serial mode passes origin and interval to the pipeline, which calls init of every stage again
+ */
+static ec_t load_checkpoint (iat_stage_t *iat, bool parallel, bool *started, uint64_t *last) {
+    /* params */
+    ec_t                ec;                                                 /* error code */
+    iat_checkpointer_t *checkpointer = &iat->checkpointer;
+    iat_checkpoint_t   *state = (iat_checkpoint_t *) checkpointer->buffer;  /* state in front of histogram */
+
+    ec = checkpoint_read(checkpointer->path, checkpointer->buffer, checkpointer->size);
+    if (ec != EC_SUCCESS) {
+        return ec;
+    }
+    if (state->fingerprint != checkpointer->fingerprint) {
+        fprintf(stderr, "Checkpoint %s was taken over other input files, quantization options or checkpoint layout\n", checkpointer->path);
+        return EC_GEN_INVALID_CHECKPOINT;
+    }
+    /* multi-threaded mode does not count the first packet as exceeded IAT, and only resumes at chunk boundaries */
+    if (state->parallel != parallel) {
+        fprintf(stderr, "Checkpoint %s was taken %s, resume %s\n", checkpointer->path,
+                state->parallel ? "with several threads" : "single-threaded", state->parallel ? "with \"-n\" > 1" : "without \"-n\"");
+        return EC_GEN_INVALID_CHECKPOINT;
+    }
+    iat->cursor = state->cursor;
+    *started = state->started;
+    *last = state->last;
+    iat->origin = state->origin;
+    iat->interval_index = state->interval_index;
+    iat->current = state->current_time;
+    iat->negative = state->negative;
+    iat->exceed = state->exceed;
+    memcpy(iat->count, checkpointer->buffer + sizeof(iat_checkpoint_t), checkpointer->size - sizeof(iat_checkpoint_t));
+    fprintf(stderr, "Resuming from checkpoint %s after %lu complete file(s)\n", checkpointer->path, iat->cursor.file_index);
+    if (parallel && (iat->cursor.offset != 0)) {
+        fprintf(stderr, "Resuming chunks of next file from offset %lu\n", iat->cursor.offset);
+    }
+    return EC_SUCCESS;
+}
+
+/* @brief Quantize one IAT
+ * @details also count the negative and max value exceed IAT,
+ *          quantized IAT equal to iat_count_size is out of histogram as well
+ */
+static inline void quantize_iat (long int iat, const iat_config_t *config, uint64_t *count, uint64_t *negative, uint64_t *exceed) {
+    /* params */
+    uint64_t quantized_iat;     /* quantized IAT */
+
+    if (iat < 0) {
+        (*negative)++;
         return;
     }
-    quantized_iat = iat_usec >> quantize_time_order;
-    if ((uint64_t) quantized_iat > iat_count_size) {
-        exceed_max_iat_count++;
+    if (config->log_digits == 0) {
+        quantized_iat = (uint64_t) iat >> config->quantize_time_order;
+    } else {
+        quantized_iat = (uint64_t) log_histogram_index(&config->log_histogram, (uint64_t) iat);
+    }
+    if (quantized_iat >= config->iat_count_size) {
+        (*exceed)++;
         return;
     }
-    quantized_iat_count[quantized_iat]++;
-    //printf("IAT: 0.%.06lu -> %lu\n", iat_usec, quantized_iat); // debug
-    
+    count[quantized_iat]++;
     return;
 }
+
+/* @brief Stage callback of chunk worker, same IAT as iat_packet except the first packet of chunk,
+ *        whose IAT is taken by merger from the last packet of previous chunk
+ */
+static void chunk_packet (const pipeline_packet_t *packet, void *arg) {
+    /* params */
+    iat_chunk_t *chunk = (iat_chunk_t *) arg;
+    uint64_t     ts = pipeline_ticks(packet->ts, chunk->config->nsec);  /* packet timestamp (tick) */
+    long int     iat;                                                   /* IAT of packet (tick) */
+
+    if (chunk->packets == 0) {
+        chunk->first = ts;
+        chunk->first_length = packet->wire_length;
+        if (chunk->joint) {
+            joint_histogram_size(&chunk->joint_histogram, packet->wire_length);
+        }
+    } else {
+        iat = pipeline_iat(chunk->last, ts);
+        quantize_iat(iat, chunk->config, chunk->count, &chunk->negative, &chunk->exceed);
+        if (chunk->joint) {
+            joint_histogram_packet(&chunk->joint_histogram, packet->wire_length, iat);
+        }
+    }
+    if (chunk->compression != 0) {
+        chunk_quantiles(chunk, packet, ts);
+    }
+    chunk->last = ts;
+    chunk->packets++;
+    return;
+}
+
+/* @brief Read chunk
+ * @details both ends are found by the same scan, so the end of a chunk is the start of the next one,
+ *          a record crossing the end belongs to this chunk and stop is past it
+ */
+static ec_t read_chunk (const char *input_file, iat_chunk_t *chunk) {
+    /* params */
+    ec_t                ec;                 /* error code */
+    pcap_mmap_t         pcap;               /* mmap reader */
+    pcap_packet_view_t  view;               /* packet view of mmap reader */
+    pipeline_packet_t   packet;             /* packet passed to chunk_packet */
+    size_t              end;                /* record boundary at end of chunk */
+    int                 rc = 0;             /* return code of mmap reader */
+    stats_thread_t     *stats = stats_thread(); /* stats slot of calling thread */
+
+    ec = pcap_mmap_open(input_file, &pcap);
+    if (ec != EC_SUCCESS) {
+        return ec;
+    }
+    chunk->start = chunk->exact ? chunk->begin : pcap_mmap_sync(&pcap, chunk->begin);
+    end = chunk->file_end ? pcap.size : pcap_mmap_sync(&pcap, chunk->end);
+    pcap.offset = chunk->start;
+    memset(&packet, 0, sizeof(pipeline_packet_t));
+    packet.linktype = TRACE_TYPE_ETH;
+    stats_read_begin(stats);
+    while ((pcap.offset < end) && (signal_stop_requested() == 0) && ((rc = pcap_mmap_next(&pcap, &view)) > 0)) {
+        stats_read_end(stats);
+        packet.ts = timespec_to_nsec(view.ts);
+        packet.wire_length = view.wire_length;
+        chunk_packet(&packet, chunk);
+        stats_packet_end(stats, view.wire_length);
+    }
+    /* a chunk split at a false boundary walks garbage, its error is only real if merger accepts its start */
+    chunk->truncated = (rc < 0);
+    chunk->stop = pcap.offset;
+    pcap_mmap_close(&pcap);
+    return ec;
+}
+
+/* @brief Worker of input pool
+ * @details a whole file is read by a pipeline of its own, with the chunk as its only stage
+ */
+static ec_t chunk_worker (size_t index, void *arg) {
+    /* params */
+    iat_pool_t         *pool = (iat_pool_t *) arg;
+    iat_chunk_t        *chunk = &pool->chunks[index];
+    const char         *path = pool->inputs->paths[chunk->file_index];  /* trace file of chunk */
+    const iat_config_t *config = &pool->iat->config;
+    ec_t                ec;         /* error code */
+    pipeline_t          pipeline;   /* pipeline of whole file */
+    pipeline_stage_t    stage;      /* chunk stage */
+
+    chunk->config = config;
+    chunk->compression = (pool->quantiles != NULL) ? (uint32_t) pool->quantiles->compression : 0;
+    chunk->joint = (pool->joint != NULL);
+    chunk->count = (uint64_t *) calloc(config->iat_count_size, sizeof(uint64_t));
+    if (chunk->count == NULL) {
+        perror("calloc");
+        return EC_GEN_UNABLE_TO_MALLOC;
+    }
+    if (chunk->joint) {
+        ec = joint_histogram_init(&chunk->joint_histogram);
+        if (ec != EC_SUCCESS) {
+            return ec;
+        }
+    }
+    if (chunk->ranged) {
+        ec = read_chunk(path, chunk);
+    } else {
+        pipeline_init(&pipeline, pool->reader, &config->bin, false);
+        memset(&stage, 0, sizeof(pipeline_stage_t));
+        stage.name = "chunk";
+        stage.arg = chunk;
+        stage.packet = chunk_packet;
+        ec = pipeline_add_stage(&pipeline, &stage);
+        if (ec == EC_SUCCESS) {
+            ec = pipeline_run(&pipeline, path);
+        }
+    }
+    /* a stop request after the last packet also marks chunk incomplete, which only costs re-reading it on resume */
+    chunk->complete = (signal_stop_requested() == 0);
+    if (ec == EC_SUCCESS) {
+        ec = chunk->ec;
+    }
+    return ec;
+}
+
+/* @brief Merger of input pool
+ * @details histogram is additive, only the IAT across chunk boundary is missing from workers.
+ *          A chunk not starting where the previous one stopped was split at a false boundary,
+ *          the rest of its file is then read again here from the last true boundary.
+ */
+static ec_t chunk_merger (size_t index, void *arg) {
+    /* params */
+    iat_pool_t  *pool = (iat_pool_t *) arg;
+    iat_stage_t *iat = pool->iat;
+    iat_chunk_t *chunk = &pool->chunks[index];
+    iat_chunk_t  rest;          /* rest of file read again from last true boundary */
+    uint64_t     i;             /* iterator */
+    ec_t         ec = EC_SUCCESS;   /* error code */
+
+    if (chunk->file_index == pool->skip_file) {
+        free(chunk->count);
+        chunk->count = NULL;
+        free_chunk_quantiles(chunk);
+        joint_histogram_free(&chunk->joint_histogram);
+        return EC_SUCCESS;
+    }
+    if (chunk->ranged && !chunk->exact && !pool->stopped && (chunk->start != pool->cursor.offset)) {
+        fprintf(stderr, "\nChunk boundary at offset %zu of %s does not follow offset %lu, reading rest of file serially\n",
+                chunk->start, pool->inputs->paths[chunk->file_index], pool->cursor.offset);
+        memset(&rest, 0, sizeof(iat_chunk_t));
+        rest.file_index = chunk->file_index;
+        rest.ranged = true;
+        rest.exact = true;
+        rest.file_end = true;
+        rest.begin = (size_t) pool->cursor.offset;
+        rest.config = chunk->config;
+        rest.joint = chunk->joint;
+        rest.compression = chunk->compression;
+        rest.count = (uint64_t *) calloc(iat->config.iat_count_size, sizeof(uint64_t));
+        if (rest.count == NULL) {
+            perror("calloc");
+            return EC_GEN_UNABLE_TO_MALLOC;
+        }
+        if (rest.joint) {
+            ec = joint_histogram_init(&rest.joint_histogram);
+        }
+        if (ec == EC_SUCCESS) {
+            ec = read_chunk(pool->inputs->paths[rest.file_index], &rest);
+        }
+        rest.complete = (signal_stop_requested() == 0);
+        if (ec == EC_SUCCESS) {
+            ec = rest.ec;
+        }
+        free(chunk->count);
+        free_chunk_quantiles(chunk);
+        joint_histogram_free(&chunk->joint_histogram);
+        *chunk = rest;
+        pool->skip_file = rest.file_index;
+        if (ec != EC_SUCCESS) {
+            return ec;
+        }
+    }
+    if (chunk->truncated) {
+        fprintf(stderr, "\nTruncated record at offset %zu of %s\n", chunk->stop, pool->inputs->paths[chunk->file_index]);
+        return EC_GEN_TRACE_READ_PACKET_ERROR;
+    }
+
+    /* merged state is at a chunk boundary until a chunk cut by stop request is merged,
+     * so the boundary before the first such chunk is the last one to save
+     */
+    if (!chunk->complete && !pool->stopped) {
+        pool->stopped = true;
+        if (iat->checkpointer.path != NULL) {
+            ec = save_checkpoint(iat, &pool->cursor, pool);
+        }
+    }
+    if (pool->quantiles != NULL) {
+        merge_quantiles(pool, chunk);
+    }
+    if (chunk->packets != 0) {
+        if (pool->started) {
+            quantize_iat(pipeline_iat(pool->last, chunk->first), &iat->config, iat->count, &iat->negative, &iat->exceed);
+            if (pool->joint != NULL) {
+                joint_histogram_pair(&pool->joint->histogram, chunk->first_length, pipeline_iat(pool->last, chunk->first));
+            }
+        }
+        pool->started = true;
+        pool->last = chunk->last;
+    }
+    for (i=0; i<iat->config.iat_count_size; i++) {
+        iat->count[i] += chunk->count[i];
+    }
+    iat->negative += chunk->negative;
+    iat->exceed += chunk->exceed;
+    free(chunk->count);
+    chunk->count = NULL;
+    if (pool->joint != NULL) {
+        joint_histogram_merge(&pool->joint->histogram, &chunk->joint_histogram);
+        joint_histogram_free(&chunk->joint_histogram);
+    }
+    if (chunk->file_end || !chunk->ranged) {
+        pool->cursor.file_index = chunk->file_index + 1;
+        pool->cursor.offset = 0;
+    } else {
+        pool->cursor.file_index = chunk->file_index;
+        pool->cursor.offset = chunk->stop;
+    }
+    fprintf(stderr, "\33[2K\rMerged %zu/%zu chunks", index + 1, pool->chunk_count);
+    fprintf(stderr, "\t| negative IAT: %lu\t| exceed max IAT: %lu", iat->negative, iat->exceed);
+    if ((ec == EC_SUCCESS) && (iat->checkpointer.path != NULL) && !pool->stopped) {
+        ec = checkpoint_if_due(iat, &pool->cursor, pool);
+    }
+    return ec;
+}
+
+/* @brief Plan chunks
+ * @details files are opened once to get their size, chunks are sized so every thread gets several of them
+ *          and a file smaller than one chunk stays whole
+ */
+static ec_t plan_chunks (iat_pool_t *pool, int threads) {
+    /* params */
+    const input_list_t *inputs = pool->inputs;
+    size_t     *sizes;              /* mmap size of each file from cursor, 0 if read by libtrace */
+    size_t      total = 0;          /* bytes of files read by mmap */
+    size_t      chunk_size;         /* bytes of one chunk */
+    size_t      base;               /* offset of first chunk of file */
+    size_t      pieces;             /* chunks of file */
+    size_t      file_count;         /* files from cursor */
+    size_t      i, k;               /* iterator */
+    pcap_mmap_t pcap;               /* mmap reader */
+    iat_chunk_t *chunk;             /* chunk being planned */
+
+    file_count = inputs->count - (size_t) pool->cursor.file_index;
+    sizes = (size_t *) calloc(file_count, sizeof(size_t));
+    if (sizes == NULL) {
+        perror("calloc");
+        return EC_GEN_UNABLE_TO_MALLOC;
+    }
+    for (i=0; i<file_count; i++) {
+        /* files the mmap reader fails on are left to pipeline_run, which reports the error */
+        if ((pool->reader != READER_LIBTRACE) && (pcap_mmap_open(inputs->paths[pool->cursor.file_index + i], &pcap) == EC_SUCCESS)) {
+            sizes[i] = pcap.size;
+            total += pcap.size;
+            pcap_mmap_close(&pcap);
+        }
+    }
+    if ((pool->cursor.offset != 0) && (sizes[0] == 0)) {
+        fprintf(stderr, "Checkpoint %s stopped within %s, which is not read by mmap reader\n",
+                pool->iat->checkpointer.path, inputs->paths[pool->cursor.file_index]);
+        free(sizes);
+        return EC_GEN_INVALID_CHECKPOINT;
+    }
+    chunk_size = total / ((size_t) threads * CHUNKS_PER_THREAD);
+    if (chunk_size < CHUNK_MIN_SIZE) {
+        chunk_size = CHUNK_MIN_SIZE;
+    }
+
+    /* count chunks, then fill them in trace order */
+    pool->chunk_count = 0;
+    for (i=0; i<file_count; i++) {
+        base = ((i == 0) && (pool->cursor.offset != 0)) ? (size_t) pool->cursor.offset : PCAP_FILE_HEADER_SIZE;
+        pool->chunk_count += (sizes[i] > base) ? (sizes[i] - base + chunk_size - 1) / chunk_size : 1;
+    }
+    pool->chunks = (iat_chunk_t *) calloc(pool->chunk_count, sizeof(iat_chunk_t));
+    if (pool->chunks == NULL) {
+        perror("calloc");
+        free(sizes);
+        return EC_GEN_UNABLE_TO_MALLOC;
+    }
+    chunk = pool->chunks;
+    for (i=0; i<file_count; i++) {
+        base = ((i == 0) && (pool->cursor.offset != 0)) ? (size_t) pool->cursor.offset : PCAP_FILE_HEADER_SIZE;
+        pieces = (sizes[i] > base) ? (sizes[i] - base + chunk_size - 1) / chunk_size : 1;
+        for (k=0; k<pieces; k++) {
+            chunk->file_index = pool->cursor.file_index + i;
+            chunk->ranged = (sizes[i] != 0);
+            chunk->exact = (k == 0);
+            chunk->file_end = (k == pieces - 1);
+            chunk->begin = base + k * chunk_size;
+            chunk->end = chunk->begin + chunk_size;
+            chunk++;
+        }
+    }
+    free(sizes);
+    return EC_SUCCESS;
+}
+
+static ec_t process_files_parallel (const input_list_t *inputs, reader_t reader, iat_stage_t *iat, quantile_stage_t *quantiles, joint_stage_t *joint,
+                                    int threads, bool started, uint64_t last) {
+    /* params */
+    ec_t        ec = EC_SUCCESS;    /* error code */
+    iat_pool_t  pool;               /* multi-threaded state */
+    size_t      i;                  /* iterator */
+    trace_cursor_t end;             /* read position after last file */
+
+    memset(&pool, 0, sizeof(iat_pool_t));
+    pool.inputs = inputs;
+    pool.reader = reader;
+    pool.iat = iat;
+    pool.quantiles = quantiles;
+    pool.joint = joint;
+    pool.cursor = iat->cursor;
+    pool.skip_file = SIZE_MAX;
+    pool.started = started;
+    pool.last = last;
+    /* nothing is left when resumed from final checkpoint */
+    if (iat->cursor.file_index < inputs->count) {
+        ec = plan_chunks(&pool, threads);
+    }
+    if ((ec == EC_SUCCESS) && (pool.chunks != NULL)) {
+        ec = input_pool_run(pool.chunk_count, threads, chunk_worker, chunk_merger, &pool);
+    }
+    /* final checkpoint is past the last file, resuming it only prints the result again */
+    if ((ec == EC_SUCCESS) && (iat->checkpointer.path != NULL) && !pool.stopped) {
+        memset(&end, 0, sizeof(trace_cursor_t));
+        end.file_index = inputs->count;
+        ec = save_checkpoint(iat, &end, &pool);
+    }
+    if (pool.chunks != NULL) {
+        for (i=0; i<pool.chunk_count; i++) {
+            free(pool.chunks[i].count);
+            free_chunk_quantiles(&pool.chunks[i]);
+            joint_histogram_free(&pool.chunks[i].joint_histogram);
+        }
+        free(pool.chunks);
+    }
+    return ec;
+}
+
+/* @brief Add packet of chunk to quantiles
+ * @details interval of a packet is the one serial mode would be in, (origin + k * interval, origin + (k + 1) * interval],
+ *          a packet earlier than the last interval stays in it as serial mode never goes back
+ */
+static void chunk_quantiles (iat_chunk_t *chunk, const pipeline_packet_t *packet, uint64_t ts) {
+    /* params */
+    interval_quantiles_t *current;              /* quantiles of last interval */
+    interval_quantiles_t *grown;                /* reallocated intervals */
+    uint64_t              index;                /* interval of packet */
+    long int              iat;                  /* IAT within chunk (tick) */
+
+    if (chunk->ec != EC_SUCCESS) {
+        return;
+    }
+    index = interval_bin_index(&chunk->config->bin, packet->ts);
+    if ((chunk->interval_count == 0) || (index > chunk->intervals[chunk->interval_count - 1].index)) {
+        if (chunk->interval_count == chunk->interval_capacity) {
+            chunk->interval_capacity = (chunk->interval_capacity == 0) ? 4 : chunk->interval_capacity * 2;
+            grown = (interval_quantiles_t *) realloc(chunk->intervals, chunk->interval_capacity * sizeof(interval_quantiles_t));
+            if (grown == NULL) {
+                perror("realloc");
+                chunk->ec = EC_GEN_UNABLE_TO_MALLOC;
+                return;
+            }
+            chunk->intervals = grown;
+        }
+        chunk->interval_count++;
+        chunk->ec = interval_quantiles_init(&chunk->intervals[chunk->interval_count - 1], index, chunk->compression);
+        if (chunk->ec != EC_SUCCESS) {
+            return;
+        }
+    }
+    current = &chunk->intervals[chunk->interval_count - 1];
+    if (chunk->packets != 0) {
+        iat = pipeline_iat(chunk->last, ts);
+        if (iat >= 0) {
+            quantile_sketch_add(&current->iat, (double) iat);
+        }
+    }
+    quantile_sketch_add(&current->size, (double) packet->wire_length);
+    current->packets++;
+    return;
+}
+
+/* @brief Merge quantiles of chunk
+ * @details an interval of chunk before the current one was already passed by previous chunks, serial mode adds it to current one too.
+ *          The IAT across chunk boundary ends at the first packet, which is in the first interval of chunk.
+ */
+static void merge_quantiles (const iat_pool_t *pool, iat_chunk_t *chunk) {
+    /* params */
+    quantile_stage_t     *quantiles = pool->quantiles;
+    interval_quantiles_t *interval = &quantiles->interval;
+    interval_quantiles_t *entry;    /* quantiles of interval of chunk */
+    long int              iat;      /* IAT across chunk boundary (tick) */
+    size_t                i;        /* iterator */
+
+    for (i=0; i<chunk->interval_count; i++) {
+        entry = &chunk->intervals[i];
+        while (interval->index < entry->index) {
+            quantile_close_interval(quantiles);
+        }
+        quantile_sketch_merge(&interval->iat, &entry->iat);
+        quantile_sketch_merge(&interval->size, &entry->size);
+        interval->packets += entry->packets;
+        if ((i == 0) && pool->started) {
+            iat = pipeline_iat(pool->last, chunk->first);
+            if (iat >= 0) {
+                quantile_sketch_add(&interval->iat, (double) iat);
+            }
+        }
+    }
+    free_chunk_quantiles(chunk);
+    return;
+}
+
+/* @brief Free quantiles of chunk
+ */
+static void free_chunk_quantiles (iat_chunk_t *chunk) {
+    /* params */
+    size_t i;   /* iterator */
+
+    for (i=0; i<chunk->interval_count; i++) {
+        interval_quantiles_free(&chunk->intervals[i]);
+    }
+    free(chunk->intervals);
+    chunk->intervals = NULL;
+    chunk->interval_count = 0;
+    chunk->interval_capacity = 0;
+    return;
+}
+
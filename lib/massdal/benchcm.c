@@ -0,0 +1,390 @@
+/********************************************************************
+Count-Min sketch benchmark
+
+Count-Min sketches on a zipf distributed stream of 32 bit items
+test 0: throughput of the hash families, one item at a time
+        and in batches with each kernel the CPU supports
+test 1: throughput and error of the classic and the blocked layout
+        at sizes from L1 to DRAM
+test 2: error and throughput of classic and conservative batched 
+        updates, and the size conservative update needs for the
+        error of the classic sketch
+test 3: throughput and error of 32, 16 and 8 bit counters in the 
+        same number of bytes as the int counters
+
+*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "prng.h"
+#include "massdal.h"
+
+/******************************************************************/
+
+#include "countmin.h"
+
+/******************************************************************/
+
+int length, width, test;
+float zipfpar;
+int * exact; // true count of each zipf rank
+unsigned int * keys; // item of each zipf rank
+
+const char * families[]={"hash31","multshift","tabulation"};
+const char * isas[]={"scalar","avx2","avx512"};
+
+#define BATCH 64 // items collected before a batched update or query
+
+/******************************************************************/
+
+void CheckArguments(int argc, char **argv) {
+
+  /*****************************************************************/
+  /* Examine the command line arguments: length of stream, width   */
+  /* of sketch and skew of the stream                              */
+  /*****************************************************************/
+
+  int failed=0;
+
+  if (argc>1)
+    length=atoi(argv[1]);
+  else length=4000000;
+
+  if (argc>2)
+    width=atoi(argv[2]);
+  else width=65536;
+
+  if (argc>3)
+    zipfpar=atof(argv[3]);
+  else
+    zipfpar=1.1;
+
+  if (argc>4)
+    test=atoi(argv[4]);
+  else test=0;
+
+  if (length<=0) failed=1;
+  if (width<=0 || width>(1<<30)) failed=1;
+  if (zipfpar<0.0) failed=1;
+  if (test<0 || test>3) failed=1;
+
+  if (failed==1)
+    {
+      printf("%s length width zipfpar test\n",argv[0]);
+      printf("length = number of items to process. Default = 4000000\n");
+      printf("width = width of sketch, a power of two to compare all families on the same width. Default = 65536\n");
+      printf("zipfpar = parameter of zipf dbn. 0.0 = uniform. 3+ = skewed. Default = 1.1\n");
+      printf("test = 0 hash families, 1 blocked layout from 16 KB to 256 MB, 2 conservative update from 16 KB to 64 MB, 3 compact counters from 16 KB to 4 MB. Default = 0\n");
+      exit(1);
+    }
+}
+
+/******************************************************************/
+
+unsigned int * CreateStream(int length)
+{
+  // items are zipf ranks spread over 32 bits by an odd multiplier,
+  // a bijection, so heavy items do not sit next to each other
+  // and the true count of every item is known
+  float zet;
+  int i, rank;
+  unsigned int * stream;
+  prng_type * prng;
+
+  stream=(unsigned int *) calloc(length,sizeof(unsigned int));
+  exact=(int *) calloc(length+1,sizeof(int));
+  keys=(unsigned int *) calloc(length+1,sizeof(unsigned int));
+  CheckMemory(stream); CheckMemory(exact); CheckMemory(keys);
+  prng=prng_Init(44545,2);
+  zet=zeta(length,zipfpar);
+  for (i=0;i<=length;i++)
+    keys[i]=(unsigned int) i*2654435761u;
+  for (i=0;i<length;i++)
+    {
+      rank=min(length,(int) floor(fastzipf(zipfpar,length,zet,prng)));
+      exact[rank]++;
+      stream[i]=keys[rank];
+    }
+  prng_Destroy(prng);
+  return(stream);
+}
+
+double AvgError(void * sketch, int (*est)(void *, unsigned int))
+{
+  // mean over the distinct items of the estimate minus the true count
+  int i, distinct=0;
+  double error=0.0;
+
+  for (i=0;i<=length;i++)
+    if (exact[i]>0)
+      {
+	error+=est(sketch,keys[i])-exact[i];
+	distinct++;
+      }
+  return error/max(distinct,1);
+}
+
+int CMEst(void * cm, unsigned int item) 
+{ return CM_PointEst((CM_type *) cm,item); }
+
+int CMBEst(void * cmb, unsigned int item) 
+{ return CMB_PointEst((CMB_type *) cmb,item); }
+
+int CM8Est(void * cm, unsigned int item) 
+{ return CM8_PointEst((CM8_type *) cm,item); }
+
+int CM16Est(void * cm, unsigned int item) 
+{ return CM16_PointEst((CM16_type *) cm,item); }
+
+int CM32Est(void * cm, unsigned int item) 
+{ return CM32_PointEst((CM32_type *) cm,item); }
+
+/******************************************************************/
+
+void RunSketch(int depth, int family, int isa, unsigned int * stream)
+{
+  // time updates and queries of the whole stream, one item at a time 
+  // if isa is negative, otherwise in batches with the given kernel
+  int i, j;
+  long uptime, querytime;
+  long long check;
+  int ans[BATCH];
+  CM_type * cm;
+
+  cm=CM_InitHash(width,depth,4711,family);
+  CheckMemory(cm);
+  if (isa>=0) CM_BatchIsa(cm,isa);
+  StartTheClock();
+  if (isa<0)
+    for (i=0;i<length;i++)
+      CM_Update(cm,stream[i],1);
+  else
+    for (i=0;i<length;i+=BATCH)
+      CM_UpdateBatch(cm,stream+i,NULL,min(BATCH,length-i));
+  uptime=StopTheClock();
+  check=0;
+  StartTheClock();
+  if (isa<0)
+    for (i=0;i<length;i++)
+      check+=CM_PointEst(cm,stream[i]);
+  else
+    for (i=0;i<length;i+=BATCH)
+      {
+	CM_PointEstBatch(cm,stream+i,min(BATCH,length-i),ans);
+	for (j=0;j<min(BATCH,length-i);j++)
+	  check+=ans[j];
+      }
+  querytime=StopTheClock();
+  // estimates are summed so the queries are not optimized away,
+  // every path of the same family and depth gives the same sum
+  printf("%-10s\t%s\t%d\t%d\t%d\t%ld\t%.2f\t%ld\t%.2f\t%lld\n",
+	 families[family],(isa<0) ? "single" : isas[isa],depth,cm->width,
+	 CM_Size(cm),uptime,(double) length/1000.0/(double) max(uptime,1),
+	 querytime,(double) length/1000.0/(double) max(querytime,1),check);
+  CM_Destroy(cm);
+}
+
+/******************************************************************/
+
+void RunLayout(int bytes, int depth, unsigned int * stream)
+{
+  // time updates and queries of the classic multiply-shift sketch 
+  // and the blocked sketch with the same counters
+  int i;
+  long cmup, cmq, cmbup, cmbq;
+  long long check=0;
+  CM_type * cm;
+  CMB_type * cmb;
+
+  cm=CM_InitHash(bytes/sizeof(int)/depth,depth,4711,CM_MULTSHIFT);
+  cmb=CMB_Init(bytes/sizeof(int)/depth,depth,4711);
+  CheckMemory(cm); CheckMemory(cmb);
+  StartTheClock();
+  for (i=0;i<length;i++)
+    CM_Update(cm,stream[i],1);
+  cmup=StopTheClock();
+  StartTheClock();
+  for (i=0;i<length;i++)
+    check+=CM_PointEst(cm,stream[i]);
+  cmq=StopTheClock();
+  StartTheClock();
+  for (i=0;i<length;i++)
+    CMB_Update(cmb,stream[i],1);
+  cmbup=StopTheClock();
+  StartTheClock();
+  for (i=0;i<length;i++)
+    check+=CMB_PointEst(cmb,stream[i]);
+  cmbq=StopTheClock();
+  printf("%d\t%d\t%.2f\t%.2f\t%.3f\t%.2f\t%.2f\t%.3f\t%lld\n",
+	 bytes>>10,depth,
+	 (double) length/1000.0/(double) max(cmup,1),
+	 (double) length/1000.0/(double) max(cmq,1),AvgError(cm,CMEst),
+	 (double) length/1000.0/(double) max(cmbup,1),
+	 (double) length/1000.0/(double) max(cmbq,1),AvgError(cmb,CMBEst),
+	 check);
+  CM_Destroy(cm);
+  CMB_Destroy(cmb);
+}
+
+/******************************************************************/
+
+void RunConservative(int bytes, unsigned int * stream, 
+		     double * cmerr, double * cuerr)
+{
+  // batched updates of the same multiply-shift sketch, classic and 
+  // conservative
+  int i;
+  long cmup, cuup;
+  CM_type * cm, * cu;
+
+  cm=CM_InitHash(bytes/sizeof(int)/4,4,4711,CM_MULTSHIFT);
+  cu=CM_InitHash(bytes/sizeof(int)/4,4,4711,CM_MULTSHIFT);
+  CheckMemory(cm); CheckMemory(cu);
+  StartTheClock();
+  for (i=0;i<length;i+=BATCH)
+    CM_UpdateBatch(cm,stream+i,NULL,min(BATCH,length-i));
+  cmup=StopTheClock();
+  StartTheClock();
+  for (i=0;i<length;i+=BATCH)
+    CM_UpdateBatchCU(cu,stream+i,NULL,min(BATCH,length-i));
+  cuup=StopTheClock();
+  *cmerr=AvgError(cm,CMEst);
+  *cuerr=AvgError(cu,CMEst);
+  printf("%d\t%.2f\t%.3f\t%.2f\t%.3f\t",
+	 bytes>>10,
+	 (double) length/1000.0/(double) max(cmup,1),*cmerr,
+	 (double) length/1000.0/(double) max(cuup,1),*cuerr);
+  // no gain to report once conservative update has no error left
+  if (*cuerr<=0.0)
+    printf("-\n");
+  else
+    printf("%.2f\n",*cmerr/(*cuerr));
+  CM_Destroy(cm);
+  CM_Destroy(cu);
+}
+
+/******************************************************************/
+
+// time updates and queries of the whole stream with one compact sketch
+#define RUNCOMPACT(name,bits) \
+  { \
+    name##_type * cmc; \
+    cmc=name##_Init(bytes*8/bits/4,4,4711,CM_MULTSHIFT); \
+    CheckMemory(cmc); \
+    StartTheClock(); \
+    for (i=0;i<length;i++) \
+      name##_Update(cmc,stream[i],1); \
+    up=StopTheClock(); \
+    StartTheClock(); \
+    for (i=0;i<length;i++) \
+      check+=name##_PointEst(cmc,stream[i]); \
+    q=StopTheClock(); \
+    printf("%d\t%d\t%d\t%.2f\t%.2f\t%.3f\t%d\t%d\n",bytes>>10,bits, \
+	   cmc->width,(double) length/1000.0/(double) max(up,1), \
+	   (double) length/1000.0/(double) max(q,1),AvgError(cmc,name##Est), \
+	   cmc->over.used,name##_Size(cmc)); \
+    name##_Destroy(cmc); \
+  }
+
+void RunCompact(int bytes, unsigned int * stream)
+{
+  // the int sketch and the compact sketches with as many bytes of
+  // counters, so 8 bit counters make rows four times wider
+  int i;
+  long up, q;
+  long long check=0;
+  CM_type * cm;
+
+  cm=CM_InitHash(bytes/sizeof(int)/4,4,4711,CM_MULTSHIFT);
+  CheckMemory(cm);
+  StartTheClock();
+  for (i=0;i<length;i++)
+    CM_Update(cm,stream[i],1);
+  up=StopTheClock();
+  StartTheClock();
+  for (i=0;i<length;i++)
+    check+=CM_PointEst(cm,stream[i]);
+  q=StopTheClock();
+  printf("%d\tint\t%d\t%.2f\t%.2f\t%.3f\t-\t%d\n",bytes>>10,cm->width,
+	 (double) length/1000.0/(double) max(up,1),
+	 (double) length/1000.0/(double) max(q,1),AvgError(cm,CMEst),
+	 CM_Size(cm));
+  CM_Destroy(cm);
+  RUNCOMPACT(CM32,32);
+  RUNCOMPACT(CM16,16);
+  RUNCOMPACT(CM8,8);
+  // sum of estimates, so the queries are not optimized away
+  printf("Check %lld\n",check);
+}
+
+/******************************************************************/
+
+int main(int argc, char **argv)
+{
+  int depth, family, isa, bytes, i, j, sizes;
+  double cmerr[16], cuerr[16], kb;
+  unsigned int * stream;
+
+  CheckArguments(argc,argv);
+  stream=CreateStream(length);
+
+  if (test==0)
+    {
+      printf("Family\t\tPath\tDepth\tWidth\tBytes\tUpd ms\tMupd/s\tQry ms\tMqry/s\tCheck\n");
+      for (depth=4;depth<=8;depth++)
+	for (family=CM_HASH31;family<=CM_TABULATION;family++)
+	  {
+	    RunSketch(depth,family,-1,stream);
+	    for (isa=CM_ISA_SCALAR;isa<=CM_ISA_AVX512;isa++)
+	      if (CM_BatchIsa(NULL,isa)==isa)
+		RunSketch(depth,family,isa,stream);
+	  }
+    }
+  if (test==1)
+    {
+      printf("\t\tClassic\t\t\tBlocked\n");
+      printf("KB\tDepth\tMupd/s\tMqry/s\tAvg err\tMupd/s\tMqry/s\tAvg err\tCheck\n");
+      for (depth=4;depth<=8;depth+=4)
+	for (bytes=16<<10;bytes<=256<<20;bytes<<=2)
+	  RunLayout(bytes,depth,stream);
+    }
+  if (test==2)
+    {
+      printf("\t\tClassic\t\tConservative\n");
+      printf("KB\tMupd/s\tAvg err\tMupd/s\tAvg err\tGain\n");
+      sizes=0;
+      for (bytes=16<<10;bytes<=64<<20;bytes<<=1)
+	{
+	  RunConservative(bytes,stream,cmerr+sizes,cuerr+sizes);
+	  sizes++;
+	}
+      // size of the conservative sketch as accurate as each classic one,
+      // log size interpolated on log error between the sizes measured
+      printf("\nClassic KB\tConservative KB\tBytes saved\n");
+      for (i=0;i<sizes;i++)
+	{
+	  for (j=0;j<sizes && cuerr[j]>cmerr[i];j++);
+	  if (j==0)
+	    printf("%d\t\t<16\n",16<<i);
+	  else if (j==sizes || cmerr[i]<=0.0)
+	    printf("%d\t\t-\n",16<<i);
+	  else
+	    {
+	      kb=(16<<(j-1))*pow(2.0,log(cuerr[j-1]/cmerr[i])
+				 /log(cuerr[j-1]/cuerr[j]));
+	      printf("%d\t\t%.0f\t\t%.2fx\n",16<<i,kb,(16<<i)/kb);
+	    }
+	}
+    }
+  if (test==3)
+    {
+      printf("KB\tBits\tWidth\tMupd/s\tMqry/s\tAvg err\tPromoted\tBytes\n");
+      for (bytes=16<<10;bytes<=4<<20;bytes<<=2)
+	RunCompact(bytes,stream);
+    }
+  free(stream);
+  free(exact);
+  free(keys);
+  return 0;
+}
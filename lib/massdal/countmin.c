@@ -15,6 +15,8 @@ to Creative Commons, 559 Nathan Abbott Way, Stanford, California
 *********************************************************************/
 
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include "prng.h"
 #include "massdal.h"
 #include "countmin.h"
@@ -31,12 +33,35 @@ double delta;                  /* probability of failure */
 /* Routines to support Count-Min sketches                               */
 /************************************************************************/
 
-CM_type * CM_Init(int width, int depth, int seed)
-{     // Initialize the sketch based on user-supplied size
+#define CM_MS(cm,j,x) ((unsigned int) (((cm)->hashm[2*(j)]*(unsigned long long) (x)+(cm)->hashm[2*(j)+1]) >> (cm)->shift))
+// multiply-shift hash of x for row j: top bits of a 64 bit multiply-add
+#define CM_TAB(t,x) ((t)[(x)&255]^(t)[256+(((x)>>8)&255)]^(t)[512+(((x)>>16)&255)]^(t)[768+((x)>>24)])
+// simple tabulation hash of x with the tables t of one row
+
+static unsigned int CM_Hash(CM_type * cm, int j, unsigned int item)
+{ // bucket of an item in row j, with whichever hash family the sketch uses
+  switch (cm->hashtype)
+    {
+    case CM_MULTSHIFT: return CM_MS(cm,j,item);
+    case CM_TABULATION: return CM_TAB(cm->tab+j*CM_TABSIZE,item) & (cm->width-1);
+    default: return hash31(cm->hasha[j],cm->hashb[j],item) % cm->width;
+    }
+}
+
+static CM_type * CM_Create(int width, int depth, int seed, int hashtype,
+			   int counters)
+{     // hash functions of a sketch, and its int counters if counters is set
   CM_type * cm;
-  int j;
+  int j, k, lgw;
   prng_type * prng;
 
+  if (hashtype!=CM_HASH31)
+    {
+      if (width>(1<<30)) return NULL;
+      for (lgw=1;(1<<lgw)<width;lgw++);
+      width=1<<lgw;
+    }
+  else lgw=0;
   cm=(CM_type *) malloc(sizeof(CM_type));
   prng=prng_Init(-abs(seed),2); 
   // initialize the generator to pick the hash functions
@@ -46,27 +71,68 @@ CM_type * CM_Init(int width, int depth, int seed)
       cm->depth=depth;
       cm->width=width;
       cm->count=0;
-      cm->counts=(int **)calloc(sizeof(int *),cm->depth);
-      cm->counts[0]=(int *)calloc(sizeof(int), cm->depth*cm->width);
+      cm->hashtype=hashtype;
+      cm->shift=64-lgw;
+      cm->isa=CM_BatchIsa(NULL,CM_ISA_BEST);
+      cm->hashm=NULL;
+      cm->tab=NULL;
+      cm->counts=NULL;
+      if (counters)
+	{
+	  cm->counts=(int **)calloc(sizeof(int *),cm->depth);
+	  if (cm->counts)
+	    cm->counts[0]=(int *)calloc(sizeof(int), cm->depth*cm->width);
+	}
       cm->hasha=(unsigned int *)calloc(sizeof(unsigned int),cm->depth);
       cm->hashb=(unsigned int *)calloc(sizeof(unsigned int),cm->depth);
-      if (cm->counts && cm->hasha && cm->hashb && cm->counts[0])
+      if (hashtype==CM_MULTSHIFT)
+	cm->hashm=(unsigned long long *)calloc(sizeof(unsigned long long),2*cm->depth);
+      if (hashtype==CM_TABULATION)
+	cm->tab=(unsigned int *)calloc(sizeof(unsigned int),CM_TABSIZE*cm->depth);
+      if (((cm->counts && cm->counts[0]) || !counters) && cm->hasha && cm->hashb
+	  && (cm->hashm || hashtype!=CM_MULTSHIFT)
+	  && (cm->tab || hashtype!=CM_TABULATION))
 	{
 	  for (j=0;j<depth;j++)
 	    {
 	      cm->hasha[j]=prng_int(prng) & MOD;
 	      cm->hashb[j]=prng_int(prng) & MOD;
 	      // pick the hash functions
-	      cm->counts[j]=(int *) cm->counts[0]+(j*cm->width);
+	      if (cm->hashm)
+		{ // 64 bit multiplier must be odd, addend is any 64 bit value
+		  cm->hashm[2*j]=((unsigned long long) prng_int(prng) << 32) 
+		    ^ (unsigned long long) prng_int(prng) ^ 1;
+		  cm->hashm[2*j+1]=((unsigned long long) prng_int(prng) << 32) 
+		    ^ (unsigned long long) prng_int(prng);
+		}
+	      if (cm->tab)
+		for (k=0;k<CM_TABSIZE;k++)
+		  cm->tab[j*CM_TABSIZE+k]=(unsigned int) prng_int(prng);
+	      if (cm->counts)
+		cm->counts[j]=(int *) cm->counts[0]+(j*cm->width);
 	    }
 	}
       else cm=NULL;
     }
+  if (prng) prng_Destroy(prng);
   return cm;
 }
 
-CM_type * CM_Copy(CM_type * cmold)
-{     // create a new sketch with the same parameters as an existing one
+CM_type * CM_Init(int width, int depth, int seed)
+{     // Initialize the sketch based on user-supplied size
+  return CM_InitHash(width,depth,seed,CM_HASH31);
+}
+
+CM_type * CM_InitHash(int width, int depth, int seed, int hashtype)
+{     // Initialize the sketch with a choice of hash family
+      // multiply-shift and tabulation round the width up to a power of two,
+      // so the bucket is a shift or a mask instead of a division
+  return CM_Create(width,depth,seed,hashtype,1);
+}
+
+static CM_type * CM_Clone(CM_type * cmold, int counters)
+{     // same hash functions as an existing sketch, and zero int counters
+      // if counters is set
   CM_type * cm;
   int j;
 
@@ -77,24 +143,49 @@ CM_type * CM_Copy(CM_type * cmold)
       cm->depth=cmold->depth;
       cm->width=cmold->width;
       cm->count=0;
-      cm->counts=(int **)calloc(sizeof(int *),cm->depth);
-      cm->counts[0]=(int *)calloc(sizeof(int), cm->depth*cm->width);
+      cm->hashtype=cmold->hashtype;
+      cm->shift=cmold->shift;
+      cm->isa=cmold->isa;
+      cm->hashm=NULL;
+      cm->tab=NULL;
+      cm->counts=NULL;
+      if (counters)
+	{
+	  cm->counts=(int **)calloc(sizeof(int *),cm->depth);
+	  if (cm->counts)
+	    cm->counts[0]=(int *)calloc(sizeof(int), cm->depth*cm->width);
+	}
       cm->hasha=(unsigned int *)calloc(sizeof(unsigned int),cm->depth);
       cm->hashb=(unsigned int *)calloc(sizeof(unsigned int),cm->depth);
-      if (cm->counts && cm->hasha && cm->hashb && cm->counts[0])
+      if (cmold->hashm)
+	cm->hashm=(unsigned long long *)calloc(sizeof(unsigned long long),2*cm->depth);
+      if (cmold->tab)
+	cm->tab=(unsigned int *)calloc(sizeof(unsigned int),CM_TABSIZE*cm->depth);
+      if (((cm->counts && cm->counts[0]) || !counters) && cm->hasha && cm->hashb
+	  && (cm->hashm || !cmold->hashm) && (cm->tab || !cmold->tab))
 	{
 	  for (j=0;j<cm->depth;j++)
 	    {
 	      cm->hasha[j]=cmold->hasha[j];
 	      cm->hashb[j]=cmold->hashb[j];
-	      cm->counts[j]=(int *) cm->counts[0]+(j*cm->width);
+	      if (cm->counts)
+		cm->counts[j]=(int *) cm->counts[0]+(j*cm->width);
 	    }
+	  if (cm->hashm)
+	    memcpy(cm->hashm,cmold->hashm,sizeof(unsigned long long)*2*cm->depth);
+	  if (cm->tab)
+	    memcpy(cm->tab,cmold->tab,sizeof(unsigned int)*CM_TABSIZE*cm->depth);
 	}
       else cm=NULL;
     }
   return cm;
 }
 
+CM_type * CM_Copy(CM_type * cmold)
+{     // create a new sketch with the same parameters as an existing one
+  return CM_Clone(cmold,1);
+}
+
 void CM_Destroy(CM_type * cm)
 {     // get rid of a sketch and free up the space
   if (!cm) return;
@@ -112,6 +203,14 @@ void CM_Destroy(CM_type * cm)
       free(cm->hashb);
       cm->hashb=NULL;
   }
+  if (cm->hashm) {
+      free(cm->hashm);
+      cm->hashm=NULL;
+  }
+  if (cm->tab) {
+      free(cm->tab);
+      cm->tab=NULL;
+  }
   free(cm);  cm=NULL;
 }
 
@@ -120,35 +219,370 @@ int CM_Size(CM_type * cm)
   int counts, hashes, admin;
   if (!cm) return 0;
   admin=sizeof(CM_type);
-  counts=cm->width*cm->depth*sizeof(int);
+  counts=cm->counts ? cm->width*cm->depth*sizeof(int) : 0;
   hashes=cm->depth*2*sizeof(unsigned int);
+  if (cm->hashm) hashes+=cm->depth*2*sizeof(unsigned long long);
+  if (cm->tab) hashes+=cm->depth*CM_TABSIZE*sizeof(unsigned int);
   return(admin + hashes + counts);
 }
 
 void CM_Update(CM_type * cm, unsigned int item, int diff)
 {
   int j;
+  unsigned int mask;
 
   if (!cm) return;
   cm->count+=diff;
+  mask=cm->width-1;
+  // one loop per hash family, so the family is not tested for every row
+  switch (cm->hashtype)
+    {
+    case CM_MULTSHIFT:
+      for (j=0;j<cm->depth;j++)
+	cm->counts[j][CM_MS(cm,j,item)]+=diff;
+      break;
+    case CM_TABULATION:
+      for (j=0;j<cm->depth;j++)
+	cm->counts[j][CM_TAB(cm->tab+j*CM_TABSIZE,item) & mask]+=diff;
+      break;
+    default:
+      for (j=0;j<cm->depth;j++)
+	cm->counts[j][hash31(cm->hasha[j],cm->hashb[j],item) % cm->width]+=diff;
+    }
+}
+
+void CM_UpdateCU(CM_type * cm, unsigned int item, int diff)
+{
+  // conservative update for streams of non-negative diffs: only raise 
+  // the counters below the new estimate, the minimum plus diff.
+  // Estimates stay upper bounds and are never higher than with CM_Update,
+  // but only CM_PointEst is meaningful afterwards. Negative diffs 
+  // would break the bound and are ignored
+  int j, est;
+  unsigned int h, loc[CM_MAX_DEPTH];
+
+  if (!cm || diff<0) return;
+  cm->count+=diff;
+  est=INT_MAX;
   for (j=0;j<cm->depth;j++)
-    cm->counts[j][hash31(cm->hasha[j],cm->hashb[j],item) % cm->width]+=diff;
-  // this can be done more efficiently if the width is a power of two
+    {
+      h=CM_Hash(cm,j,item);
+      if (j<CM_MAX_DEPTH) loc[j]=h;
+      est=min(est,cm->counts[j][h]);
+    }
+  est+=diff;
+  for (j=0;j<cm->depth;j++)
+    { // rows past CM_MAX_DEPTH are hashed again
+      h=(j<CM_MAX_DEPTH) ? loc[j] : CM_Hash(cm,j,item);
+      if (cm->counts[j][h]<est) cm->counts[j][h]=est;
+    }
 }
 
 int CM_PointEst(CM_type * cm, unsigned int query)
 {
   // return an estimate of the count of an item by taking the minimum
-  int j, ans;
+  int j, ans, est;
+  unsigned int mask;
 
   if (!cm) return 0;
-  ans=cm->counts[0][hash31(cm->hasha[0],cm->hashb[0],query) % cm->width];
-  for (j=1;j<cm->depth;j++)
-    ans=min(ans,cm->counts[j][hash31(cm->hasha[j],cm->hashb[j],query)%cm->width]);
-  // this can be done more efficiently if the width is a power of two
+  mask=cm->width-1;
+  ans=cm->counts[0][CM_Hash(cm,0,query)];
+  switch (cm->hashtype)
+    {
+    case CM_MULTSHIFT:
+      for (j=1;j<cm->depth;j++)
+	{
+	  est=cm->counts[j][CM_MS(cm,j,query)];
+	  ans=min(ans,est);
+	}
+      break;
+    case CM_TABULATION:
+      for (j=1;j<cm->depth;j++)
+	{
+	  est=cm->counts[j][CM_TAB(cm->tab+j*CM_TABSIZE,query) & mask];
+	  ans=min(ans,est);
+	}
+      break;
+    default:
+      for (j=1;j<cm->depth;j++)
+	ans=min(ans,cm->counts[j][hash31(cm->hasha[j],cm->hashb[j],query)%cm->width]);
+    }
   return (ans);
 }
 
+/************************************************************************/
+/* Batched updates and queries: keys of a block are hashed together     */
+/* with AVX2 or AVX-512 where the CPU has them, and the counters of the */
+/* next block are prefetched while the current block is applied         */
+/************************************************************************/
+
+typedef void (*CM_Kernel)(CM_type *, int, const unsigned int *, unsigned int *);
+// hash CM_BATCH keys for one row into buckets
+
+static void CM_HashScalar(CM_type * cm, int j, const unsigned int * keys, 
+			  unsigned int * idx)
+{ // portable kernel, and the only one for hash31 as it needs a division
+  int k;
+  for (k=0;k<CM_BATCH;k++)
+    idx[k]=CM_Hash(cm,j,keys[k]);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+static void CM_HashAVX2(CM_type * cm, int j, const unsigned int * keys, 
+			unsigned int * idx)
+{ // 8 keys per vector, multiply-shift in 4 lanes of 64 bits
+  // as 32x32 bit multiplies of both halves of the multiplier
+  int k;
+  __m256i x, lo, hi, alo, ahi, b, mask, even, m0, m1;
+  __m128i sh;
+  const int * t;
+
+  if (cm->hashtype==CM_MULTSHIFT)
+    {
+      alo=_mm256_set1_epi64x((long long) (cm->hashm[2*j] & 0xffffffff));
+      ahi=_mm256_set1_epi64x((long long) (cm->hashm[2*j] >> 32));
+      b=_mm256_set1_epi64x((long long) cm->hashm[2*j+1]);
+      sh=_mm_cvtsi32_si128(cm->shift);
+      even=_mm256_setr_epi32(0,2,4,6,0,2,4,6);
+      for (k=0;k<CM_BATCH;k+=8)
+	{
+	  x=_mm256_loadu_si256((const __m256i *) (keys+k));
+	  lo=_mm256_cvtepu32_epi64(_mm256_castsi256_si128(x));
+	  hi=_mm256_cvtepu32_epi64(_mm256_extracti128_si256(x,1));
+	  m0=_mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(lo,alo),
+	      _mm256_slli_epi64(_mm256_mul_epu32(lo,ahi),32)),b);
+	  m1=_mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(hi,alo),
+	      _mm256_slli_epi64(_mm256_mul_epu32(hi,ahi),32)),b);
+	  m0=_mm256_permutevar8x32_epi32(_mm256_srl_epi64(m0,sh),even);
+	  m1=_mm256_permutevar8x32_epi32(_mm256_srl_epi64(m1,sh),even);
+	  _mm256_storeu_si256((__m256i *) (idx+k),
+	      _mm256_inserti128_si256(m0,_mm256_castsi256_si128(m1),1));
+	}
+    }
+  else if (cm->hashtype==CM_TABULATION)
+    {
+      t=(const int *) cm->tab+j*CM_TABSIZE;
+      mask=_mm256_set1_epi32(255);
+      for (k=0;k<CM_BATCH;k+=8)
+	{
+	  x=_mm256_loadu_si256((const __m256i *) (keys+k));
+	  lo=_mm256_xor_si256(
+	      _mm256_i32gather_epi32(t,_mm256_and_si256(x,mask),4),
+	      _mm256_i32gather_epi32(t+256,
+		  _mm256_and_si256(_mm256_srli_epi32(x,8),mask),4));
+	  hi=_mm256_xor_si256(
+	      _mm256_i32gather_epi32(t+512,
+		  _mm256_and_si256(_mm256_srli_epi32(x,16),mask),4),
+	      _mm256_i32gather_epi32(t+768,_mm256_srli_epi32(x,24),4));
+	  _mm256_storeu_si256((__m256i *) (idx+k),_mm256_and_si256(
+	      _mm256_xor_si256(lo,hi),_mm256_set1_epi32(cm->width-1)));
+	}
+    }
+  else CM_HashScalar(cm,j,keys,idx);
+}
+
+__attribute__((target("avx512f")))
+static void CM_HashAVX512(CM_type * cm, int j, const unsigned int * keys, 
+			  unsigned int * idx)
+{ // 16 keys per vector, the whole block at once
+  __m512i x, lo, hi, alo, ahi, b, mask;
+  __m128i sh;
+  const int * t;
+
+  x=_mm512_loadu_si512((const void *) keys);
+  if (cm->hashtype==CM_MULTSHIFT)
+    {
+      alo=_mm512_set1_epi64((long long) (cm->hashm[2*j] & 0xffffffff));
+      ahi=_mm512_set1_epi64((long long) (cm->hashm[2*j] >> 32));
+      b=_mm512_set1_epi64((long long) cm->hashm[2*j+1]);
+      sh=_mm_cvtsi32_si128(cm->shift);
+      lo=_mm512_cvtepu32_epi64(_mm512_castsi512_si256(x));
+      hi=_mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(x,1));
+      lo=_mm512_add_epi64(_mm512_add_epi64(_mm512_mul_epu32(lo,alo),
+	  _mm512_slli_epi64(_mm512_mul_epu32(lo,ahi),32)),b);
+      hi=_mm512_add_epi64(_mm512_add_epi64(_mm512_mul_epu32(hi,alo),
+	  _mm512_slli_epi64(_mm512_mul_epu32(hi,ahi),32)),b);
+      _mm256_storeu_si256((__m256i *) idx,
+	  _mm512_cvtepi64_epi32(_mm512_srl_epi64(lo,sh)));
+      _mm256_storeu_si256((__m256i *) (idx+8),
+	  _mm512_cvtepi64_epi32(_mm512_srl_epi64(hi,sh)));
+    }
+  else if (cm->hashtype==CM_TABULATION)
+    {
+      t=(const int *) cm->tab+j*CM_TABSIZE;
+      mask=_mm512_set1_epi32(255);
+      lo=_mm512_xor_si512(
+	  _mm512_i32gather_epi32(_mm512_and_si512(x,mask),t,4),
+	  _mm512_i32gather_epi32(
+	      _mm512_and_si512(_mm512_srli_epi32(x,8),mask),t+256,4));
+      hi=_mm512_xor_si512(
+	  _mm512_i32gather_epi32(
+	      _mm512_and_si512(_mm512_srli_epi32(x,16),mask),t+512,4),
+	  _mm512_i32gather_epi32(_mm512_srli_epi32(x,24),t+768,4));
+      _mm512_storeu_si512((void *) idx,_mm512_and_si512(
+	  _mm512_xor_si512(lo,hi),_mm512_set1_epi32(cm->width-1)));
+    }
+  else CM_HashScalar(cm,j,keys,idx);
+}
+#endif
+
+int CM_BatchIsa(CM_type * cm, int isa)
+{ // pick the kernel of the batched routines of a sketch, capped by 
+  // what the CPU supports: CM_ISA_BEST for the widest one. Returns the
+  // one picked, and only asks the CPU if cm is NULL. Sketches pick
+  // CM_ISA_BEST when they are made, so there is no shared state to race on
+  int best=CM_ISA_SCALAR;
+
+#if defined(__x86_64__) || defined(__i386__)
+  if ((isa<0 || isa>=CM_ISA_AVX512) && __builtin_cpu_supports("avx512f"))
+    best=CM_ISA_AVX512;
+  else if ((isa<0 || isa>=CM_ISA_AVX2) && __builtin_cpu_supports("avx2"))
+    best=CM_ISA_AVX2;
+#endif
+  if (cm) cm->isa=best;
+  return best;
+}
+
+static CM_Kernel CM_KernelOf(CM_type * cm)
+{ // kernel picked by the sketch
+#if defined(__x86_64__) || defined(__i386__)
+  if (cm->isa==CM_ISA_AVX512) return CM_HashAVX512;
+  if (cm->isa==CM_ISA_AVX2) return CM_HashAVX2;
+#endif
+  return CM_HashScalar;
+}
+
+static void CM_HashBlock(CM_type * cm, CM_Kernel kernel, unsigned int * items,
+			 int n, unsigned int * idx, int write)
+{ // hash up to CM_BATCH items for every row and prefetch their counters
+  // short blocks are padded, the padding is hashed but never applied
+  unsigned int keys[CM_BATCH];
+  int j, k, m;
+
+  m=min(n,CM_BATCH);
+  memcpy(keys,items,m*sizeof(unsigned int));
+  for (k=m;k<CM_BATCH;k++) keys[k]=0;
+  for (j=0;j<cm->depth;j++)
+    {
+      kernel(cm,j,keys,idx+j*CM_BATCH);
+      for (k=0;k<m;k++)
+	if (write)
+	  __builtin_prefetch(cm->counts[j]+idx[j*CM_BATCH+k],1);
+	else
+	  __builtin_prefetch(cm->counts[j]+idx[j*CM_BATCH+k],0);
+    }
+}
+
+static void CM_Batch(CM_type * cm, unsigned int * items, int * diffs, int n,
+		     int conservative)
+{ // update with n items at once, each with weight diffs[i], or 1 if 
+  // diffs is NULL. Same counts as calling CM_Update or CM_UpdateCU 
+  // for each item in turn
+  int i, j, k, m, est;
+  int w[CM_BATCH];
+  unsigned int idx[2*CM_BATCH*CM_MAX_DEPTH], * cur;
+  CM_Kernel kernel;
+
+  if (!cm || n<=0) return;
+  if (cm->depth>CM_MAX_DEPTH)
+    { // no room for the buckets of two blocks, go one at a time
+      for (i=0;i<n;i++)
+	if (conservative)
+	  CM_UpdateCU(cm,items[i],diffs ? diffs[i] : 1);
+	else
+	  CM_Update(cm,items[i],diffs ? diffs[i] : 1);
+      return;
+    }
+  kernel=CM_KernelOf(cm);
+  CM_HashBlock(cm,kernel,items,n,idx,1);
+  for (i=0;i<n;i+=CM_BATCH)
+    {
+      cur=idx+((i/CM_BATCH)&1)*CM_BATCH*cm->depth;
+      if (i+CM_BATCH<n)
+	CM_HashBlock(cm,kernel,items+i+CM_BATCH,n-i-CM_BATCH,
+		     idx+(((i/CM_BATCH)+1)&1)*CM_BATCH*cm->depth,1);
+      // counters of the next block are on their way while this one is added
+      m=min(n-i,CM_BATCH);
+      for (k=0;k<m;k++)
+	{
+	  w[k]=diffs ? diffs[i+k] : 1;
+	  cm->count+=w[k];
+	}
+      if (!conservative)
+	for (j=0;j<cm->depth;j++)
+	  for (k=0;k<m;k++)
+	    cm->counts[j][cur[j*CM_BATCH+k]]+=w[k];
+      else
+	for (k=0;k<m;k++)
+	  { // items in turn, a later item may see the counters of an earlier one
+	    if (w[k]<0) 
+	      {
+		cm->count-=w[k];
+		continue;
+	      }
+	    est=cm->counts[0][cur[k]];
+	    for (j=1;j<cm->depth;j++)
+	      est=min(est,cm->counts[j][cur[j*CM_BATCH+k]]);
+	    est+=w[k];
+	    for (j=0;j<cm->depth;j++)
+	      if (cm->counts[j][cur[j*CM_BATCH+k]]<est)
+		cm->counts[j][cur[j*CM_BATCH+k]]=est;
+	  }
+    }
+}
+
+void CM_UpdateBatch(CM_type * cm, unsigned int * items, int * diffs, int n)
+{ // update with n items at once
+  CM_Batch(cm,items,diffs,n,0);
+}
+
+void CM_UpdateBatchCU(CM_type * cm, unsigned int * items, int * diffs, int n)
+{ // conservative update with n items at once
+  CM_Batch(cm,items,diffs,n,1);
+}
+
+void CM_PointEstBatch(CM_type * cm, unsigned int * items, int n, int * ans)
+{ // estimate the counts of n items at once into ans, 
+  // same answers as calling CM_PointEst for each item
+  int i, j, k, m, est;
+  unsigned int idx[2*CM_BATCH*CM_MAX_DEPTH], * cur;
+  CM_Kernel kernel;
+
+  if (n<=0) return;
+  if (!cm) 
+    {
+      for (i=0;i<n;i++) ans[i]=0;
+      return;
+    }
+  if (cm->depth>CM_MAX_DEPTH)
+    {
+      for (i=0;i<n;i++)
+	ans[i]=CM_PointEst(cm,items[i]);
+      return;
+    }
+  kernel=CM_KernelOf(cm);
+  CM_HashBlock(cm,kernel,items,n,idx,0);
+  for (i=0;i<n;i+=CM_BATCH)
+    {
+      cur=idx+((i/CM_BATCH)&1)*CM_BATCH*cm->depth;
+      if (i+CM_BATCH<n)
+	CM_HashBlock(cm,kernel,items+i+CM_BATCH,n-i-CM_BATCH,
+		     idx+(((i/CM_BATCH)+1)&1)*CM_BATCH*cm->depth,0);
+      m=min(n-i,CM_BATCH);
+      for (k=0;k<m;k++)
+	ans[i+k]=cm->counts[0][cur[k]];
+      for (j=1;j<cm->depth;j++)
+	for (k=0;k<m;k++)
+	  {
+	    est=cm->counts[j][cur[j*CM_BATCH+k]];
+	    ans[i+k]=min(ans[i+k],est);
+	  }
+    }
+}
+
 int CM_PointMed(CM_type * cm, unsigned int query)
 {
   // return an estimate of the count by taking the median estimate
@@ -159,7 +593,7 @@ int CM_PointMed(CM_type * cm, unsigned int query)
   if (!cm) return 0;
   ans=(int *) calloc(1+cm->depth,sizeof(int));
   for (j=0;j<cm->depth;j++)
-    ans[j+1]=cm->counts[j][hash31(cm->hasha[j],cm->hashb[j],query)%cm->width];
+    ans[j+1]=cm->counts[j][CM_Hash(cm,j,query)];
 
   if (cm->depth==1)
     result=ans[1];
@@ -183,11 +617,18 @@ int CM_Compatible(CM_type * cm1, CM_type * cm2)
   if (!cm1 || !cm2) return 0;
   if (cm1->width!=cm2->width) return 0;
   if (cm1->depth!=cm2->depth) return 0;
+  if (cm1->hashtype!=cm2->hashtype) return 0;
   for (i=0;i<cm1->depth;i++)
     {
       if (cm1->hasha[i]!=cm2->hasha[i]) return 0;
       if (cm1->hashb[i]!=cm2->hashb[i]) return 0;
     }
+  if (cm1->hashm && 
+      memcmp(cm1->hashm,cm2->hashm,sizeof(unsigned long long)*2*cm1->depth)) 
+    return 0;
+  if (cm1->tab && 
+      memcmp(cm1->tab,cm2->tab,sizeof(unsigned int)*CM_TABSIZE*cm1->depth)) 
+    return 0;
   return 1;
 }
 
@@ -229,7 +670,7 @@ int CM_Residue(CM_type * cm, unsigned int * Q)
       for (i=0;i<cm->width;i++)
 	bitmap[i]=0;
       for (i=1;i<Q[0];i++)
-	bitmap[hash31(cm->hasha[j],cm->hashb[j],Q[i]) % cm->width]=1;
+	bitmap[CM_Hash(cm,j,Q[i])]=1;
       for (i=0;i<cm->width;i++)
 	if (bitmap[i]==0) nextest+=cm->counts[j][i];
       estimate=max(estimate,nextest);
@@ -415,6 +856,379 @@ double CMF_InnerProd(CMF_type * cm1, CMF_type * cm2)
   return result;
 }
 
+/************************************************************************/
+/* Routines to support blocked Count-Min sketches                       */
+/************************************************************************/
+
+CMB_type * CMB_Init(int width, int depth, int seed)
+{     // Initialize the sketch with the counters of CM_Init(width,depth)
+      // rounded up to a power of two number of 64 byte blocks
+  CMB_type * cmb;
+  int lgb;
+  prng_type * prng;
+
+  if (depth!=1 && depth!=2 && depth!=4 && depth!=8) return NULL;
+  if (width<=0 || (long long) width*depth>(1LL<<30)) return NULL;
+  for (lgb=1;(CMB_SLOTS<<lgb)<width*depth;lgb++);
+  // at least two blocks, so the shift is less than 64
+
+  cmb=(CMB_type *) malloc(sizeof(CMB_type));
+  prng=prng_Init(-abs(seed),2); 
+  // initialize the generator to pick the hash function
+
+  if (cmb && prng)
+    {
+      cmb->depth=depth;
+      cmb->blocks=1<<lgb;
+      cmb->width=CMB_SLOTS*cmb->blocks/depth;
+      cmb->count=0;
+      cmb->shift=64-lgb;
+      for (cmb->slotbits=0;(depth<<cmb->slotbits)<CMB_SLOTS;cmb->slotbits++);
+      cmb->counts=(int *)aligned_alloc(64,sizeof(int)*CMB_SLOTS*cmb->blocks);
+      if (cmb->counts)
+	{
+	  memset(cmb->counts,0,sizeof(int)*CMB_SLOTS*cmb->blocks);
+	  cmb->hasha=((unsigned long long) prng_int(prng) << 32) 
+	    ^ (unsigned long long) prng_int(prng) ^ 1;
+	  cmb->hashb=((unsigned long long) prng_int(prng) << 32) 
+	    ^ (unsigned long long) prng_int(prng);
+	  // pick the hash function, the multiplier must be odd
+	}
+      else 
+	{
+	  free(cmb);
+	  cmb=NULL;
+	}
+    }
+  if (prng) prng_Destroy(prng);
+  return cmb;
+}
+
+CMB_type * CMB_Copy(CMB_type * cmbold)
+{     // create a new sketch with the same parameters as an existing one
+  CMB_type * cmb;
+
+  if (!cmbold) return(NULL);
+  cmb=(CMB_type *) malloc(sizeof(CMB_type));
+  if (cmb)
+    {
+      *cmb=*cmbold;
+      cmb->count=0;
+      cmb->counts=(int *)aligned_alloc(64,sizeof(int)*CMB_SLOTS*cmb->blocks);
+      if (cmb->counts)
+	memset(cmb->counts,0,sizeof(int)*CMB_SLOTS*cmb->blocks);
+      else
+	{
+	  free(cmb);
+	  cmb=NULL;
+	}
+    }
+  return cmb;
+}
+
+void CMB_Destroy(CMB_type * cmb)
+{     // get rid of a sketch and free up the space
+  if (!cmb) return;
+  if (cmb->counts) free(cmb->counts);
+  free(cmb);
+}
+
+int CMB_Size(CMB_type * cmb)
+{ // return the size of the sketch in bytes
+  if (!cmb) return 0;
+  return(sizeof(CMB_type) + sizeof(int)*CMB_SLOTS*cmb->blocks);
+}
+
+void CMB_Update(CMB_type * cmb, unsigned int item, int diff)
+{
+  // row j owns slots j<<slotbits onwards of the block,
+  // and takes slotbits more bits of the hash below the block number
+  int j, * block;
+  unsigned long long h;
+  unsigned int mask;
+
+  if (!cmb) return;
+  cmb->count+=diff;
+  h=cmb->hasha*item+cmb->hashb;
+  block=cmb->counts+(h>>cmb->shift)*CMB_SLOTS;
+  mask=(1<<cmb->slotbits)-1;
+  for (j=0;j<cmb->depth;j++)
+    block[(j<<cmb->slotbits)
+	  +((h>>(cmb->shift-(j+1)*cmb->slotbits)) & mask)]+=diff;
+}
+
+void CMB_UpdateCU(CMB_type * cmb, unsigned int item, int diff)
+{
+  // conservative update, as CM_UpdateCU, within the one block of the item
+  int j, est, * slot[CMB_SLOTS];
+  unsigned long long h;
+  unsigned int mask;
+
+  if (!cmb || diff<0) return;
+  cmb->count+=diff;
+  h=cmb->hasha*item+cmb->hashb;
+  mask=(1<<cmb->slotbits)-1;
+  for (j=0;j<cmb->depth;j++)
+    slot[j]=cmb->counts+(h>>cmb->shift)*CMB_SLOTS+(j<<cmb->slotbits)
+      +((h>>(cmb->shift-(j+1)*cmb->slotbits)) & mask);
+  est=*slot[0];
+  for (j=1;j<cmb->depth;j++)
+    est=min(est,*slot[j]);
+  est+=diff;
+  for (j=0;j<cmb->depth;j++)
+    if (*slot[j]<est) *slot[j]=est;
+}
+
+int CMB_PointEst(CMB_type * cmb, unsigned int query)
+{
+  // return an estimate of the count of an item by taking the minimum
+  int j, ans, est, * block;
+  unsigned long long h;
+  unsigned int mask;
+
+  if (!cmb) return 0;
+  h=cmb->hasha*query+cmb->hashb;
+  block=cmb->counts+(h>>cmb->shift)*CMB_SLOTS;
+  mask=(1<<cmb->slotbits)-1;
+  ans=block[(h>>(cmb->shift-cmb->slotbits)) & mask];
+  for (j=1;j<cmb->depth;j++)
+    {
+      est=block[(j<<cmb->slotbits)
+		+((h>>(cmb->shift-(j+1)*cmb->slotbits)) & mask)];
+      ans=min(ans,est);
+    }
+  return (ans);
+}
+
+/************************************************************************/
+/* Compact CM sketches: 8, 16 or 32 bit counters, with the counts of    */
+/* counters that do not fit promoted into a side table                  */
+/************************************************************************/
+
+#define CMO_SLOT(key,bits) ((int) (((key)*0x9E3779B97F4A7C15ULL) >> (64-(bits))))
+// slot of a key: top bits of a multiply, positions of one bucket in 
+// several rows share their low bits and would collide on them
+
+static void CMO_Grow(CMO_type * over)
+{ // double the side table, it is kept as it is if there is no room
+  int i, k, size, bits;
+  unsigned int * keys;
+  long long * vals;
+
+  bits=over->size ? over->bits+1 : 6;
+  size=1<<bits;
+  keys=(unsigned int *) calloc(sizeof(unsigned int),size);
+  vals=(long long *) calloc(sizeof(long long),size);
+  if (!keys || !vals)
+    {
+      free(keys); free(vals);
+      return;
+    }
+  for (i=0;i<over->size;i++)
+    if (over->keys[i])
+      {
+	k=CMO_SLOT(over->keys[i],bits);
+	while (keys[k]) k=(k+1) & (size-1);
+	keys[k]=over->keys[i];
+	vals[k]=over->vals[i];
+      }
+  free(over->keys); free(over->vals);
+  over->keys=keys;
+  over->vals=vals;
+  over->size=size;
+  over->bits=bits;
+}
+
+static long long * CMO_Find(CMO_type * over, unsigned int pos, int insert)
+{ // count of the promoted counter at pos, added as 0 if insert is set,
+  // NULL if it is not there or there is no room to add it
+  unsigned int key=pos+1;
+  int k;
+
+  if (insert && 2*(over->used+1)>over->size) CMO_Grow(over);
+  if (over->size==0) return NULL;
+  k=CMO_SLOT(key,over->bits);
+  while (over->keys[k] && over->keys[k]!=key) k=(k+1) & (over->size-1);
+  if (over->keys[k]==key) return over->vals+k;
+  if (!insert || over->used+1>=over->size) return NULL;
+  // one slot always stays empty, so a probe for a missing key ends
+  over->keys[k]=key;
+  over->vals[k]=0;
+  over->used++;
+  return over->vals+k;
+}
+
+#define CM_ROWS(cm,item,pos,body) \
+  switch ((cm)->hashtype) \
+    { \
+    case CM_MULTSHIFT: \
+      for (j=0;j<(cm)->depth;j++) \
+	{ \
+	  pos=j*(cm)->width+CM_MS(cm,j,item); \
+	  body \
+	} \
+      break; \
+    case CM_TABULATION: \
+      for (j=0;j<(cm)->depth;j++) \
+	{ \
+	  pos=j*(cm)->width+(CM_TAB((cm)->tab+j*CM_TABSIZE,item) & ((cm)->width-1)); \
+	  body \
+	} \
+      break; \
+    default: \
+      for (j=0;j<(cm)->depth;j++) \
+	{ \
+	  pos=j*(cm)->width+hash31((cm)->hasha[j],(cm)->hashb[j],item) % (cm)->width; \
+	  body \
+	} \
+    }
+// run body for the counter pos of an item in each row j, pos indexes the 
+// rows one after the other, one loop per hash family as in CM_Update
+
+// Routines of one counter width. A counter holding cmax is promoted: its
+// count is in the side table, or cmax if the side table had no room.
+// Comments are C style as the routines are one macro
+#define CM_COMPACT(name,ctype,cmax) \
+static long long name##_Get(name##_type * cm, unsigned int pos) \
+{ /* count of the counter at pos */ \
+  long long * v; \
+  if (cm->counts[pos]<cmax) return cm->counts[pos]; \
+  v=CMO_Find(&cm->over,pos,0); \
+  return v ? *v : cmax; \
+} \
+\
+static void name##_Add(name##_type * cm, unsigned int pos, long long diff) \
+{ /* add to a counter that is promoted or does not stay in [0,cmax) */ \
+  long long * v, val; \
+  if (cm->counts[pos]<cmax) \
+    { \
+      val=cm->counts[pos]+diff; \
+      if (val<cmax) \
+	{ \
+	  cm->counts[pos]=(ctype) max(val,0); \
+	  return; \
+	} \
+      cm->counts[pos]=cmax; \
+      v=CMO_Find(&cm->over,pos,1); \
+      if (v) *v=val; \
+    } \
+  else \
+    { \
+      v=CMO_Find(&cm->over,pos,0); \
+      if (v) *v=max(*v+diff,0); \
+    } \
+} \
+\
+name##_type * name##_Init(int width, int depth, int seed, int hashtype) \
+{ /* Initialize the sketch with a choice of hash family, as CM_InitHash */ \
+  name##_type * cm; \
+  cm=(name##_type *) calloc(sizeof(name##_type),1); \
+  if (!cm) return NULL; \
+  cm->hash=CM_Create(width,depth,seed,hashtype,0); \
+  if (cm->hash) \
+    { \
+      cm->depth=cm->hash->depth; \
+      cm->width=cm->hash->width; \
+      cm->counts=(ctype *) calloc(sizeof(ctype),cm->depth*cm->width); \
+    } \
+  if (!cm->counts) \
+    { \
+      name##_Destroy(cm); \
+      return NULL; \
+    } \
+  return cm; \
+} \
+\
+name##_type * name##_Copy(name##_type * cmold) \
+{ /* create a new sketch with the same parameters as an existing one */ \
+  name##_type * cm; \
+  if (!cmold) return NULL; \
+  cm=(name##_type *) calloc(sizeof(name##_type),1); \
+  if (!cm) return NULL; \
+  cm->hash=CM_Clone(cmold->hash,0); \
+  cm->depth=cmold->depth; \
+  cm->width=cmold->width; \
+  if (cm->hash) \
+    cm->counts=(ctype *) calloc(sizeof(ctype),cm->depth*cm->width); \
+  if (!cm->counts) \
+    { \
+      name##_Destroy(cm); \
+      return NULL; \
+    } \
+  return cm; \
+} \
+\
+void name##_Destroy(name##_type * cm) \
+{ /* get rid of a sketch and free up the space */ \
+  if (!cm) return; \
+  if (cm->counts) free(cm->counts); \
+  if (cm->hash) CM_Destroy(cm->hash); \
+  if (cm->over.keys) free(cm->over.keys); \
+  if (cm->over.vals) free(cm->over.vals); \
+  free(cm); \
+} \
+\
+int name##_Size(name##_type * cm) \
+{ /* return the size of the sketch in bytes, with the side table */ \
+  if (!cm) return 0; \
+  return sizeof(name##_type)+CM_Size(cm->hash) \
+    +cm->depth*cm->width*sizeof(ctype) \
+    +cm->over.size*(sizeof(unsigned int)+sizeof(long long)); \
+} \
+\
+void name##_Update(name##_type * cm, unsigned int item, int diff) \
+{ /* a counter that stays below cmax is one add, others go through Add */ \
+  int j; \
+  unsigned int pos; \
+  long long val; \
+  ctype * counts; \
+  if (!cm) return; \
+  cm->count+=diff; \
+  /* in a local, stores to char counters could change cm->counts otherwise */ \
+  counts=cm->counts; \
+  /* a promoted counter holds cmax, so for diff>=0 one test is enough */ \
+  CM_ROWS(cm->hash,item,pos, \
+	  val=(long long) counts[pos]+diff; \
+	  if (val<cmax && (diff>=0 || (val>=0 && counts[pos]<cmax))) \
+	    counts[pos]=(ctype) val; \
+	  else \
+	    name##_Add(cm,pos,diff);) \
+} \
+\
+long long name##_PointEst(name##_type * cm, unsigned int query) \
+{ /* return an estimate of the count of an item by taking the minimum */ \
+  int j; \
+  unsigned int pos; \
+  long long ans=LLONG_MAX, est; \
+  if (!cm) return 0; \
+  CM_ROWS(cm->hash,query,pos, \
+	  est=name##_Get(cm,pos); \
+	  ans=min(ans,est);) \
+  return ans; \
+} \
+\
+int name##_Merge(name##_type * cm, name##_type * cmadd) \
+{ /* add the counters of a sketch with the same parameters, 0 if not */ \
+  unsigned int pos; \
+  long long val; \
+  if (!cm || !cmadd || !CM_Compatible(cm->hash,cmadd->hash)) return 0; \
+  for (pos=0;pos<(unsigned int) (cm->depth*cm->width);pos++) \
+    if (cmadd->counts[pos]) \
+      { \
+	val=(long long) cm->counts[pos]+cmadd->counts[pos]; \
+	if (cm->counts[pos]<cmax && cmadd->counts[pos]<cmax && val<cmax) \
+	  cm->counts[pos]=(ctype) val; \
+	else \
+	  name##_Add(cm,pos,name##_Get(cmadd,pos)); \
+      } \
+  cm->count+=cmadd->count; \
+  return 1; \
+}
+
+CM_COMPACT(CM8,unsigned char,UCHAR_MAX)
+CM_COMPACT(CM16,unsigned short,USHRT_MAX)
+CM_COMPACT(CM32,unsigned int,UINT_MAX)
+
 /************************************************************************/
 /* Routines to support hierarchical Count-Min sketches                  */
 /************************************************************************/
@@ -1,16 +1,37 @@
-// Two different structures: 
+// Four different structures: 
 //   1 -- The basic CM Sketch
-//   2 -- The hierarchical CM Sketch: with log n levels, for range sums etc. 
+//   2 -- The blocked CM Sketch: one cache line per item
+//   3 -- Compact CM Sketches: 8, 16 or 32 bit counters
+//   4 -- The hierarchical CM Sketch: with log n levels, for range sums etc. 
 
 #define min(x,y)	((x) < (y) ? (x) : (y))
 #define max(x,y)	((x) > (y) ? (x) : (y))
 
+// Hash families for the rows of a CM sketch
+#define CM_HASH31     0 // ((a x + b) mod 2^31-1) mod width: any width, one division per row
+#define CM_MULTSHIFT  1 // (a x + b) over 64 bits, top log(width) bits: width a power of two
+#define CM_TABULATION 2 // xor of 4 random tables indexed by the bytes of x, masked: width a power of two
+#define CM_TABSIZE    1024 // entries of the tables of one row, 4 tables of 256
+
+// Kernels of the batched routines, chosen for each sketch when it is made
+#define CM_ISA_BEST   -1 // widest one the CPU supports
+#define CM_ISA_SCALAR 0
+#define CM_ISA_AVX2   1 // 8 keys per vector
+#define CM_ISA_AVX512 2 // 16 keys per vector
+#define CM_BATCH      16 // keys hashed together, counters of the next block are prefetched
+#define CM_MAX_DEPTH  32 // rows whose buckets the batched routines and CM_UpdateCU keep on the stack
+
 typedef struct CM_type{
   long long count;
   int depth;
   int width;
   int ** counts;
   unsigned int *hasha, *hashb;
+  int hashtype; // one of CM_HASH31, CM_MULTSHIFT, CM_TABULATION
+  int shift; // multiply-shift: 64 - log(width)
+  unsigned long long *hashm; // multiply-shift: odd multiplier and addend of each row
+  unsigned int *tab; // tabulation: CM_TABSIZE entries for each row
+  int isa; // kernel of the batched routines, one of CM_ISA_*
 } CM_type;
 
 typedef struct CMF_type{ // shadow of above stucture with floats
@@ -22,12 +43,18 @@ typedef struct CMF_type{ // shadow of above stucture with floats
 } CMF_type;
 
 extern CM_type * CM_Init(int, int, int);
+extern CM_type * CM_InitHash(int, int, int, int);
 extern CM_type * CM_Copy(CM_type *);
 extern void CM_Destroy(CM_type *);
 extern int CM_Size(CM_type *);
 
 extern void CM_Update(CM_type *, unsigned int, int); 
 extern int CM_PointEst(CM_type *, unsigned int);
+extern void CM_UpdateCU(CM_type *, unsigned int, int);
+extern void CM_UpdateBatch(CM_type *, unsigned int *, int *, int);
+extern void CM_UpdateBatchCU(CM_type *, unsigned int *, int *, int);
+extern void CM_PointEstBatch(CM_type *, unsigned int *, int, int *);
+extern int CM_BatchIsa(CM_type *, int);
 extern int CM_PointMed(CM_type *, unsigned int);
 extern int CM_InnerProd(CM_type *, CM_type *);
 extern int CM_Residue(CM_type *, unsigned int *);
@@ -40,6 +67,89 @@ extern void CMF_Update(CMF_type *, unsigned int, double);
 extern double CMF_InnerProd(CMF_type *, CMF_type *);
 extern double CMF_PointProd(CMF_type *, CMF_type *, unsigned int);
 
+// Blocked CM Sketch: all d counters of an item share one 64 byte block,
+// so an update or a query is one cache miss instead of d.
+// One multiply-shift hash picks the block from its top bits, the bits
+// below pick the counter of each row within the row's own 16/d slots,
+// so the rows of an item never share a counter.
+//
+// Error bound: with w=16*blocks/d counters per row and N the total count,
+// the counter of row j over-counts by the items sharing both the block
+// and the slot, E[error] <= N/w per row as in the classic sketch.
+// The d rows are not independent though: they all see the same block,
+// so Pr[estimate > true + e N/w] is not (1/e)^d as for independent rows.
+// Conditioned on a block holding a fraction L of N, each row over-counts
+// by at most e L N d/16 with probability 1-1/e, independently of the others,
+// giving Pr[error > e L N d/16] <= (1/e)^d. Block loads L of a skewed
+// stream vary more than row loads, so the blocked sketch needs somewhat 
+// more counters than the classic one for the same guarantee, as blocked
+// Bloom filters need more bits, in exchange for d-1 fewer cache misses.
+
+#define CMB_SLOTS 16 // int counters of a 64 byte block
+
+typedef struct CMB_type{
+  long long count;
+  int depth; // 1, 2, 4 or 8 rows
+  int width; // counters per row, CMB_SLOTS*blocks/depth
+  int blocks; // 64 byte blocks, a power of two
+  int shift; // 64 - log(blocks)
+  int slotbits; // log(CMB_SLOTS/depth): bits picking the counter of a row
+  int * counts; // blocks*CMB_SLOTS counters, 64 byte aligned
+  unsigned long long hasha, hashb;
+} CMB_type;
+
+extern CMB_type * CMB_Init(int, int, int);
+extern CMB_type * CMB_Copy(CMB_type *);
+extern void CMB_Destroy(CMB_type *);
+extern int CMB_Size(CMB_type *);
+extern void CMB_Update(CMB_type *, unsigned int, int);
+extern void CMB_UpdateCU(CMB_type *, unsigned int, int);
+extern int CMB_PointEst(CMB_type *, unsigned int);
+
+// Compact CM Sketches: the counters of CM_InitHash in 8, 16 or 32 bits,
+// so four or two times more counters fit in the same cache budget.
+// A counter reaching the largest value of its width is promoted: its count
+// moves to a side table of 64 bit counts keyed by the counter's position,
+// and the counter keeps the largest value as a mark. On a skewed stream 
+// few counters of a wide sketch are promoted, those of the heavy items,
+// so estimates are those of the int sketch with the same hash functions.
+// Updates and queries of promoted counters look up the side table, so
+// narrow counters cost more per item on streams with many heavy items.
+// Should the side table have no room to grow, a promoted counter missing 
+// from it saturates at the largest value and estimates may be low.
+// Counters are unsigned: negative diffs are fine as long as no counter 
+// would go below zero (the strict turnstile model), lower counts stay 0.
+
+typedef struct CMO_type{ // side table of promoted counters
+  int size; // slots, a power of two, 0 until the first promotion
+  int bits; // log of size
+  int used;
+  unsigned int * keys; // position of the counter plus one, 0 if empty
+  long long * vals; // count of the counter
+} CMO_type;
+
+#define CM_COMPACT_TYPE(name,ctype) \
+typedef struct name##_type{ \
+  long long count; \
+  int depth; \
+  int width; \
+  ctype * counts; /* depth*width counters, row after row */ \
+  CM_type * hash; /* hash functions of the rows, without counters */ \
+  CMO_type over; /* counts of promoted counters */ \
+} name##_type; \
+\
+extern name##_type * name##_Init(int, int, int, int); \
+extern name##_type * name##_Copy(name##_type *); \
+extern void name##_Destroy(name##_type *); \
+extern int name##_Size(name##_type *); \
+extern void name##_Update(name##_type *, unsigned int, int); \
+extern long long name##_PointEst(name##_type *, unsigned int); \
+extern int name##_Merge(name##_type *, name##_type *);
+
+CM_COMPACT_TYPE(CM8,unsigned char)
+CM_COMPACT_TYPE(CM16,unsigned short)
+CM_COMPACT_TYPE(CM32,unsigned int)
+
 typedef struct CMH_type{
   long long count;
   int U; // size of the universe in bits